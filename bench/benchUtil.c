@@ -0,0 +1,265 @@
+/*
+ * benchUtil.c
+ *
+ * Helpers shared by the benchmark programs: clock, checks, and synthetic
+ * assist data with every field filled to its broadcast width (see gps.h)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gps.h"
+#include "benchUtil.h"
+
+
+// main.c isn't linked in, the library code still logs through these
+FILE *fpDbg_G;
+int  dbgLevel_G = 0;
+
+static uint32_t benchRand_G = 0x12345678;
+
+
+uint64_t bench_now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void bench_fail(const char *file, int line, const char *what)
+{
+    fprintf(stderr, "%s:%d: check failed: %s\n", file, line, what);
+    exit(1);
+}
+
+
+static int cmpU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+// pct in [0, 100]; sorts v in place
+uint64_t bench_percentile(uint64_t *v, int n, double pct)
+{
+    int i;
+
+    if(n == 0){
+        return 0;
+    }
+    qsort(v, n, sizeof(uint64_t), cmpU64);
+    i = (int)(pct / 100.0 * (n - 1) + 0.5);
+    return v[i];
+}
+
+
+static int cmpDouble(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static double median(double *v, int n)
+{
+    qsort(v, n, sizeof(double), cmpDouble);
+    return (n & 1) ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/*
+ * Times fn: calibrates the ops per sample to BENCH_SAMPLE_NS, warms up,
+ * then takes BENCH_SAMPLES samples. If their spread (median absolute
+ * deviation over median) is above BENCH_MAX_SPREAD the round is thrown
+ * away, up to BENCH_ROUNDS times. Prints one line: median ns/op, bytes/s
+ * if bytes_op, spread, and whether it settled. Returns 0 if it did.
+ */
+int bench_measure(const char *name, bench_fn_t fn, void *arg, double bytes_op,
+                  struct bench_result *r)
+{
+    double ns[BENCH_SAMPLES], dev[BENCH_SAMPLES];
+    uint64_t t0, t;
+    int ops = 1, round;
+
+    // calibrate, doubling up to a sample's length
+    for(;;){
+        t0 = bench_now_ns();
+        fn(arg, ops);
+        t = bench_now_ns() - t0;
+        if((t >= BENCH_SAMPLE_NS) || (ops >= (1 << 30))){
+            break;
+        }
+        ops = (t < BENCH_SAMPLE_NS / 16) ? ops * 16 : ops * 2;
+    }
+    fn(arg, ops);
+
+    for(round = 0; round < BENCH_ROUNDS; round++){
+        for(int i=0; i < BENCH_SAMPLES; i++){
+            t0 = bench_now_ns();
+            fn(arg, ops);
+            ns[i] = (double)(bench_now_ns() - t0) / ops;
+        }
+        r->ns_op = median(ns, BENCH_SAMPLES);
+        r->min_ns_op = ns[0];
+        for(int i=0; i < BENCH_SAMPLES; i++){
+            dev[i] = (ns[i] > r->ns_op) ? ns[i] - r->ns_op : r->ns_op - ns[i];
+        }
+        r->spread = median(dev, BENCH_SAMPLES) / r->ns_op;
+        if(r->spread <= BENCH_MAX_SPREAD){
+            break;
+        }
+    }
+    r->ops    = ops;
+    r->stable = (round < BENCH_ROUNDS);
+
+    printf("%-34s %10.2f ns/op", name, r->ns_op);
+    if(bytes_op > 0){
+        printf(" %9.2f MB/s", bytes_op * 1e3 / r->ns_op);
+    }else{
+        printf("             ");
+    }
+    printf("  +-%4.1f%%  (min %.2f)%s\n", 100 * r->spread, r->min_ns_op,
+           r->stable ? "" : "  UNSTABLE");
+
+    return r->stable ? 0 : -1;
+}
+
+
+void bench_seed(uint32_t seed)
+{
+    benchRand_G = seed ? seed : 1;
+}
+
+// xorshift32, reproducible across runs
+uint32_t bench_rand(void)
+{
+    benchRand_G ^= benchRand_G << 13;
+    benchRand_G ^= benchRand_G >> 17;
+    benchRand_G ^= benchRand_G << 5;
+    return benchRand_G;
+}
+
+int bench_rand_field(int bits, int is_signed)
+{
+    uint32_t v = bench_rand();
+
+    if(bits < 32){
+        v &= (1u << bits) - 1;
+        if(is_signed && (v & (1u << (bits - 1)))){
+            v |= ~((1u << bits) - 1);
+        }
+    }
+    return (int)v;
+}
+
+
+#define RF(bits, sgn)   bench_rand_field(bits, sgn)
+
+void bench_fill_assist(struct gps_assist_data *gps, int n_sv)
+{
+    memset(gps, 0, sizeof(struct gps_assist_data));
+
+    gps->ionosphere.alpha_0 = RF(8, 1);
+    gps->ionosphere.alpha_1 = RF(8, 1);
+    gps->ionosphere.alpha_2 = RF(8, 1);
+    gps->ionosphere.alpha_3 = RF(8, 1);
+    gps->ionosphere.beta_0  = RF(8, 1);
+    gps->ionosphere.beta_1  = RF(8, 1);
+    gps->ionosphere.beta_2  = RF(8, 1);
+    gps->ionosphere.beta_3  = RF(8, 1);
+
+    gps->utc.a0          = RF(32, 1);
+    gps->utc.a1          = RF(24, 1);
+    gps->utc.delta_t_ls  = 18;
+    gps->utc.t_ot        = RF(8, 0);
+    gps->utc.wn_t        = RF(8, 0);
+    gps->utc.wn_lsf      = RF(8, 0);
+    gps->utc.dn          = 1 + RF(3, 0) % 7;
+    gps->utc.delta_t_lsf = 18;
+
+    gps->almanac.wna  = RF(8, 0);
+    gps->almanac.n_sv = n_sv;
+    for(int i=0; i < n_sv; i++){
+        struct gps_almanac_sv *a = &gps->almanac.svs[i];
+
+        a->sv_id     = i + 1;
+        a->sv_health = RF(8, 0);
+        a->e         = RF(16, 0);
+        a->t_oa      = RF(8, 0);
+        a->ksii      = RF(16, 1);
+        a->omega_dot = RF(16, 1);
+        a->a_powhalf = 5153 * 2048 + RF(10, 1);
+        a->omega_0   = RF(24, 1);
+        a->w         = RF(24, 1);
+        a->m_0       = RF(24, 1);
+        a->a_f0      = RF(11, 1);
+        a->a_f1      = RF(11, 1);
+        gps->almanac.gen[i] = 1;
+    }
+
+    gps->ephemeris.n_sv = n_sv;
+    for(int i=0; i < n_sv; i++){
+        struct gps_ephemeris_sv *e = &gps->ephemeris.svs[i];
+
+        e->sv_id      = i + 1;
+        e->code_on_l2 = RF(2, 0);
+        e->week_no    = RF(10, 0);
+        e->l2_p_flag  = RF(1, 0);
+        e->sv_ura     = RF(4, 0);
+        e->sv_health  = 0;
+        e->t_gd       = RF(8, 1);
+        e->iodc       = RF(10, 0);
+        e->t_oc       = RF(16, 0);
+        e->a_f2       = RF(8, 1);
+        e->a_f1       = RF(16, 1);
+        e->a_f0       = RF(22, 1);
+        e->c_rs       = RF(16, 1);
+        e->delta_n    = RF(16, 1);
+        e->m_0        = RF(32, 1);
+        e->c_uc       = RF(16, 1);
+        e->e          = RF(25, 0);
+        e->c_us       = RF(16, 1);
+        e->a_powhalf  = 5153u * 524288u + RF(16, 0);
+        e->t_oe       = e->t_oc;
+        e->fit_flag   = RF(1, 0);
+        e->c_ic       = RF(16, 1);
+        e->omega_0    = RF(32, 1);
+        e->c_is       = RF(16, 1);
+        e->i_0        = RF(32, 1);
+        e->c_rc       = RF(16, 1);
+        e->w          = RF(32, 1);
+        e->omega_dot  = RF(24, 1);
+        e->idot       = RF(14, 1);
+        e->aodo       = RF(5, 0);
+        gps->ephemeris.gen[i] = 1;
+    }
+
+    gps->ref_pos.latitude  = 41.0082;
+    gps->ref_pos.longitude = 28.9784;
+    gps->ref_pos.altitude  = 39.125;
+
+    gps->ref_time.wn   = 2340;
+    gps->ref_time.tow  = 345600.250;
+    gps->ref_time.when = 1780000000;
+
+    gps->fields = GPS_FIELD_IONOSPHERE | GPS_FIELD_UTC | GPS_FIELD_ALMANAC |
+                  GPS_FIELD_EPHEMERIS | GPS_FIELD_REFPOS | GPS_FIELD_REFTIME;
+    gps->gen = gps->gen_ionosphere = gps->gen_utc = 1;
+}
+
+/* bench_fill_assist() with orbits to propagate: toe and toc within the day
+ * after tow (s), eccentricities up to GPS' 0.03 */
+void bench_fill_orbits(struct gps_assist_data *gps, int n_sv, int tow)
+{
+    bench_fill_assist(gps, n_sv);
+    for(int i=0; i < n_sv; i++){
+        struct gps_ephemeris_sv *e = &gps->ephemeris.svs[i];
+
+        e->t_oe = e->t_oc = (tow + (int)(bench_rand() % 86400)) / 16;
+        e->e    = bench_rand() % (uint32_t)(0.03 * 0x1p33);
+    }
+}
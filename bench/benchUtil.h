@@ -0,0 +1,52 @@
+/*
+ * benchUtil.h
+ *
+ * Header for the helpers shared by the benchmark programs
+ *
+ */
+
+#ifndef __BENCH_UTIL_H__
+#define __BENCH_UTIL_H__
+
+#include <stdint.h>
+
+#include "gps.h"
+
+
+#define BENCH_CHECK(cond)   do { if(!(cond)) bench_fail(__FILE__, __LINE__, #cond); } while(0)
+
+/* bench_measure(): samples of at least BENCH_SAMPLE_NS each, retried
+ * while their spread is above BENCH_MAX_SPREAD */
+#define BENCH_SAMPLES       15
+#define BENCH_SAMPLE_NS     5000000ULL
+#define BENCH_MAX_SPREAD    0.05
+#define BENCH_ROUNDS        4
+
+
+// runs the operation under test ops times
+typedef void (*bench_fn_t)(void *arg, int ops);
+
+struct bench_result {
+    double ns_op;           /* median of the samples */
+    double min_ns_op;
+    double spread;          /* median absolute deviation / median */
+    int    ops;             /* per sample */
+    int    stable;
+};
+
+
+uint64_t bench_now_ns(void);
+void bench_fail(const char *file, int line, const char *what);
+
+void bench_seed(uint32_t seed);
+uint32_t bench_rand(void);
+int  bench_rand_field(int bits, int is_signed);
+
+uint64_t bench_percentile(uint64_t *v, int n, double pct);
+int bench_measure(const char *name, bench_fn_t fn, void *arg, double bytes_op,
+                  struct bench_result *r);
+
+void bench_fill_assist(struct gps_assist_data *gps, int n_sv);
+void bench_fill_orbits(struct gps_assist_data *gps, int n_sv, int tow);
+
+#endif /* __BENCH_UTIL_H__ */
@@ -0,0 +1,222 @@
+/*
+ * bench_e2e.c
+ *
+ * The whole program against a simulated receiver (see rxSim.h): time
+ * from a cold start to control_f's "ALL Messages are HERE", over a matrix
+ * of baud rates, line noise and SVs whose ephemeris is missed. Every run
+ * starts the real binary on a fresh pty with its own log, and reports per
+ * cell p50 / p99 completion time, bytes each way on the wire, the polls
+ * asked more than once and the answers lost to the receiver's TX buffer.
+ *
+ *   bench_e2e [-n runs per cell] [-t timeout s] [-b binary] [-f]
+ *
+ * -f runs the full matrix, the default its corners and middle. Build the
+ * program first (make); runs that time out count as failed and are left
+ * out of the percentiles. The program under test still opens SOCK_PATH,
+ * the shm region and the metrics socket of config.h, don't run it next to
+ * a live instance.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "benchUtil.h"
+#include "rxSim.h"
+
+
+#define DONE_MARK   "ALL Messages are HERE"
+#define MAX_RUNS    100
+
+struct miss_s {
+    const char *name;
+    int n;                          // of the SVs the program wants
+    int times;
+};
+
+static const int bauds_G[]      = { 9600, 38400, 115200 };
+static const double noises_G[]  = { 0, 1e-4, 1e-3 };
+static const struct miss_s misses_G[] = {
+    { "none",          0, 0 },
+    { "4 SVs once",    4, 1 },
+    { "8 SVs twice",   8, 2 },
+};
+
+static struct rxSim_s sim_G;
+
+
+struct run_s {
+    int ok;
+    uint64_t ns;
+    uint64_t bytesIn, bytesOut;
+    int retries;
+    int lost;
+};
+
+// new lines of the log, looking for the mark
+static int logDone(int fd, char *carry)
+{
+    char buf[4096 + 64];
+    int keep = strlen(carry);
+    ssize_t n;
+
+    memcpy(buf, carry, keep);
+    while((n = read(fd, buf + keep, sizeof(buf) - 1 - keep)) > 0){
+        buf[keep + n] = '\0';
+        if(strstr(buf, DONE_MARK)){
+            return 1;
+        }
+        keep += n;
+        if(keep > 32){
+            memmove(buf, buf + keep - 32, 32);
+            keep = 32;
+        }
+    }
+    memcpy(carry, buf, keep);
+    carry[keep] = '\0';
+    return 0;
+}
+
+static void runOnce(const char *bin, int baud, double noise, const struct miss_s *miss,
+                    int timeoutS, struct run_s *r)
+{
+    static int nRun;
+    char logPath[64], baudStr[16], carry[64] = "";
+    uint64_t t0, deadline;
+    int logFd, status;
+    pid_t pid;
+
+    memset(r, 0, sizeof(struct run_s));
+    BENCH_CHECK(rxSim_open(&sim_G, baud, noise, miss->n, miss->times) == 0);
+    snprintf(logPath, sizeof(logPath), "/tmp/bench_e2e.%d.%d.log", (int)getpid(), nRun++);
+    unlink(logPath);
+    snprintf(baudStr, sizeof(baudStr), "%d", baud);
+
+    t0 = bench_now_ns();
+    pid = fork();
+    BENCH_CHECK(pid >= 0);
+    if(pid == 0){
+        int null = open("/dev/null", O_WRONLY);
+
+        dup2(null, 1);
+        dup2(null, 2);
+        execl(bin, bin, "-d", sim_G.slaveName, "-b", baudStr, "-l", logPath, (char *)NULL);
+        _exit(127);
+    }
+
+    // the program creates the log once it is up
+    deadline = t0 + timeoutS * 1000000000ULL;
+    while(((logFd = open(logPath, O_RDONLY)) < 0) && (bench_now_ns() < deadline)){
+        rxSim_run(&sim_G, 5);
+    }
+
+    while((logFd >= 0) && (bench_now_ns() < deadline)){
+        if(rxSim_run(&sim_G, 20) < 0){
+            break;
+        }
+        if(logDone(logFd, carry)){
+            r->ok = 1;
+            break;
+        }
+        if(waitpid(pid, &status, WNOHANG) == pid){
+            pid = -1;
+            break;
+        }
+    }
+    r->ns       = bench_now_ns() - t0;
+    r->bytesIn  = sim_G.bytesIn;
+    r->bytesOut = sim_G.bytesOut;
+    r->retries  = rxSim_retries(&sim_G);
+    r->lost     = sim_G.lost;
+
+    if(pid > 0){
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+    if(logFd >= 0){
+        close(logFd);
+    }
+    unlink(logPath);
+    rxSim_close(&sim_G);
+}
+
+
+int main(int argc, char *argv[])
+{
+    const char *bin = "./rawGpsDataJsonizer";
+    int runs = 3, timeoutS = 90, full = 0, opt, failed = 0;
+    static struct run_s r[MAX_RUNS];
+    uint64_t ns[MAX_RUNS];
+
+    while((opt = getopt(argc, argv, "n:t:b:f")) != -1){
+        switch(opt){
+        case 'n': runs = atoi(optarg); break;
+        case 't': timeoutS = atoi(optarg); break;
+        case 'b': bin = optarg; break;
+        case 'f': full = 1; break;
+        default:
+            fprintf(stderr, "usage: %s [-n runs] [-t timeout s] [-b binary] [-f]\n", argv[0]);
+            return 1;
+        }
+    }
+    if(runs < 1 || runs > MAX_RUNS){
+        runs = (runs < 1) ? 1 : MAX_RUNS;
+    }
+    if(access(bin, X_OK) != 0){
+        fprintf(stderr, "%s not found, build it first (make)\n", bin);
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    bench_seed(43);
+
+    printf("%-7s %-6s %-12s %4s %9s %9s %9s %9s %8s %6s\n", "baud", "noise", "missing",
+           "ok", "p50 s", "p99 s", "rx B", "tx B", "retries", "lost");
+
+    for(int b=0; b < 3; b++){
+        for(int n=0; n < 3; n++){
+            for(int m=0; m < 3; m++){
+                uint64_t in = 0, out = 0;
+                int ok = 0, retries = 0, lost = 0;
+
+                // the corners and the middle unless asked for all of it
+                if(!full && !((b != 1 && n != 1 && m != 2) || (b == 1 && n == 1 && m == 1))){
+                    continue;
+                }
+                for(int i=0; i < runs; i++){
+                    runOnce(bin, bauds_G[b], noises_G[n], &misses_G[m], timeoutS, &r[i]);
+                    if(r[i].ok){
+                        ns[ok++] = r[i].ns;
+                    }
+                    in  += r[i].bytesIn;
+                    out += r[i].bytesOut;
+                    retries += r[i].retries;
+                    lost += r[i].lost;
+                }
+                failed += runs - ok;
+
+                printf("%-7d %-6g %-12s %2d/%-2d", bauds_G[b], noises_G[n], misses_G[m].name, ok, runs);
+                if(ok){
+                    printf(" %9.2f %9.2f", bench_percentile(ns, ok, 50) / 1e9,
+                           bench_percentile(ns, ok, 99) / 1e9);
+                }else{
+                    printf(" %9s %9s", "-", "-");
+                }
+                printf(" %9llu %9llu %8.1f %6.1f\n", (unsigned long long)(out / runs),
+                       (unsigned long long)(in / runs), (double)retries / runs, (double)lost / runs);
+                fflush(stdout);
+            }
+        }
+    }
+
+    if(failed){
+        printf("\n%d runs didn't complete within %d s\n", failed, timeoutS);
+    }
+    return 0;
+}
@@ -0,0 +1,460 @@
+/*
+ * bench_json.c
+ *
+ * Assist data serializer (json_assist_data()): the output for
+ * bench_fill_assist() sets, with negative and scaled values, goes through
+ * a strict JSON parser and every number has to come back under its key,
+ * in order, as the value of the set. The number appenders are compared
+ * with fixed expected strings, and a buffer too small has to be reported.
+ * Reports the cost of serializing a full 32 SV set.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <limits.h>
+
+#include "gps.h"
+#include "gpsView.h"
+#include "json.h"
+#include "config.h"
+#include "benchUtil.h"
+
+
+#define N_SV        32
+#define N_SETS      200
+#define MAX_NUMS    4096
+#define KEY_LEN     24
+
+
+// a number of the document, under the last key seen
+struct num_s {
+    char   key[KEY_LEN];
+    double v;
+};
+
+struct parse_s {
+    const char *p;
+    char key[KEY_LEN];
+    struct num_s nums[MAX_NUMS];
+    int n;
+    int next;               // of nums, being compared
+};
+
+static struct parse_s parse_G;
+
+
+/* A strict parser: RFC 8259 grammar, no escapes needed by the serializer
+ * besides \" and \\, which are still accepted */
+
+static int parseValue(struct parse_s *ps);
+
+static void skipWs(struct parse_s *ps)
+{
+    while((*ps->p == ' ') || (*ps->p == '\t') || (*ps->p == '\n') || (*ps->p == '\r')){
+        ps->p++;
+    }
+}
+
+static int parseString(struct parse_s *ps, char *out, int size)
+{
+    int n = 0;
+
+    if(*ps->p++ != '"'){
+        return -1;
+    }
+    while(*ps->p != '"'){
+        char c = *ps->p++;
+
+        if((unsigned char)c < 0x20){
+            return -1;
+        }
+        if(c == '\\'){
+            c = *ps->p++;
+            if((c != '"') && (c != '\\')){
+                return -1;
+            }
+        }
+        if(out && (n < size - 1)){
+            out[n++] = c;
+        }
+    }
+    ps->p++;
+    if(out){
+        out[n] = '\0';
+    }
+    return 0;
+}
+
+static int digits(struct parse_s *ps)
+{
+    const char *s = ps->p;
+
+    while((*ps->p >= '0') && (*ps->p <= '9')){
+        ps->p++;
+    }
+    return (ps->p > s) ? 0 : -1;
+}
+
+static int parseNumber(struct parse_s *ps)
+{
+    const char *s = ps->p;
+    struct num_s *num;
+
+    if(*ps->p == '-'){
+        ps->p++;
+    }
+    if(*ps->p == '0'){
+        ps->p++;
+    }else if(digits(ps) < 0){
+        return -1;
+    }
+    if(*ps->p == '.'){
+        ps->p++;
+        if(digits(ps) < 0){
+            return -1;
+        }
+    }
+    if((*ps->p == 'e') || (*ps->p == 'E')){
+        ps->p++;
+        if((*ps->p == '+') || (*ps->p == '-')){
+            ps->p++;
+        }
+        if(digits(ps) < 0){
+            return -1;
+        }
+    }
+
+    if(ps->n == MAX_NUMS){
+        return -1;
+    }
+    num = &ps->nums[ps->n++];
+    memcpy(num->key, ps->key, KEY_LEN);
+    num->v = strtod(s, NULL);
+    return 0;
+}
+
+static int parseObject(struct parse_s *ps)
+{
+    ps->p++;
+    skipWs(ps);
+    if(*ps->p == '}'){
+        ps->p++;
+        return 0;
+    }
+    while(1){
+        skipWs(ps);
+        if(parseString(ps, ps->key, KEY_LEN) < 0){
+            return -1;
+        }
+        skipWs(ps);
+        if(*ps->p++ != ':'){
+            return -1;
+        }
+        if(parseValue(ps) < 0){
+            return -1;
+        }
+        skipWs(ps);
+        if(*ps->p == '}'){
+            ps->p++;
+            return 0;
+        }
+        if(*ps->p++ != ','){
+            return -1;
+        }
+    }
+}
+
+static int parseArray(struct parse_s *ps)
+{
+    ps->p++;
+    skipWs(ps);
+    if(*ps->p == ']'){
+        ps->p++;
+        return 0;
+    }
+    while(1){
+        if(parseValue(ps) < 0){
+            return -1;
+        }
+        skipWs(ps);
+        if(*ps->p == ']'){
+            ps->p++;
+            return 0;
+        }
+        if(*ps->p++ != ','){
+            return -1;
+        }
+    }
+}
+
+static int parseValue(struct parse_s *ps)
+{
+    skipWs(ps);
+    switch(*ps->p){
+    case '{':   return parseObject(ps);
+    case '[':   return parseArray(ps);
+    case '"':   return parseString(ps, NULL, 0);
+    case 'n':   return strncmp(ps->p, "null", 4) ? -1 : (ps->p += 4, 0);
+    case 't':   return strncmp(ps->p, "true", 4) ? -1 : (ps->p += 4, 0);
+    case 'f':   return strncmp(ps->p, "false", 5) ? -1 : (ps->p += 5, 0);
+    default:    return parseNumber(ps);
+    }
+}
+
+static int parseDoc(struct parse_s *ps, const char *s)
+{
+    ps->p    = s;
+    ps->n    = 0;
+    ps->next = 0;
+    ps->key[0] = '\0';
+    if(parseValue(ps) < 0){
+        return -1;
+    }
+    skipWs(ps);
+    return (*ps->p == '\0') ? 0 : -1;
+}
+
+
+/* The numbers of the document, in the order the set has them */
+
+static void expectNum(const char *key, double v, double tol)
+{
+    struct num_s *num = &parse_G.nums[parse_G.next++];
+
+    BENCH_CHECK(parse_G.next <= parse_G.n);
+    if(strcmp(num->key, key) || !(fabs(num->v - v) <= tol)){
+        fprintf(stderr, "number %d: \"%s\":%.17g, expected \"%s\":%.17g\n",
+                parse_G.next - 1, num->key, num->v, key, v);
+        exit(1);
+    }
+}
+
+#define EXPECT_INT(f)               expectNum(#f, (double)p->f, 0);
+#define EXPECT_FIELD(f, lsb, unit)  EXPECT_INT(f)
+
+static void expectIono(const struct gps_ionosphere_model *p)
+{
+    GPS_IONO_FIELDS(EXPECT_FIELD)
+}
+
+static void expectUtc(const struct gps_utc_model *p)
+{
+    GPS_UTC_FIELDS(EXPECT_FIELD)
+}
+
+static void expectAlm(const struct gps_almanac_sv *p)
+{
+    EXPECT_INT(sv_id)
+    EXPECT_INT(sv_health)
+    GPS_ALM_FIELDS(EXPECT_FIELD)
+}
+
+static void expectEph(const struct gps_ephemeris_sv *p)
+{
+    EXPECT_INT(sv_id)
+    EXPECT_INT(code_on_l2)
+    EXPECT_INT(l2_p_flag)
+    EXPECT_INT(sv_ura)
+    EXPECT_INT(sv_health)
+    EXPECT_INT(iodc)
+    EXPECT_INT(fit_flag)
+    EXPECT_INT(aodo)
+    GPS_EPH_FIELDS(EXPECT_FIELD)
+}
+
+static void expectSet(const struct gps_assist_data *gps)
+{
+    expectNum("fields", gps->fields, 0);
+    expectNum("gen", gps->gen, 0);
+    expectIono(&gps->ionosphere);
+    expectUtc(&gps->utc);
+    // scaled: rounded to the decimals json_assist_data() writes
+    expectNum("latitude", gps->ref_pos.latitude, 0.5e-7 * (1 + 1e-9));
+    expectNum("longitude", gps->ref_pos.longitude, 0.5e-7 * (1 + 1e-9));
+    expectNum("altitude", gps->ref_pos.altitude, 0.5e-3 * (1 + 1e-9));
+    expectNum("wn", gps->ref_time.wn, 0);
+    expectNum("tow", gps->ref_time.tow, 0.5e-3 * (1 + 1e-9));
+    expectNum("when", (double)gps->ref_time.when, 0);
+    expectNum("wna", gps->almanac.wna, 0);
+    for(int i=0; i < gps->almanac.n_sv; i++){
+        expectAlm(&gps->almanac.svs[i]);
+    }
+    for(int i=0; i < gps->ephemeris.n_sv; i++){
+        expectEph(&gps->ephemeris.svs[i]);
+    }
+    BENCH_CHECK(parse_G.next == parse_G.n);
+}
+
+// a bench_fill_assist() set somewhere on earth, below sea level at times
+static void fillSet(struct gps_assist_data *gps)
+{
+    bench_fill_assist(gps, N_SV);
+    gps->ref_pos.latitude  = ((int)(bench_rand() % 1800000001u) - 900000000) * 1e-7 +
+                             (bench_rand() % 1000) * 1e-11;
+    gps->ref_pos.longitude = ((int)(bench_rand() % 3600000001u) - 1800000000) * 1e-7;
+    gps->ref_pos.altitude  = ((int)(bench_rand() % 2000000u) - 500000) * 1e-3 + 1e-4;
+    gps->ref_time.tow      = (bench_rand() % 604800000u) * 1e-3 + 2e-4;
+}
+
+static void checkSets(void)
+{
+    static struct gps_assist_data gps;
+    static char buf[JSON_BUF_SIZE];
+    struct json_buf jb;
+    int negative = 0;
+
+    bench_seed(31);
+    json_buf_init(&jb, buf, sizeof(buf));
+    for(int n=0; n < N_SETS; n++){
+        fillSet(&gps);
+        json_buf_reset(&jb);
+        BENCH_CHECK(json_assist_data(&jb, &gps) == 0);
+        if(parseDoc(&parse_G, json_buf_str(&jb)) < 0){
+            fprintf(stderr, "not JSON at offset %d: %.40s\n",
+                    (int)(parse_G.p - buf), parse_G.p);
+            exit(1);
+        }
+        expectSet(&gps);
+        for(int i=0; i < parse_G.n; i++){
+            negative += (parse_G.nums[i].v < 0);
+        }
+    }
+    BENCH_CHECK(negative > N_SETS * 100);
+    printf("%d sets of %d SVs parsed back, %d numbers each, %d negative\n",
+           N_SETS, N_SV, parse_G.n, negative);
+}
+
+
+/* The appenders, against fixed strings */
+
+struct expect_s {
+    char kind;              // i int, f fixed, d double, r real
+    double v;
+    int decimals;
+    const char *out;
+};
+
+static const struct expect_s expect_G[] = {
+    { 'i', 0,                     0,  "0" },
+    { 'i', -1,                    0,  "-1" },
+    { 'i', 99,                    0,  "99" },
+    { 'i', -100,                  0,  "-100" },
+    { 'i', 2147483647,            0,  "2147483647" },
+    { 'i', -2147483648.0,         0,  "-2147483648" },
+    { 'i', 4294967295.0,          0,  "4294967295" },
+    { 'f', -5,                    3,  "-0.005" },
+    { 'f', 5,                     3,  "0.005" },
+    { 'f', -123456789,            7,  "-12.3456789" },
+    { 'f', 1000,                  3,  "1.000" },
+    { 'f', -7,                    0,  "-7" },
+    { 'd', 41.0082,               7,  "41.0082000" },
+    { 'd', -28.97845678,          7,  "-28.9784568" },
+    { 'd', -0.0000004,            7,  "-0.0000004" },
+    { 'd', -0.00000004,           7,  "0.0000000" },
+    { 'd', -412.3456,             3,  "-412.346" },
+    { 'd', 345600.25,             3,  "345600.250" },
+    { 'd', 1e300,                 3,  "null" },
+    { 'd', NAN,                   3,  "null" },
+    { 'r', 0,                     7,  "0" },
+    { 'r', 1.5,                   7,  "1.5" },
+    { 'r', -1.5e-9,               7,  "-1.5e-9" },
+    { 'r', 0x1p-30,               7,  "9.313226e-10" },
+    { 'r', -0x1p11,               7,  "-2.048e3" },
+    { 'r', 9.9999999,             7,  "1e1" },
+    { 'r', -123456789,            3,  "-1.23e8" },
+    { 'r', INFINITY,              7,  "null" },
+};
+
+static void checkAppenders(void)
+{
+    char buf[64];
+    struct json_buf jb;
+    int n = sizeof(expect_G) / sizeof(expect_G[0]);
+
+    json_buf_init(&jb, buf, sizeof(buf));
+    for(int i=0; i < n; i++){
+        const struct expect_s *e = &expect_G[i];
+
+        json_buf_reset(&jb);
+        switch(e->kind){
+        case 'i':   json_put_int(&jb, (long long)e->v); break;
+        case 'f':   json_put_fixed(&jb, (long long)e->v, e->decimals); break;
+        case 'd':   json_put_double(&jb, e->v, e->decimals); break;
+        default:    json_put_real(&jb, e->v, e->decimals); break;
+        }
+        if(strcmp(json_buf_str(&jb), e->out)){
+            fprintf(stderr, "%c %.17g, %d: \"%s\", expected \"%s\"\n",
+                    e->kind, e->v, e->decimals, json_buf_str(&jb), e->out);
+            exit(1);
+        }
+    }
+    json_buf_reset(&jb);
+    json_put_int(&jb, LLONG_MIN);
+    BENCH_CHECK(strcmp(json_buf_str(&jb), "-9223372036854775808") == 0);
+    printf("%d appender outputs as expected\n", n + 1);
+}
+
+// a set that doesn't fit is an error, and leaves room for the NUL
+static void checkOverflow(void)
+{
+    static struct gps_assist_data gps;
+    static char buf[JSON_BUF_SIZE];
+    struct json_buf jb;
+    size_t full;
+
+    bench_seed(32);
+    fillSet(&gps);
+    json_buf_init(&jb, buf, sizeof(buf));
+    BENCH_CHECK(json_assist_data(&jb, &gps) == 0);
+    full = jb.len;
+
+    json_buf_init(&jb, buf, full);
+    BENCH_CHECK(json_assist_data(&jb, &gps) == -1);
+    BENCH_CHECK(jb.len < full);
+    json_buf_init(&jb, buf, full + 1);
+    BENCH_CHECK(json_assist_data(&jb, &gps) == 0);
+    BENCH_CHECK(parseDoc(&parse_G, json_buf_str(&jb)) == 0);
+    printf("overflow reported\n");
+}
+
+
+struct encode_s {
+    struct json_buf jb;
+    const struct gps_assist_data *gps;
+};
+
+static void doEncode(void *arg, int ops)
+{
+    struct encode_s *e = arg;
+
+    for(int i=0; i < ops; i++){
+        json_buf_reset(&e->jb);
+        json_assist_data(&e->jb, e->gps);
+    }
+}
+
+
+int main(void)
+{
+    static struct gps_assist_data gps;
+    static char buf[JSON_BUF_SIZE];
+    static struct encode_s enc;
+    struct bench_result r;
+
+    checkAppenders();
+    checkSets();
+    checkOverflow();
+
+    bench_seed(1);
+    fillSet(&gps);
+    json_buf_init(&enc.jb, buf, sizeof(buf));
+    enc.gps = &gps;
+    json_assist_data(&enc.jb, &gps);
+    printf("%d SVs: %d bytes\n", N_SV, (int)enc.jb.len);
+    bench_measure("json_assist_data", doEncode, &enc, enc.jb.len, &r);
+
+    return 0;
+}
@@ -0,0 +1,190 @@
+/*
+ * bench_metrics.c
+ *
+ * Metrics registry: cost of counting from the hot paths against a shared
+ * atomic and a locked counter, and of rendering a scrape. Before timing,
+ * threads (more than there are slots) count concurrently and the totals
+ * are checked exact, histogram buckets are checked against log2, and the
+ * socket endpoint (plain and HTTP) and the file are checked to serve the
+ * rendered text.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "metrics.h"
+#include "benchUtil.h"
+
+
+#define N_THREADS   (METRICS_MAX_THREADS + 4)
+#define PER_THREAD  100000
+#define ITERS       10000000
+#define SOCK        "/tmp/bench_metrics.sock"
+#define PROM_FILE   "/tmp/bench_metrics.prom"
+
+
+static void *countThread(void *arg)
+{
+    uint64_t k = (uintptr_t)arg;
+
+    for(int i=0; i < PER_THREAD; i++){
+        metrics_add(METRIC_UART_RX_BYTES, k);
+        metrics_add(METRIC_UBX_CKSUM_ERRORS, 1);
+        metrics_observe(METRIC_UART_READ_BYTES, 100);
+    }
+    return NULL;
+}
+
+static int scrape(const char *req, char *buf, int size)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    int len = 0, n;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, SOCK);
+    BENCH_CHECK(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    if(req){
+        BENCH_CHECK(write(fd, req, strlen(req)) == (ssize_t)strlen(req));
+    }
+    while((n = read(fd, buf + len, size - 1 - len)) > 0){
+        len += n;
+    }
+    close(fd);
+    buf[len] = '\0';
+    return len;
+}
+
+// value of the first sample line starting with name
+static double sample(const char *text, const char *name)
+{
+    char key[128];
+    const char *p;
+
+    snprintf(key, sizeof(key), "\n%s ", name);
+    p = strstr(text, key);
+    BENCH_CHECK(p != NULL);
+    return strtod(p + strlen(key), NULL);
+}
+
+
+int main(void)
+{
+    static char text[METRICS_TEXT_SIZE], got[METRICS_TEXT_SIZE + 256];
+    pthread_t th[N_THREADS], srv;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    struct metricsServer_s *ms;
+    volatile uint64_t shared = 0, locked = 0;
+    uint64_t want = 0, t0, t1;
+    int len;
+    const char *p;
+    FILE *fp;
+
+    // concurrent counting, some threads on the shared slot
+    for(int i=0; i < N_THREADS; i++){
+        pthread_create(&th[i], NULL, countThread, (void *)(uintptr_t)(i + 1));
+        want += (uint64_t)(i + 1) * PER_THREAD;
+    }
+    for(int i=0; i < N_THREADS; i++){
+        pthread_join(th[i], NULL);
+    }
+    BENCH_CHECK(metrics_counter(METRIC_UART_RX_BYTES) == want);
+    BENCH_CHECK(metrics_counter(METRIC_UBX_CKSUM_ERRORS) == (uint64_t)N_THREADS * PER_THREAD);
+
+    // log2 buckets: 100 is below 128, above 64
+    metrics_observe(METRIC_CONTROL_CYCLE_NS, 3000000);         // 2^21 < 3 ms < 2^22
+    metrics_observe(METRIC_CONTROL_CYCLE_NS, 0);
+    metrics_set(METRIC_ASSIST_GENERATION, 42);
+    len = metrics_render(text, sizeof(text));
+    BENCH_CHECK(len > 0 && len == (int)strlen(text));
+    BENCH_CHECK(sample(text, "bbbrf_uart_rx_bytes_total") == want);
+    BENCH_CHECK(sample(text, "bbbrf_uart_read_bytes_bucket{le=\"64\"}") == 0);
+    BENCH_CHECK(sample(text, "bbbrf_uart_read_bytes_bucket{le=\"128\"}") == N_THREADS * PER_THREAD);
+    BENCH_CHECK(sample(text, "bbbrf_uart_read_bytes_sum") == 100.0 * N_THREADS * PER_THREAD);
+    BENCH_CHECK(sample(text, "bbbrf_control_cycle_seconds_bucket{le=\"0.002097152\"}") == 1);
+    BENCH_CHECK(sample(text, "bbbrf_control_cycle_seconds_bucket{le=\"0.004194304\"}") == 2);
+    BENCH_CHECK(sample(text, "bbbrf_control_cycle_seconds_bucket{le=\"+Inf\"}") == 2);
+    BENCH_CHECK(sample(text, "bbbrf_ringbuffer_dropped_bytes_total{buffer=\"ubx_msg\"}") == 0);
+    BENCH_CHECK(sample(text, "bbbrf_assist_generation") == 42);
+    // one HELP / TYPE for the two ring buffers
+    p = strstr(text, "# TYPE bbbrf_ringbuffer_dropped_bytes_total counter");
+    BENCH_CHECK(p && !strstr(p + 1, "# TYPE bbbrf_ringbuffer_dropped_bytes_total"));
+
+    // le is inclusive: 64 is in le="64", one more is not
+    metrics_observe(METRIC_UART_READ_BYTES, 64);
+    metrics_observe(METRIC_UART_READ_BYTES, 65);
+    BENCH_CHECK(metrics_render(text, sizeof(text)) > 0);
+    BENCH_CHECK(sample(text, "bbbrf_uart_read_bytes_bucket{le=\"32\"}") == 0);
+    BENCH_CHECK(sample(text, "bbbrf_uart_read_bytes_bucket{le=\"64\"}") == 1);
+    BENCH_CHECK(sample(text, "bbbrf_uart_read_bytes_bucket{le=\"128\"}") == N_THREADS * PER_THREAD + 2);
+    printf("%d threads on %d slots count exact, %d bytes rendered:\n%.600s...\n\n",
+           N_THREADS, METRICS_MAX_THREADS, len, text);
+
+    // the exporter
+    unlink(PROM_FILE);
+    ms = metricsServer_init(SOCK, PROM_FILE, 1);
+    BENCH_CHECK(ms != NULL);
+    pthread_create(&srv, NULL, metricsServer_f, ms);
+
+    BENCH_CHECK(scrape(NULL, got, sizeof(got)) == len);
+    BENCH_CHECK(!strcmp(got, text));
+    scrape("GET /metrics HTTP/1.0\r\n\r\n", got, sizeof(got));
+    BENCH_CHECK(!strncmp(got, "HTTP/1.0 200 OK\r\n", 17));
+    BENCH_CHECK(!strcmp(strstr(got, "\r\n\r\n") + 4, text));
+    BENCH_CHECK((fp = fopen(PROM_FILE, "r")) != NULL);
+    BENCH_CHECK((int)fread(got, 1, sizeof(got), fp) == len);
+    fclose(fp);
+    printf("socket (plain and HTTP) and file serve the same text\n\n");
+
+    // costs, on this thread's own slot
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        metrics_add(METRIC_UART_RX_BYTES, 1);
+    }
+    t1 = bench_now_ns();
+    printf("metrics_add          %6.2f ns/op\n", (t1 - t0) / (double)ITERS);
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        metrics_observe(METRIC_UART_READ_BYTES, i & 127);
+    }
+    t1 = bench_now_ns();
+    printf("metrics_observe      %6.2f ns/op\n", (t1 - t0) / (double)ITERS);
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        __atomic_fetch_add(&shared, 1, __ATOMIC_RELAXED);
+    }
+    t1 = bench_now_ns();
+    printf("shared atomic add    %6.2f ns/op  (uncontended)\n", (t1 - t0) / (double)ITERS);
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        pthread_mutex_lock(&mutex);
+        locked++;
+        pthread_mutex_unlock(&mutex);
+    }
+    t1 = bench_now_ns();
+    printf("locked add           %6.2f ns/op  (uncontended)\n", (t1 - t0) / (double)ITERS);
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS / 10000; i++){
+        metrics_render(text, sizeof(text));
+    }
+    t1 = bench_now_ns();
+    printf("metrics_render       %6.2f us/scrape\n", (t1 - t0) / 1e3 / (ITERS / 10000));
+
+    unlink(SOCK);
+    unlink(PROM_FILE);
+    return 0;
+}
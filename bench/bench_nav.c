@@ -0,0 +1,405 @@
+/*
+ * bench_nav.c
+ *
+ * The navigation stream and its history (see navHist.h): N_EPOCHS epochs
+ * of NAV-POSLLH / SOL / VELNED / TIMEUTC, a poll answer now and then, over
+ * a week rollover, through nav_frame() into the ring of a shm region, more
+ * than it holds. Every value of a fix is a function of its epoch, so a
+ * wrong or torn fix shows. Reports
+ *
+ *   nav_frame         serial_f's part, per frame
+ *   find              navHist_find(), per lookup
+ *   an hour           navHist_buckets(), the last hour in minutes
+ *   GET HIST          the same over the pubServer's socket, request to answer
+ *
+ * and checks the buckets against a plain scan, and that a reader of the
+ * region mapped read only, querying while the writer appends back to back,
+ * never takes a fix that isn't one.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ubx.h"
+#include "metrics.h"
+#include "shmPub.h"
+#include "pubServer.h"
+#include "navHist.h"
+#include "benchUtil.h"
+
+
+#define BENCH_SHM       "/bench_nav.gps"
+#define BENCH_SOCK      "/tmp/bench_nav.sock"
+#define N_EPOCHS        (3 * NAV_HIST_SIZE + 1000)
+#define POLL_EVERY      97              // a polled POSLLH after the epoch
+#define WEEK_MS         604800000LL
+#define START_MS        (2000 * WEEK_MS + WEEK_MS - 3600000)     // an hour to the next week
+#define N_FINDS         100000
+#define READ_NS         500000000ULL
+
+static struct navBucket_s buckets_G[NAV_HIST_BUCKETS];
+static volatile int writerRun_G;
+
+
+static int64_t msOf(int k)
+{
+    return START_MS + (int64_t)k * 1000;
+}
+
+static int32_t valOf(int k, int v)
+{
+    switch(v){
+    case NAV_LAT:       return 473977000 + (k * 37) % 1000 - 500;
+    case NAV_LON:       return 85455000 + k;
+    case NAV_HEIGHT:    return 500000 + k % 200;
+    case NAV_HMSL:      return 450000 + k % 200;
+    case NAV_HACC:      return 1000 + k % 50;
+    case NAV_VACC:      return 2000 + k % 70;
+    case NAV_NUM_SV:    return 5 + k % 8;
+    case NAV_PDOP:      return 100 + k % 90;
+    case NAV_VEL_N:     return k % 100 - 50;
+    case NAV_VEL_E:     return -(k % 30);
+    case NAV_VEL_D:     return k % 7;
+    case NAV_GSPEED:    return k % 100;
+    case NAV_HEADING:   return (k * 1000) % 36000000;
+    default:            return 10 + k % 5;
+    }
+}
+
+// the frames of epoch k, back to back. Returns their bytes, *lens each one's
+static int epochFrames(int k, uint8_t *buf, int *lens)
+{
+    struct ubx_nav_posllh pos;
+    struct ubx_nav_sol sol;
+    struct ubx_nav_velned vel;
+    struct ubx_nav_timeutc utc;
+    int64_t ms = msOf(k);
+    uint32_t itow = ms % WEEK_MS;
+    int n = 0;
+
+    memset(&pos, 0, sizeof(pos));
+    pos.itow   = itow;
+    pos.lat    = valOf(k, NAV_LAT);
+    pos.lon    = valOf(k, NAV_LON);
+    pos.height = valOf(k, NAV_HEIGHT);
+    pos.hmsl   = valOf(k, NAV_HMSL);
+    pos.hacc   = valOf(k, NAV_HACC);
+    pos.vacc   = valOf(k, NAV_VACC);
+    n += lens[0] = ubx_nav_posllh_encode(buf + n, 128, &pos);
+
+    memset(&sol, 0, sizeof(sol));
+    sol.itow    = itow;
+    sol.week    = ms / WEEK_MS;
+    sol.gps_fix = 3;
+    sol.num_sv  = valOf(k, NAV_NUM_SV);
+    sol.pdop    = valOf(k, NAV_PDOP);
+    n += lens[1] = ubx_nav_sol_encode(buf + n, 128, &sol);
+
+    memset(&vel, 0, sizeof(vel));
+    vel.itow    = itow;
+    vel.vel_n   = valOf(k, NAV_VEL_N);
+    vel.vel_e   = valOf(k, NAV_VEL_E);
+    vel.vel_d   = valOf(k, NAV_VEL_D);
+    vel.gspeed  = valOf(k, NAV_GSPEED);
+    vel.heading = valOf(k, NAV_HEADING);
+    vel.sacc    = valOf(k, NAV_SACC);
+    n += lens[2] = ubx_nav_velned_encode(buf + n, 128, &vel);
+
+    memset(&utc, 0, sizeof(utc));
+    utc.itow  = itow;
+    utc.year  = 2018;
+    utc.month = 5;
+    utc.day   = 1;
+    utc.sec   = k % 60;
+    utc.valid = 0x07;
+    n += lens[3] = ubx_nav_timeutc_encode(buf + n, 128, &utc);
+
+    // a poll of the epoch just in
+    lens[4] = 0;
+    if((k % POLL_EVERY) == 0){
+        memcpy(buf + n, buf, lens[0]);
+        n += lens[4] = lens[0];
+    }
+    return n;
+}
+
+// a fix that is the one of its time, or not
+static int fixOk(const struct navFix_s *f)
+{
+    int k = (f->timeMs - START_MS) / 1000;
+
+    if( (k < 0) || (k >= N_EPOCHS) || (f->timeMs != msOf(k)) || (f->have != NAV_HAVE_ALL) ||
+        (f->gpsFix != 3) || (f->utcMs != 1525132800000LL + (k % 60) * 1000) ){
+        return 0;
+    }
+    for(int v=0; v < NAV_N_VALS; v++){
+        if(f->val[v] != valOf(k, v)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+static void runStream(struct nav_s *nav, struct navHist_s *h)
+{
+    uint8_t buf[1024];
+    struct navFix_s f;
+    uint64_t ns = 0, t0, first, end;
+    int lens[5], frames = 0, streamed = 0, p;
+
+    for(int k=0; k < N_EPOCHS; k++){
+        epochFrames(k, buf, lens);
+        t0 = bench_now_ns();
+        p = 0;
+        for(int i=0; i < 5; i++){
+            if(lens[i]){
+                streamed += nav_frame(nav, buf + p, lens[i]);
+                p += lens[i];
+                frames++;
+            }
+        }
+        ns += bench_now_ns() - t0;
+    }
+    printf("%d epochs, %d frames\n", N_EPOCHS, frames);
+    printf("  nav_frame   %8.1f ns/frame\n", (double)ns / frames);
+
+    // the POSLLH go on to control_f, the polled ones are no fix of their own
+    BENCH_CHECK(streamed == 3 * N_EPOCHS);
+    BENCH_CHECK(nav->fixes == N_EPOCHS);
+    BENCH_CHECK(metrics_counter(METRIC_NAV_DROPPED) == (N_EPOCHS + POLL_EVERY - 1) / POLL_EVERY);
+    BENCH_CHECK(navHist_span(h, &first, &end) == NAV_HIST_SIZE);
+    BENCH_CHECK(end == N_EPOCHS);
+    for(uint64_t i = first; i < end; i++){
+        BENCH_CHECK(navHist_read(h, i, &f) == 0);
+        BENCH_CHECK(fixOk(&f) && (f.timeMs == msOf(i)));
+    }
+    BENCH_CHECK(navHist_read(h, first - 1, &f) < 0);
+    BENCH_CHECK(navHist_read(h, end, &f) < 0);
+}
+
+static void checkFind(const struct navHist_s *h)
+{
+    uint64_t first, end, i, t0, ns;
+    int64_t ms;
+
+    navHist_span(h, &first, &end);
+    BENCH_CHECK(navHist_find(h, 0) == first);
+    BENCH_CHECK(navHist_find(h, msOf(end)) == end);
+    BENCH_CHECK(navHist_find(h, msOf(first + 10) - 1) == first + 10);
+    BENCH_CHECK(navHist_find(h, msOf(first + 10)) == first + 10);
+
+    bench_seed(49);
+    t0 = bench_now_ns();
+    for(int n=0; n < N_FINDS; n++){
+        i  = first + bench_rand() % (end - first);
+        ms = msOf(i) - (bench_rand() % 1000);
+        BENCH_CHECK(navHist_find(h, ms) == i);
+    }
+    ns = bench_now_ns() - t0;
+    printf("  find        %8.1f ns/lookup (%d fixes)\n", (double)ns / N_FINDS, NAV_HIST_SIZE);
+}
+
+// the last hour in minutes, against a plain scan of the fixes
+static void checkBuckets(const struct navHist_s *h)
+{
+    struct navFix_s last, f;
+    uint64_t first, end, t0, ns;
+    int64_t from, to;
+    int n, reps = 0;
+
+    BENCH_CHECK(navHist_last(h, &last) == 0);
+    to   = last.timeMs + 1;
+    from = to - 3600 * 1000;
+    n = navHist_buckets(h, from, to, 60 * 1000, buckets_G, NAV_HIST_BUCKETS);
+    BENCH_CHECK(n == 60);
+
+    navHist_span(h, &first, &end);
+    for(int b=0; b < n; b++){
+        for(int v=0; v < NAV_N_VALS; v++){
+            int32_t mn = 0, mx = 0;
+            int64_t sum = 0;
+            int cnt = 0;
+
+            for(uint64_t i = first; i < end; i++){
+                navHist_read(h, i, &f);
+                if( (f.timeMs < buckets_G[b].startMs) || (f.timeMs >= buckets_G[b].startMs + 60000) ){
+                    continue;
+                }
+                if( (cnt == 0) || (f.val[v] < mn) ) mn = f.val[v];
+                if( (cnt == 0) || (f.val[v] > mx) ) mx = f.val[v];
+                sum += f.val[v];
+                cnt++;
+            }
+            BENCH_CHECK( (buckets_G[b].n[v] == (uint32_t)cnt) && (cnt == 60) &&
+                         (buckets_G[b].min[v] == mn) && (buckets_G[b].max[v] == mx) &&
+                         (buckets_G[b].mean[v] == (double)sum / cnt) );
+        }
+    }
+    BENCH_CHECK(navHist_buckets(h, from, to, 1000, buckets_G, NAV_HIST_BUCKETS) < 0);
+
+    t0 = bench_now_ns();
+    do{
+        navHist_buckets(h, from, to, 60 * 1000, buckets_G, NAV_HIST_BUCKETS);
+        reps++;
+    }while((ns = bench_now_ns() - t0) < 200000000ULL);
+    printf("  an hour     %8.1f us for 60 buckets of 60 fixes\n", ns / 1e3 / reps);
+}
+
+static int connectTo(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    BENCH_CHECK(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+// GET HIST over the socket, the whole answer
+static void checkServer(const struct navHist_s *h)
+{
+    static char buf[JSON_BUF_SIZE];
+    const char *cmd = "GET HIST 3600 60\n";
+    struct pubServer_s *ps = pubServer_init(BENCH_SOCK);
+    uint64_t t0, ns = 0;
+    pthread_t th;
+    int fd, len, r, nb = 0;
+
+    BENCH_CHECK(ps != NULL);
+    pubServer_setHistory(ps, h);
+    pthread_create(&th, NULL, pubServer_f, ps);
+    pthread_detach(th);
+    fd = connectTo(BENCH_SOCK);
+
+    for(int rep=0; rep < 20; rep++){
+        t0 = bench_now_ns();
+        BENCH_CHECK(write(fd, cmd, strlen(cmd)) == (ssize_t)strlen(cmd));
+        len = 0;
+        do{
+            r = read(fd, buf + len, sizeof(buf) - 1 - len);
+            BENCH_CHECK(r > 0);
+            len += r;
+        }while(buf[len - 1] != '\n');
+        ns += bench_now_ns() - t0;
+    }
+    buf[len] = '\0';
+    BENCH_CHECK(!strncmp(buf, "{\"hist\":{\"from_ms\":", 19));
+    for(const char *p = buf; (p = strstr(p, "\"fixes\":60,")) != NULL; p++){
+        nb++;
+    }
+    BENCH_CHECK(nb == 60);
+    BENCH_CHECK(strstr(buf, "\"lat\":[47.39") != NULL);
+    printf("  GET HIST    %8.1f us for a %d byte answer\n", ns / 1e3 / 20, len);
+
+    BENCH_CHECK(write(fd, "GET HIST 3600 1\n", 16) == 16);
+    len = read(fd, buf, sizeof(buf) - 1);
+    BENCH_CHECK( (len > 0) && !strncmp(buf, "{\"error\":", 9) );
+    close(fd);
+}
+
+
+struct readerStats {
+    uint64_t queries, fixes, bad;
+};
+
+// another process's view: the region mapped read only
+static void *reader_f(void *arg)
+{
+    struct readerStats *st = arg;
+    struct shmPubReader_s rd;
+    const struct navHist_s *h;
+    struct navFix_s f;
+    uint64_t first, end;
+
+    BENCH_CHECK(shmPub_open(&rd, BENCH_SHM) == 0);
+    h = &rd.region->hist;
+    while(writerRun_G){
+        navHist_span(h, &first, &end);
+        // the oldest, the ones the writer is about to overwrite
+        for(uint64_t i = first; i < first + 64; i++){
+            if(navHist_read(h, i, &f) == 0){
+                st->fixes++;
+                st->bad += !fixOk(&f);
+            }
+        }
+        if(navHist_last(h, &f) == 0){
+            st->fixes++;
+            st->bad += !fixOk(&f);
+        }
+        if(navHist_buckets(h, f.timeMs - 600000 + 1, f.timeMs + 1, 60000, buckets_G, NAV_HIST_BUCKETS) > 0){
+            for(int v=0; v < NAV_N_VALS; v++){
+                st->bad += (buckets_G[0].min[v] > buckets_G[0].max[v]);
+            }
+        }
+        st->queries++;
+    }
+    shmPub_close(&rd);
+    return NULL;
+}
+
+// the writer appending back to back, readers at the same time
+static void checkConcurrent(struct navHist_s *h)
+{
+    struct readerStats st;
+    struct navFix_s f;
+    pthread_t rd;
+    uint64_t t0, n = 0;
+    int k;
+
+    memset(&st, 0, sizeof(st));
+    writerRun_G = 1;
+    pthread_create(&rd, NULL, reader_f, &st);
+    t0 = bench_now_ns();
+    while(bench_now_ns() - t0 < READ_NS){
+        // the same epochs again, time goes back but the readers don't care
+        k = n % N_EPOCHS;
+        memset(&f, 0, sizeof(f));
+        f.timeMs = msOf(k);
+        f.utcMs  = 1525132800000LL + (k % 60) * 1000;
+        f.have   = NAV_HAVE_ALL;
+        f.gpsFix = 3;
+        for(int v=0; v < NAV_N_VALS; v++){
+            f.val[v] = valOf(k, v);
+        }
+        navHist_append(h, &f);
+        n++;
+    }
+    writerRun_G = 0;
+    pthread_join(rd, NULL);
+
+    printf("%llu fixes appended while a reader ran %llu queries: %llu fixes taken, %llu wrong\n",
+           (unsigned long long)n, (unsigned long long)st.queries,
+           (unsigned long long)st.fixes, (unsigned long long)st.bad);
+    BENCH_CHECK(st.queries > 0);
+    BENCH_CHECK(st.bad == 0);
+}
+
+
+int main(void)
+{
+    static struct nav_s nav;
+    struct shmPubRegion_s *region;
+
+    region = shmPub_create(BENCH_SHM);
+    BENCH_CHECK(region != NULL);
+    nav_init(&nav, &region->hist, region, NULL);
+
+    runStream(&nav, &region->hist);
+    checkFind(&region->hist);
+    checkBuckets(&region->hist);
+    checkServer(&region->hist);
+    checkConcurrent(&region->hist);
+
+    shmPub_destroy(region, BENCH_SHM);
+    unlink(BENCH_SOCK);
+    return 0;
+}
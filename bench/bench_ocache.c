@@ -0,0 +1,146 @@
+/*
+ * bench_ocache.c
+ *
+ * Chebyshev orbit cache: accuracy against orbit_propagate() over a day of
+ * queries, refits on a new IODE, and the cost of a query against a direct
+ * propagation of the set. The bounds checked are the ones orbitCache.h
+ * documents.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gps.h"
+#include "orbit.h"
+#include "orbitCache.h"
+#include "benchUtil.h"
+
+
+#define N_SV        32
+#define T_START     345600              // s of week
+#define DAY         86400
+#define STEP        1.37                // s between checked epochs
+
+#define MAX_POS_ERR 1e-3                // m
+#define MAX_VEL_ERR 1e-5                // m/s
+#define MAX_CLK_ERR 1e-15               // s
+
+
+struct query_s {
+    struct orbit_cache *oc;
+    double t;                           // inside one window
+};
+
+static struct query_s query_G;
+
+
+static double maxAbs3(const double *a, double x, double y, double z)
+{
+    return fmax(fabs(a[0] - x), fmax(fabs(a[1] - y), fabs(a[2] - z)));
+}
+
+static void checkDay(struct orbit_cache *oc, const struct orbit_engine *oe)
+{
+    static struct orbit_state st;
+    double maxPos = 0, maxVel = 0, maxClk = 0, maxDrift = 0;
+    double pos[3], vel[3], clk[2];
+    unsigned int fits = oc->fits;
+    int n = 0;
+
+    for(double t = T_START + 0.5; t < T_START + DAY; t += STEP){
+        orbit_propagate(oe, t, &st);
+        for(int k=0; k < N_SV; k++){
+            BENCH_CHECK(ocache_query(oc, st.sv_id[k], t, pos, vel, clk) == 0);
+            maxPos   = fmax(maxPos, maxAbs3(pos, st.x[k], st.y[k], st.z[k]));
+            maxVel   = fmax(maxVel, maxAbs3(vel, st.vx[k], st.vy[k], st.vz[k]));
+            maxClk   = fmax(maxClk, fabs(clk[0] - st.clk_bias[k]));
+            maxDrift = fmax(maxDrift, fabs(clk[1] - st.clk_drift[k]));
+            n++;
+        }
+    }
+    printf("%d queries over a day: position %.2e m, velocity %.2e m/s, clock %.2e s, "
+           "drift %.2e s/s, %u fits\n", n, maxPos, maxVel, maxClk, maxDrift, oc->fits - fits);
+    BENCH_CHECK(maxPos < MAX_POS_ERR);
+    BENCH_CHECK(maxVel < MAX_VEL_ERR);
+    BENCH_CHECK(maxClk < MAX_CLK_ERR);
+    // one fit pass per window of the day, all SVs at once
+    BENCH_CHECK(oc->fits - fits <= DAY / OCACHE_WINDOW + 1);
+}
+
+// a new IODE for one SV refits its window, the others keep theirs
+static void checkNewIode(struct orbit_cache *oc, struct orbit_engine *oe,
+                         struct gps_assist_data *gps)
+{
+    static struct orbit_state st;
+    struct gps_ephemeris_sv *e = &gps->ephemeris.svs[3];
+    double t = T_START + 1000.5, pos[3];
+    unsigned int fits;
+
+    BENCH_CHECK(ocache_query(oc, e->sv_id, t, pos, NULL, NULL) == 0);
+    e->iodc = (e->iodc + 1) & 0x3ff;
+    e->m_0 += 1 << 20;
+    BENCH_CHECK(ocache_update(oc, &gps->ephemeris) == 1);
+    BENCH_CHECK(orbit_engine_load(oe, &gps->ephemeris) == 1);
+    orbit_propagate(oe, t, &st);
+
+    fits = oc->fits;
+    BENCH_CHECK(ocache_query(oc, e->sv_id, t, pos, NULL, NULL) == 0);
+    BENCH_CHECK(oc->fits == fits + 1);
+    BENCH_CHECK(maxAbs3(pos, st.x[3], st.y[3], st.z[3]) < MAX_POS_ERR);
+    BENCH_CHECK(ocache_query(oc, e->sv_id + 1, t, pos, NULL, NULL) == 0);
+    BENCH_CHECK(oc->fits == fits + 1);
+    BENCH_CHECK(ocache_query(oc, 40, t, pos, NULL, NULL) == -1);
+}
+
+
+static void doQuery(void *arg, int ops)
+{
+    struct query_s *q = arg;
+    double pos[3], vel[3], clk[2];
+
+    for(int i=0; i < ops; i++){
+        ocache_query(q->oc, 1 + (i & (N_SV - 1)), q->t + (i & 255), pos, vel, clk);
+    }
+}
+
+static void doPropagate(void *arg, int ops)
+{
+    static struct orbit_state st;
+
+    for(int i=0; i < ops; i++){
+        orbit_propagate(arg, T_START + i, &st);
+    }
+}
+
+
+int main(void)
+{
+    static struct gps_assist_data gps;
+    static struct orbit_cache oc;
+    static struct orbit_engine oe;
+    struct bench_result r;
+
+    bench_seed(27);
+    bench_fill_orbits(&gps, N_SV, T_START);
+
+    ocache_init(&oc);
+    orbit_engine_init(&oe);
+    BENCH_CHECK(ocache_update(&oc, &gps.ephemeris) == N_SV);
+    BENCH_CHECK(orbit_engine_load(&oe, &gps.ephemeris) == N_SV);
+
+    printf("struct orbit_cache %zu bytes, %.0f s windows of degree %d\n",
+           sizeof(struct orbit_cache), OCACHE_WINDOW, OCACHE_DEGREE);
+
+    checkDay(&oc, &oe);
+    checkNewIode(&oc, &oe, &gps);
+
+    query_G.oc = &oc;
+    query_G.t  = T_START + 10 * OCACHE_WINDOW + 100;
+    bench_measure("ocache_query, pos vel clk", doQuery, &query_G, 0, &r);
+    bench_measure("orbit_propagate, all SVs", doPropagate, &oe, 0, &r);
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+/*
+ * bench_orbit.c
+ *
+ * Orbit engine: time to propagate 32 SVs over every second of a day, and
+ * agreement with a direct implementation of IS-GPS-200 table 20-IV
+ * (Kepler's equation iterated to convergence, atan2 for the true anomaly,
+ * full sin/cos everywhere, long double). Velocities and clock drift are
+ * checked against central differences of the reference.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "gps.h"
+#include "orbit.h"
+#include "benchUtil.h"
+
+
+#define N_SV        32
+#define DAY         86400
+#define CHECK_STEP  7                   // s between checked epochs
+#define DIFF_H      0.5                 // s, central differences
+#define T_START     345600              // s of week
+
+#define FIT_S       7200                // s either side of toe, the 4 h fit interval
+
+/* The reference is evaluated in long double where that is wider, so that
+ * its own rounding stays out of the comparison */
+#if LDBL_MANT_DIG > DBL_MANT_DIG
+#define MAX_POS_ERR 1e-7                // m, within the fit interval
+#else
+#define MAX_POS_ERR 3e-7
+#endif
+#define MAX_POS_DAY 1e-6                // m, up to a day off toe
+#define MAX_VEL_ERR 1e-4                // m/s, bounded by the differences
+#define MAX_CLK_ERR 1e-15               // s
+#define MAX_DRIFT_ERR 1e-15             // s/s
+
+
+typedef long double real;
+
+struct ref_s {
+    double x, y, z;
+    double clk;
+};
+
+static real refWrap(real dt)
+{
+    if(dt > GPS_HALF_WEEK){
+        dt -= 2 * GPS_HALF_WEEK;
+    }else if(dt < -GPS_HALF_WEEK){
+        dt += 2 * GPS_HALF_WEEK;
+    }
+    return dt;
+}
+
+// IS-GPS-200 table 20-IV, as written
+static void refPropagate(const struct gps_ephemeris_sv *e, real t, struct ref_s *r)
+{
+    const real pi = GPS_PI;
+    real sqrt_a = e->a_powhalf * 0x1p-19L;
+    real a      = sqrt_a * sqrt_a;
+    real ecc    = e->e * 0x1p-33L;
+    real toe    = e->t_oe * 0x1p4L;
+    real toc    = e->t_oc * 0x1p4L;
+    real tk     = refWrap(t - toe);
+    real n      = sqrtl(GPS_MU / (a * a * a)) + e->delta_n * 0x1p-43L * pi;
+    real m      = e->m_0 * 0x1p-31L * pi + n * tk;
+    real ek     = m, prev;
+
+    for(int i=0; i < 100; i++){
+        prev = ek;
+        ek   = m + ecc * sinl(ek);
+        if(fabsl(ek - prev) < 1e-18L){
+            break;
+        }
+    }
+
+    real v    = atan2l(sqrtl(1 - ecc * ecc) * sinl(ek), cosl(ek) - ecc);
+    real phi  = v + e->w * 0x1p-31L * pi;
+    real du   = e->c_us * 0x1p-29L * sinl(2 * phi) + e->c_uc * 0x1p-29L * cosl(2 * phi);
+    real dr   = e->c_rs * 0x1p-5L * sinl(2 * phi) + e->c_rc * 0x1p-5L * cosl(2 * phi);
+    real di   = e->c_is * 0x1p-29L * sinl(2 * phi) + e->c_ic * 0x1p-29L * cosl(2 * phi);
+    real u    = phi + du;
+    real rad  = a * (1 - ecc * cosl(ek)) + dr;
+    real inc  = e->i_0 * 0x1p-31L * pi + di + e->idot * 0x1p-43L * pi * tk;
+    real xp   = rad * cosl(u);
+    real yp   = rad * sinl(u);
+    real om   = e->omega_0 * 0x1p-31L * pi +
+                (e->omega_dot * 0x1p-43L * pi - GPS_OMEGA_E) * tk - GPS_OMEGA_E * toe;
+    real tc   = refWrap(t - toc);
+
+    r->x   = xp * cosl(om) - yp * cosl(inc) * sinl(om);
+    r->y   = xp * sinl(om) + yp * cosl(inc) * cosl(om);
+    r->z   = yp * sinl(inc);
+    r->clk = e->a_f0 * 0x1p-31L + e->a_f1 * 0x1p-43L * tc + e->a_f2 * 0x1p-55L * tc * tc +
+             GPS_F_REL * ecc * sqrt_a * sinl(ek) - e->t_gd * 0x1p-31L;
+}
+
+
+static void check(const struct orbit_engine *oe, const struct gps_ephemeris *eph)
+{
+    struct orbit_state st;
+    struct ref_s r, rm, rp;
+    double maxFit = 0, maxPos = 0, maxVel = 0, maxClk = 0, maxDrift = 0;
+
+    for(int s=0; s < DAY; s += CHECK_STEP){
+        double t = T_START + s;
+
+        orbit_propagate(oe, t, &st);
+        for(int k=0; k < N_SV; k++){
+            const struct gps_ephemeris_sv *e = &eph->svs[k];
+            double dp, dv;
+
+            refPropagate(e, t, &r);
+            refPropagate(e, t - DIFF_H, &rm);
+            refPropagate(e, t + DIFF_H, &rp);
+
+            dp = fmax(fabs(st.x[k] - r.x), fmax(fabs(st.y[k] - r.y), fabs(st.z[k] - r.z)));
+            dv = fmax(fabs(st.vx[k] - (rp.x - rm.x) / (2 * DIFF_H)),
+                      fmax(fabs(st.vy[k] - (rp.y - rm.y) / (2 * DIFF_H)),
+                           fabs(st.vz[k] - (rp.z - rm.z) / (2 * DIFF_H))));
+            if(fabs(t - e->t_oe * 16.0) <= FIT_S){
+                maxFit = fmax(maxFit, dp);
+            }
+            maxPos   = fmax(maxPos, dp);
+            maxVel   = fmax(maxVel, dv);
+            maxClk   = fmax(maxClk, fabs(st.clk_bias[k] - r.clk));
+            maxDrift = fmax(maxDrift, fabs(st.clk_drift[k] - (rp.clk - rm.clk) / (2 * DIFF_H)));
+        }
+    }
+    printf("vs reference, every %d s of a day: position %.2e m (%.2e m within %d s of toe),\n"
+           "  velocity %.2e m/s, clock %.2e s, drift %.2e s/s\n",
+           CHECK_STEP, maxPos, maxFit, FIT_S, maxVel, maxClk, maxDrift);
+    BENCH_CHECK(maxFit < MAX_POS_ERR);
+    BENCH_CHECK(maxPos < MAX_POS_DAY);
+    BENCH_CHECK(maxVel < MAX_VEL_ERR);
+    BENCH_CHECK(maxClk < MAX_CLK_ERR);
+    BENCH_CHECK(maxDrift < MAX_DRIFT_ERR);
+}
+
+
+int main(void)
+{
+    static struct gps_assist_data gps;
+    static struct orbit_engine oe;
+    static struct orbit_state st;
+    double best = 1e9;
+
+    bench_seed(26);
+    bench_fill_orbits(&gps, N_SV, T_START);
+
+    orbit_engine_init(&oe);
+    BENCH_CHECK(orbit_engine_load(&oe, &gps.ephemeris) == N_SV);
+    BENCH_CHECK(orbit_engine_load(&oe, &gps.ephemeris) == 0);
+    gps.ephemeris.svs[5].iodc ^= 1;
+    BENCH_CHECK(orbit_engine_load(&oe, &gps.ephemeris) == 1);
+    BENCH_CHECK(orbit_engine_slot(&oe, 6) == 5);
+
+    check(&oe, &gps.ephemeris);
+
+    for(int run=0; run < 3; run++){
+        uint64_t t0 = bench_now_ns();
+
+        for(int s=0; s < DAY; s++){
+            orbit_propagate(&oe, T_START + s, &st);
+        }
+        best = fmin(best, (bench_now_ns() - t0) / 1e9);
+    }
+    printf("%d SVs x %d epochs: %.3f s (target: well under 1 s), %.1f ns/SV\n",
+           N_SV, DAY, best, best * 1e9 / N_SV / DAY);
+
+    return 0;
+}
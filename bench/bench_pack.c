@@ -0,0 +1,175 @@
+/*
+ * bench_pack.c
+ *
+ * Bit packed assist data: footprint against struct gps_assist_data, cost
+ * of packing / unpacking a set, and of reading fields through the
+ * generated accessors against plain struct members. Before timing, sets
+ * are checked to round trip exactly, every accessor is checked against
+ * its struct member, and out of range fields are checked to be refused.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gps.h"
+#include "gpsPack.h"
+#include "benchUtil.h"
+
+
+#define ITERS       2000
+#define READ_ITERS  20000
+
+
+static void checkSame(const struct gps_assist_data *a, const struct gps_assist_data *b)
+{
+    BENCH_CHECK(a->fields == b->fields && a->gen == b->gen);
+    BENCH_CHECK(a->gen_ionosphere == b->gen_ionosphere && a->gen_utc == b->gen_utc);
+    BENCH_CHECK(!memcmp(&a->ionosphere, &b->ionosphere, sizeof(a->ionosphere)));
+    BENCH_CHECK(!memcmp(&a->utc, &b->utc, sizeof(a->utc)));
+    BENCH_CHECK(!memcmp(&a->almanac, &b->almanac, sizeof(a->almanac)));
+    BENCH_CHECK(!memcmp(&a->ephemeris, &b->ephemeris, sizeof(a->ephemeris)));
+    BENCH_CHECK(a->ref_pos.latitude == b->ref_pos.latitude);
+    BENCH_CHECK(a->ref_pos.longitude == b->ref_pos.longitude);
+    BENCH_CHECK(a->ref_pos.altitude == b->ref_pos.altitude);
+    BENCH_CHECK(a->ref_time.wn == b->ref_time.wn && a->ref_time.tow == b->ref_time.tow);
+    BENCH_CHECK(a->ref_time.when == b->ref_time.when);
+}
+
+#define CHECK_ALM(n, b, s)  BENCH_CHECK((int32_t)gps_pack_alm_##n(r) == (int32_t)sv->n);
+#define CHECK_EPH(n, b, s)  BENCH_CHECK((int32_t)gps_pack_eph_##n(r) == (int32_t)sv->n);
+#define CHECK_IONO(n, b, s) BENCH_CHECK((int32_t)gps_pack_iono_##n(&p->ionosphere) == gps->ionosphere.n);
+#define CHECK_UTC(n, b, s)  BENCH_CHECK((int32_t)gps_pack_utc_##n(&p->utc) == gps->utc.n);
+
+static void checkAccessors(const struct gps_pack *p, const struct gps_assist_data *gps)
+{
+    GPS_PACK_IONO_FIELDS(CHECK_IONO)
+    GPS_PACK_UTC_FIELDS(CHECK_UTC)
+
+    for(int i=0; i < p->n_alm; i++){
+        const struct gps_pack_alm *r = gps_pack_alm_sv(p, i);
+        const struct gps_almanac_sv *sv = &gps->almanac.svs[i];
+
+        GPS_PACK_ALM_FIELDS(CHECK_ALM)
+    }
+    for(int i=0; i < p->n_eph; i++){
+        const struct gps_pack_eph *r = gps_pack_eph_sv(p, i);
+        const struct gps_ephemeris_sv *sv = &gps->ephemeris.svs[i];
+
+        GPS_PACK_EPH_FIELDS(CHECK_EPH)
+    }
+}
+
+/* Extremes of every width, through the setters and back */
+#define EXTREMES_EPH(n, b, s) \
+    gps_pack_eph_set_##n(&r, s ? (1u << (b - 1)) : (uint32_t)((1ULL << b) - 1)); \
+    BENCH_CHECK((int64_t)gps_pack_eph_##n(&r) == (s ? -(1LL << (b - 1)) : (int64_t)((1ULL << b) - 1))); \
+    gps_pack_eph_set_##n(&r, 0); \
+    BENCH_CHECK(gps_pack_eph_##n(&r) == 0);
+
+static void checkExtremes(void)
+{
+    struct gps_pack_eph r;
+
+    memset(&r, 0xa5, sizeof(r));
+    GPS_PACK_EPH_FIELDS(EXTREMES_EPH)
+    for(int i=0; i < GPS_PACK_EPH_WORDS; i++){
+        BENCH_CHECK(r.w[i] == 0 || i == GPS_PACK_EPH_WORDS - 1);
+    }
+}
+
+static void checkRefused(const struct gps_assist_data *gps, struct gps_pack *p)
+{
+    static struct gps_assist_data bad;
+
+    bad = *gps;
+    bad.ephemeris.svs[3].idot = 1 << 13;            // s14
+    BENCH_CHECK(gps_pack(p, GPS_PACK_MAX_SIZE, &bad) < 0);
+    bad = *gps;
+    bad.almanac.svs[5].a_f0 = -1025;                // s11
+    BENCH_CHECK(gps_pack(p, GPS_PACK_MAX_SIZE, &bad) < 0);
+    bad = *gps;
+    bad.ephemeris.svs[0].sv_health = 64;            // u6
+    BENCH_CHECK(gps_pack(p, GPS_PACK_MAX_SIZE, &bad) < 0);
+    BENCH_CHECK(gps_pack(p, gps_pack_size(gps) - 1, gps) < 0);
+}
+
+
+int main(void)
+{
+    static struct gps_assist_data gps, back;
+    static uint8_t packBuf[GPS_PACK_MAX_SIZE];
+    struct gps_pack *p = (struct gps_pack *)packBuf;
+    static const int nSvs[] = { 32, 64 };
+    uint64_t t0, t1;
+    int64_t sum = 0;
+
+    bench_seed(38);
+
+    printf("struct gps_assist_data  %6zu bytes\n", sizeof(struct gps_assist_data));
+    printf("packed records: eph %zu bits (%d B vs %zu B), alm %zu bits (%d B vs %zu B)\n",
+           sizeof(struct gps_pack_eph_layout), (int)sizeof(struct gps_pack_eph),
+           sizeof(struct gps_ephemeris_sv),
+           sizeof(struct gps_pack_alm_layout), (int)sizeof(struct gps_pack_alm),
+           sizeof(struct gps_almanac_sv));
+
+    checkExtremes();
+
+    for(int k=0; k < 2; k++){
+        int n = nSvs[k];
+        int len;
+
+        bench_fill_assist(&gps, n);
+        len = gps_pack(p, sizeof(packBuf), &gps);
+        BENCH_CHECK(len == (int)gps_pack_size(&gps));
+        BENCH_CHECK(gps_unpack(&back, p) == 0);
+        checkSame(&gps, &back);
+        checkAccessors(p, &gps);
+        checkRefused(&gps, p);
+
+        t0 = bench_now_ns();
+        for(int i=0; i < ITERS; i++){
+            gps_pack(p, sizeof(packBuf), &gps);
+        }
+        t1 = bench_now_ns();
+        printf("%2d SVs: packed %5d bytes (%4.1f%%), pack %6.2f us",
+               n, len, 100.0 * len / sizeof(struct gps_assist_data),
+               (t1 - t0) / 1e3 / ITERS);
+
+        t0 = bench_now_ns();
+        for(int i=0; i < ITERS; i++){
+            gps_unpack(&back, p);
+        }
+        t1 = bench_now_ns();
+        printf(", unpack %6.2f us, %d sets per MB\n",
+               (t1 - t0) / 1e3 / ITERS, (1 << 20) / len);
+    }
+
+    // the full set is in p and gps now: read a few orbit fields of every SV
+    t0 = bench_now_ns();
+    for(int it=0; it < READ_ITERS; it++){
+        for(int i=0; i < gps.ephemeris.n_sv; i++){
+            const struct gps_ephemeris_sv *e = &gps.ephemeris.svs[i];
+            sum += (int64_t)e->m_0 + e->omega_dot + e->idot + e->t_oe + e->e;
+        }
+        __asm__ __volatile__("" ::: "memory");
+    }
+    t1 = bench_now_ns();
+    printf("read 5 eph fields: struct %5.2f ns/SV", (t1 - t0) / (double)READ_ITERS / gps.ephemeris.n_sv);
+
+    t0 = bench_now_ns();
+    for(int it=0; it < READ_ITERS; it++){
+        for(int i=0; i < p->n_eph; i++){
+            const struct gps_pack_eph *r = gps_pack_eph_sv(p, i);
+            sum -= (int64_t)gps_pack_eph_m_0(r) + gps_pack_eph_omega_dot(r) + gps_pack_eph_idot(r) +
+                   (int64_t)gps_pack_eph_t_oe(r) + gps_pack_eph_e(r);
+        }
+        __asm__ __volatile__("" ::: "memory");
+    }
+    t1 = bench_now_ns();
+    printf(", packed %5.2f ns/SV\n", (t1 - t0) / (double)READ_ITERS / p->n_eph);
+    BENCH_CHECK(sum == 0);
+
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * bench_parity.c
+ *
+ * Subframe parity (gps_parity_check_subframes()): words are encoded bit by
+ * bit from the parity equations of IS-GPS-200 20.3.5.2, independently of
+ * the tables of gps.c, and have to check clean and give their data back
+ * through gps_word_data(). Every single bit flip of a subframe has to be
+ * reported on the word it hit, and on the next one when it hit D29 / D30.
+ * Reports the cost per word of a batch.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gps.h"
+#include "benchUtil.h"
+
+
+#define N_SF        64
+
+
+struct batch_s {
+    const uint32_t *words;
+    uint16_t fail[N_SF];
+};
+
+
+// bit i of d, d1 the most significant of 24
+#define D(i)    ((d >> (24 - (i))) & 1)
+
+// IS-GPS-200 table 20-XIV, d the source data bits
+static uint32_t parityBits(uint32_t d, uint32_t d29s, uint32_t d30s)
+{
+    uint32_t p25 = d29s ^ D(1)^D(2)^D(3)^D(5)^D(6)^D(10)^D(11)^D(12)^D(13)^D(14)^D(17)^D(18)^D(20)^D(23);
+    uint32_t p26 = d30s ^ D(2)^D(3)^D(4)^D(6)^D(7)^D(11)^D(12)^D(13)^D(14)^D(15)^D(18)^D(19)^D(21)^D(24);
+    uint32_t p27 = d29s ^ D(1)^D(3)^D(4)^D(5)^D(7)^D(8)^D(12)^D(13)^D(14)^D(15)^D(16)^D(19)^D(20)^D(22);
+    uint32_t p28 = d30s ^ D(2)^D(4)^D(5)^D(6)^D(8)^D(9)^D(13)^D(14)^D(15)^D(16)^D(17)^D(20)^D(21)^D(23);
+    uint32_t p29 = d30s ^ D(1)^D(3)^D(5)^D(6)^D(7)^D(9)^D(10)^D(14)^D(15)^D(16)^D(17)^D(18)^D(21)^D(22)^D(24);
+    uint32_t p30 = d29s ^ D(3)^D(5)^D(6)^D(8)^D(9)^D(10)^D(11)^D(13)^D(15)^D(19)^D(22)^D(23)^D(24);
+
+    return (p25 << 5) | (p26 << 4) | (p27 << 3) | (p28 << 2) | (p29 << 1) | p30;
+}
+
+static uint32_t encodeWord(uint32_t d, uint32_t prev)
+{
+    uint32_t d29s = (prev >> 1) & 1, d30s = prev & 1;
+
+    return (((d ^ (0xffffff * d30s)) & 0xffffff) << 6) | parityBits(d, d29s, d30s);
+}
+
+// a subframe of random data; words 2 and 10 spend d23 / d24 on D29 = D30 = 0
+static void encodeSubframe(uint32_t *sf, uint32_t *data)
+{
+    uint32_t prev = 0;
+
+    for(int j=0; j < GPS_SF_WORDS; j++){
+        uint32_t d = bench_rand() & 0xffffff;
+
+        if((j == 1) || (j == 9)){
+            for(uint32_t t=0; t < 4; t++){
+                d = (d & ~3u) | t;
+                if((encodeWord(d, prev) & 3) == 0){
+                    break;
+                }
+            }
+            BENCH_CHECK((encodeWord(d, prev) & 3) == 0);
+        }
+        data[j] = d;
+        sf[j]   = prev = encodeWord(d, prev);
+    }
+}
+
+
+static void doCheck(void *arg, int ops)
+{
+    struct batch_s *b = arg;
+
+    for(int i=0; i < ops; i++){
+        gps_parity_check_subframes(b->words, N_SF, b->fail);
+    }
+}
+
+
+int main(void)
+{
+    static uint32_t words[N_SF * GPS_SF_WORDS], data[N_SF * GPS_SF_WORDS];
+    static struct batch_s batch;
+    struct bench_result r;
+    uint16_t fail[N_SF];
+    int flips = 0;
+
+    bench_seed(29);
+    for(int i=0; i < N_SF; i++){
+        encodeSubframe(&words[i * GPS_SF_WORDS], &data[i * GPS_SF_WORDS]);
+    }
+
+    // clean: every word checks, and gives its data back
+    memset(fail, 0xff, sizeof(fail));
+    BENCH_CHECK(gps_parity_check_subframes(words, N_SF, fail) == 0);
+    for(int i=0; i < N_SF; i++){
+        uint32_t prev = 0;
+
+        BENCH_CHECK(fail[i] == 0);
+        for(int j=0; j < GPS_SF_WORDS; j++){
+            uint32_t w = words[i * GPS_SF_WORDS + j];
+
+            BENCH_CHECK(gps_parity_check_word(w, prev) == 0);
+            BENCH_CHECK(gps_word_data(w, prev) == data[i * GPS_SF_WORDS + j]);
+            prev = w;
+        }
+    }
+
+    // every single bit flip, on its word, and the next when it is D29 / D30
+    for(int i=0; i < N_SF; i += 7){
+        for(int j=0; j < GPS_SF_WORDS; j++){
+            for(int b=0; b < 30; b++){
+                uint32_t *w = &words[i * GPS_SF_WORDS + j];
+                uint16_t want = 1 << j;
+
+                if((b < 2) && (j < GPS_SF_WORDS - 1)){
+                    want |= 1 << (j + 1);
+                }
+                *w ^= 1u << b;
+                BENCH_CHECK(gps_parity_check_subframes(words, N_SF, fail) == __builtin_popcount(want));
+                BENCH_CHECK(fail[i] == want);
+                *w ^= 1u << b;
+                flips++;
+            }
+        }
+    }
+    printf("%d subframes clean, %d single bit flips reported on their words\n", N_SF, flips);
+
+    batch.words = words;
+    bench_measure("parity, 64 subframes", doCheck, &batch, N_SF * GPS_SF_WORDS * 4, &r);
+    printf("%.2f ns/word\n", r.ns_op / (N_SF * GPS_SF_WORDS));
+
+    return 0;
+}
@@ -0,0 +1,209 @@
+/*
+ * bench_plan.c
+ *
+ * The aid poll plan (updateSvPollPlan()) and the acks it is checked
+ * against. Checks that the per SV polls, acks and missing counts cover
+ * GPS PRN 1..32 and nothing else, that a prediction narrows the ephemeris
+ * polls to the usable SVs, PRN 32 included, and that a NAV-POSLLH without
+ * a fix doesn't become the reference position the prediction is made
+ * from. Reports the cost of rebuilding the plan.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "config.h"
+#include "gps.h"
+#include "ubx.h"
+#include "ubx-parse.h"
+#include "list.h"
+#include "predict.h"
+#include "benchUtil.h"
+
+
+#define ITERS       100000
+
+
+static void freeNode(void *data)
+{
+    free(data);
+}
+
+// the per SV polls of msg_id prepAidMissingPollMsgs() queues
+static int missingPolls(struct msgStrmCheck_s *msgChk, int id, uint8_t *svs)
+{
+    list *ll = create_list();
+    int n = 0;
+
+    prepAidMissingPollMsgs(ll, msgChk);
+    while(size(ll)){
+        struct ubx_hdr *h = front(ll);
+
+        if( (h->msg_class == UBX_CLASS_AID) && (h->msg_id == id) ){
+            BENCH_CHECK(h->payload_len == 1);
+            svs[n++] = *((uint8_t *)(h + 1));
+        }
+        remove_front(ll, freeNode);
+    }
+    free(ll);
+    return n;
+}
+
+// an answer of msg_class / msg_id, whose first payload byte is sv, as control_f acks it
+static void ack(struct msgStrmCheck_s *msgChk, int cls, int id, int sv)
+{
+    uint8_t pl[8], frame[64];
+
+    memset(pl, 0, sizeof(pl));
+    pl[0] = sv;
+    ubx_frame_encode(frame, sizeof(frame), cls, id, pl, sizeof(pl));
+    updateValidUbxMsgList(frame, msgChk);
+}
+
+static void checkAcks(void)
+{
+    static struct msgStrmCheck_s msgChk;
+    uint8_t svs[64];
+
+    // nothing known: every PRN, 1..32, once each
+    memset(&msgChk, 0, sizeof(msgChk));
+    BENCH_CHECK(areThereMissingMessages(&msgChk) == 32 + 32 + 3);
+    BENCH_CHECK(missingPolls(&msgChk, UBX_AID_ALM, svs) == 32);
+    for(int i=0; i < 32; i++){
+        BENCH_CHECK(svs[i] == i + 1);
+    }
+    BENCH_CHECK(missingPolls(&msgChk, UBX_AID_EPH, svs) == 32);
+    BENCH_CHECK((svs[0] == 1) && (svs[31] == 32));
+
+    // PRN 32 answered is PRN 32 acked; ids out of GPS' go nowhere
+    ack(&msgChk, UBX_CLASS_AID, UBX_AID_EPH, 32);
+    ack(&msgChk, UBX_CLASS_AID, UBX_AID_EPH, 120);
+    ack(&msgChk, UBX_CLASS_AID, UBX_AID_ALM, 0);
+    ack(&msgChk, UBX_CLASS_AID, UBX_AID_ALM, 33);
+    BENCH_CHECK(msgChk.ubxAidAck.ephAck[32] && !msgChk.ubxAidAck.almAck[0]);
+    BENCH_CHECK(missingPolls(&msgChk, UBX_AID_EPH, svs) == 31);
+    BENCH_CHECK(svs[30] == 31);
+    BENCH_CHECK(missingPolls(&msgChk, UBX_AID_ALM, svs) == 32);
+
+    for(int s=1; s <= 32; s++){
+        ack(&msgChk, UBX_CLASS_AID, UBX_AID_ALM, s);
+        ack(&msgChk, UBX_CLASS_AID, UBX_AID_EPH, s);
+    }
+    ack(&msgChk, UBX_CLASS_AID, UBX_AID_INI, 0);
+    ack(&msgChk, UBX_CLASS_AID, UBX_AID_HUI, 0);
+    BENCH_CHECK(areThereMissingMessages(&msgChk) == 1);
+    ack(&msgChk, UBX_CLASS_NAV, UBX_NAV_POSLLH, 0);
+    BENCH_CHECK(areThereMissingMessages(&msgChk) == 0);
+    printf("polls and acks of PRN 1..32 ok\n");
+}
+
+
+// a sky where PRN 32 is visible and every third SV never rises
+static void fillPrediction(struct predict_set *ps)
+{
+    memset(ps, 0, sizeof(struct predict_set));
+    for(int s=1; s <= 32; s++){
+        struct sv_predict *p = &(ps->sv[ps->n_sv++]);
+
+        p->sv_id = s;
+        p->flags = (s % 3) ? (PREDICT_USABLE | PREDICT_VISIBLE) : 0;
+        p->elev  = (s % 3) ? s : -20;
+    }
+}
+
+static void checkPlan(void)
+{
+    static struct msgStrmCheck_s msgChk;
+    static struct predict_set ps;
+    uint8_t svs[64], seen[UBX_AID_N_SV];
+    int n;
+
+    memset(&msgChk, 0, sizeof(msgChk));
+    fillPrediction(&ps);
+    BENCH_CHECK(updateSvPollPlan(&msgChk, &ps) == 22);
+    BENCH_CHECK(msgChk.svPlan.ephSv[0] == 32);
+
+    n = missingPolls(&msgChk, UBX_AID_EPH, svs);
+    BENCH_CHECK(n == 22);
+    for(int i=0; i < n; i++){
+        BENCH_CHECK(svs[i] % 3);
+    }
+
+    // almanacs: every PRN once, the predicted ones first
+    memset(seen, 0, sizeof(seen));
+    n = missingPolls(&msgChk, UBX_AID_ALM, svs);
+    BENCH_CHECK(n == 32);
+    for(int i=0; i < n; i++){
+        BENCH_CHECK((svs[i] >= 1) && (svs[i] <= 32) && !seen[svs[i]]);
+        BENCH_CHECK((i < 22) == ((svs[i] % 3) != 0));
+        seen[svs[i]] = 1;
+    }
+    BENCH_CHECK(areThereMissingMessages(&msgChk) == 32 + 22 + 3);
+    printf("plan of 22 usable SVs, PRN 32 first, ok\n");
+}
+
+
+static void dispatch(struct gps_assist_data *gps, const void *frame, int len)
+{
+    BENCH_CHECK(ubx_msg_dispatch(ubx_parse_dt, (void *)frame, len, gps) == len);
+}
+
+// a fix only becomes the reference position with an accuracy to go by
+static void checkRefPos(void)
+{
+    static struct gps_assist_data gps;
+    struct ubx_nav_posllh pos;
+    struct ubx_aid_ini ini;
+    uint8_t frame[128];
+
+    memset(&gps, 0, sizeof(gps));
+    memset(&pos, 0, sizeof(pos));
+    pos.hacc = 0xffffffff;                      // no fix: 0,0 and hAcc at its limit
+    dispatch(&gps, frame, ubx_nav_posllh_encode(frame, sizeof(frame), &pos));
+    BENCH_CHECK(!(gps.fields & GPS_FIELD_REFPOS));
+
+    // so the receiver's AID-INI position still counts
+    memset(&ini, 0, sizeof(ini));
+    ini.x     = 410082000;
+    ini.y     = 289784000;
+    ini.z     = 3900;
+    ini.flags = 0x01 | 0x20;
+    dispatch(&gps, frame, ubx_aid_ini_encode(frame, sizeof(frame), &ini));
+    BENCH_CHECK((gps.fields & GPS_FIELD_REFPOS) && (gps.ref_pos.latitude > 41.0));
+
+    pos.lat  = 395000000;
+    pos.lon  = 325000000;
+    pos.hacc = REF_POS_MAX_HACC_M * 1000 + 1;
+    dispatch(&gps, frame, ubx_nav_posllh_encode(frame, sizeof(frame), &pos));
+    BENCH_CHECK(gps.ref_pos.latitude > 41.0);
+
+    pos.hacc = 3000;                            // 3 m: a fix, it takes over
+    dispatch(&gps, frame, ubx_nav_posllh_encode(frame, sizeof(frame), &pos));
+    BENCH_CHECK((gps.ref_pos.latitude == 39.5) && (gps.ref_pos.longitude == 32.5));
+    printf("reference position ok\n");
+}
+
+
+int main(void)
+{
+    static struct msgStrmCheck_s msgChk;
+    static struct predict_set ps;
+    uint64_t t0, t1;
+
+    checkAcks();
+    checkPlan();
+    checkRefPos();
+
+    fillPrediction(&ps);
+    memset(&msgChk, 0, sizeof(msgChk));
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        updateSvPollPlan(&msgChk, &ps);
+    }
+    t1 = bench_now_ns();
+    printf("updateSvPollPlan, 32 SVs predicted  %7.2f us\n", (t1 - t0) / 1e3 / ITERS);
+
+    return 0;
+}
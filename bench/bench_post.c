@@ -0,0 +1,113 @@
+/*
+ * bench_post.c
+ *
+ * Upload path against the stand-in server with injected response delays:
+ * payloads are produced at a fixed rate, as control_f would, and the
+ * benchmark reports delivered throughput, enqueue cost, connection reuse,
+ * batching and the enqueue-to-server latency distribution. Every request
+ * body has to be a JSON array, a batch of one too, and chunked responses
+ * must leave a keep-alive connection usable.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "post.h"
+#include "benchUtil.h"
+#include "httpStub.h"
+
+
+#define N_PAYLOADS      1000
+#define PERIOD_US       500
+#define PAD_LEN         900
+
+
+static void runPhase(struct httpStub_s *hs, const char *url, int delayUs, int closeEvery,
+                     int chunked)
+{
+    static char data[PAD_LEN + 64];
+    static char pad[PAD_LEN + 1];
+    struct postStats_s st;
+    struct post_s post;
+    uint64_t t0, tEnd, enqMax = 0, enqSum = 0;
+    int settled;
+
+    memset(pad, 'x', PAD_LEN);
+    httpStub_reset(hs);
+    hs->delayUs    = delayUs;
+    hs->closeEvery = closeEvery;
+    hs->chunked    = chunked;
+    BENCH_CHECK(post_initialize() == 0);
+
+    post.postAddress = (char *)url;
+    post.postData    = data;
+
+    t0 = bench_now_ns();
+    for(int i=0; i < N_PAYLOADS; i++){
+        uint64_t t = bench_now_ns();
+
+        snprintf(data, sizeof(data), "{\"t\":%llu,\"seq\":%d,\"pad\":\"%s\"}",
+                 (unsigned long long)t, i, pad);
+        BENCH_CHECK(post2Server(&post) >= 0);
+        t = bench_now_ns() - t;
+        enqSum += t;
+        if(t > enqMax){
+            enqMax = t;
+        }
+        usleep(PERIOD_US);
+    }
+
+    // wait until everything was either delivered, dropped or given up on
+    do{
+        post_getStats(&st);
+        settled = (st.sent + st.dropped + st.failed == st.queued);
+        if(!settled){
+            usleep(1000);
+        }
+    }while(!settled);
+    tEnd = bench_now_ns();
+    postCleanup();
+
+    BENCH_CHECK(st.failed == 0);
+    BENCH_CHECK(httpStub_payloads(hs) == st.sent);
+    BENCH_CHECK(hs->notArrays == 0);
+    if(!closeEvery){
+        // a response read to its end leaves the connection in step
+        BENCH_CHECK(st.connects <= POST_WORKERS);
+    }
+
+    printf("  %6d us %5d %c | %7.0f /s %5d req %3d conn %5.1f per req %4d drop | "
+           "enq %5.1f us max %6.1f us | p50 %7.2f p99 %7.2f max %7.2f ms\n",
+           delayUs, closeEvery, chunked ? 'c' : ' ',
+           st.sent / ((tEnd - t0) / 1e9), (int)st.requests, (int)st.connects,
+           (double)st.sent / st.requests, (int)st.dropped,
+           enqSum / 1e3 / N_PAYLOADS, enqMax / 1e3,
+           bench_percentile(hs->latNs, hs->nLat, 50) / 1e6,
+           bench_percentile(hs->latNs, hs->nLat, 99) / 1e6,
+           bench_percentile(hs->latNs, hs->nLat, 100) / 1e6);
+}
+
+
+int main(void)
+{
+    struct httpStub_s *hs = httpStub_start();
+    char url[64];
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/assist", hs->port);
+
+    printf("%d payloads of %d bytes, one every %d us\n", N_PAYLOADS, PAD_LEN + 40, PERIOD_US);
+    printf("   delay close   |   sent/s   req conn  batch drop | enqueue               | latency\n");
+    runPhase(hs, url, 0, 0, 0);
+    runPhase(hs, url, 0, 5, 0);
+    runPhase(hs, url, 0, 0, 1);
+    runPhase(hs, url, 0, 5, 1);
+    runPhase(hs, url, 2000, 0, 0);
+    runPhase(hs, url, 20000, 0, 0);
+    runPhase(hs, url, 100000, 0, 0);
+
+    return 0;
+}
@@ -0,0 +1,356 @@
+/*
+ * bench_prims.c
+ *
+ * The hot primitives, one repeatable number each (see bench_measure()):
+ *
+ *   ubx_checksum                    over a 1 KB frame
+ *   parseUartInput_4_UbxMsg         a scratchpad of back to back frames,
+ *                                   and the same frames in line noise,
+ *                                   scanned as control_f does
+ *   ringbuffer_write / _read        100 byte reads of the serial port
+ *                                   passed between two threads
+ *   gps_unpack_sf123 / sf45         one SV's subframes
+ *   push_back / remove_front        a command through the tx list
+ *   ubx_msg_dispatch                an empty frame, handler first / last
+ *                                   in the table, or not in it
+ *   trace_*                         one frame's stamps through every stage
+ *
+ * It also checks, through trace_dump(), that a frame's FRAMED stamp is
+ * serial_f's, taken when the framer returned it, and not the time
+ * control_f's scan got to it.
+ *
+ * Run it before and after a change; a line marked UNSTABLE didn't settle
+ * within BENCH_MAX_SPREAD and isn't worth comparing.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "gps.h"
+#include "ubx.h"
+#include "ringBuf.h"
+#include "list.h"
+#include "trace.h"
+#include "benchUtil.h"
+
+
+#define FRAME_LEN       1024
+#define SCRATCH_LEN     SCRATCHPAD_BUF_SIZE
+#define CHUNK           100         // serial_f reads up to 100 bytes
+#define NOISE_PCT       30
+
+
+static uint8_t frame_G[FRAME_LEN];
+static uint8_t clean_G[SCRATCH_LEN];
+static uint8_t noisy_G[SCRATCH_LEN];
+static int     frames_G;
+static volatile int sink_G;
+
+
+static void fillRand(void *p, int n)
+{
+    uint8_t *b = p;
+
+    for(int i=0; i < n; i++){
+        b[i] = bench_rand();
+    }
+}
+
+// a valid frame of pl_len random payload bytes, returns its length
+static int randFrame(uint8_t *buf, int pl_len)
+{
+    static uint8_t pl[FRAME_LEN];
+
+    fillRand(pl, pl_len);
+    // a class no schema knows about, the parsers only look at the framing
+    return ubx_frame_encode(buf, FRAME_LEN, 0x0a, 0x04, pl, pl_len);
+}
+
+// frames of AID-EPH-like sizes back to back, noisePct% of the bytes junk
+static int fillScratch(uint8_t *buf, int noisePct)
+{
+    int len = 0, n = 0;
+
+    while(len < SCRATCH_LEN - FRAME_LEN){
+        int junk = noisePct ? (bench_rand() % 200) * noisePct / (100 - noisePct) : 0;
+
+        fillRand(buf + len, junk);
+        for(int i=0; i < junk; i++){
+            if(buf[len + i] == UBX_SYNC0){
+                buf[len + i] = 0;
+            }
+        }
+        len += junk;
+        len += randFrame(buf + len, 40 + bench_rand() % 64);
+        n++;
+    }
+    memset(buf + len, 0, SCRATCH_LEN - len);
+    frames_G = n;
+    return len;
+}
+
+
+/* Operations */
+static void opChecksum(void *arg, int ops)
+{
+    uint8_t ck[2];
+
+    for(int i=0; i < ops; i++){
+        ubx_checksum(frame_G + 2, FRAME_LEN - 4, ck);
+        sink_G += ck[0];
+    }
+}
+
+// control_f's scan of the scratchpad
+static int scan(uint8_t *buf, int len)
+{
+    int n = 0;
+
+    for(int i=0; i < len; ){
+        int rv = parseUartInput_4_UbxMsg(buf + i, len - i);
+
+        if(rv < 0){
+            i++;
+        }else{
+            i += rv;
+            n++;
+        }
+    }
+    return n;
+}
+
+static void opScan(void *arg, int ops)
+{
+    for(int i=0; i < ops; i++){
+        sink_G += scan(arg, SCRATCH_LEN);
+    }
+}
+
+
+struct rbArg_s {
+    struct ringbuffer_s *rb;
+    int ops;
+};
+
+static void *rbWriter(void *arg)
+{
+    struct rbArg_s *a = arg;
+    uint8_t chunk[CHUNK];
+
+    memset(chunk, 0x5a, sizeof(chunk));
+    for(int i=0; i < a->ops; ){
+        if(ringbuffer_write(a->rb, chunk, CHUNK) == CHUNK){
+            i++;
+        }else{
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// one op: a chunk written by the writer thread and read here
+static void opRingbuffer(void *arg, int ops)
+{
+    struct rbArg_s a = { arg, ops };
+    uint8_t chunk[CHUNK];
+    pthread_t w;
+
+    pthread_create(&w, NULL, rbWriter, &a);
+    for(int i=0; i < ops; ){
+        if(ringbuffer_read(a.rb, chunk, CHUNK) == CHUNK){
+            i++;
+        }else{
+            sched_yield();
+        }
+    }
+    pthread_join(w, NULL);
+    sink_G += chunk[0];
+}
+
+
+static uint32_t sf123_G[24];
+static uint32_t sf45_G[8];
+
+static void opSf123(void *arg, int ops)
+{
+    struct gps_ephemeris_sv eph;
+
+    for(int i=0; i < ops; i++){
+        sink_G += gps_unpack_sf123(sf123_G, &eph);
+        sink_G += eph.m_0;
+    }
+}
+
+static void opSf45(void *arg, int ops)
+{
+    struct gps_almanac_sv alm;
+
+    for(int i=0; i < ops; i++){
+        sink_G += gps_unpack_sf45_almanac(sf45_G, &alm);
+        sink_G += alm.m_0;
+    }
+}
+
+
+static void keepNode(void *data)
+{
+}
+
+static void opList(void *arg, int ops)
+{
+    list *ll = arg;
+    static int cmd;
+
+    for(int i=0; i < ops; i++){
+        push_back(ll, &cmd);
+        remove_front(ll, keepNode);
+    }
+}
+
+
+static void handler(struct ubx_hdr *hdr, void *pl, int pl_len, void *ud)
+{
+    sink_G++;
+}
+
+// the size of ubx_parse_dt, and a message of no schema at either end
+static struct ubx_dispatch_entry dt_G[] = {
+    { 0x0a, 0x04, handler },
+    UBX_DISPATCH(NAV, POSLLH, handler),
+    UBX_DISPATCH(NAV, SOL,    handler),
+    UBX_DISPATCH(TIM, TP,     handler),
+    UBX_DISPATCH(RXM, RAW,    handler),
+    UBX_DISPATCH(AID, INI,    handler),
+    UBX_DISPATCH(AID, HUI,    handler),
+    UBX_DISPATCH(AID, ALM,    handler),
+    UBX_DISPATCH(AID, EPH,    handler),
+    { 0x0a, 0x05, handler },
+    { 0, 0, NULL },
+};
+
+static void opDispatch(void *arg, int ops)
+{
+    for(int i=0; i < ops; i++){
+        sink_G += ubx_msg_dispatch(dt_G, arg, sizeof(struct ubx_hdr) + 2, NULL);
+    }
+}
+
+
+// what the pipeline adds per frame: serial_f's stamps, then the frame's stages
+static void opTrace(void *arg, int ops)
+{
+    for(int i=0; i < ops; i++){
+        trace_read();
+        trace_framed(FRAME_LEN);
+        trace_uartRead(FRAME_LEN);
+        trace_queued(trace_frame(arg, 0, FRAME_LEN));
+        trace_dispatched();
+        trace_published();
+    }
+}
+
+
+// dur of the last slice of the dump on track tid, -1 if there is none
+static double lastSliceUs(const char *dump, int tid)
+{
+    char key[16];
+    const char *p, *last = NULL;
+
+    snprintf(key, sizeof(key), "\"tid\":%d,", tid);
+    for(p = dump; (p = strstr(p, key)) != NULL; p++){
+        last = p;
+    }
+    if((last == NULL) || ((p = strstr(last, "\"dur\":")) == NULL)){
+        return -1;
+    }
+    return strtod(p + 6, NULL);
+}
+
+// a frame control_f scans 20 ms after serial_f framed it
+static void checkTrace(const uint8_t *frame)
+{
+    static char dump[4 * 1024 * 1024];
+    const char *path = "/tmp/bench_prims.trace.json";
+    FILE *fp;
+    size_t n;
+
+    trace_read();
+    trace_framed(FRAME_LEN);
+    usleep(20000);
+    trace_uartRead(FRAME_LEN);
+    trace_queued(trace_frame(frame, 0, FRAME_LEN));
+
+    BENCH_CHECK(trace_dump(path) == 0);
+    BENCH_CHECK((fp = fopen(path, "r")) != NULL);
+    n = fread(dump, 1, sizeof(dump) - 1, fp);
+    dump[n] = '\0';
+    fclose(fp);
+    unlink(path);
+
+    // track 2 is READ -> FRAMED, 3 FRAMED -> QUEUED
+    BENCH_CHECK((lastSliceUs(dump, 2) >= 0) && (lastSliceUs(dump, 2) < 5000));
+    BENCH_CHECK(lastSliceUs(dump, 3) >= 20000);
+    printf("trace: FRAMED stamped by serial_f, the scan's wait is in QUEUED\n");
+}
+
+
+int main(void)
+{
+    static uint8_t first[16], last[16], miss[16];
+    struct ringbuffer_s *rb = ringbuffer_init();
+    list *ll = create_list();
+    struct bench_result r;
+    int unstable = 0, cleanLen, noisyLen, n;
+
+    bench_seed(42);
+
+    // inputs, checked before they are timed
+    BENCH_CHECK(randFrame(frame_G, FRAME_LEN - 8) == FRAME_LEN);
+    cleanLen = fillScratch(clean_G, 0);
+    n = frames_G;
+    BENCH_CHECK(scan(clean_G, SCRATCH_LEN) == n);
+    noisyLen = fillScratch(noisy_G, NOISE_PCT);
+    BENCH_CHECK(scan(noisy_G, SCRATCH_LEN) == frames_G);
+    printf("scratchpad: %d frames in %d bytes clean, %d frames in %d bytes with %d%% noise\n",
+           n, cleanLen, frames_G, noisyLen, NOISE_PCT);
+
+    fillRand(sf123_G, sizeof(sf123_G));
+    fillRand(sf45_G, sizeof(sf45_G));
+
+    ubx_frame_encode(first, sizeof(first), 0x0a, 0x04, frame_G, 0);
+    ubx_frame_encode(last,  sizeof(last),  0x0a, 0x05, frame_G, 0);
+    ubx_frame_encode(miss,  sizeof(miss),  0x0a, 0x07, frame_G, 0);
+    sink_G = 0;
+    opDispatch(first, 1);
+    opDispatch(last, 1);
+    BENCH_CHECK(sink_G == 2 * (8 + 1));
+    opDispatch(miss, 1);
+    BENCH_CHECK(sink_G == 3 * 8 + 2);
+
+    printf("\n%-34s %13s %13s  %s\n", "", "time", "throughput", "spread");
+    unstable += bench_measure("ubx_checksum 1 KB", opChecksum, NULL, FRAME_LEN - 4, &r);
+    unstable += bench_measure("scan scratchpad, clean", opScan, clean_G, SCRATCH_LEN, &r);
+    unstable += bench_measure("scan scratchpad, 30% noise", opScan, noisy_G, SCRATCH_LEN, &r);
+    unstable += bench_measure("ringbuffer 100 B, two threads", opRingbuffer, rb, CHUNK, &r);
+    unstable += bench_measure("gps_unpack_sf123", opSf123, NULL, sizeof(sf123_G), &r);
+    unstable += bench_measure("gps_unpack_sf45_almanac", opSf45, NULL, sizeof(sf45_G), &r);
+    unstable += bench_measure("push_back + remove_front", opList, ll, 0, &r);
+    unstable += bench_measure("dispatch, first entry", opDispatch, first, 0, &r);
+    unstable += bench_measure("dispatch, last entry", opDispatch, last, 0, &r);
+    unstable += bench_measure("dispatch, no handler", opDispatch, miss, 0, &r);
+    unstable += bench_measure("trace, one frame all stages", opTrace, frame_G, 0, &r);
+
+    checkTrace(frame_G);
+
+    if(unstable){
+        printf("\n%d measurements didn't settle, rerun on a quieter machine\n", -unstable);
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * bench_pub.c
+ *
+ * Fan-out of the publish server: N subscribers on the unix socket, one of
+ * them never reading. Measures how long publishing takes on the caller's
+ * side and how long until every live subscriber has the update, and
+ * checks the stuck client gets dropped instead of holding anything up.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "gps.h"
+#include "pubServer.h"
+#include "benchUtil.h"
+
+
+#define N_SUBS      16
+#define N_UPDATES   200
+#define BENCH_SOCK  "/tmp/bench_pub.sock"
+
+
+static int connectTo(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    BENCH_CHECK(connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+// buffered reader per socket, one '\n' terminated line at a time
+struct lineReader {
+    int  fd;
+    int  len;
+    char buf[128 * 1024];
+};
+
+static struct lineReader readers_G[N_SUBS + 2];
+
+static struct lineReader *readerOf(int fd)
+{
+    for(int i=0; i < N_SUBS + 2; i++){
+        if(readers_G[i].fd == fd || readers_G[i].fd == 0){
+            readers_G[i].fd = fd;
+            return &readers_G[i];
+        }
+    }
+    bench_fail(__FILE__, __LINE__, "too many readers");
+    return NULL;
+}
+
+static int readLine(int fd, char *line, int size)
+{
+    struct lineReader *lr = readerOf(fd);
+    char *nl;
+    int n;
+
+    while((nl = memchr(lr->buf, '\n', lr->len)) == NULL){
+        int r = read(fd, lr->buf + lr->len, sizeof(lr->buf) - lr->len);
+        BENCH_CHECK(r > 0);
+        lr->len += r;
+    }
+    n = nl - lr->buf + 1;
+    BENCH_CHECK(n < size);
+    memcpy(line, lr->buf, n);
+    line[n] = '\0';
+    lr->len -= n;
+    memmove(lr->buf, nl + 1, lr->len);
+    return n;
+}
+
+// reads until the assist line of generation gen arrived
+static void waitGen(int fd, unsigned int gen)
+{
+    static char line[64 * 1024];
+    char want[32];
+
+    snprintf(want, sizeof(want), "\"gen\":%u,", gen);
+    do{
+        readLine(fd, line, sizeof(line));
+    }while(strstr(line, want) == NULL);
+}
+
+
+int main(void)
+{
+    static struct gps_assist_data gps;
+    static char line[64 * 1024];
+    struct pubServer_s *ps;
+    pthread_t th;
+    int subs[N_SUBS], stuck, q;
+    uint64_t t0, tPub = 0, tFan = 0;
+
+    bench_fill_assist(&gps, 32);
+
+    ps = pubServer_init(BENCH_SOCK);
+    BENCH_CHECK(ps != NULL);
+    pthread_create(&th, NULL, pubServer_f, ps);
+
+    pubServer_publishAssist(ps, &gps);
+
+    // request / response
+    q = connectTo(BENCH_SOCK);
+    BENCH_CHECK(write(q, "GET SV 5\n", 9) == 9);
+    readLine(q, line, sizeof(line));
+    BENCH_CHECK(strncmp(line, "{\"sv_id\":5,\"almanac\":", 21) == 0);
+    BENCH_CHECK(write(q, "GET FIX\n", 8) == 8);
+    readLine(q, line, sizeof(line));
+    BENCH_CHECK(strstr(line, "no fix") != NULL);
+    BENCH_CHECK(write(q, "GET ASSIST\n", 11) == 11);
+    readLine(q, line, sizeof(line));
+    BENCH_CHECK(strstr(line, "\"ephemeris\":[") != NULL);
+
+    stuck = connectTo(BENCH_SOCK);
+    BENCH_CHECK(write(stuck, "SUB ALL\n", 8) == 8);
+
+    for(int i=0; i < N_SUBS; i++){
+        subs[i] = connectTo(BENCH_SOCK);
+        BENCH_CHECK(write(subs[i], "SUB ASSIST\n", 11) == 11);
+        waitGen(subs[i], gps.gen);
+    }
+
+    for(int u=0; u < N_UPDATES; u++){
+        gps.gen++;
+        gps.ephemeris.svs[u % 32].t_oe++;
+
+        t0 = bench_now_ns();
+        pubServer_publishAssist(ps, &gps);
+        tPub += bench_now_ns() - t0;
+
+        for(int i=0; i < N_SUBS; i++){
+            waitGen(subs[i], gps.gen);
+        }
+        tFan += bench_now_ns() - t0;
+    }
+
+    // the stuck subscriber must have been cut off by now
+    {
+        struct pollfd pfd = { .fd = stuck, .events = POLLIN };
+        char sink[64 * 1024];
+        int r, total = 0;
+
+        while((poll(&pfd, 1, 1000) == 1) && ((r = read(stuck, sink, sizeof(sink))) > 0)){
+            total += r;
+        }
+        BENCH_CHECK(r == 0);
+        printf("stuck client dropped after %d bytes\n", total);
+    }
+
+    printf("%d subscribers, %d updates of %d bytes\n", N_SUBS, N_UPDATES,
+           (int)ps->assistMsg->len);
+    printf("  publish call     %8.2f us\n", tPub / 1e3 / N_UPDATES);
+    printf("  all delivered    %8.2f us\n", tFan / 1e3 / N_UPDATES);
+
+    unlink(BENCH_SOCK);
+    return 0;
+}
@@ -0,0 +1,442 @@
+/*
+ * bench_raw.c
+ *
+ * The RXM-RAW column store (see rawStore.h) on an hour of synthetic 10 Hz
+ * epochs of N_SVS SVs, starting half an hour before the end of a GPS day
+ * so the store opens two pairs of files. Reports
+ *
+ *   producer          rawStore_frame(), serial_f's part, per frame
+ *   writer            rawStore_poll() through the chunks, epochs a second
+ *   stored            bytes an epoch takes on disk, against its frame
+ *   scan              rawRead_chunk() over both days, rows and MB a second
+ *
+ * checks every value read back is the one sent, rawRead_find(), that a
+ * writer thread keeps up with a producer at PACED_HZ without a drop, and
+ * that a day torn by a crash or a failed index write is cut back to its
+ * whole chunks before anything is appended, and that the roll over of a
+ * day deletes the days before the last ones kept. The files go to a
+ * directory of /tmp of its own, removed at the end.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "ubx.h"
+#include "metrics.h"
+#include "rawStore.h"
+#include "benchUtil.h"
+
+
+#define N_SVS           12
+#define N_EPOCHS        36000           // an hour at 10 Hz
+#define EPOCH_MS        100
+#define WEEK            2000
+#define START_ITOW      (4 * 86400000 - 1800000)    // day 3, half an hour to go
+#define FRAME_LEN       (8 + 8 + N_SVS * 24)
+#define BATCH           (RAW_QUEUE_FRAMES / 2)
+
+#define PACED_WEEK      (WEEK + 1)
+#define PACED_EPOCHS    5000
+#define PACED_HZ        2000            // 200 times the receiver's
+
+#define CRASH_WEEK      (WEEK + 2)
+#define CRASH_EPOCHS    10
+#define KEEP_WEEK       (WEEK + 3)
+
+static uint8_t frames_G[N_EPOCHS][FRAME_LEN];
+static struct rawColumns_s cols_G;
+static volatile int writerRun_G;
+
+
+// epoch k: SVs on near linear ranges, a few dm of noise, a cycle slip now and then
+static void epochOf(int k, int week, uint8_t *frame)
+{
+    struct ubx_rxm_raw m;
+    struct ubx_rxm_raw_block b[N_SVS];
+    double t = k * (EPOCH_MS / 1e3);
+
+    memset(&m, 0, sizeof(m));
+    m.week   = week;
+    m.itow   = START_ITOW + k * EPOCH_MS;
+    m.num_sv = N_SVS;
+    memset(b, 0, sizeof(b));
+    for(int i=0; i < N_SVS; i++){
+        double rate = (i - N_SVS / 2) * 350.0;
+
+        b[i].sv     = 2 * i + 1;
+        b[i].pr_mes = 2.0e7 + 1.5e5 * i + rate * t + (bench_rand() % 1000) * 1e-3;
+        b[i].cp_mes = (b[i].pr_mes - (bench_rand() % 100) * 1e-3) / 0.1903;
+        b[i].do_mes = -rate / 0.1903 + (bench_rand() % 100) * 1e-2f;
+        b[i].cno    = 30 + i + (bench_rand() % 3);
+        b[i].mes_qi = 7;
+        b[i].lli    = (bench_rand() % 5000) == 0;
+    }
+    BENCH_CHECK(ubx_rxm_raw_encode(frame, FRAME_LEN, &m, b) == FRAME_LEN);
+}
+
+static const struct ubx_rxm_raw *frameRaw(const uint8_t *frame)
+{
+    return ubx_rxm_raw_get(frame + sizeof(struct ubx_hdr), FRAME_LEN - sizeof(struct ubx_hdr) - 2);
+}
+
+static int64_t epochMs(int week, int k)
+{
+    return week * GPS_WEEK_MS + START_ITOW + (int64_t)k * EPOCH_MS;
+}
+
+static uint64_t dirBytes(const char *dir)
+{
+    char path[512];
+    struct dirent *e;
+    struct stat st;
+    uint64_t n = 0;
+    DIR *d = opendir(dir);
+
+    BENCH_CHECK(d != NULL);
+    while((e = readdir(d)) != NULL){
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        if( (stat(path, &st) == 0) && S_ISREG(st.st_mode) ){
+            n += st.st_size;
+        }
+    }
+    closedir(d);
+    return n;
+}
+
+static void removeDir(const char *dir)
+{
+    char path[512];
+    struct dirent *e;
+    DIR *d = opendir(dir);
+
+    if(d == NULL){
+        return;
+    }
+    while((e = readdir(d)) != NULL){
+        if(e->d_name[0] != '.'){
+            snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+            unlink(path);
+        }
+    }
+    closedir(d);
+    rmdir(dir);
+}
+
+
+// the hour, a queue's worth at a time: producer and writer timed apart
+static void runStore(struct rawStore_s *rs)
+{
+    uint64_t pushNs = 0, pollNs = 0, t0;
+    int k = 0, n;
+
+    while(k < N_EPOCHS){
+        n = (N_EPOCHS - k < BATCH) ? N_EPOCHS - k : BATCH;
+        t0 = bench_now_ns();
+        for(int i=0; i < n; i++){
+            rawStore_frame(rs, frames_G[k + i], FRAME_LEN);
+        }
+        pushNs += bench_now_ns() - t0;
+        k += n;
+
+        t0 = bench_now_ns();
+        BENCH_CHECK(rawStore_poll(rs) == n);
+        pollNs += bench_now_ns() - t0;
+    }
+    t0 = bench_now_ns();
+    BENCH_CHECK(rawStore_flush(rs) == 0);
+    pollNs += bench_now_ns() - t0;
+
+    BENCH_CHECK(metrics_counter(METRIC_RAW_DROPPED) == 0);
+    BENCH_CHECK(metrics_counter(METRIC_RAW_EPOCHS) == N_EPOCHS);
+    printf("%d epochs of %d SVs, %d byte frames\n", N_EPOCHS, N_SVS, FRAME_LEN);
+    printf("  producer %8.1f ns/frame\n", (double)pushNs / N_EPOCHS);
+    printf("  writer   %8.0f epochs/s  (%.1f us/epoch)\n",
+           N_EPOCHS / (pollNs / 1e9), pollNs / 1e3 / N_EPOCHS);
+}
+
+// every row of a day's chunks against the frame it came from
+static uint64_t checkDay(const char *dir, int64_t day, int *epochs)
+{
+    struct rawReader_s rd;
+    const struct ubx_rxm_raw *m;
+    const struct ubx_rxm_raw_block *b;
+    uint64_t rows = 0;
+    int k, i;
+
+    BENCH_CHECK(rawRead_open(&rd, dir, day) == 0);
+    BENCH_CHECK(rd.nChunks > 0);
+    for(int c=0; c < rd.nChunks; c++){
+        BENCH_CHECK(rawRead_chunk(&rd, c, &cols_G) == (int)rd.index[c].rows);
+        for(int r=0; r < cols_G.rows; r++){
+            BENCH_CHECK(cols_G.timeMs[r] / GPS_DAY_MS == day);
+            k = (cols_G.timeMs[r] - epochMs(WEEK, 0)) / EPOCH_MS;
+            i = (cols_G.sv[r] - 1) / 2;
+            BENCH_CHECK( (k >= 0) && (k < N_EPOCHS) && (i >= 0) && (i < N_SVS) );
+            m = frameRaw(frames_G[k]);
+            b = ubx_rxm_raw_block(m, i);
+            BENCH_CHECK( (cols_G.sv[r] == b->sv) && (cols_G.pr[r] == b->pr_mes) &&
+                         (cols_G.cp[r] == b->cp_mes) && (cols_G.dop[r] == b->do_mes) &&
+                         (cols_G.cno[r] == b->cno) && (cols_G.qi[r] == b->mes_qi) &&
+                         (cols_G.lli[r] == b->lli) );
+            // by SV, in time within each
+            BENCH_CHECK( (r == 0) || (cols_G.sv[r] > cols_G.sv[r - 1]) ||
+                         ((cols_G.sv[r] == cols_G.sv[r - 1]) && (cols_G.timeMs[r] > cols_G.timeMs[r - 1])) );
+        }
+        rows += cols_G.rows;
+    }
+
+    // the chunk of a time, the first and past the last
+    for(int c=0; c < rd.nChunks; c++){
+        int64_t mid = (rd.index[c].firstMs + rd.index[c].lastMs) / 2;
+
+        BENCH_CHECK(rawRead_find(&rd, mid) == c);
+        BENCH_CHECK(rawRead_find(&rd, rd.index[c].lastMs) == c);
+    }
+    BENCH_CHECK(rawRead_find(&rd, 0) == 0);
+    BENCH_CHECK(rawRead_find(&rd, rd.index[rd.nChunks - 1].lastMs + 1) == rd.nChunks);
+
+    *epochs = rows / N_SVS;
+    rawRead_close(&rd);
+    return rows;
+}
+
+static void checkScan(const char *dir)
+{
+    int64_t first = epochMs(WEEK, 0) / GPS_DAY_MS;
+    uint64_t rows = 0, bytes = dirBytes(dir), t0, ns;
+    struct rawReader_s rd;
+    int epochs[2];
+
+    // the round trip, both days
+    rows += checkDay(dir, first, &epochs[0]);
+    rows += checkDay(dir, first + 1, &epochs[1]);
+    BENCH_CHECK(rows == (uint64_t)N_EPOCHS * N_SVS);
+    BENCH_CHECK(epochs[0] == 1800000 / EPOCH_MS);
+    printf("  stored   %8.1f bytes/epoch  (%.1fx smaller than the frames), days of %d and %d epochs\n",
+           (double)bytes / N_EPOCHS, (double)N_EPOCHS * FRAME_LEN / bytes, epochs[0], epochs[1]);
+
+    // decode only
+    t0 = bench_now_ns();
+    rows = 0;
+    for(int64_t day = first; day <= first + 1; day++){
+        BENCH_CHECK(rawRead_open(&rd, dir, day) == 0);
+        for(int c=0; c < rd.nChunks; c++){
+            rows += rawRead_chunk(&rd, c, &cols_G);
+        }
+        rawRead_close(&rd);
+    }
+    ns = bench_now_ns() - t0;
+    printf("  scan     %8.2f Mrows/s  %.1f MB/s of store\n", rows / (ns / 1e3), bytes / (ns / 1e3));
+}
+
+
+static void *writer_f(void *arg)
+{
+    struct rawStore_s *rs = arg;
+    int run;
+
+    do{
+        run = writerRun_G;
+        if(rawStore_poll(rs) == 0){
+            usleep(1000);
+        }else{
+            run = 1;
+        }
+    }while(run);
+    rawStore_flush(rs);
+    return NULL;
+}
+
+// serial_f and the writer thread, the way the program runs them
+static void checkPaced(struct rawStore_s *rs, const char *dir)
+{
+    uint8_t frame[FRAME_LEN];
+    uint64_t next = bench_now_ns(), dropped = metrics_counter(METRIC_RAW_DROPPED);
+    struct rawReader_s rd;
+    pthread_t wr;
+    int rows = 0;
+
+    writerRun_G = 1;
+    pthread_create(&wr, NULL, writer_f, rs);
+    for(int k=0; k < PACED_EPOCHS; k++){
+        epochOf(k, PACED_WEEK, frame);
+        while(bench_now_ns() < next){
+            ;
+        }
+        rawStore_frame(rs, frame, FRAME_LEN);
+        next += 1000000000ULL / PACED_HZ;
+    }
+    writerRun_G = 0;
+    pthread_join(wr, NULL);
+
+    BENCH_CHECK(rawRead_open(&rd, dir, epochMs(PACED_WEEK, 0) / GPS_DAY_MS) == 0);
+    for(int c=0; c < rd.nChunks; c++){
+        rows += rawRead_chunk(&rd, c, &cols_G);
+    }
+    rawRead_close(&rd);
+    printf("%d epochs at %d Hz with the writer running: %d stored, %llu dropped\n",
+           PACED_EPOCHS, PACED_HZ, rows / N_SVS,
+           (unsigned long long)(metrics_counter(METRIC_RAW_DROPPED) - dropped));
+    BENCH_CHECK(metrics_counter(METRIC_RAW_DROPPED) == dropped);
+    BENCH_CHECK(rows == PACED_EPOCHS * N_SVS);
+}
+
+
+// n epochs from k on into their own chunk
+static int storeChunk(struct rawStore_s *rs, int week, int k, int n)
+{
+    uint8_t frame[FRAME_LEN];
+
+    for(int i=0; i < n; i++){
+        epochOf(k + i, week, frame);
+        rawStore_frame(rs, frame, FRAME_LEN);
+    }
+    BENCH_CHECK(rawStore_poll(rs) == n);
+    return rawStore_flush(rs);
+}
+
+static off_t fileSize(const char *dir, int64_t day, const char *ext)
+{
+    char path[256];
+    struct stat st;
+
+    rawStore_path(path, sizeof(path), dir, day, ext);
+    BENCH_CHECK(stat(path, &st) == 0);
+    return st.st_size;
+}
+
+// the chunks of day: each whole, the last one ending the .col
+static int checkWhole(const char *dir, int64_t day)
+{
+    struct rawReader_s rd;
+    int n;
+
+    BENCH_CHECK(rawRead_open(&rd, dir, day) == 0);
+    for(int c=0; c < rd.nChunks; c++){
+        BENCH_CHECK(rawRead_chunk(&rd, c, &cols_G) == CRASH_EPOCHS * N_SVS);
+    }
+    BENCH_CHECK(fileSize(dir, day, "idx") == (off_t)(rd.nChunks * sizeof(struct rawIndex_s)));
+    BENCH_CHECK(fileSize(dir, day, "col") == (off_t)(rd.index[rd.nChunks - 1].offset +
+                                                     rd.index[rd.nChunks - 1].bytes));
+    n = rd.nChunks;
+    rawRead_close(&rd);
+    return n;
+}
+
+/*
+ * A crash in the middle of a chunk and of its index entry, then a failed
+ * index write: what follows is appended to the day as if they never were.
+ */
+static void checkCrash(const char *dir)
+{
+    static const uint8_t junk[100];
+    int64_t day = epochMs(CRASH_WEEK, 0) / GPS_DAY_MS;
+    uint64_t dropped = metrics_counter(METRIC_RAW_DROPPED);
+    struct rawStore_s *rs;
+    char path[256];
+    int fd;
+
+    rs = rawStore_init(dir);
+    BENCH_CHECK(rs != NULL);
+    BENCH_CHECK(storeChunk(rs, CRASH_WEEK, 0, CRASH_EPOCHS) == 0);
+    BENCH_CHECK(storeChunk(rs, CRASH_WEEK, CRASH_EPOCHS, CRASH_EPOCHS) == 0);
+
+    // part of a chunk and half an entry, and the writer gone
+    rawStore_path(path, sizeof(path), dir, day, "col");
+    fd = open(path, O_WRONLY | O_APPEND);
+    BENCH_CHECK((fd >= 0) && (write(fd, junk, sizeof(junk)) == sizeof(junk)));
+    close(fd);
+    rawStore_path(path, sizeof(path), dir, day, "idx");
+    fd = open(path, O_WRONLY | O_APPEND);
+    BENCH_CHECK((fd >= 0) && (write(fd, junk, sizeof(struct rawIndex_s) / 2) == sizeof(struct rawIndex_s) / 2));
+    close(fd);
+
+    rs = rawStore_init(dir);
+    BENCH_CHECK(rs != NULL);
+    BENCH_CHECK(storeChunk(rs, CRASH_WEEK, 2 * CRASH_EPOCHS, CRASH_EPOCHS) == 0);
+    BENCH_CHECK(checkWhole(dir, day) == 3);
+
+    // the index can't be written: the chunk is in the .col, lost all the same
+    fd = open(path, O_RDONLY);
+    BENCH_CHECK((fd >= 0) && (dup2(fd, rs->idxFd) == rs->idxFd));
+    close(fd);
+    BENCH_CHECK(storeChunk(rs, CRASH_WEEK, 3 * CRASH_EPOCHS, CRASH_EPOCHS) == -1);
+    BENCH_CHECK(metrics_counter(METRIC_RAW_DROPPED) == dropped + CRASH_EPOCHS);
+    BENCH_CHECK(storeChunk(rs, CRASH_WEEK, 4 * CRASH_EPOCHS, CRASH_EPOCHS) == 0);
+    BENCH_CHECK(checkWhole(dir, day) == 4);
+
+    printf("torn chunk and index entry cut off on reopen, lost index write counted dropped\n");
+}
+
+
+// files of days gone by, and one not the store's: the roll over deletes the old days only
+static void checkKeep(const char *dir)
+{
+    int64_t day = epochMs(KEEP_WEEK, 0) / GPS_DAY_MS;
+    struct rawStore_s *rs;
+    char path[256];
+    int fd;
+
+    for(int64_t d = day - 10; d < day; d++){
+        rawStore_path(path, sizeof(path), dir, d, "col");
+        BENCH_CHECK((fd = open(path, O_WRONLY | O_CREAT, 0644)) >= 0);
+        close(fd);
+        rawStore_path(path, sizeof(path), dir, d, "idx");
+        BENCH_CHECK((fd = open(path, O_WRONLY | O_CREAT, 0644)) >= 0);
+        close(fd);
+    }
+    snprintf(path, sizeof(path), "%s/rxmraw-notes.txt", dir);
+    BENCH_CHECK((fd = open(path, O_WRONLY | O_CREAT, 0644)) >= 0);
+    close(fd);
+
+    rs = rawStore_init(dir);
+    BENCH_CHECK(rs != NULL);
+    rs->keepDays = 3;
+    // opening a day isn't a roll over, the next one is
+    BENCH_CHECK(storeChunk(rs, KEEP_WEEK, 0, CRASH_EPOCHS) == 0);
+    rawStore_path(path, sizeof(path), dir, day - 10, "col");
+    BENCH_CHECK(access(path, F_OK) == 0);
+    BENCH_CHECK(storeChunk(rs, KEEP_WEEK, 1800000 / EPOCH_MS, CRASH_EPOCHS) == 0);
+
+    for(int64_t d = day - 10; d <= day + 1; d++){
+        rawStore_path(path, sizeof(path), dir, d, "col");
+        BENCH_CHECK((access(path, F_OK) == 0) == (d > day + 1 - 3));
+        rawStore_path(path, sizeof(path), dir, d, "idx");
+        BENCH_CHECK((access(path, F_OK) == 0) == (d > day + 1 - 3));
+    }
+    snprintf(path, sizeof(path), "%s/rxmraw-notes.txt", dir);
+    BENCH_CHECK(access(path, F_OK) == 0);
+
+    printf("roll over kept the last %d days\n", rs->keepDays);
+}
+
+
+int main(void)
+{
+    struct rawStore_s *rs;
+    char dir[64];
+
+    snprintf(dir, sizeof(dir), "/tmp/bench_raw.%d", (int)getpid());
+    bench_seed(48);
+    for(int k=0; k < N_EPOCHS; k++){
+        epochOf(k, WEEK, frames_G[k]);
+    }
+
+    rs = rawStore_init(dir);
+    BENCH_CHECK(rs != NULL);
+    runStore(rs);
+    checkScan(dir);
+    checkPaced(rs, dir);
+    checkCrash(dir);
+    checkKeep(dir);
+
+    removeDir(dir);
+    return 0;
+}
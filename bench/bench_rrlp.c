@@ -0,0 +1,235 @@
+/*
+ * bench_rrlp.c
+ *
+ * RRLP assistance PDUs: encoder cost for a full set, cost of a request
+ * answered from the memo, and a mix of handset requests. Before timing,
+ * the PDUs are walked back with a small PER reader to check the layout,
+ * the list sizes, the more-data flags and a few element fields.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gps.h"
+#include "rrlp.h"
+#include "benchUtil.h"
+
+
+#define N_SV        32
+#define ITERS       5000
+
+
+struct per_reader {
+    const uint8_t *buf;
+    int len;
+    int pos;
+};
+
+static uint32_t get(struct per_reader *r, int n)
+{
+    uint32_t v = 0;
+
+    BENCH_CHECK(r->pos + n <= r->len * 8);
+    while(n--){
+        v = (v << 1) | ((r->buf[r->pos >> 3] >> (7 - (r->pos & 7))) & 1);
+        r->pos++;
+    }
+    return v;
+}
+
+static const struct gps_ephemeris_sv *ephOf(const struct gps_assist_data *gps, int satId)
+{
+    for(int i=0; i < gps->ephemeris.n_sv; i++){
+        if(gps->ephemeris.svs[i].sv_id == satId + 1){
+            return &gps->ephemeris.svs[i];
+        }
+    }
+    return NULL;
+}
+
+/* Walks one PDU, returns its more-data flag; counts the elements seen */
+static int checkPdu(const struct gps_assist_data *gps, const uint8_t *pdu, int len,
+                    int *nEph, int *nAlm, int *hdr)
+{
+    static const int ephTail[] = { 23, 24, 24, 16, 8, 16, 8, 16, 22, 16, 16, 32, 16,
+                                   32, 16, 32, 16, 1, 5, 16, 32, 16, 32, 16, 32, 24 };
+    struct per_reader r = { pdu, len, 0 };
+    int refTime, refLoc, nav, iono, utc, alm;
+
+    BENCH_CHECK(len <= RRLP_PDU_MAX_LEN);
+    BENCH_CHECK(get(&r, 3) == 0);          // referenceNumber
+    BENCH_CHECK(get(&r, 1) == 0);          // component: assistanceData
+    BENCH_CHECK(get(&r, 3) == 2);
+    BENCH_CHECK(get(&r, 1) == 0);
+    BENCH_CHECK(get(&r, 6) == 0x06);       // gps-AssistData, moreAssDataToBeSent
+
+    refTime = get(&r, 1);
+    refLoc  = get(&r, 1);
+    BENCH_CHECK(get(&r, 1) == 0);
+    nav     = get(&r, 1);
+    iono    = get(&r, 1);
+    utc     = get(&r, 1);
+    alm     = get(&r, 1);
+    BENCH_CHECK(get(&r, 2) == 0);
+
+    if(refTime){
+        BENCH_CHECK(get(&r, 2) == 0);
+        BENCH_CHECK(get(&r, 23) < 7560000);
+        BENCH_CHECK(get(&r, 10) == (gps->ref_time.wn & 1023));
+        *hdr |= RRLP_AR_REF_TIME;
+    }
+    if(refLoc){
+        BENCH_CHECK(get(&r, 5) == 13);
+        BENCH_CHECK(get(&r, 8) == 0x90);
+        get(&r, 13 * 8 - 8);
+        get(&r, 8);
+        *hdr |= RRLP_AR_REF_LOC;
+    }
+    if(nav){
+        int n = get(&r, 4) + 1;
+
+        for(int i=0; i < n; i++){
+            const struct gps_ephemeris_sv *eph = ephOf(gps, get(&r, 6));
+
+            BENCH_CHECK(eph != NULL);
+            BENCH_CHECK(get(&r, 3) == 0);
+            BENCH_CHECK((int)get(&r, 2) == eph->code_on_l2);
+            BENCH_CHECK((int)get(&r, 4) == eph->sv_ura);
+            BENCH_CHECK((int)get(&r, 6) == eph->sv_health);
+            BENCH_CHECK((int)get(&r, 10) == eph->iodc);
+            BENCH_CHECK((int)get(&r, 1) == eph->l2_p_flag);
+            for(int k=0; k < (int)(sizeof(ephTail) / sizeof(ephTail[0])); k++){
+                get(&r, ephTail[k]);
+            }
+            BENCH_CHECK((int)get(&r, 14) - 8192 == eph->idot);     // value - lb
+        }
+        *nEph += n;
+    }
+    if(iono){
+        get(&r, 64);
+        *hdr |= RRLP_AR_IONO_MODEL;
+    }
+    if(utc){
+        get(&r, 104);
+        *hdr |= RRLP_AR_UTC_MODEL;
+    }
+    if(alm){
+        int n;
+
+        BENCH_CHECK((int)get(&r, 8) == gps->almanac.wna);
+        n = get(&r, 6) + 1;
+        for(int i=0; i < n; i++){
+            BENCH_CHECK(get(&r, 6) < 64);
+            get(&r, 182);
+        }
+        *nAlm += n;
+    }
+
+    {
+        int more = get(&r, 1);
+
+        // only the padding is left
+        BENCH_CHECK((r.len * 8 - r.pos) < 8);
+        return more;
+    }
+}
+
+static void checkSet(const struct gps_assist_data *gps, void **pdu, int *len, int n,
+                     int wantEph, int wantAlm, int wantHdr)
+{
+    int nEph = 0, nAlm = 0, hdr = 0;
+
+    for(int i=0; i < n; i++){
+        BENCH_CHECK(checkPdu(gps, pdu[i], len[i], &nEph, &nAlm, &hdr) == (i < n - 1));
+    }
+    BENCH_CHECK(nEph == wantEph);
+    BENCH_CHECK(nAlm == wantAlm);
+    BENCH_CHECK(hdr == wantHdr);
+}
+
+
+int main(void)
+{
+    static struct gps_assist_data gps;
+    static uint8_t arenaBuf[RRLP_ARENA_SIZE];
+    struct rrlp_arena arena;
+    struct rrlp_assist_req full = { 0x3f, 0xffffffffULL };
+    struct rrlp_assist_req ephOnly = { RRLP_AR_EPHEMERIS | RRLP_AR_REF_TIME, 0x0000f0f0ULL };
+    void *pdu[RRLP_MAX_PDUS];
+    int len[RRLP_MAX_PDUS];
+    int n, bytes = 0;
+    unsigned long hits, misses;
+    uint64_t t0, tEnc, tHit, tMix;
+
+    bench_fill_assist(&gps, N_SV);
+    gps.ref_time.when = time(NULL);
+    for(int i=0; i < N_SV; i++){
+        gps.ephemeris.svs[i].t_oc %= 37800;
+        gps.ephemeris.svs[i].t_oe = gps.ephemeris.svs[i].t_oc;
+        gps.ephemeris.svs[i]._rsvd1 = i;
+    }
+
+    rrlp_arena_init(&arena, arenaBuf, sizeof(arenaBuf));
+    n = rrlp_gps_assist_pdus_arena(&gps, &full, &arena, pdu, len, RRLP_MAX_PDUS);
+    BENCH_CHECK(n > 0);
+    checkSet(&gps, pdu, len, n, N_SV, N_SV, 0x0f);
+    for(int i=0; i < n; i++){
+        bytes += len[i];
+    }
+
+    // memo: a hit hands back the same bytes, the time stamp refreshed
+    n = rrlp_gps_assist_pdus(&gps, &ephOnly, pdu, len, RRLP_MAX_PDUS);
+    checkSet(&gps, pdu, len, n, 8, 0, RRLP_AR_REF_TIME);
+    BENCH_CHECK(rrlp_gps_assist_pdus(&gps, &ephOnly, pdu, len, RRLP_MAX_PDUS) == n);
+    rrlp_cache_stats(&hits, &misses);
+    BENCH_CHECK((hits == 1) && (misses == 1));
+
+    // a new generation is a miss
+    gps.gen++;
+    BENCH_CHECK(rrlp_gps_assist_pdus(&gps, &ephOnly, pdu, len, RRLP_MAX_PDUS) == n);
+    rrlp_cache_stats(&hits, &misses);
+    BENCH_CHECK(misses == 2);
+
+    // too few output slots
+    BENCH_CHECK(rrlp_gps_assist_pdus(&gps, &full, pdu, len, 2) == -1);
+
+    n = rrlp_gps_assist_pdus_arena(&gps, &full, &arena, pdu, len, RRLP_MAX_PDUS);
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        rrlp_arena_init(&arena, arenaBuf, sizeof(arenaBuf));
+        rrlp_gps_assist_pdus_arena(&gps, &full, &arena, pdu, len, RRLP_MAX_PDUS);
+    }
+    tEnc = bench_now_ns() - t0;
+
+    rrlp_gps_assist_pdus(&gps, &full, pdu, len, RRLP_MAX_PDUS);
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        rrlp_gps_assist_pdus(&gps, &full, pdu, len, RRLP_MAX_PDUS);
+    }
+    tHit = bench_now_ns() - t0;
+
+    // handsets asking for one of 6 typical SV sets, the store changing
+    // every 1000 requests
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        struct rrlp_assist_req req = { 0x3f, 0xffULL << (4 * (i % 6)) };
+
+        if(i % 1000 == 0){
+            gps.gen++;
+        }
+        rrlp_gps_assist_pdus(&gps, &req, pdu, len, RRLP_MAX_PDUS);
+    }
+    tMix = bench_now_ns() - t0;
+    rrlp_cache_stats(&hits, &misses);
+
+    printf("full set, %d SVs: %d PDUs, %d bytes\n", N_SV, n, bytes);
+    printf("  encode           %8.2f us\n", tEnc / 1e3 / ITERS);
+    printf("  memo hit         %8.2f us\n", tHit / 1e3 / ITERS);
+    printf("  handset mix      %8.2f us per request  (%lu hits, %lu misses overall)\n",
+           tMix / 1e3 / ITERS, hits, misses);
+
+    return 0;
+}
@@ -0,0 +1,328 @@
+/*
+ * bench_rrlp_req.c
+ *
+ * RRLP assistance requests: replays a synthetic mix of handset
+ * msrPositionRsp PDUs (a few dozen handset states, some malformed) through
+ * the decoder alone, through decode + encode of every request, and through
+ * the batch mode. Everything runs on one thread, so the rates are per core.
+ * Before timing, a request built by hand from the specs is decoded, every
+ * request of the mix is checked to decode back to what was built, and
+ * truncated or random PDUs are fed to the decoder.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gps.h"
+#include "rrlp.h"
+#include "benchUtil.h"
+
+
+#define N_SV        32
+#define N_PROFILES  48
+#define N_REQS      1024
+#define BAD_PCT     3
+#define ROUNDS      20
+#define REQ_MAX     64
+
+
+struct bitWriter {
+    uint8_t *buf;
+    int pos;
+};
+
+static void put(struct bitWriter *w, uint32_t v, int n)
+{
+    while(n--){
+        uint8_t m = 0x80 >> (w->pos & 7);
+
+        if((v >> n) & 1){
+            w->buf[w->pos >> 3] |= m;
+        }else{
+            w->buf[w->pos >> 3] &= ~m;
+        }
+        w->pos++;
+    }
+}
+
+typedef struct profile_s {
+    uint8_t  gad[40];       /* 49.031 Requested GPS Data */
+    int      gadLen;
+    struct rrlp_assist_req expect;
+}profile_t;
+
+/* A handset state: what it asks for and which ephemerides it already has */
+static void makeProfile(profile_t *p, int idx)
+{
+    static const uint8_t first[] = { 0x6f, 0x68, 0x08, 0x48, 0x0c, 0x29 };
+    int nHave = 0;
+
+    memset(p, 0, sizeof(*p));
+    p->gad[0] = first[idx % sizeof(first)];
+    p->gadLen = 2;
+
+    if(p->gad[0] & 0x08){
+        p->expect.eph_svs = ~0ULL;
+        if(idx % 4){
+            nHave = idx % 9;
+            p->gad[2] = 0x40 | (idx & 0x3);             // GPS week
+            p->gad[3] = 0x12;
+            p->gad[4] = 0x20;                           // GPS_Toe
+            p->gad[5] = (nHave << 4) | 2;               // N_SAT, T-Toe limit
+            for(int i=0; i < nHave; i++){
+                int sat = (idx * 7 + i * 5) % N_SV;
+
+                p->gad[6 + 2 * i] = sat;
+                p->gad[7 + 2 * i] = bench_rand() & 0xff;  // IODE
+                p->expect.eph_svs &= ~(1ULL << sat);
+            }
+            p->gadLen = 6 + 2 * nHave;
+        }
+    }
+
+    if(p->gad[0] & 0x01) p->expect.req_elems |= RRLP_AR_ALMANAC;
+    if(p->gad[0] & 0x02) p->expect.req_elems |= RRLP_AR_UTC_MODEL;
+    if(p->gad[0] & 0x04) p->expect.req_elems |= RRLP_AR_IONO_MODEL;
+    if(p->gad[0] & 0x08) p->expect.req_elems |= RRLP_AR_EPHEMERIS;
+    if(p->gad[0] & 0x20) p->expect.req_elems |= RRLP_AR_REF_LOC;
+    if(p->gad[0] & 0x40) p->expect.req_elems |= RRLP_AR_REF_TIME;
+}
+
+/* msrPositionRsp { locationError { gpsAssDataMissing, additionalAssistanceData } } */
+static int buildReq(uint8_t *buf, const profile_t *p, int ref)
+{
+    struct bitWriter w = { buf, 0 };
+
+    memset(buf, 0, REQ_MAX);
+    put(&w, ref & 7, 3);
+    put(&w, 0, 1);
+    put(&w, 1, 3);          // msrPositionRsp
+    put(&w, 0, 1);
+    put(&w, 0x02, 7);       // locationError only
+    put(&w, 0, 1);
+    put(&w, 1, 1);          // additionalAssistanceData
+    put(&w, 0, 1);
+    put(&w, 6, 4);          // gpsAssDataMissing
+    put(&w, 0, 1);
+    put(&w, 0x2, 2);        // gpsAssistanceData
+    put(&w, p->gadLen - 1, 6);
+    for(int i=0; i < p->gadLen; i++){
+        put(&w, p->gad[i], 8);
+    }
+    return (w.pos + 7) / 8;
+}
+
+static int sameReq(const struct rrlp_assist_req *a, const struct rrlp_assist_req *b)
+{
+    return a->req_elems == b->req_elems && a->eph_svs == b->eph_svs;
+}
+
+
+static profile_t profiles[N_PROFILES];
+static uint8_t   reqBuf[N_REQS][REQ_MAX];
+static void     *reqs[N_REQS];
+static int       reqLens[N_REQS];
+static int       reqProfile[N_REQS];        /* -1: malformed */
+static int       answerOf[N_REQS];
+
+static struct rrlp_batch batch;
+static uint8_t batchArena[RRLP_BATCH_MAX_ANSWERS * RRLP_ARENA_SIZE];
+static uint8_t naiveArena[RRLP_ARENA_SIZE];
+
+
+/*
+ * msrPositionRsp asking for assistance, laid out by hand from 44.031 (PER
+ * unaligned) and 49.031 10.10, not with buildReq():
+ *
+ *   101 0 001              referenceNumber 5, component ext, msrPositionRsp
+ *   0 0000010              MsrPosition-Rsp ext, locationError only
+ *   0 1                    LocationError ext, additionalAssistanceData
+ *   0 0110                 locErrorReason ext, gpsAssDataMissing
+ *   0 10                   AdditionalAssistanceData ext, gpsAssistanceData
+ *   001011                 GPSAssistanceData, 12 octets:
+ *     6d 00                almanac, iono, nav model, ref location, ref time
+ *     47 52 30 32          GPS week, GPS_Toe, N_SAT 3, T-Toe limit 2
+ *     03 5a 11 07 1f c3    satID / IODE: PRN 4, 18 and 32
+ *   0                      padding
+ */
+static const uint8_t handReq[] = {
+    0xa2, 0x04, 0x99, 0x16, 0xda, 0x00, 0x8e, 0xa4,
+    0x60, 0x64, 0x06, 0xb4, 0x22, 0x0e, 0x3f, 0x86
+};
+
+static void checkHandReq(void)
+{
+    struct rrlp_assist_req ar;
+    uint8_t cut[sizeof(handReq)];
+
+    memcpy(cut, handReq, sizeof(handReq));
+    BENCH_CHECK(rrlp_decode_assistance_request(&ar, cut, sizeof(handReq)) == 0);
+    BENCH_CHECK(ar.req_elems == (RRLP_AR_ALMANAC | RRLP_AR_IONO_MODEL | RRLP_AR_EPHEMERIS |
+                                 RRLP_AR_REF_LOC | RRLP_AR_REF_TIME));
+    BENCH_CHECK(ar.eph_svs == ~((1ULL << 3) | (1ULL << 17) | (1ULL << 31)));
+
+    // the last IODE is short of a bit
+    BENCH_CHECK(rrlp_decode_assistance_request(&ar, cut, sizeof(handReq) - 1) == -1);
+
+    printf("decoder: hand built msrPositionRsp ok, its truncation rejected\n");
+}
+
+static void checkDecoder(void)
+{
+    struct rrlp_assist_req ar;
+    uint8_t junk[REQ_MAX];
+    int nBad = 0;
+
+    for(int i=0; i < N_REQS; i++){
+        int rv = rrlp_decode_assistance_request(&ar, reqs[i], reqLens[i]);
+
+        if(reqProfile[i] < 0){
+            BENCH_CHECK(rv < 0);
+            nBad++;
+            continue;
+        }
+        BENCH_CHECK(rv == 0);
+        BENCH_CHECK(sameReq(&ar, &profiles[reqProfile[i]].expect));
+
+        // every truncation is caught, nothing past the end is read
+        for(int len=0; len < reqLens[i]; len++){
+            uint8_t *cut = malloc(len ? len : 1);
+
+            memcpy(cut, reqs[i], len);
+            BENCH_CHECK(rrlp_decode_assistance_request(&ar, cut, len) < 0);
+            free(cut);
+        }
+    }
+
+    for(int i=0; i < 200000; i++){
+        int len = 1 + bench_rand() % REQ_MAX;
+
+        for(int j=0; j < len; j++){
+            junk[j] = bench_rand();
+        }
+        if(rrlp_decode_assistance_request(&ar, junk, len) == 0){
+            BENCH_CHECK(!(ar.req_elems & ~0x3fu));
+        }
+    }
+
+    printf("decoder: %d requests round trip, %d malformed rejected, "
+           "all truncations rejected, 200000 random PDUs survived\n",
+           N_REQS - nBad, nBad);
+}
+
+static void checkBatch(struct gps_assist_data *gps)
+{
+    void *pdu[RRLP_MAX_PDUS];
+    int len[RRLP_MAX_PDUS];
+    struct rrlp_arena arena;
+    int served;
+
+    served = rrlp_batch_serve(gps, &batch, reqs, reqLens, N_REQS, answerOf);
+
+    for(int i=0; i < N_REQS; i++){
+        struct rrlp_answer *a;
+        int n;
+
+        if(reqProfile[i] < 0){
+            BENCH_CHECK(answerOf[i] < 0);
+            continue;
+        }
+        BENCH_CHECK(answerOf[i] >= 0);
+        a = &batch.answer[answerOf[i]];
+        BENCH_CHECK(sameReq(&a->req, &profiles[reqProfile[i]].expect));
+
+        // same PDUs as encoding this request on its own
+        rrlp_arena_init(&arena, naiveArena, sizeof(naiveArena));
+        n = rrlp_gps_assist_pdus_arena(gps, &a->req, &arena, pdu, len, RRLP_MAX_PDUS);
+        BENCH_CHECK(n == a->n_pdus);
+        for(int k=0; k < n; k++){
+            BENCH_CHECK(len[k] == a->len[k]);
+            BENCH_CHECK(!memcmp(pdu[k], a->pdu[k], len[k]));
+        }
+    }
+
+    printf("batch: %d requests served by %d distinct answers, %d KB of PDUs\n",
+           served, batch.n_answers, batch.arena.used / 1024);
+}
+
+
+int main(void)
+{
+    static struct gps_assist_data gps;
+    struct rrlp_assist_req ar;
+    uint64_t t0, t1;
+    double decodeRate, naiveRate, batchRate;
+    int nBad = 0;
+
+    bench_seed(37);
+    bench_fill_assist(&gps, N_SV);
+    rrlp_batch_init(&batch, batchArena, sizeof(batchArena));
+
+    for(int i=0; i < N_PROFILES; i++){
+        makeProfile(&profiles[i], i);
+    }
+
+    // skewed mix: a few handset states are much more common than the rest
+    for(int i=0; i < N_REQS; i++){
+        uint32_t r = bench_rand();
+        int p = (r % 100 < 60) ? (r >> 8) % 6 : (r >> 8) % N_PROFILES;
+
+        reqs[i] = reqBuf[i];
+        reqLens[i] = buildReq(reqBuf[i], &profiles[p], i);
+        reqProfile[i] = p;
+
+        if(bench_rand() % 100 < BAD_PCT){
+            reqProfile[i] = -1;
+            switch(nBad++ % 3){
+            case 0: reqBuf[i][0] ^= 0x06; break;        // another component
+            case 1: reqLens[i] = 2;  break;             // cut short
+            case 2: reqBuf[i][1] |= 0x7c; break;        // measurement results
+            }
+        }
+    }
+
+    checkHandReq();
+    checkDecoder();
+    checkBatch(&gps);
+
+    t0 = bench_now_ns();
+    for(int r=0; r < ROUNDS; r++){
+        for(int i=0; i < N_REQS; i++){
+            rrlp_decode_assistance_request(&ar, reqs[i], reqLens[i]);
+        }
+    }
+    t1 = bench_now_ns();
+    decodeRate = (double)ROUNDS * N_REQS * 1e9 / (t1 - t0);
+
+    t0 = bench_now_ns();
+    for(int r=0; r < ROUNDS; r++){
+        for(int i=0; i < N_REQS; i++){
+            void *pdu[RRLP_MAX_PDUS];
+            int len[RRLP_MAX_PDUS];
+            struct rrlp_arena arena;
+
+            if(rrlp_decode_assistance_request(&ar, reqs[i], reqLens[i]) == 0){
+                rrlp_arena_init(&arena, naiveArena, sizeof(naiveArena));
+                rrlp_gps_assist_pdus_arena(&gps, &ar, &arena, pdu, len, RRLP_MAX_PDUS);
+            }
+        }
+    }
+    t1 = bench_now_ns();
+    naiveRate = (double)ROUNDS * N_REQS * 1e9 / (t1 - t0);
+
+    t0 = bench_now_ns();
+    for(int r=0; r < ROUNDS; r++){
+        rrlp_batch_serve(&gps, &batch, reqs, reqLens, N_REQS, answerOf);
+    }
+    t1 = bench_now_ns();
+    batchRate = (double)ROUNDS * N_REQS * 1e9 / (t1 - t0);
+
+    printf("%d requests x %d rounds, one core:\n", N_REQS, ROUNDS);
+    printf("  decode only           %10.0f req/s\n", decodeRate);
+    printf("  decode + encode each  %10.0f req/s\n", naiveRate);
+    printf("  batch serve           %10.0f req/s  (%.1fx)\n", batchRate, batchRate / naiveRate);
+
+    return 0;
+}
@@ -0,0 +1,176 @@
+/*
+ * bench_share.c
+ *
+ * Cross-talk between serial_f and control_f through their shared state,
+ * with the old packed layouts (rebuilt here) and the current ones:
+ *
+ *   port   serial_f bumps ticksBtwReceive on every loop while control_f
+ *          reads fd / baudRate, once in the same line, once apart
+ *   list   serial_f polls size() on every loop while control_f queues
+ *          and drains commands, size() locked as it was, or atomic
+ *
+ * Each phase runs both threads for a fixed time and reports the loop
+ * rate of each. On a single core the two never run at once, so there is
+ * no line to bounce and the port phases come out alike.
+ *
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "serial.h"
+#include "ringBuf.h"
+#include "list.h"
+#include "benchUtil.h"
+
+
+#define PHASE_NS    300000000ULL
+
+
+/* serialPort_s as it was */
+#pragma pack(1)
+struct oldPort_s {
+    int fd;
+    int baudRate;
+    int parity;
+    uint8_t ticksBtwReceive;
+};
+#pragma pack()
+
+struct phase_s {
+    volatile int stop;
+    int fd, baud;                   // offsets of the read fields
+    uint8_t *ticks;
+    void *port;
+    list *ll;
+    int lockedSize;
+    uint64_t writerLoops;
+    uint64_t readerLoops;
+};
+
+
+static int lockedSize(list *ll)
+{
+    int n;
+
+    pthread_mutex_lock(&ll->mutex);
+    n = ll->size;
+    pthread_mutex_unlock(&ll->mutex);
+    return n;
+}
+
+/* serial_f: count idle loops, see if there is something to send */
+static void *writer_f(void *arg)
+{
+    struct phase_s *ph = arg;
+    uint64_t n = 0;
+
+    while(!ph->stop){
+        __atomic_store_n(ph->ticks, __atomic_load_n(ph->ticks, __ATOMIC_RELAXED) + 1, __ATOMIC_RELAXED);
+        if(ph->ll){
+            n += ph->lockedSize ? lockedSize(ph->ll) : size(ph->ll);
+        }
+        n++;
+    }
+    ph->writerLoops = n;
+    return NULL;
+}
+
+static void keepNode(void *data)
+{
+}
+
+/* control_f: uses the port settings, or feeds the command list */
+static void *reader_f(void *arg)
+{
+    struct phase_s *ph = arg;
+    const volatile int *fd   = (const volatile int *)((char *)ph->port + ph->fd);
+    const volatile int *baud = (const volatile int *)((char *)ph->port + ph->baud);
+    static int cmd;
+    uint64_t n = 0;
+    int sink = 0;
+
+    while(!ph->stop){
+        if(ph->ll){
+            push_back(ph->ll, &cmd);
+            remove_front(ph->ll, keepNode);
+        }else{
+            sink += *fd + *baud;
+        }
+        n++;
+    }
+    ph->readerLoops = n + (sink == 42);
+    return NULL;
+}
+
+static void runPhase(const char *name, struct phase_s *ph)
+{
+    pthread_t w, r;
+    uint64_t t0;
+
+    ph->stop = 0;
+    pthread_create(&w, NULL, writer_f, ph);
+    pthread_create(&r, NULL, reader_f, ph);
+    t0 = bench_now_ns();
+    while(bench_now_ns() - t0 < PHASE_NS){
+        usleep(10000);
+    }
+    ph->stop = 1;
+    pthread_join(w, NULL);
+    pthread_join(r, NULL);
+
+    printf("  %-28s serial_f %7.2f M loops/s   control_f %7.2f M loops/s\n", name,
+           ph->writerLoops * 1e3 / PHASE_NS, ph->readerLoops * 1e3 / PHASE_NS);
+}
+
+
+int main(void)
+{
+    struct oldPort_s *oldPort = NULL;
+    struct serialPort_s *newPort = NULL;
+    struct phase_s ph;
+    list *ll = create_list();
+
+    BENCH_CHECK(posix_memalign((void **)&oldPort, CACHE_LINE_SIZE, sizeof(*oldPort)) == 0);
+    BENCH_CHECK(posix_memalign((void **)&newPort, CACHE_LINE_SIZE, sizeof(*newPort)) == 0);
+    memset(oldPort, 0, sizeof(*oldPort));
+    memset(newPort, 0, sizeof(*newPort));
+
+    printf("ticksBtwReceive at +%zu (old) / +%zu (now), serialPort_s %zu bytes, "
+           "ringbuffer data at +%zu, list %zu bytes\n",
+           offsetof(struct oldPort_s, ticksBtwReceive),
+           offsetof(struct serialPort_s, ticksBtwReceive), sizeof(struct serialPort_s),
+           offsetof(struct ringbuffer_s, buffer), sizeof(list));
+    BENCH_CHECK(offsetof(struct serialPort_s, ticksBtwReceive) >= CACHE_LINE_SIZE);
+    BENCH_CHECK(((uintptr_t)ll & (CACHE_LINE_SIZE - 1)) == 0);
+
+    memset(&ph, 0, sizeof(ph));
+    ph.port  = oldPort;
+    ph.fd    = offsetof(struct oldPort_s, fd);
+    ph.baud  = offsetof(struct oldPort_s, baudRate);
+    ph.ticks = &oldPort->ticksBtwReceive;
+    runPhase("port, ticks next to fd", &ph);
+
+    ph.port  = newPort;
+    ph.fd    = offsetof(struct serialPort_s, fd);
+    ph.baud  = offsetof(struct serialPort_s, baudRate);
+    ph.ticks = &newPort->ticksBtwReceive;
+    runPhase("port, ticks on its own line", &ph);
+
+    ph.ll = ll;
+    ph.lockedSize = 1;
+    runPhase("list, size() locked", &ph);
+
+    ph.lockedSize = 0;
+    runPhase("list, size() atomic", &ph);
+
+    BENCH_CHECK(size(ll) == 0);
+
+    return 0;
+}
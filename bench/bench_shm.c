@@ -0,0 +1,155 @@
+/*
+ * bench_shm.c
+ *
+ * Reader throughput of the shared memory publication, with the writer
+ * idle and with the writer rewriting the fix back to back. Each fix the
+ * writer stores has all its fields derived from one counter, so a torn
+ * snapshot would show up as a mismatch.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "gps.h"
+#include "ubx.h"
+#include "shmPub.h"
+#include "benchUtil.h"
+
+
+#define BENCH_SHM       "/bench_shm.gps"
+#define N_READERS       2
+#define READ_NS         500000000ULL     // per phase
+
+
+static volatile int writerRun_G;
+static struct shmPubRegion_s *region_G;
+
+struct readerStats {
+    uint64_t reads;
+    uint64_t assistReads;
+    uint64_t ns;
+};
+
+
+static void fixOf(uint32_t k, struct ubx_nav_posllh *fix)
+{
+    fix->itow   = k;
+    fix->lon    = (int32_t)(k * 3);
+    fix->lat    = -(int32_t)k;
+    fix->height = (int32_t)(k ^ 0x5a5a5a5a);
+    fix->hmsl   = (int32_t)(k + 7);
+    fix->hacc   = k >> 1;
+    fix->vacc   = ~k;
+}
+
+static void *writer_f(void *arg)
+{
+    static struct gps_assist_data gps;
+    struct ubx_nav_posllh fix;
+    uint32_t k = 1;
+
+    bench_fill_assist(&gps, 32);
+    while(writerRun_G){
+        fixOf(k, &fix);
+        shmPub_writeFix(region_G, &fix);
+        if((k & 1023) == 0){
+            gps.gen++;
+            shmPub_writeAssist(region_G, &gps);
+        }
+        k++;
+    }
+    return NULL;
+}
+
+static void *reader_f(void *arg)
+{
+    static __thread struct gps_assist_data gps;
+    struct readerStats *st = arg;
+    struct shmPubReader_s rd;
+    struct ubx_nav_posllh fix, want;
+    uint64_t t0, now;
+
+    BENCH_CHECK(shmPub_open(&rd, BENCH_SHM) == 0);
+
+    t0 = bench_now_ns();
+    do{
+        for(int i=0; i < 1000; i++){
+            BENCH_CHECK(shmPub_readFix(&rd, &fix, NULL) >= 0);
+            fixOf(fix.itow, &want);
+            BENCH_CHECK(!memcmp(&fix, &want, sizeof(fix)));
+        }
+        st->reads += 1000;
+
+        BENCH_CHECK(shmPub_readAssist(&rd, &gps, NULL) >= 0);
+        BENCH_CHECK(gps.ephemeris.n_sv == 32);
+        st->assistReads++;
+
+        now = bench_now_ns();
+    }while(now - t0 < READ_NS);
+    st->ns = now - t0;
+
+    shmPub_close(&rd);
+    return NULL;
+}
+
+static void runPhase(const char *name, int withWriter)
+{
+    struct readerStats st[N_READERS];
+    pthread_t rd[N_READERS], wr;
+    uint64_t reads = 0, assistReads = 0;
+    double nsPerRead = 0;
+
+    memset(st, 0, sizeof(st));
+    writerRun_G = withWriter;
+    if(withWriter){
+        pthread_create(&wr, NULL, writer_f, NULL);
+    }
+    for(int i=0; i < N_READERS; i++){
+        pthread_create(&rd[i], NULL, reader_f, &st[i]);
+    }
+    for(int i=0; i < N_READERS; i++){
+        pthread_join(rd[i], NULL);
+        reads += st[i].reads;
+        assistReads += st[i].assistReads;
+        nsPerRead += (double)st[i].ns / st[i].reads / N_READERS;
+    }
+    if(withWriter){
+        writerRun_G = 0;
+        pthread_join(wr, NULL);
+    }
+
+    printf("  %-12s %7.1f M fix reads/s  %7.1f ns per read  %8.1f k assist reads/s\n",
+           name, reads / (READ_NS / 1e9) / 1e6, nsPerRead, assistReads / (READ_NS / 1e9) / 1e3);
+}
+
+
+int main(void)
+{
+    static struct gps_assist_data gps;
+    struct ubx_nav_posllh fix;
+    struct shmPubReader_s rd;
+
+    region_G = shmPub_create(BENCH_SHM);
+    BENCH_CHECK(region_G != NULL);
+
+    // nothing published yet
+    BENCH_CHECK(shmPub_open(&rd, BENCH_SHM) == 0);
+    BENCH_CHECK(shmPub_readFix(&rd, &fix, NULL) == -1);
+    shmPub_close(&rd);
+
+    fixOf(1, &fix);
+    shmPub_writeFix(region_G, &fix);
+    bench_fill_assist(&gps, 32);
+    BENCH_CHECK(shmPub_writeAssist(region_G, &gps) == 1);
+    BENCH_CHECK(shmPub_writeAssist(region_G, &gps) == 0);
+
+    printf("%d readers, region %d bytes\n", N_READERS, (int)sizeof(struct shmPubRegion_s));
+    runPhase("idle writer", 0);
+    runPhase("busy writer", 1);
+
+    shmPub_destroy(region_G, BENCH_SHM);
+    return 0;
+}
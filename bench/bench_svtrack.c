@@ -0,0 +1,335 @@
+/*
+ * bench_svtrack.c
+ *
+ * The table of tracked SVs (see svTrack.h) and the ephemeris poll plan it
+ * makes (trackSvPollPlan()). Reports
+ *
+ *   svTrack_frame     serial_f's part, per NAV-SVINFO of N_CH channels
+ *   svTrack_read      control_f's copy of the table
+ *   polls             the AID-EPH polls of a refresh, and of the
+ *                     prediction alone, for the same sky
+ *
+ * checks the table through SVs coming and going, that the plan only asks
+ * for SVs tracked with an ephemeris, newest first, and that a reader never
+ * takes a table half written by a writer going back to back.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "ubx.h"
+#include "list.h"
+#include "metrics.h"
+#include "predict.h"
+#include "svTrack.h"
+#include "benchUtil.h"
+
+
+#define N_CH            16
+#define N_FRAMES        200000
+#define N_READS         200000
+#define N_PATTERNS      64
+#define RACE_NS         500000000ULL
+#define FRAME_SIZE      (8 + 8 + N_CH * 12)
+
+// a channel of a NAV-SVINFO
+struct chan {
+    int sv;
+    int flags;
+    int quality;
+    int elev;
+};
+
+static uint8_t patterns_G[N_PATTERNS][FRAME_SIZE];
+static volatile int writerRun_G;
+static uint64_t reads_G, torn_G;
+
+
+static int svinfoFrame(uint8_t *frame, uint32_t itow, const struct chan *c, int n, int cno)
+{
+    struct ubx_nav_svinfo m;
+    struct ubx_nav_svinfo_block b[N_CH];
+
+    memset(&m, 0, sizeof(m));
+    memset(b, 0, sizeof(b));
+    m.itow   = itow;
+    m.num_ch = n;
+    for(int i=0; i < n; i++){
+        b[i].chn     = i;
+        b[i].svid    = c[i].sv;
+        b[i].flags   = c[i].flags;
+        b[i].quality = c[i].quality;
+        b[i].cno     = cno;
+        b[i].elev    = c[i].elev;
+        b[i].azim    = c[i].sv * 10;
+    }
+    return ubx_nav_svinfo_encode(frame, FRAME_SIZE, &m, b);
+}
+
+static void freeNode(void *data)
+{
+    free(data);
+}
+
+// SVs the AID-EPH polls of prepAidPollMsgs() ask for, a poll of none is all 32
+static int ephPolls(struct msgStrmCheck_s *msgChk, uint8_t *svs)
+{
+    list *ll = create_list();
+    int n = 0;
+
+    prepAidPollMsgs(ll, msgChk);
+    while(size(ll)){
+        struct ubx_hdr *h = front(ll);
+
+        if( (h->msg_class == UBX_CLASS_AID) && (h->msg_id == UBX_AID_EPH) ){
+            if(h->payload_len == 1){
+                svs[n++] = *((uint8_t *)(h + 1));
+            }else{
+                for(int s=1; s <= 32; s++){ svs[n++] = s; }
+            }
+        }
+        remove_front(ll, freeNode);
+    }
+    free(ll);
+    return n;
+}
+
+
+// a full table decoded back to back, and copied out
+static void runFrames(void)
+{
+    static struct svTrack_s t;
+    struct svTrackTable_s tb;
+    struct chan c[N_CH];
+    uint8_t frame[FRAME_SIZE];
+    uint64_t t0, ns;
+    int len, n = 0;
+
+    for(int i=0; i < N_CH; i++){
+        c[i].sv      = 1 + 2 * i;
+        c[i].flags   = SVINFO_SV_USED | SVINFO_ORBIT_AVAIL | SVINFO_ORBIT_EPH;
+        c[i].quality = 7;
+        c[i].elev    = 5 + 5 * i;
+    }
+    len = svinfoFrame(frame, 1000, c, N_CH, 40);
+    BENCH_CHECK(len == FRAME_SIZE);
+
+    svTrack_init(&t);
+    t0 = bench_now_ns();
+    for(int k=0; k < N_FRAMES; k++){
+        n += svTrack_frame(&t, frame, len);
+    }
+    ns = bench_now_ns() - t0;
+    BENCH_CHECK(n == N_FRAMES);
+    BENCH_CHECK(t.table.updates == N_FRAMES);
+    printf("NAV-SVINFO of %d channels, %d bytes\n", N_CH, len);
+    printf("  svTrack_frame  %8.1f ns/frame\n", (double)ns / N_FRAMES);
+
+    t0 = bench_now_ns();
+    for(int k=0; k < N_READS; k++){
+        n = svTrack_read(&t, &tb, 0);
+    }
+    ns = bench_now_ns() - t0;
+    BENCH_CHECK(n == N_CH);
+    printf("  svTrack_read   %8.1f ns/copy  (%d bytes)\n", (double)ns / N_READS, (int)sizeof(tb));
+}
+
+// SVs coming and going, what they are tracked as, the plan of each sky
+static void checkTable(void)
+{
+    static struct svTrack_s t;
+    static struct msgStrmCheck_s msgChk;
+    struct svTrackTable_s tb;
+    const int eph = SVINFO_SV_USED | SVINFO_ORBIT_AVAIL | SVINFO_ORBIT_EPH;
+    struct chan first[] = {
+        {  2, eph,                 7, 60 },
+        {  5, eph,                 6, 20 },
+        {  9, eph,                 4, 45 },
+        { 12, 0,                   1,  3 },     // searching
+        { 14, SVINFO_ORBIT_AVAIL,  7, 30 },     // no ephemeris yet
+        { 17, eph | SVINFO_UNHEALTHY, 7, 50 },
+        { 135, SVINFO_DIFF_CORR,   7, 35 },     // SBAS
+    };
+    struct chan second[] = {
+        {  2, eph,                 7, 61 },
+        {  9, eph,                 5, 44 },
+        { 14, eph,                 7, 31 },     // now with one
+        { 20, eph,                 4,  8 },     // just risen
+        { 32, eph,                 6, 12 },     // just risen, higher
+        { 17, eph | SVINFO_UNHEALTHY, 7, 50 },
+    };
+    uint8_t frame[FRAME_SIZE], svs[64];
+    int n;
+
+    svTrack_init(&t);
+    BENCH_CHECK(svTrack_read(&t, &tb, 0) == -1);
+    BENCH_CHECK(svTrack_frame(&t, frame, ubx_frame_encode(frame, sizeof(frame), UBX_CLASS_NAV,
+                                                          UBX_NAV_POSLLH, frame, 0)) == 0);
+
+    BENCH_CHECK(svTrack_frame(&t, frame, svinfoFrame(frame, 1000, first, 7, 40)) == 1);
+    BENCH_CHECK(svTrack_read(&t, &tb, 0) == 4);
+    BENCH_CHECK(tb.updates == 1 && tb.itow == 1000);
+    BENCH_CHECK(tb.sv[2].tracked && tb.sv[5].tracked && tb.sv[9].tracked && tb.sv[14].tracked);
+    BENCH_CHECK(!tb.sv[12].tracked && (tb.sv[12].quality == 1) && !tb.sv[17].tracked);
+    BENCH_CHECK((tb.sv[2].since == 1) && (tb.sv[2].elev == 60) && (tb.sv[2].azim == 20) &&
+                (tb.sv[2].cno == 40) && (tb.sv[2].chn == 0));
+
+    BENCH_CHECK(svTrack_frame(&t, frame, svinfoFrame(frame, 11000, second, 6, 41)) == 1);
+    BENCH_CHECK(svTrack_read(&t, &tb, 0) == 5);
+    BENCH_CHECK((tb.sv[5].flags == 0) && !tb.sv[5].tracked && (tb.sv[12].quality == 0));
+    BENCH_CHECK((tb.sv[2].since == 1) && (tb.sv[14].since == 1) && (tb.sv[20].since == 2));
+    BENCH_CHECK(tb.sv[32].tracked && (tb.sv[32].since == 2));
+
+    // SVs 14, 20 and 32 have just become useful, 20 and 32 are the new
+    // ones; then by elevation. Almanacs: every PRN, 1..32
+    memset(&msgChk, 0, sizeof(msgChk));
+    BENCH_CHECK(trackSvPollPlan(&msgChk, &tb) == 5);
+    BENCH_CHECK(msgChk.svPlan.valid && (msgChk.svPlan.nAlm == 32));
+    for(int i=0; i < 32; i++){
+        BENCH_CHECK(msgChk.svPlan.almSv[i] == i + 1);
+    }
+    BENCH_CHECK((msgChk.svPlan.ephSv[0] == 32) && (msgChk.svPlan.ephSv[1] == 20) &&
+                (msgChk.svPlan.ephSv[2] == 2) && (msgChk.svPlan.ephSv[3] == 9) &&
+                (msgChk.svPlan.ephSv[4] == 14));
+    n = ephPolls(&msgChk, svs);
+    BENCH_CHECK((n == 5) && (svs[0] == 32) && (svs[4] == 14));
+
+    // gone stale: the plan stays as it was, control_f doesn't apply it
+    usleep(2000);
+    BENCH_CHECK(svTrack_read(&t, &tb, 1000000) == -1);
+    BENCH_CHECK(svTrack_read(&t, &tb, 0) == 5);
+    printf("table and plan ok\n");
+}
+
+// the prediction's polls against the receiver's, for a sky of a dozen tracked
+static void comparePolls(void)
+{
+    static struct predict_set ps;
+    static struct svTrack_s t;
+    static struct msgStrmCheck_s msgChk;
+    struct svTrackTable_s tb;
+    struct chan c[N_CH];
+    uint8_t frame[FRAME_SIZE], svs[64];
+    int order[MAX_SV], k, n = 0, predicted;
+
+    memset(&msgChk, 0, sizeof(msgChk));
+    predicted = ephPolls(&msgChk, svs);
+    printf("SVs the AID-EPH polls of a refresh ask for: %d with nothing known", predicted);
+
+    // two of three SVs visible, the rest rising; the receiver tracks the
+    // visible ones, most of them with an ephemeris
+    memset(&ps, 0, sizeof(ps));
+    for(int s=1; s <= 32; s++){
+        ps.sv[ps.n_sv].sv_id = s;
+        ps.sv[ps.n_sv].flags = PREDICT_USABLE | ((s % 3) ? PREDICT_VISIBLE : 0);
+        ps.sv[ps.n_sv].elev  = (s % 3) ? 5 + s : -10;
+        ps.n_sv++;
+    }
+    updateSvPollPlan(&msgChk, &ps);
+    predicted = ephPolls(&msgChk, svs);
+    printf(", %d predicted usable", predicted);
+
+    k = predict_poll_order(&ps, order, MAX_SV, 1);
+    for(int i=0; (i < k) && (n < N_CH); i++){
+        if(ps.sv[order[i] - 1].flags & PREDICT_VISIBLE){
+            c[n].sv      = order[i];
+            c[n].flags   = SVINFO_SV_USED | SVINFO_ORBIT_AVAIL | ((n % 4) ? SVINFO_ORBIT_EPH : 0);
+            c[n].quality = (n % 5) ? 7 : 2;
+            c[n].elev    = 5 + order[i];
+            n++;
+        }
+    }
+    svTrack_init(&t);
+    svTrack_frame(&t, frame, svinfoFrame(frame, 1000, c, n, 40));
+    BENCH_CHECK(svTrack_read(&t, &tb, 0) > 0);
+    trackSvPollPlan(&msgChk, &tb);
+    n = ephPolls(&msgChk, svs);
+    printf(", %d tracked with an ephemeris\n", n);
+    for(int i=0; i < n; i++){
+        BENCH_CHECK(tb.sv[svs[i]].tracked && (tb.sv[svs[i]].flags & SVINFO_ORBIT_EPH));
+    }
+    BENCH_CHECK(n < predicted);
+}
+
+
+// a table is one pattern throughout: every SV on a channel has its cno
+static void *reader_f(void *arg)
+{
+    const struct svTrack_s *t = arg;
+    static struct svTrackTable_s tb;
+    uint64_t reads = 0, bad = 0;
+
+    while(writerRun_G){
+        int n = svTrack_read(t, &tb, 0), cno = -1, tracked = 0;
+
+        if(n < 0){
+            continue;
+        }
+        for(int s=1; s < SV_TRACK_N_SV; s++){
+            if(tb.sv[s].flags == 0){
+                continue;
+            }
+            if(cno < 0){
+                cno = tb.sv[s].cno;
+            }
+            bad += (tb.sv[s].cno != cno) || ((tb.sv[s].elev != cno) && (tb.sv[s].elev != cno + 1));
+            tracked += tb.sv[s].tracked;
+        }
+        bad += (tracked != n) || ((int)((tb.updates - 1) % N_PATTERNS) + 10 != cno);
+        reads++;
+    }
+    reads_G = reads;
+    torn_G  = bad;
+    return NULL;
+}
+
+static void checkConcurrent(void)
+{
+    static struct svTrack_s t;
+    struct chan c[N_CH];
+    pthread_t rd;
+    uint64_t t0;
+    int len[N_PATTERNS];
+    uint32_t k = 0;
+
+    // pattern p: cno and elevation p + 10, every other SV on a channel
+    for(int p=0; p < N_PATTERNS; p++){
+        for(int i=0; i < N_CH; i++){
+            c[i].sv      = 1 + 2 * i + (p & 1);
+            c[i].flags   = SVINFO_SV_USED | SVINFO_ORBIT_EPH;
+            c[i].quality = (i + p) % 8;
+            c[i].elev    = p + 10 + (i & 1);
+        }
+        len[p] = svinfoFrame(patterns_G[p], p, c, N_CH, p + 10);
+    }
+
+    svTrack_init(&t);
+    writerRun_G = 1;
+    pthread_create(&rd, NULL, reader_f, &t);
+    t0 = bench_now_ns();
+    while(bench_now_ns() - t0 < RACE_NS){
+        svTrack_frame(&t, patterns_G[k % N_PATTERNS], len[k % N_PATTERNS]);
+        k++;
+    }
+    writerRun_G = 0;
+    pthread_join(rd, NULL);
+
+    printf("%u NAV-SVINFO taken back to back while a reader copied %llu tables, %llu torn\n",
+           k, (unsigned long long)reads_G, (unsigned long long)torn_G);
+    BENCH_CHECK(reads_G > 0);
+    BENCH_CHECK(torn_G == 0);
+}
+
+
+int main(void)
+{
+    runFrames();
+    checkTable();
+    comparePolls();
+    checkConcurrent();
+    return 0;
+}
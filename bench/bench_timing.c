@@ -0,0 +1,303 @@
+/*
+ * bench_timing.c
+ *
+ * The timepulse path: TIM-TP frames written on the master side of a pty,
+ * read off the slave the way serial_f does (read, CLOCK_REALTIME, framer,
+ * timing_frame()) into an NTP SHM refclock unit of its own, with a local
+ * reader taking the samples as ntpd / chrony would. Checks the UTC of each
+ * sample and reports p50 / p99 of
+ *
+ *   read -> store     the read returning to the sample being in the segment
+ *   write -> store    the frame written on the master to the same, pty included
+ *   read -> reader    the read returning to the reader holding the sample
+ *
+ * and the leap second indicator, TIM-TM2 / SVIN in the shm region.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+#include <time.h>
+
+#include "ubx.h"
+#include "ntpShm.h"
+#include "shmPub.h"
+#include "timing.h"
+#include "benchUtil.h"
+
+
+#define BENCH_UNIT      9               // key 0x4e545039, out of the daemons' way
+#define BENCH_SHM       "/bench_timing.gps"
+#define N_PULSES        2000
+#define PERIOD_US       2000            // the receiver's is a second, only tow says so
+#define WEEK            2000
+#define TOW_MS          388800250       // mid day 4, 250.5 ms into a second
+#define TOW_SUB_MS      0x80000000u
+
+static int masterFd_G;
+static volatile int run_G;
+static uint64_t writeNs_G[N_PULSES];
+static uint64_t seenNs_G[N_PULSES];
+static int nSeen_G, badSeen_G, torn_G;
+
+
+static uint64_t realtimeNs(const struct timespec *ts)
+{
+    return (uint64_t)ts->tv_sec * 1000000000ULL + ts->tv_nsec;
+}
+
+static uint64_t realNow(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return realtimeNs(&ts);
+}
+
+static void pulseOf(int k, struct ubx_tim_tp *tp)
+{
+    memset(tp, 0, sizeof(struct ubx_tim_tp));
+    tp->tow_ms     = TOW_MS + k * 1000;
+    tp->tow_sub_ms = TOW_SUB_MS;
+    tp->q_err      = -1234 + k;
+    tp->week       = WEEK;
+    tp->flags      = 0;             // GPS time
+}
+
+static void *writer_f(void *arg)
+{
+    struct ubx_tim_tp tp;
+    uint8_t frame[64];
+    int len;
+
+    for(int k=0; k < N_PULSES; k++){
+        pulseOf(k, &tp);
+        len = ubx_tim_tp_encode(frame, sizeof(frame), &tp);
+        writeNs_G[k] = realNow();
+        BENCH_CHECK(write(masterFd_G, frame, len) == len);
+        usleep(PERIOD_US);
+    }
+    return NULL;
+}
+
+// a daemon polling the segment, only faster
+static void *reader_f(void *arg)
+{
+    struct ntpShmTime_s *shm = arg;
+    struct ntpShmSample_s s;
+    struct timespec want;
+    int r;
+
+    while(run_G){
+        r = ntpShm_read(shm, &s);
+        if(r == 0){
+            sched_yield();
+            continue;
+        }
+        if(r < 0){
+            torn_G++;
+            continue;
+        }
+        if(nSeen_G < N_PULSES){
+            seenNs_G[nSeen_G++] = realNow() - realtimeNs(&s.receive);
+        }
+        // the sample of pulse k is its UTC, 18 s off GPS time
+        want.tv_sec = GPS_EPOCH_UNIX + (int64_t)WEEK * GPS_WEEK_SECONDS + TOW_MS / 1000 - 18;
+        if( (s.clock.tv_nsec != 250500000) || ((s.clock.tv_sec - want.tv_sec) < 0) ||
+            ((s.clock.tv_sec - want.tv_sec) >= N_PULSES) || (s.leap != NTP_SHM_LEAP_NONE) ||
+            (s.precision != TIMING_SHM_PRECISION) ){
+            badSeen_G++;
+        }
+    }
+    return NULL;
+}
+
+static int openPty(int *slaveFd)
+{
+    struct termios tty;
+    char name[64];
+    int fd;
+
+    fd = posix_openpt(O_RDWR | O_NOCTTY);
+    BENCH_CHECK( (fd >= 0) && (grantpt(fd) == 0) && (unlockpt(fd) == 0) &&
+                 (ptsname_r(fd, name, sizeof(name)) == 0) );
+    *slaveFd = open(name, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    BENCH_CHECK(*slaveFd >= 0);
+    tcgetattr(*slaveFd, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(*slaveFd, TCSANOW, &tty);
+    return fd;
+}
+
+static void report(const char *name, uint64_t *ns, int n)
+{
+    printf("  %-16s %6d samples  p50 %8.1f us  p99 %8.1f us  max %8.1f us\n", name, n,
+           bench_percentile(ns, n, 50) / 1e3, bench_percentile(ns, n, 99) / 1e3,
+           bench_percentile(ns, n, 100) / 1e3);
+}
+
+
+// the pulse path, pty to reader
+static void runPulses(struct timing_s *t, struct ntpShmTime_s *shm)
+{
+    static uint64_t storeNs[N_PULSES], wireNs[N_PULSES];
+    struct ubxFramer_s framer;
+    struct timespec arrival;
+    struct pollfd pfd;
+    pthread_t wr, rd;
+    uint8_t buf[100];
+    uint32_t samples;
+    int slaveFd, r, p, used, flen, k = 0, n = 0;
+
+    masterFd_G = openPty(&slaveFd);
+    ubxFramer_init(&framer);
+    run_G = 1;
+    pthread_create(&rd, NULL, reader_f, shm);
+    pthread_create(&wr, NULL, writer_f, NULL);
+
+    while(k < N_PULSES){
+        pfd.fd      = slaveFd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd, 1, 1000) <= 0){
+            break;
+        }
+        r = read(slaveFd, buf, sizeof(buf));
+        if(r <= 0){
+            continue;
+        }
+        clock_gettime(CLOCK_REALTIME, &arrival);
+        for(p = 0; (flen = ubxFramer_push(&framer, buf + p, r - p, &used)) > 0; p += used){
+            samples = t->samples;
+            BENCH_CHECK(timing_frame(t, framer.buf, flen, &arrival) == 1);
+            if(t->samples != samples){
+                // the frame of pulse k tells pulse k - 1 has been
+                uint64_t now = realNow();
+
+                storeNs[n] = now - realtimeNs(&arrival);
+                wireNs[n]  = now - writeNs_G[k];
+                n++;
+            }
+            k++;
+        }
+    }
+
+    pthread_join(wr, NULL);
+    usleep(10000);
+    run_G = 0;
+    pthread_join(rd, NULL);
+    close(slaveFd);
+    close(masterFd_G);
+
+    printf("%d TIM-TP frames, %d samples, %d seen by the reader (%d torn, %d wrong)\n",
+           k, n, nSeen_G, torn_G, badSeen_G);
+    BENCH_CHECK(k == N_PULSES);
+    BENCH_CHECK(n == N_PULSES - 1);
+    BENCH_CHECK(nSeen_G > 0);
+    BENCH_CHECK(badSeen_G == 0);
+    report("read -> store", storeNs, n);
+    report("write -> store", wireNs, n);
+    report("read -> reader", seenNs_G, nSeen_G);
+}
+
+// a leap second at the end of the pulse's day, and one the next week
+static void checkLeap(struct timing_s *t)
+{
+    struct gps_utc_model utc;
+    struct ubx_tim_tp tp;
+    struct timespec ts;
+    int dn;
+
+    pulseOf(0, &tp);
+    dn = (TOW_MS / 1000) / 86400;
+
+    memset(&utc, 0, sizeof(utc));
+    utc.delta_t_ls  = 18;
+    utc.delta_t_lsf = 19;
+    utc.wn_lsf      = WEEK & 0xff;
+    utc.dn          = dn + 1;       // the event is at the end of day dn
+    timing_setUtc(t, &utc);
+    BENCH_CHECK(timing_pulseUtc(t, &tp, &ts) == NTP_SHM_LEAP_ADD);
+    BENCH_CHECK(ts.tv_sec == GPS_EPOCH_UNIX + (int64_t)WEEK * GPS_WEEK_SECONDS + TOW_MS / 1000 - 18);
+
+    utc.wn_lsf = (WEEK + 1) & 0xff;
+    timing_setUtc(t, &utc);
+    BENCH_CHECK(timing_pulseUtc(t, &tp, &ts) == NTP_SHM_LEAP_NONE);
+
+    // UTC time base: no leap seconds to take out
+    tp.flags = 0x01;
+    BENCH_CHECK(timing_pulseUtc(t, &tp, &ts) == NTP_SHM_LEAP_NONE);
+    BENCH_CHECK(ts.tv_sec == GPS_EPOCH_UNIX + (int64_t)WEEK * GPS_WEEK_SECONDS + TOW_MS / 1000);
+    printf("leap second indicator ok\n");
+}
+
+// TIM-TM2 and TIM-SVIN as the shm region's readers get them
+static void checkRegion(struct timing_s *t)
+{
+    struct shmPubReader_s rd;
+    struct shmPubTimeData_s got;
+    struct ubx_tim_tm2 tm2;
+    struct ubx_tim_svin svin;
+    struct timespec now;
+    uint8_t frame[64];
+    int len;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    memset(&tm2, 0, sizeof(tm2));
+    tm2.ch       = 0;
+    tm2.flags    = 0x05;
+    tm2.count    = 42;
+    tm2.wn_r     = WEEK;
+    tm2.tow_ms_r = 1234567;
+    tm2.acc_est  = 25;
+    len = ubx_tim_tm2_encode(frame, sizeof(frame), &tm2);
+    BENCH_CHECK(timing_frame(t, frame, len, &now) == 1);
+
+    memset(&svin, 0, sizeof(svin));
+    svin.dur    = 3600;
+    svin.mean_x = 123456789;
+    svin.obs    = 3600;
+    svin.valid  = 1;
+    len = ubx_tim_svin_encode(frame, sizeof(frame), &svin);
+    BENCH_CHECK(timing_frame(t, frame, len, &now) == 1);
+
+    BENCH_CHECK(shmPub_open(&rd, BENCH_SHM) == 0);
+    BENCH_CHECK(shmPub_readTime(&rd, &got, NULL) >= 0);
+    BENCH_CHECK(memcmp(&got.tm2, &tm2, sizeof(tm2)) == 0);
+    BENCH_CHECK(memcmp(&got.svin, &svin, sizeof(svin)) == 0);
+    BENCH_CHECK(got.tp.week == WEEK);
+    shmPub_close(&rd);
+    printf("TIM-TM2 / TIM-SVIN in the shm region ok\n");
+}
+
+
+int main(void)
+{
+    static struct timing_s t;
+    struct shmPubRegion_s *region;
+    struct ntpShmTime_s *shm;
+
+    shm = ntpShm_attach(BENCH_UNIT);
+    BENCH_CHECK(shm != NULL);
+    region = shmPub_create(BENCH_SHM);
+    BENCH_CHECK(region != NULL);
+    timing_init(&t, shm, region);
+
+    runPulses(&t, shm);
+    checkLeap(&t);
+    checkRegion(&t);
+
+    shmPub_destroy(region, BENCH_SHM);
+    ntpShm_detach(shm);
+    ntpShm_remove(BENCH_UNIT);
+    return 0;
+}
@@ -0,0 +1,210 @@
+/*
+ * bench_ubx.c
+ *
+ * UBX message schema: cost of the generated views, encoders and JSON
+ * serializers for each message. Before timing, every message is encoded,
+ * checked to come back through ubx_msg_dispatch() to its handler
+ * unchanged, and payloads of every other length are checked to be
+ * refused by the views and never reach a handler.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ubx.h"
+#include "json.h"
+#include "benchUtil.h"
+
+
+#define ITERS       200000
+#define N_RAW_SV    12
+
+
+static uint8_t payload_G[1024];
+static int     handled_G;
+static int     handledLen_G;
+
+static void handler(struct ubx_hdr *hdr, void *pl, int pl_len, void *ud)
+{
+    handled_G++;
+    handledLen_G = pl_len;
+    BENCH_CHECK(!memcmp(pl, payload_G, pl_len));
+}
+
+static struct ubx_dispatch_entry dt_G[] = {
+    UBX_DISPATCH(NAV, POSLLH, handler),
+    UBX_DISPATCH(NAV, SOL,    handler),
+    UBX_DISPATCH(TIM, TP,     handler),
+    UBX_DISPATCH(RXM, RAW,    handler),
+    UBX_DISPATCH(AID, INI,    handler),
+    UBX_DISPATCH(AID, HUI,    handler),
+    UBX_DISPATCH(AID, ALM,    handler),
+    UBX_DISPATCH(AID, EPH,    handler),
+    { 0, 0, NULL },
+};
+
+/* frame round trip through the dispatcher, and every wrong length refused */
+static void checkFrame(uint8_t *frame, int len, int shortLen)
+{
+    struct ubx_hdr *hdr = (struct ubx_hdr *)frame;
+    int plLen = hdr->payload_len;
+    static uint8_t bad[1100];
+
+    BENCH_CHECK(len == (int)sizeof(struct ubx_hdr) + plLen + 2);
+    memcpy(payload_G, frame + sizeof(struct ubx_hdr), plLen);
+
+    handled_G = 0;
+    BENCH_CHECK(ubx_msg_dispatch(dt_G, frame, len, NULL) == len);
+    BENCH_CHECK(handled_G == 1 && handledLen_G == plLen);
+
+    for(int l=0; l < plLen + 40; l++){
+        int want = (l == plLen) || (l == shortLen);
+        int n;
+
+        BENCH_CHECK((ubx_schema_check(hdr->msg_class, hdr->msg_id,
+                                      frame + sizeof(struct ubx_hdr), l) == 0) == want);
+        if(want){
+            continue;
+        }
+        n = ubx_frame_encode(bad, sizeof(bad), hdr->msg_class, hdr->msg_id,
+                             frame + sizeof(struct ubx_hdr), l < plLen ? l : plLen);
+        if(l > plLen){
+            // pad with junk
+            bad[4] = l & 0xff;
+            bad[5] = l >> 8;
+            memset(bad + sizeof(struct ubx_hdr) + plLen, 0x5a, l - plLen);
+            n = sizeof(struct ubx_hdr) + l + 2;
+            ubx_checksum(bad + 2, sizeof(struct ubx_hdr) - 2 + l, bad + n - 2);
+        }
+        handled_G = 0;
+        BENCH_CHECK(ubx_msg_dispatch(dt_G, bad, n, NULL) == n);
+        BENCH_CHECK(handled_G == 0);
+    }
+
+    // truncated buffer: never read past len
+    BENCH_CHECK(ubx_msg_dispatch(dt_G, frame, len - 1, NULL) < 0);
+}
+
+static void fillRand(void *p, int n)
+{
+    uint8_t *b = p;
+
+    for(int i=0; i < n; i++){
+        b[i] = bench_rand();
+    }
+}
+
+
+int main(void)
+{
+    static uint8_t frame[2048];
+    static char jsonBuf[16384];
+    struct json_buf jb;
+    struct ubx_nav_posllh posllh;
+    struct ubx_nav_sol sol;
+    struct ubx_tim_tp tp;
+    struct ubx_aid_eph eph;
+    struct ubx_rxm_raw raw;
+    struct ubx_rxm_raw_block blocks[N_RAW_SV];
+    const struct ubx_nav_posllh *view;
+    volatile int plLen = sizeof(struct ubx_nav_posllh);
+    volatile int sink = 0;
+    uint64_t t0, t1;
+    int len;
+
+    bench_seed(39);
+    json_buf_init(&jb, jsonBuf, sizeof(jsonBuf));
+
+    fillRand(&posllh, sizeof(posllh));
+    fillRand(&sol, sizeof(sol));
+    fillRand(&tp, sizeof(tp));
+    fillRand(&eph, sizeof(eph));
+    eph.present = 1;
+
+    memset(&raw, 0, sizeof(raw));
+    raw.itow = 345600000;
+    raw.week = 2340;
+    raw.num_sv = N_RAW_SV;
+    for(int i=0; i < N_RAW_SV; i++){
+        blocks[i].cp_mes = 1.1e8 + i * 12345.678;
+        blocks[i].pr_mes = 2.1e7 + i * 1000.25;
+        blocks[i].do_mes = -1234.5f + i;
+        blocks[i].sv     = i + 1;
+        blocks[i].mes_qi = 7;
+        blocks[i].cno    = 40 + i;
+        blocks[i].lli    = 0;
+    }
+
+    len = ubx_nav_posllh_encode(frame, sizeof(frame), &posllh);
+    checkFrame(frame, len, -1);
+    len = ubx_nav_sol_encode(frame, sizeof(frame), &sol);
+    checkFrame(frame, len, -1);
+    len = ubx_tim_tp_encode(frame, sizeof(frame), &tp);
+    checkFrame(frame, len, -1);
+    len = ubx_aid_eph_encode(frame, sizeof(frame), &eph);
+    checkFrame(frame, len, 8);
+    len = ubx_rxm_raw_encode(frame, sizeof(frame), &raw, blocks);
+    BENCH_CHECK(len == 6 + 8 + 24 * N_RAW_SV + 2);
+    checkFrame(frame, len, -1);
+    BENCH_CHECK(ubx_rxm_raw_encode(frame, len - 1, &raw, blocks) < 0);
+
+    BENCH_CHECK(ubx_schema_json(&jb, frame, len) == 0);
+    printf("%.160s...\n", json_buf_str(&jb));
+    printf("all schema messages round trip, every other payload length refused\n\n");
+
+    // view: length check and cast of a frame in place
+    len = ubx_nav_posllh_encode(frame, sizeof(frame), &posllh);
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        view = ubx_nav_posllh_get(frame + sizeof(struct ubx_hdr), plLen);
+        sink += view->lat;
+    }
+    t1 = bench_now_ns();
+    printf("NAV-POSLLH view        %7.2f ns\n", (t1 - t0) / (double)ITERS);
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        ubx_nav_posllh_encode(frame, sizeof(frame), &posllh);
+        __asm__ __volatile__("" ::: "memory");
+    }
+    t1 = bench_now_ns();
+    printf("NAV-POSLLH encode      %7.2f ns\n", (t1 - t0) / (double)ITERS);
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        json_buf_reset(&jb);
+        ubx_nav_posllh_json(&jb, &posllh);
+    }
+    t1 = bench_now_ns();
+    printf("NAV-POSLLH json        %7.2f ns  (%d bytes)\n", (t1 - t0) / (double)ITERS, (int)jb.len);
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS / 10; i++){
+        json_buf_reset(&jb);
+        ubx_aid_eph_json(&jb, &eph);
+    }
+    t1 = bench_now_ns();
+    printf("AID-EPH json           %7.2f ns  (%d bytes)\n", (t1 - t0) / (double)(ITERS / 10), (int)jb.len);
+
+    len = ubx_rxm_raw_encode(frame, sizeof(frame), &raw, blocks);
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS / 10; i++){
+        json_buf_reset(&jb);
+        ubx_schema_json(&jb, frame, len);
+    }
+    t1 = bench_now_ns();
+    printf("RXM-RAW %2d SVs json    %7.2f ns  (%d bytes)\n", N_RAW_SV,
+           (t1 - t0) / (double)(ITERS / 10), (int)jb.len);
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        sink += ubx_msg_dispatch(dt_G, frame, len, NULL);
+    }
+    t1 = bench_now_ns();
+    printf("RXM-RAW dispatch       %7.2f ns  (checksum, schema check, handler)\n",
+           (t1 - t0) / (double)ITERS);
+
+    return 0;
+}
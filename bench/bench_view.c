@@ -0,0 +1,219 @@
+/*
+ * bench_view.c
+ *
+ * Engineering units view of the assist data (gpsView.h): raw -> view ->
+ * raw over bench_fill_assist() sets gives the broadcast integers back,
+ * AID-HUI as the receiver sends it lands in the store bit identical to the
+ * integers it was made from, and gps_view_refresh() converts only what
+ * moved. Reports the cost of a full and of a one SV refresh.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "gps.h"
+#include "gpsView.h"
+#include "ubx.h"
+#include "ubx-parse.h"
+#include "benchUtil.h"
+
+
+#define N_SV        32
+#define N_SETS      500
+
+
+struct refresh_s {
+    struct gps_assist_view *v;
+    struct gps_assist_data *gps;
+};
+
+
+// one rounding of raw * scale * unit, and the nearest integer back is raw
+#define CHECK_FIELD(f, lsb, unit)                                           \
+    BENCH_CHECK(v.f == (double)raw->f * (lsb) * (unit));                    \
+    BENCH_CHECK(nearbyint(v.f / ((lsb) * (unit))) == (double)raw->f);
+
+static void checkAlm(const struct gps_almanac_sv *raw)
+{
+    struct gps_alm_view_sv v;
+
+    gps_alm_from_raw(&v, raw);
+    BENCH_CHECK((v.sv_id == raw->sv_id) && (v.sv_health == raw->sv_health));
+    GPS_ALM_FIELDS(CHECK_FIELD)
+}
+
+static void checkEph(const struct gps_ephemeris_sv *raw)
+{
+    struct gps_eph_view_sv v;
+
+    gps_eph_from_raw(&v, raw);
+    BENCH_CHECK((v.sv_id == raw->sv_id) && (v.iodc == raw->iodc));
+    GPS_EPH_FIELDS(CHECK_FIELD)
+}
+
+static void checkRoundTrip(void)
+{
+    static struct gps_assist_data gps;
+    int negative = 0;
+
+    bench_seed(30);
+    for(int n=0; n < N_SETS; n++){
+        struct gps_ionosphere_model iono;
+        struct gps_utc_model utc;
+        struct gps_iono_view iv;
+        struct gps_utc_view uv;
+
+        bench_fill_assist(&gps, N_SV);
+
+        gps_iono_from_raw(&iv, &gps.ionosphere);
+        gps_iono_to_raw(&iono, &iv);
+        BENCH_CHECK(memcmp(&iono, &gps.ionosphere, sizeof(iono)) == 0);
+
+        gps_utc_from_raw(&uv, &gps.utc);
+        gps_utc_to_raw(&utc, &uv);
+        BENCH_CHECK(memcmp(&utc, &gps.utc, sizeof(utc)) == 0);
+        negative += (uv.a0 < 0) + (iv.alpha_1 < 0) + (iv.beta_0 < 0);
+
+        for(int i=0; i < N_SV; i++){
+            checkAlm(&gps.almanac.svs[i]);
+            checkEph(&gps.ephemeris.svs[i]);
+        }
+    }
+    // the sets have to exercise the sign, not only the scale
+    BENCH_CHECK(negative > N_SETS);
+    printf("%d sets raw -> view -> raw ok\n", N_SETS);
+}
+
+
+// AID-HUI carries the UTC and Klobuchar parameters as floating point
+static void checkHui(void)
+{
+    static struct gps_assist_data src, gps;
+    struct ubx_aid_hui hui;
+    uint8_t frame[128];
+    int len;
+
+    bench_seed(31);
+    memset(&gps, 0, sizeof(gps));
+    for(int n=0; n < N_SETS; n++){
+        unsigned int gen;
+
+        bench_fill_assist(&src, 1);
+
+        memset(&hui, 0, sizeof(hui));
+        hui.utc_a1  = src.utc.a1 * 0x1p-50;
+        hui.utc_a0  = src.utc.a0 * 0x1p-30;
+        hui.utc_tot = src.utc.t_ot * 4096;
+        hui.utc_wnt = src.utc.wn_t;
+        hui.utc_ls  = src.utc.delta_t_ls;
+        hui.utc_wnf = src.utc.wn_lsf;
+        hui.utc_dn  = src.utc.dn;
+        hui.utc_lsf = src.utc.delta_t_lsf;
+        hui.klob_a0 = src.ionosphere.alpha_0 * 0x1p-30f;
+        hui.klob_a1 = src.ionosphere.alpha_1 * 0x1p-27f;
+        hui.klob_a2 = src.ionosphere.alpha_2 * 0x1p-24f;
+        hui.klob_a3 = src.ionosphere.alpha_3 * 0x1p-24f;
+        hui.klob_b0 = src.ionosphere.beta_0 * 0x1p11f;
+        hui.klob_b1 = src.ionosphere.beta_1 * 0x1p14f;
+        hui.klob_b2 = src.ionosphere.beta_2 * 0x1p16f;
+        hui.klob_b3 = src.ionosphere.beta_3 * 0x1p16f;
+        hui.flags   = 0x02 | 0x04;
+
+        len = ubx_aid_hui_encode(frame, sizeof(frame), &hui);
+        BENCH_CHECK(ubx_msg_dispatch(ubx_parse_dt, frame, len, &gps) == len);
+        BENCH_CHECK(memcmp(&gps.utc, &src.utc, sizeof(gps.utc)) == 0);
+        BENCH_CHECK(memcmp(&gps.ionosphere, &src.ionosphere, sizeof(gps.ionosphere)) == 0);
+
+        // the same parameters again are no new generation
+        gen = gps.gen;
+        BENCH_CHECK(ubx_msg_dispatch(ubx_parse_dt, frame, len, &gps) == len);
+        BENCH_CHECK(gps.gen == gen);
+    }
+    printf("%d AID-HUI bit identical to the broadcast integers\n", N_SETS);
+}
+
+
+static void checkRefresh(void)
+{
+    static struct gps_assist_data gps;
+    static struct gps_assist_view v;
+    struct gps_ephemeris_sv *e = &gps.ephemeris.svs[5];
+    struct gps_eph_view_sv ev;
+
+    bench_seed(32);
+    bench_fill_assist(&gps, N_SV);
+    gps_view_init(&v);
+
+    BENCH_CHECK(gps_view_refresh(&v, &gps) == 2 + 2 * N_SV);
+    BENCH_CHECK((v.n_alm == N_SV) && (v.n_eph == N_SV));
+    BENCH_CHECK(gps_view_refresh(&v, &gps) == 0);
+
+    // one new ephemeris: that SV only
+    e->iodc = (e->iodc + 1) & 0x3ff;
+    e->m_0 += 12345;
+    gps.ephemeris.gen[5] = ++gps.gen;
+    BENCH_CHECK(gps_view_refresh(&v, &gps) == 1);
+    gps_eph_from_raw(&ev, e);
+    BENCH_CHECK((v.eph[5].iodc == ev.iodc) && (v.eph[5].m_0 == ev.m_0));
+
+    // an almanac and the UTC parameters
+    gps.almanac.svs[31].m_0 = -gps.almanac.svs[31].m_0;
+    gps.almanac.gen[31] = ++gps.gen;
+    gps.utc.a0 = -1;
+    gps.gen_utc = ++gps.gen;
+    BENCH_CHECK(gps_view_refresh(&v, &gps) == 2);
+    BENCH_CHECK(v.alm[31].m_0 == gps.almanac.svs[31].m_0 * 0x1p-23 * GPS_PI);
+    BENCH_CHECK(v.utc.a0 == -0x1p-30);
+
+    // a new SV appended to the set
+    gps.ephemeris.n_sv = N_SV + 1;
+    gps.ephemeris.svs[N_SV] = *e;
+    gps.ephemeris.gen[N_SV] = ++gps.gen;
+    BENCH_CHECK(gps_view_refresh(&v, &gps) == 1);
+    BENCH_CHECK(v.n_eph == N_SV + 1);
+    printf("incremental refresh ok\n");
+}
+
+
+static void doFull(void *arg, int ops)
+{
+    struct refresh_s *r = arg;
+
+    for(int i=0; i < ops; i++){
+        gps_view_init(r->v);
+        gps_view_refresh(r->v, r->gps);
+    }
+}
+
+static void doOneSv(void *arg, int ops)
+{
+    struct refresh_s *r = arg;
+
+    for(int i=0; i < ops; i++){
+        r->gps->ephemeris.gen[i & (N_SV - 1)] = ++r->gps->gen;
+        gps_view_refresh(r->v, r->gps);
+    }
+}
+
+
+int main(void)
+{
+    static struct gps_assist_data gps;
+    static struct gps_assist_view v;
+    struct refresh_s arg = { &v, &gps };
+    struct bench_result r;
+
+    checkRoundTrip();
+    checkHui();
+    checkRefresh();
+
+    bench_fill_assist(&gps, N_SV);
+    printf("struct gps_assist_view %zu bytes\n", sizeof(v));
+    bench_measure("gps_view_refresh, full", doFull, &arg, 0, &r);
+    bench_measure("gps_view_refresh, one SV", doOneSv, &arg, 0, &r);
+
+    return 0;
+}
@@ -0,0 +1,155 @@
+/*
+ * bench_wire.c
+ *
+ * Binary wire format against JSON for a full 32 SV assist data set:
+ * size, encode and decode time, and the size of a typical delta.
+ * Round trips are checked before anything is timed.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gps.h"
+#include "gpsWire.h"
+#include "json.h"
+#include "config.h"
+#include "benchUtil.h"
+
+
+#define N_SV    32
+#define ITERS   20000
+
+
+static void check_record(enum gps_wire_record rec, const void *a, const void *b)
+{
+    int n;
+    const struct gps_wire_field *f = gps_wire_schema(rec, &n);
+
+    for(int i=0; i < n; i++){
+        int va = *(const int *)((const char *)a + f[i].offset);
+        int vb = *(const int *)((const char *)b + f[i].offset);
+
+        if(va != vb){
+            fprintf(stderr, "field %s: %d != %d\n", f[i].name, va, vb);
+            exit(1);
+        }
+    }
+}
+
+static void check_same(const struct gps_assist_data *a, const struct gps_assist_data *b)
+{
+    BENCH_CHECK(a->fields == b->fields);
+    BENCH_CHECK(a->gen == b->gen);
+    check_record(GPS_WIRE_REC_IONO, &a->ionosphere, &b->ionosphere);
+    check_record(GPS_WIRE_REC_UTC, &a->utc, &b->utc);
+
+    BENCH_CHECK(a->almanac.wna == b->almanac.wna);
+    BENCH_CHECK(a->almanac.n_sv == b->almanac.n_sv);
+    for(int i=0; i < a->almanac.n_sv; i++){
+        BENCH_CHECK(a->almanac.svs[i].sv_id == b->almanac.svs[i].sv_id);
+        check_record(GPS_WIRE_REC_ALM, &a->almanac.svs[i], &b->almanac.svs[i]);
+    }
+
+    BENCH_CHECK(a->ephemeris.n_sv == b->ephemeris.n_sv);
+    for(int i=0; i < a->ephemeris.n_sv; i++){
+        BENCH_CHECK(a->ephemeris.svs[i].sv_id == b->ephemeris.svs[i].sv_id);
+        check_record(GPS_WIRE_REC_EPH, &a->ephemeris.svs[i], &b->ephemeris.svs[i]);
+    }
+
+    BENCH_CHECK(a->ref_pos.latitude == b->ref_pos.latitude);
+    BENCH_CHECK(a->ref_pos.longitude == b->ref_pos.longitude);
+    BENCH_CHECK(a->ref_pos.altitude == b->ref_pos.altitude);
+    BENCH_CHECK(a->ref_time.wn == b->ref_time.wn);
+    BENCH_CHECK(a->ref_time.tow == b->ref_time.tow);
+    BENCH_CHECK(a->ref_time.when == b->ref_time.when);
+}
+
+
+int main(void)
+{
+    static struct gps_assist_data gps, next, out;
+    static uint8_t wire[GPS_WIRE_MAX_LEN];
+    static uint8_t delta[GPS_WIRE_MAX_LEN];
+    static char jbuf[JSON_BUF_SIZE];
+    struct json_buf jb;
+    int wlen, dlen, jlen;
+    uint64_t t0, tEnc, tDec, tDelta, tJson;
+
+    bench_seed(1);
+    bench_fill_assist(&gps, N_SV);
+    // decoded ref_pos comes back on the 1e-7 deg / mm grid
+    gps.ref_pos.latitude  = 410082000 * 1e-7;
+    gps.ref_pos.longitude = 289784000 * 1e-7;
+    gps.ref_pos.altitude  = 39125 * 1e-3;
+
+    // full round trip
+    wlen = gps_wire_encode(wire, sizeof(wire), &gps, NULL);
+    BENCH_CHECK(wlen > 0);
+    BENCH_CHECK(gps_wire_decode(&out, wire, wlen) == wlen);
+    check_same(&gps, &out);
+
+    // malformed input is refused and leaves the store alone
+    BENCH_CHECK(gps_wire_encode(wire, wlen - 1, &gps, NULL) == -1);
+    BENCH_CHECK(gps_wire_decode(&out, wire, wlen - 1) == -1);
+    wire[5] |= 0x80;
+    BENCH_CHECK(gps_wire_decode(&out, wire, wlen) == -1);
+    wire[5] &= ~0x80;
+    check_same(&gps, &out);
+
+    // delta: a new UTC set and three new ephemerides
+    next = gps;
+    next.gen++;
+    next.utc.a0++;
+    for(int i=4; i < 7; i++){
+        next.ephemeris.svs[i].iodc = (next.ephemeris.svs[i].iodc + 1) & 0x3ff;
+        next.ephemeris.svs[i].t_oe += 450;
+        next.ephemeris.gen[i] = next.gen;
+    }
+    dlen = gps_wire_encode(delta, sizeof(delta), &next, &gps);
+    BENCH_CHECK(dlen > 0);
+    BENCH_CHECK(dlen == GPS_WIRE_HDR_LEN + 13 + 8 + 3 * 64);
+    BENCH_CHECK(gps_wire_decode(&out, delta, dlen) == dlen);
+    check_same(&next, &out);
+    BENCH_CHECK(gps_wire_decode(&out, delta, dlen) == GPS_WIRE_EBASE);
+
+    json_buf_init(&jb, jbuf, sizeof(jbuf));
+    json_assist_data(&jb, &gps);
+    BENCH_CHECK(!jb.overflow);
+    jlen = jb.len;
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        json_buf_reset(&jb);
+        json_assist_data(&jb, &gps);
+    }
+    tJson = bench_now_ns() - t0;
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        wlen = gps_wire_encode(wire, sizeof(wire), &gps, NULL);
+    }
+    tEnc = bench_now_ns() - t0;
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        gps_wire_decode(&out, wire, wlen);
+    }
+    tDec = bench_now_ns() - t0;
+
+    t0 = bench_now_ns();
+    for(int i=0; i < ITERS; i++){
+        dlen = gps_wire_encode(delta, sizeof(delta), &next, &gps);
+    }
+    tDelta = bench_now_ns() - t0;
+
+    printf("%d SVs, %d iterations\n", N_SV, ITERS);
+    printf("  json         %6d bytes  %8.2f us encode\n", jlen, tJson / 1e3 / ITERS);
+    printf("  wire full    %6d bytes  %8.2f us encode  %8.2f us decode\n",
+           wlen, tEnc / 1e3 / ITERS, tDec / 1e3 / ITERS);
+    printf("  wire delta   %6d bytes  %8.2f us encode\n", dlen, tDelta / 1e3 / ITERS);
+    printf("  wire/json    %6.1f %%\n", 100.0 * wlen / jlen);
+
+    return 0;
+}
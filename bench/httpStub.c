@@ -0,0 +1,214 @@
+/*
+ * httpStub.c
+ *
+ * Stand-in HTTP/1.1 server for the upload benchmarks: keep-alive, one
+ * thread per connection, a configurable delay before each response, and
+ * optionally chunked responses. Every JSON object of a request body
+ * carrying "t":<CLOCK_MONOTONIC ns> is counted as a payload and its upload
+ * latency recorded; bodies other than a JSON array are counted apart.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "benchUtil.h"
+#include "httpStub.h"
+
+
+#define STUB_BUF    (512 * 1024)
+
+static pthread_mutex_t stubMutex_G = PTHREAD_MUTEX_INITIALIZER;
+
+struct stubConn {
+    struct httpStub_s *hs;
+    int fd;
+};
+
+
+static void recordBody(struct httpStub_s *hs, const char *body, size_t len)
+{
+    uint64_t now = bench_now_ns();
+    const char *p = body, *end = body + len;
+
+    pthread_mutex_lock(&stubMutex_G);
+    hs->requests++;
+    if((len < 2) || (body[0] != '[') || (body[len - 1] != ']')){
+        hs->notArrays++;
+    }
+    while((p = memmem(p, end - p, "\"t\":", 4)) != NULL){
+        uint64_t t = strtoull(p + 4, NULL, 10);
+
+        hs->payloads++;
+        if(hs->nLat < HTTP_STUB_MAX_LAT){
+            hs->latNs[hs->nLat++] = now - t;
+        }
+        p += 4;
+    }
+    pthread_mutex_unlock(&stubMutex_G);
+}
+
+/* The chunked answer has an extension, a trailer, and "0\r\n\r\n" inside
+ * its data, so only chunk sizes tell where it ends; it goes out in two
+ * writes split inside a size line */
+static int respond(struct httpStub_s *hs, int fd, int last)
+{
+    static const char ok[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok";
+    static const char okClose[] = "HTTP/1.1 200 OK\r\nContent-Length: 2\r\nConnection: close\r\n\r\nok";
+    static const char chunked[] = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+                                  "6;note=x\r\nx0\r\n\r\n\r\n"
+                                  "2\r\nok\r\n"
+                                  "0\r\nX-Trailer: 1\r\n\r\n";
+    static const char chunkedClose[] = "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n"
+                                       "Connection: close\r\n\r\n"
+                                       "2\r\nok\r\n0\r\n\r\n";
+    const char *r = ok;
+    int len = sizeof(ok) - 1, split;
+
+    if(hs->chunked){
+        r   = last ? chunkedClose : chunked;
+        len = last ? sizeof(chunkedClose) - 1 : sizeof(chunked) - 1;
+    }else if(last){
+        r   = okClose;
+        len = sizeof(okClose) - 1;
+    }
+    split = hs->chunked ? (int)(strstr(r, "2\r\nok") + 1 - r) : len;
+    if(write(fd, r, split) != split){
+        return -1;
+    }
+    if(split < len){
+        usleep(50);
+        if(write(fd, r + split, len - split) != len - split){
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void *stubConn_f(void *arg)
+{
+    struct stubConn *sc = arg;
+    struct httpStub_s *hs = sc->hs;
+    char *buf = malloc(STUB_BUF + 1);
+    int len = 0, served = 0;
+
+    while(1){
+        char *end, *cl;
+        long bodyLen;
+        int hdrLen, r, last;
+
+        buf[len] = '\0';
+        while((end = strstr(buf, "\r\n\r\n")) == NULL){
+            r = read(sc->fd, buf + len, STUB_BUF - len);
+            if(r <= 0){
+                goto out;
+            }
+            len += r;
+            buf[len] = '\0';
+        }
+        hdrLen  = end + 4 - buf;
+        cl      = strcasestr(buf, "content-length:");
+        bodyLen = cl ? strtol(cl + 15, NULL, 10) : 0;
+        while(len < hdrLen + bodyLen){
+            r = read(sc->fd, buf + len, STUB_BUF - len);
+            if(r <= 0){
+                goto out;
+            }
+            len += r;
+        }
+
+        if(hs->delayUs){
+            usleep(hs->delayUs);
+        }
+        recordBody(hs, buf + hdrLen, bodyLen);
+
+        served++;
+        last = hs->closeEvery && (served % hs->closeEvery == 0);
+        if((respond(hs, sc->fd, last) < 0) || last){
+            break;
+        }
+
+        len -= hdrLen + bodyLen;
+        memmove(buf, buf + hdrLen + bodyLen, len);
+    }
+
+out:
+    close(sc->fd);
+    free(buf);
+    free(sc);
+    return NULL;
+}
+
+static void *stubAccept_f(void *arg)
+{
+    struct httpStub_s *hs = arg;
+    pthread_t th;
+    int fd, one = 1;
+
+    while((fd = accept(hs->listenFd, NULL, NULL)) >= 0){
+        struct stubConn *sc = malloc(sizeof(struct stubConn));
+
+        sc->hs = hs;
+        sc->fd = fd;
+        // the split chunked answer mustn't wait on a delayed ack
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        pthread_mutex_lock(&stubMutex_G);
+        hs->connections++;
+        pthread_mutex_unlock(&stubMutex_G);
+        pthread_create(&th, NULL, stubConn_f, sc);
+        pthread_detach(th);
+    }
+    return NULL;
+}
+
+
+// listens on an ephemeral port of 127.0.0.1
+struct httpStub_s *httpStub_start(void)
+{
+    struct httpStub_s *hs = calloc(1, sizeof(struct httpStub_s));
+    struct sockaddr_in addr;
+    socklen_t alen = sizeof(addr);
+    pthread_t th;
+    int one = 1;
+
+    hs->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    setsockopt(hs->listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    BENCH_CHECK(bind(hs->listenFd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    BENCH_CHECK(listen(hs->listenFd, 64) == 0);
+    getsockname(hs->listenFd, (struct sockaddr *)&addr, &alen);
+    hs->port = ntohs(addr.sin_port);
+
+    pthread_create(&th, NULL, stubAccept_f, hs);
+    pthread_detach(th);
+    return hs;
+}
+
+void httpStub_reset(struct httpStub_s *hs)
+{
+    pthread_mutex_lock(&stubMutex_G);
+    hs->requests = hs->payloads = hs->connections = hs->notArrays = 0;
+    hs->nLat = 0;
+    pthread_mutex_unlock(&stubMutex_G);
+}
+
+uint64_t httpStub_payloads(struct httpStub_s *hs)
+{
+    uint64_t n;
+
+    pthread_mutex_lock(&stubMutex_G);
+    n = hs->payloads;
+    pthread_mutex_unlock(&stubMutex_G);
+    return n;
+}
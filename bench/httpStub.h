@@ -0,0 +1,38 @@
+/*
+ * httpStub.h
+ *
+ * Header for the stand-in HTTP server used by the upload benchmarks
+ *
+ */
+
+#ifndef __httpStub_h__
+#define __httpStub_h__
+
+#include <stdint.h>
+
+
+#define HTTP_STUB_MAX_LAT   100000
+
+typedef struct httpStub_s
+{
+    int port;
+    int listenFd;
+    volatile int delayUs;           // injected before every response
+    volatile int closeEvery;        // close the connection after n requests, 0: never
+    volatile int chunked;           // answer with a chunked body, extensions and trailer
+
+    // filled by the connection threads, under mutex
+    uint64_t requests;
+    uint64_t payloads;
+    uint64_t connections;
+    uint64_t notArrays;             // request bodies that aren't a JSON array
+    int      nLat;
+    uint64_t latNs[HTTP_STUB_MAX_LAT];
+}httpStub_t;
+
+
+struct httpStub_s *httpStub_start(void);
+void httpStub_reset(struct httpStub_s *hs);
+uint64_t httpStub_payloads(struct httpStub_s *hs);
+
+#endif
@@ -0,0 +1,669 @@
+/*
+ * rxSim.c
+ *
+ * Simulated LEA-6T on a pty for the end to end benchmarks (see rxSim.h)
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <termios.h>
+
+#include "gps.h"
+#include "ubx.h"
+#include "orbit.h"
+#include "predict.h"
+#include "benchUtil.h"
+#include "rxSim.h"
+
+
+#define PUT_FIELD(w, v, nb, pos)    ((w) |= ((uint32_t)(v) & ((1u << (nb)) - 1)) << (pos))
+
+// the NAV messages the program can turn on, navMask's bits
+static const uint8_t rxSimNav_G[4] = { UBX_NAV_POSLLH, UBX_NAV_SOL, UBX_NAV_VELNED, UBX_NAV_TIMEUTC };
+
+
+/* Subframe words of an SV, the inverse of gps_unpack_sf45_almanac() */
+static void packSf45(const struct gps_almanac_sv *alm, int svId, uint32_t *sf)
+{
+    memset(sf, 0, 8 * sizeof(uint32_t));
+    PUT_FIELD(sf[0], 1, 2, 22);
+    PUT_FIELD(sf[0], svId, 6, 16);
+    PUT_FIELD(sf[0], alm->e, 16, 0);
+    PUT_FIELD(sf[1], alm->t_oa, 8, 16);
+    PUT_FIELD(sf[1], alm->ksii, 16, 0);
+    PUT_FIELD(sf[2], alm->omega_dot, 16, 8);
+    PUT_FIELD(sf[2], alm->sv_health, 8, 0);
+    PUT_FIELD(sf[3], alm->a_powhalf, 24, 0);
+    PUT_FIELD(sf[4], alm->omega_0, 24, 0);
+    PUT_FIELD(sf[5], alm->w, 24, 0);
+    PUT_FIELD(sf[6], alm->m_0, 24, 0);
+    PUT_FIELD(sf[7], alm->a_f0 >> 3, 8, 16);
+    PUT_FIELD(sf[7], alm->a_f0, 3, 2);
+    PUT_FIELD(sf[7], alm->a_f1, 11, 5);
+}
+
+/* ... and of gps_unpack_sf123(), IODE in both subframes */
+static void packSf123(const struct gps_ephemeris_sv *eph, uint32_t *sf)
+{
+    uint32_t *sf1 = &sf[0], *sf2 = &sf[8], *sf3 = &sf[16];
+    int iode = eph->iodc & 0xff;
+
+    memset(sf, 0, 24 * sizeof(uint32_t));
+    PUT_FIELD(sf1[0], eph->week_no, 10, 14);
+    PUT_FIELD(sf1[0], eph->code_on_l2, 2, 12);
+    PUT_FIELD(sf1[0], eph->sv_ura, 4, 8);
+    PUT_FIELD(sf1[0], eph->sv_health, 6, 2);
+    PUT_FIELD(sf1[0], eph->iodc >> 8, 2, 0);
+    PUT_FIELD(sf1[1], eph->l2_p_flag, 1, 23);
+    PUT_FIELD(sf1[4], eph->t_gd, 8, 0);
+    PUT_FIELD(sf1[5], eph->iodc, 8, 16);
+    PUT_FIELD(sf1[5], eph->t_oc, 16, 0);
+    PUT_FIELD(sf1[6], eph->a_f2, 8, 16);
+    PUT_FIELD(sf1[6], eph->a_f1, 16, 0);
+    PUT_FIELD(sf1[7], eph->a_f0, 22, 2);
+
+    PUT_FIELD(sf2[0], iode, 8, 16);
+    PUT_FIELD(sf2[0], eph->c_rs, 16, 0);
+    PUT_FIELD(sf2[1], eph->delta_n, 16, 8);
+    PUT_FIELD(sf2[1], eph->m_0 >> 24, 8, 0);
+    PUT_FIELD(sf2[2], eph->m_0, 24, 0);
+    PUT_FIELD(sf2[3], eph->c_uc, 16, 8);
+    PUT_FIELD(sf2[3], eph->e >> 24, 8, 0);
+    PUT_FIELD(sf2[4], eph->e, 24, 0);
+    PUT_FIELD(sf2[5], eph->c_us, 16, 8);
+    PUT_FIELD(sf2[5], eph->a_powhalf >> 24, 8, 0);
+    PUT_FIELD(sf2[6], eph->a_powhalf, 24, 0);
+    PUT_FIELD(sf2[7], eph->t_oe, 16, 8);
+    PUT_FIELD(sf2[7], eph->fit_flag, 1, 7);
+    PUT_FIELD(sf2[7], eph->aodo, 5, 2);
+
+    PUT_FIELD(sf3[0], eph->c_ic, 16, 8);
+    PUT_FIELD(sf3[0], eph->omega_0 >> 24, 8, 0);
+    PUT_FIELD(sf3[1], eph->omega_0, 24, 0);
+    PUT_FIELD(sf3[2], eph->c_is, 16, 8);
+    PUT_FIELD(sf3[2], eph->i_0 >> 24, 8, 0);
+    PUT_FIELD(sf3[3], eph->i_0, 24, 0);
+    PUT_FIELD(sf3[4], eph->c_rc, 16, 8);
+    PUT_FIELD(sf3[4], eph->w >> 24, 8, 0);
+    PUT_FIELD(sf3[5], eph->w, 24, 0);
+    PUT_FIELD(sf3[6], eph->omega_dot, 24, 0);
+    PUT_FIELD(sf3[7], iode, 8, 16);
+    PUT_FIELD(sf3[7], eph->idot, 14, 2);
+}
+
+
+/* Answers */
+static void queue(struct rxSim_s *sim, const uint8_t *frame, int len)
+{
+    if(len < 0){
+        return;
+    }
+    if(sim->txLen + len > RX_SIM_TXBUF){
+        // the receiver's own buffer overflows, as it would
+        sim->txErrors |= (1 << RX_SIM_PORT) | 0x80;
+        sim->lost++;
+        return;
+    }
+    for(int i=0; i < len; i++){
+        uint8_t b = frame[i];
+
+        if((sim->noise > 0) && (bench_rand() < sim->noise * 4294967296.0)){
+            b ^= 1 << (bench_rand() & 7);
+            sim->corrupted++;
+        }
+        sim->tx[(sim->txHead + sim->txLen) % RX_SIM_TXQ] = b;
+        sim->txLen++;
+    }
+    if(sim->txLen > sim->txPeak){
+        sim->txPeak = sim->txLen;
+    }
+}
+
+// MON polls: the TX buffer as it is, the others the right size
+static void answerMon(struct rxSim_s *sim, int id)
+{
+    uint8_t frame[160];
+    int p = RX_SIM_PORT;
+
+    if(id == UBX_MON_TXBUF){
+        struct ubx_mon_txbuf m;
+
+        memset(&m, 0, sizeof(m));
+        m.pending[p]    = sim->txLen;
+        m.usage[p]      = sim->txLen * 100 / RX_SIM_TXBUF;
+        m.peak_usage[p] = sim->txPeak * 100 / RX_SIM_TXBUF;
+        m.t_usage       = m.usage[p];
+        m.t_peak_usage  = m.peak_usage[p];
+        m.errors        = sim->txErrors;
+        sim->txErrors   = 0;
+        queue(sim, frame, ubx_mon_txbuf_encode(frame, sizeof(frame), &m));
+    }else if(id == UBX_MON_RXBUF){
+        struct ubx_mon_rxbuf m;
+
+        memset(&m, 0, sizeof(m));
+        queue(sim, frame, ubx_mon_rxbuf_encode(frame, sizeof(frame), &m));
+    }else if(id == UBX_MON_IO){
+        struct ubx_mon_io m[6];
+
+        memset(m, 0, sizeof(m));
+        m[p].rx_bytes = sim->bytesIn;
+        m[p].tx_bytes = sim->bytesOut;
+        queue(sim, frame, ubx_mon_io_encode(frame, sizeof(frame), m, 6));
+    }else if(id == UBX_MON_MSGPP){
+        struct ubx_mon_msgpp m;
+
+        memset(&m, 0, sizeof(m));
+        queue(sim, frame, ubx_mon_msgpp_encode(frame, sizeof(frame), &m));
+    }
+}
+
+static void answerAlm(struct rxSim_s *sim, int sv)
+{
+    struct ubx_aid_alm m;
+    uint32_t words[8];
+    uint8_t frame[64];
+
+    m.sv_id    = sv;
+    m.gps_week = 2340;
+    packSf45(&sim->gps.almanac.svs[sv - 1], sv, words);
+    memcpy(m.alm_words, words, sizeof(words));
+    queue(sim, frame, ubx_aid_alm_encode(frame, sizeof(frame), &m));
+}
+
+static void answerEph(struct rxSim_s *sim, int sv)
+{
+    struct ubx_aid_eph m;
+    uint32_t words[24];
+    uint8_t frame[128];
+
+    if((sim->missMask & (1ULL << sv)) && (sim->asked[RX_SIM_EPH][sv] <= sim->missTimes)){
+        return;
+    }
+    m.sv_id   = sv;
+    m.present = 1;
+    packSf123(&sim->gps.ephemeris.svs[sv - 1], words);
+    memcpy(m.eph_words, words, sizeof(words));
+    queue(sim, frame, ubx_aid_eph_encode(frame, sizeof(frame), &m));
+}
+
+static void ask(struct rxSim_s *sim, int item, int sv)
+{
+    if(sim->asked[item][sv] < 0xffff){
+        sim->asked[item][sv]++;
+    }
+}
+
+static void command(struct rxSim_s *sim, const struct ubx_hdr *hdr, const uint8_t *pl)
+{
+    uint8_t frame[128];
+    int sv = (hdr->payload_len >= 1) ? pl[0] : -1;
+
+    sim->commands++;
+
+    if(hdr->msg_class == UBX_CLASS_CFG){
+        uint8_t ack[2] = { hdr->msg_class, hdr->msg_id };
+
+        if( (hdr->msg_id == UBX_CFG_MSG) && (hdr->payload_len == 3) &&
+            (pl[0] == UBX_CLASS_TIM) && (pl[1] == UBX_TIM_TP) ){
+            sim->tpRate = pl[2];
+            sim->tpNs   = bench_now_ns() + 1000000000ULL;
+        }
+        if( (hdr->msg_id == UBX_CFG_MSG) && (hdr->payload_len == 3) &&
+            (pl[0] == UBX_CLASS_RXM) && (pl[1] == UBX_RXM_RAW) ){
+            sim->rawRate = pl[2];
+            sim->rawNs   = bench_now_ns();
+        }
+        if( (hdr->msg_id == UBX_CFG_MSG) && (hdr->payload_len == 3) &&
+            (pl[0] == UBX_CLASS_NAV) && (pl[1] == UBX_NAV_SVINFO) ){
+            sim->svinfoRate = pl[2];
+            sim->svinfoNs   = bench_now_ns();
+        }
+        if( (hdr->msg_id == UBX_CFG_MSG) && (hdr->payload_len == 3) && (pl[0] == UBX_CLASS_NAV) ){
+            for(int i=0; i < 4; i++){
+                if(pl[1] == rxSimNav_G[i]){
+                    sim->navMask |= 1 << i;
+                    sim->navRate  = pl[2];
+                    sim->navNs    = bench_now_ns();
+                }
+            }
+        }
+        if( (hdr->msg_id == UBX_CFG_RATE) && ubx_cfg_rate_get(pl, hdr->payload_len) ){
+            sim->measMs = ubx_cfg_rate_get(pl, hdr->payload_len)->meas_rate;
+        }
+        queue(sim, frame, ubx_frame_encode(frame, sizeof(frame), 0x05, 0x01, ack, 2));
+        return;
+    }
+    if(hdr->payload_len > 1){
+        return;                     // not a poll
+    }
+    if((sv == 0) || (sv >= RX_SIM_N_SV)){
+        return;                     // GPS PRN 1..32 only
+    }
+
+    if(hdr->msg_class == UBX_CLASS_MON){
+        answerMon(sim, hdr->msg_id);
+    }else if((hdr->msg_class == UBX_CLASS_AID) && (hdr->msg_id == UBX_AID_HUI)){
+        struct ubx_aid_hui m;
+
+        memset(&m, 0, sizeof(m));
+        m.health  = 0xffffffff;
+        m.utc_a0  = 1e-9;
+        m.utc_ls  = 18;
+        m.utc_lsf = 18;
+        m.utc_dn  = 7;
+        m.flags   = 0x06;
+        ask(sim, RX_SIM_HUI, 0);
+        queue(sim, frame, ubx_aid_hui_encode(frame, sizeof(frame), &m));
+    }else if((hdr->msg_class == UBX_CLASS_AID) && (hdr->msg_id == UBX_AID_INI)){
+        struct ubx_aid_ini m;
+
+        memset(&m, 0, sizeof(m));
+        m.wn    = sim->gps.ref_time.wn;
+        m.tow   = (uint32_t)(sim->gps.ref_time.tow * 1e3);
+        m.flags = 0x03;
+        ask(sim, RX_SIM_INI, 0);
+        queue(sim, frame, ubx_aid_ini_encode(frame, sizeof(frame), &m));
+    }else if((hdr->msg_class == UBX_CLASS_NAV) && (hdr->msg_id == UBX_NAV_POSLLH)){
+        struct ubx_nav_posllh m;
+
+        memset(&m, 0, sizeof(m));
+        m.lat    = (int32_t)(sim->gps.ref_pos.latitude * 1e7);
+        m.lon    = (int32_t)(sim->gps.ref_pos.longitude * 1e7);
+        m.height = (int32_t)(sim->gps.ref_pos.altitude * 1e3);
+        m.hacc   = 2500;
+        ask(sim, RX_SIM_POSLLH, 0);
+        queue(sim, frame, ubx_nav_posllh_encode(frame, sizeof(frame), &m));
+    }else if((hdr->msg_class == UBX_CLASS_AID) && (hdr->msg_id == UBX_AID_ALM)){
+        // no SV: every one, numbered 1..32 as the receiver does
+        for(int s = (sv < 0) ? 1 : sv; s <= ((sv < 0) ? 32 : sv); s++){
+            ask(sim, RX_SIM_ALM, s);
+            answerAlm(sim, s);
+        }
+    }else if((hdr->msg_class == UBX_CLASS_AID) && (hdr->msg_id == UBX_AID_EPH)){
+        for(int s = (sv < 0) ? 1 : sv; s <= ((sv < 0) ? 32 : sv); s++){
+            ask(sim, RX_SIM_EPH, s);
+            answerEph(sim, s);
+        }
+    }
+}
+
+// frames whatever the program sent, as the receiver's parser would
+static void frameCommands(struct rxSim_s *sim)
+{
+    int i = 0;
+
+    while(sim->rxLen - i >= (int)sizeof(struct ubx_hdr) + 2){
+        const struct ubx_hdr *hdr = (const struct ubx_hdr *)(sim->rx + i);
+        int len;
+        uint8_t ck[2];
+
+        if((hdr->sync[0] != UBX_SYNC0) || (hdr->sync[1] != UBX_SYNC1)){
+            i++;
+            continue;
+        }
+        len = sizeof(struct ubx_hdr) + hdr->payload_len + 2;
+        if(len > RX_SIM_RXBUF){
+            i++;
+            continue;
+        }
+        if(sim->rxLen - i < len){
+            break;
+        }
+        ubx_checksum(sim->rx + i + 2, len - 4, ck);
+        if((ck[0] != sim->rx[i + len - 2]) || (ck[1] != sim->rx[i + len - 1])){
+            i++;
+            continue;
+        }
+        command(sim, hdr, sim->rx + i + sizeof(struct ubx_hdr));
+        i += len;
+    }
+    memmove(sim->rx, sim->rx + i, sim->rxLen - i);
+    sim->rxLen -= i;
+}
+
+
+// TIM-TP, shortly after the pulse it doesn't give
+static void timepulse(struct rxSim_s *sim)
+{
+    struct ubx_tim_tp m;
+    uint8_t frame[64];
+
+    if( (sim->tpRate == 0) || (bench_now_ns() < sim->tpNs) ){
+        return;
+    }
+    memset(&m, 0, sizeof(m));
+    m.week   = sim->gps.ref_time.wn;
+    m.tow_ms = (uint32_t)(sim->gps.ref_time.tow * 1e3) + (sim->pulses + 1) * 1000;
+    m.q_err  = (int32_t)(bench_rand() % 20000) - 10000;
+    m.flags  = 0x01;
+    queue(sim, frame, ubx_tim_tp_encode(frame, sizeof(frame), &m));
+    sim->pulses++;
+    sim->tpNs += 1000000000ULL * sim->tpRate;
+}
+
+// RXM-RAW of the first RX_SIM_RAW_SVS SVs, every rawRate measurements
+static void measurement(struct rxSim_s *sim)
+{
+    struct ubx_rxm_raw m;
+    struct ubx_rxm_raw_block b[RX_SIM_RAW_SVS];
+    uint8_t frame[8 + 8 + RX_SIM_RAW_SVS * 24];
+    uint64_t period = (uint64_t)sim->measMs * sim->rawRate * 1000000ULL;
+    double t;
+
+    if( (sim->rawRate == 0) || (bench_now_ns() < sim->rawNs) ){
+        return;
+    }
+    t = sim->rawEpochs * period / 1e9;
+    memset(&m, 0, sizeof(m));
+    m.week   = sim->gps.ref_time.wn;
+    m.itow   = (int32_t)(sim->gps.ref_time.tow * 1e3 + t * 1e3);
+    m.num_sv = RX_SIM_RAW_SVS;
+    for(int i=0; i < RX_SIM_RAW_SVS; i++){
+        b[i].sv     = i + 1;
+        b[i].do_mes = -2000.0f + 400.0f * i;
+        b[i].pr_mes = 2.1e7 + 1e5 * i - b[i].do_mes * 0.19 * t;
+        b[i].cp_mes = b[i].pr_mes / 0.19;
+        b[i].cno    = 35 + i;
+        b[i].mes_qi = 7;
+        b[i].lli    = 0;
+    }
+    queue(sim, frame, ubx_rxm_raw_encode(frame, sizeof(frame), &m, b));
+    sim->rawEpochs++;
+    sim->rawNs += period;
+}
+
+// the navigation messages of an epoch, every navRate measurements
+static void navigation(struct rxSim_s *sim)
+{
+    uint64_t period = (uint64_t)sim->measMs * sim->navRate * 1000000ULL;
+    uint32_t itow = (uint32_t)(sim->gps.ref_time.tow * 1e3) + sim->navEpochs * period / 1000000;
+    uint8_t frame[128];
+
+    if( (sim->navMask == 0) || (sim->navRate == 0) || (bench_now_ns() < sim->navNs) ){
+        return;
+    }
+    if(sim->navMask & 0x01){
+        struct ubx_nav_posllh m;
+
+        memset(&m, 0, sizeof(m));
+        m.itow   = itow;
+        m.lat    = (int32_t)(sim->gps.ref_pos.latitude * 1e7) + sim->navEpochs % 7;
+        m.lon    = (int32_t)(sim->gps.ref_pos.longitude * 1e7) - sim->navEpochs % 5;
+        m.height = (int32_t)(sim->gps.ref_pos.altitude * 1e3);
+        m.hmsl   = m.height - 40000;
+        m.hacc   = 2500;
+        m.vacc   = 4000;
+        queue(sim, frame, ubx_nav_posllh_encode(frame, sizeof(frame), &m));
+    }
+    if(sim->navMask & 0x02){
+        struct ubx_nav_sol m;
+
+        memset(&m, 0, sizeof(m));
+        m.itow    = itow;
+        m.week    = sim->gps.ref_time.wn;
+        m.gps_fix = 3;
+        m.flags   = 0x0d;
+        m.pdop    = 150;
+        m.num_sv  = 9;
+        queue(sim, frame, ubx_nav_sol_encode(frame, sizeof(frame), &m));
+    }
+    if(sim->navMask & 0x04){
+        struct ubx_nav_velned m;
+
+        memset(&m, 0, sizeof(m));
+        m.itow    = itow;
+        m.vel_n   = sim->navEpochs % 3 - 1;
+        m.sacc    = 20;
+        queue(sim, frame, ubx_nav_velned_encode(frame, sizeof(frame), &m));
+    }
+    if(sim->navMask & 0x08){
+        struct ubx_nav_timeutc m;
+
+        memset(&m, 0, sizeof(m));
+        m.itow  = itow;
+        m.year  = 2018;
+        m.month = 5;
+        m.day   = 1;
+        m.valid = 0x07;
+        queue(sim, frame, ubx_nav_timeutc_encode(frame, sizeof(frame), &m));
+    }
+    sim->navEpochs++;
+    sim->navNs += period;
+}
+
+// NAV-SVINFO of the SVs in trackMask, every svinfoRate measurements
+static void svInfo(struct rxSim_s *sim)
+{
+    struct ubx_nav_svinfo m;
+    struct ubx_nav_svinfo_block b[RX_SIM_CHANNELS];
+    uint8_t frame[8 + 8 + RX_SIM_CHANNELS * 12];
+    uint64_t period = (uint64_t)sim->measMs * sim->svinfoRate * 1000000ULL;
+
+    if( (sim->svinfoRate == 0) || (bench_now_ns() < sim->svinfoNs) ){
+        return;
+    }
+    memset(&m, 0, sizeof(m));
+    memset(b, 0, sizeof(b));
+    m.itow = (uint32_t)(sim->gps.ref_time.tow * 1e3) + sim->svinfoEpochs * period / 1000000;
+    for(int s=1; (s < RX_SIM_N_SV) && (m.num_ch < RX_SIM_CHANNELS); s++){
+        struct ubx_nav_svinfo_block *c = &b[m.num_ch];
+
+        if( !(sim->trackMask & (1ULL << s)) ){
+            continue;
+        }
+        c->chn     = m.num_ch;
+        c->svid    = s;
+        c->flags   = 0x0d;          // used, orbit, ephemeris
+        c->quality = 7;
+        c->cno     = 35 + s % 10;
+        c->elev    = 10 + (s * 7) % 70;
+        c->azim    = (s * 37) % 360;
+        m.num_ch++;
+    }
+    queue(sim, frame, ubx_nav_svinfo_encode(frame, sizeof(frame), &m, b));
+    sim->svinfoEpochs++;
+    sim->svinfoNs += period;
+}
+
+
+/* Line */
+
+// writes what the baud rate allows since the line was last free
+static void pace(struct rxSim_s *sim)
+{
+    uint64_t now = bench_now_ns();
+    uint64_t nsByte = 10000000000ULL / sim->baud;
+    int n, chunk;
+    ssize_t w;
+
+    if(sim->txLen == 0){
+        if(sim->lineFreeNs < now){
+            sim->lineFreeNs = now;
+        }
+        return;
+    }
+    if(sim->lineFreeNs > now){
+        return;
+    }
+    n = (now - sim->lineFreeNs) / nsByte + 1;
+    if(n > sim->txLen){
+        n = sim->txLen;
+    }
+    chunk = RX_SIM_TXQ - sim->txHead;
+    if(chunk > n){
+        chunk = n;
+    }
+    w = write(sim->fd, sim->tx + sim->txHead, chunk);
+    if(w <= 0){
+        return;
+    }
+    sim->txHead = (sim->txHead + w) % RX_SIM_TXQ;
+    sim->txLen -= w;
+    sim->bytesOut += w;
+    sim->lineFreeNs += w * nsByte;
+}
+
+/*
+ * Serves the program for ms milliseconds: reads and answers commands,
+ * puts the answers on the line as fast as the baud rate goes.
+ * Returns -1 if the line broke.
+ */
+int rxSim_run(struct rxSim_s *sim, int ms)
+{
+    uint64_t end = bench_now_ns() + ms * 1000000ULL;
+    struct pollfd pfd;
+    ssize_t n;
+
+    while(bench_now_ns() < end){
+        pfd.fd      = sim->fd;
+        pfd.events  = POLLIN;
+        pfd.revents = 0;
+        poll(&pfd, 1, 1);
+
+        if(pfd.revents & POLLIN){
+            n = read(sim->fd, sim->rx + sim->rxLen, RX_SIM_RXBUF - sim->rxLen);
+            if(n > 0){
+                sim->rxLen += n;
+                sim->bytesIn += n;
+                frameCommands(sim);
+                if(sim->rxLen == RX_SIM_RXBUF){
+                    sim->rxLen = 0;
+                }
+            }else if((n < 0) && (errno != EAGAIN) && (errno != EINTR)){
+                return -1;
+            }
+        }
+        timepulse(sim);
+        measurement(sim);
+        navigation(sim);
+        svInfo(sim);
+        pace(sim);
+    }
+    return 0;
+}
+
+
+/*
+ * bench_fill_assist()'s orbits are random bits: mostly unhealthy SVs that
+ * never rise, ephemerides the program rejects. These spread the SVs along
+ * the 6 planes of the real constellation, the ephemeris of each on the
+ * orbit of its almanac, so the program's visibility prediction has a sky
+ * to work with.
+ */
+static void constellation(struct gps_assist_data *gps)
+{
+    int t = (int)gps->ref_time.tow;
+
+    gps->almanac.wna = gps->ref_time.wn & 0xff;
+    for(int i=0; i < gps->almanac.n_sv; i++){
+        struct gps_almanac_sv *a = &gps->almanac.svs[i];
+        struct gps_ephemeris_sv *e = &gps->ephemeris.svs[i];
+
+        a->sv_health = 0;
+        a->e         = 0.01 * (1 << 21);
+        a->t_oa      = t >> 12;
+        a->ksii      = 0;                               // 0.3 semi-circles, 54 degrees
+        a->omega_dot = -8e-9 / GPS_PI * 0x1p38;
+        a->omega_0   = ((i % 6) / 3.0 - 1.0) * (1 << 23);
+        a->w         = 0;
+        a->m_0       = ((i * 0.618034 - (int)(i * 0.618034)) * 2.0 - 1.0) * ((1 << 23) - 1);
+
+        e->week_no   = gps->ref_time.wn & 0x3ff;
+        e->e         = (unsigned int)a->e << 12;
+        e->a_powhalf = (unsigned int)a->a_powhalf << 8;
+        e->t_oc      = e->t_oe = t >> 4;
+        e->i_0       = 0.3 * 0x1p31;
+        e->omega_0   = a->omega_0 * 256;
+        e->omega_dot = a->omega_dot * 32;
+        e->w         = 0;
+        e->m_0       = a->m_0 * 256;
+        e->delta_n   = 0;
+        e->idot      = 0;
+    }
+}
+
+/*
+ * The first n SVs the program will want ephemerides of: once it has the
+ * almanac it only polls, and only checks for, the ones predicted usable.
+ */
+static uint64_t wantedSvs(const struct gps_assist_data *gps, int n)
+{
+    static struct gps_assist_view view;
+    static struct predict_set ps;
+    int order[MAX_SV];
+    uint64_t mask = 0;
+    int k;
+
+    gps_view_init(&view);
+    gps_view_refresh(&view, gps);
+    if(predict_from_assist(gps, &view, &ps) < 0){
+        return 0;
+    }
+    k = predict_poll_order(&ps, order, MAX_SV, 1);
+    for(int i=0; (i < k) && (n > 0); i++){
+        if((order[i] >= 1) && (order[i] < RX_SIM_N_SV)){
+            mask |= 1ULL << order[i];
+            n--;
+        }
+    }
+    return mask;
+}
+
+int rxSim_open(struct rxSim_s *sim, int baud, double noise, int nMiss, int missTimes)
+{
+    struct termios tty;
+
+    memset(sim, 0, sizeof(struct rxSim_s));
+    sim->baud      = baud;
+    sim->noise     = noise;
+    sim->missTimes = missTimes;
+    sim->measMs    = 1000;             // the receiver's default
+    bench_fill_assist(&sim->gps, 32);
+    constellation(&sim->gps);
+    sim->missMask  = wantedSvs(&sim->gps, nMiss);
+    sim->trackMask = wantedSvs(&sim->gps, RX_SIM_CHANNELS);
+
+    sim->fd = posix_openpt(O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+    if((sim->fd < 0) || (grantpt(sim->fd) < 0) || (unlockpt(sim->fd) < 0) ||
+       (ptsname_r(sim->fd, sim->slaveName, sizeof(sim->slaveName)) != 0)){
+        return -1;
+    }
+    sim->slaveFd = open(sim->slaveName, O_RDWR | O_NOCTTY | O_CLOEXEC);
+    if(sim->slaveFd < 0){
+        return -1;
+    }
+    // raw from the start, the program sets its own attributes later
+    tcgetattr(sim->slaveFd, &tty);
+    cfmakeraw(&tty);
+    tcsetattr(sim->slaveFd, TCSANOW, &tty);
+    sim->lineFreeNs = bench_now_ns();
+
+    return 0;
+}
+
+void rxSim_close(struct rxSim_s *sim)
+{
+    close(sim->slaveFd);
+    close(sim->fd);
+}
+
+// polls asked again after the first one
+int rxSim_retries(const struct rxSim_s *sim)
+{
+    int n = 0;
+
+    for(int i=0; i < RX_SIM_N_ITEMS; i++){
+        for(int s=0; s < RX_SIM_N_SV; s++){
+            n += (sim->asked[i][s] > 1) ? sim->asked[i][s] - 1 : 0;
+        }
+    }
+    return n;
+}
@@ -0,0 +1,101 @@
+/*
+ * rxSim.h
+ *
+ * Header for the simulated LEA-6T used by the end to end benchmarks
+ *
+ * The receiver sits on the master side of a pty; the program under test
+ * opens the slave as its serial port. Commands are framed and answered
+ * the way the receiver does (AID-HUI / INI / ALM / EPH and NAV-POSLLH
+ * polls, an ACK for every CFG), from a synthetic assist data set of GPS
+ * PRN 1..32; a per SV poll of any other PRN goes unanswered. The
+ * answers go out paced at the configured baud rate (10 bits a byte),
+ * each byte corrupted with probability noise, and ephemeris polls of nMiss
+ * of the SVs the program wants go unanswered the first missTimes times
+ * they are asked. Answers wait in a TX buffer of RX_SIM_TXBUF bytes, as
+ * the receiver's does; one that doesn't fit is lost, and MON-TXBUF polls
+ * report its usage as the port UART1's (MON-IO / RXBUF / MSGPP get
+ * answers of the right size). Once a CFG-MSG turns TIM-TP on, one goes
+ * out every second in between the answers; RXM-RAW, of RX_SIM_RAW_SVS
+ * SVs, every measurement of CFG-RATE, and NAV-POSLLH / SOL / VELNED /
+ * TIMEUTC, those turned on, every navRate measurements. NAV-SVINFO puts
+ * the first RX_SIM_CHANNELS SVs the program predicts usable on channels,
+ * tracked with an ephemeris.
+ *
+ */
+
+#ifndef __rxSim_h__
+#define __rxSim_h__
+
+#include <stdint.h>
+
+#include "gps.h"
+
+
+#define RX_SIM_TXQ          (64 * 1024)
+#define RX_SIM_RXBUF        1024
+#define RX_SIM_TXBUF        4096        // the receiver's, RX_SIM_TXQ is only storage
+#define RX_SIM_PORT         1           // UART1 in the MON messages
+#define RX_SIM_RAW_SVS      10          // tracked, in an RXM-RAW
+#define RX_SIM_CHANNELS     12          // SVs in a NAV-SVINFO
+#define RX_SIM_N_SV         33          // PRN n at [n], 1..32
+
+// what a poll asks for, to count the times it is asked
+enum rxSimItem_e { RX_SIM_HUI, RX_SIM_INI, RX_SIM_POSLLH, RX_SIM_ALM, RX_SIM_EPH, RX_SIM_N_ITEMS };
+
+typedef struct rxSim_s
+{
+    int fd;                         // pty master
+    int slaveFd;                    // kept open, the master survives the program closing it
+    char slaveName[64];
+
+    // link and receiver behaviour
+    int baud;
+    double noise;
+    uint64_t missMask;              // bit n: PRN n
+    int missTimes;
+
+    struct gps_assist_data gps;
+
+    // command framing
+    uint8_t rx[RX_SIM_RXBUF];
+    int rxLen;
+
+    // answers waiting for the line
+    uint8_t tx[RX_SIM_TXQ];
+    int txHead;
+    int txLen;
+    uint64_t lineFreeNs;            // when the last byte written is through
+    int txPeak;
+    uint8_t txErrors;               // MON-TXBUF errors since the last one
+    int tpRate;                     // TIM-TP, per CFG-MSG
+    uint64_t tpNs;                  // when the next one is due
+    int pulses;
+    int rawRate;                    // RXM-RAW, per CFG-MSG
+    int measMs;                     // CFG-RATE
+    uint64_t rawNs;
+    int rawEpochs;
+    int navRate;                    // NAV-*, per CFG-MSG
+    uint8_t navMask;                // bit n: the n-th of rxSimNav_G
+    uint64_t navNs;
+    int navEpochs;
+    int svinfoRate;                 // NAV-SVINFO, per CFG-MSG
+    uint64_t trackMask;             // bit n: PRN n on a channel
+    uint64_t svinfoNs;
+    int svinfoEpochs;
+
+    // what went over the wire
+    uint64_t bytesIn;
+    uint64_t bytesOut;
+    uint64_t corrupted;
+    int lost;                       // answers that didn't fit the TX buffer
+    int commands;
+    uint16_t asked[RX_SIM_N_ITEMS][RX_SIM_N_SV];   // [0]: polls of no SV
+}rxSim_t;
+
+
+int rxSim_open(struct rxSim_s *sim, int baud, double noise, int nMiss, int missTimes);
+void rxSim_close(struct rxSim_s *sim);
+int rxSim_run(struct rxSim_s *sim, int ms);
+int rxSim_retries(const struct rxSim_s *sim);
+
+#endif
@@ -12,6 +12,70 @@
 /*   Socket Related Settings              */
 #define SOCK_PATH "/tmp/bbbrf.sock"
 
+/*   Shared Memory Related Settings       */
+#define SHM_PUB_NAME "/bbbrf.gps"
+
+
+/*   Upload Related Settings              */
+#define POST_SERVER_URL   ""      /* http://host[:port]/path, "" disables uploads */
+#define POST_QUEUE_SIZE   64      /* pending payloads, the oldest goes first when full */
+#define POST_BATCH_MAX    16      /* payloads coalesced into one request */
+#define POST_BATCH_BYTES  (256 * 1024)
+#define POST_WORKERS      2
+#define POST_POOL_SIZE    4       /* kept alive connections */
+#define POST_TIMEOUT_MS   5000
+
+
+/*   Metrics Related Settings             */
+#define METRICS_SOCK_PATH   "/tmp/bbbrf.metrics.sock"
+#define METRICS_FILE_PATH   "/tmp/bbbrf.prom"   /* "" disables the file */
+#define METRICS_FILE_PERIOD 10                  /* seconds */
+
+/*   Latency Trace Related Settings       */
+#define TRACE_FILE_PATH     "/tmp/bbbrf.trace.json" /* rewritten every control cycle, "" disables */
+
+
+/*   Receiver Monitor Related Settings    */
+#define RX_HEALTH_PORT       1      /* our port in the MON messages: 0 I2C, 1 UART1, 2 UART2, 3 USB, 4 SPI */
+#define RX_HEALTH_PERIOD     10     /* seconds between two MON-IO / RXBUF / MSGPP polls */
+#define RX_HEALTH_WINDOW     16     /* most polls out between two MON-TXBUF probes */
+#define RX_HEALTH_HIGH       50     /* % TX buffer usage that holds the polls back ... */
+#define RX_HEALTH_LOW        20     /* ... until it is down to this */
+#define RX_HEALTH_TIMEOUT_MS 3000   /* a probe unanswered this long is sent again */
+#define RX_HEALTH_HOLD_MS    200    /* between two probes while the polls are held */
+#define RX_HEALTH_GIVE_UP    3      /* probes unanswered in a row before no more throttling */
+
+
+/*   Poll Scheduler Related Settings      */
+#define TX_SCHED_BUDGET      3072   /* answer bytes on their way at most, under the receiver's TX buffer */
+#define TX_SCHED_SLACK_MS    300    /* on top of the wire time, before the answers are looked for */
+
+
+/*   Time Related Settings                */
+#define TIMING_SHM_UNIT      0      /* NTP SHM refclock unit (key 0x4e545030 + unit), -1 for none */
+#define TIMING_SHM_PRECISION -10    /* log2 seconds: a serial sample, ~1 ms */
+#define TIMING_LEAP_SECONDS  18     /* GPS - UTC until an AID-HUI tells */
+#define TIMING_SVIN_RATE     10     /* a TIM-SVIN every so many navigation solutions */
+
+
+/*   Raw Measurement Related Settings     */
+#define RAW_STORE_DIR        "/var/lib/bbbrf.raw"  /* RXM-RAW column files, a pair per GPS day; "" disables */
+#define RAW_KEEP_DAYS        14     /* GPS days of files kept, older ones deleted as the day rolls over; 0 keeps all */
+#define RAW_RATE_HZ          10     /* measurement rate at most ... */
+#define RAW_LINE_SHARE       50     /* ... and the % of the line's bytes RXM-RAW may take */
+#define RAW_QUEUE_FRAMES     256    /* serial_f to the writer, a power of two; ~25 s at 10 Hz */
+#define RAW_CHUNK_EPOCHS     600    /* epochs in a chunk of the file */
+#define RAW_FLUSH_S          10     /* a chunk is written after this long anyway */
+
+/*   Navigation Related Settings          */
+#define NAV_RATE_HZ          1      /* NAV-POSLLH / SOL / VELNED / TIMEUTC, at most the measurement rate */
+#define NAV_HIST_SIZE        16384  /* fixes kept in the shm region, a power of two; 4.5 h at 1 Hz */
+#define NAV_HIST_BUCKETS     120    /* most buckets a GET HIST answers with */
+#define NAV_SVINFO_S         10     /* NAV-SVINFO period, the SVs the ephemeris polls follow */
+#define SV_TRACK_MIN_QUALITY 4      /* NAV-SVINFO quality an SV counts as tracked from, code lock */
+#define SV_TRACK_MAX_AGE_S   30     /* older NAV-SVINFO: back to the visibility prediction */
+#define REF_POS_MAX_HACC_M   10000  /* NAV-POSLLH less accurate than this isn't a reference position */
+
 
 /*   Log Messages Related Settings        */
 #define DBG_LOG_MSG_PATH "/tmp/aidGps.log"
@@ -24,7 +88,18 @@
 
 /*              Misc                        */
 
-/*  incoming eph+alm+ini+hui+posllh ~= 4800 */
-#define SCRATCHPAD_BUF_SIZE  5000
+/*  state shared between threads keeps each writer's fields on its own line */
+#define CACHE_LINE_SIZE      64
+#define CACHE_ALIGNED        __attribute__((aligned(CACHE_LINE_SIZE)))
+
+/*  incoming eph+alm+ini+hui+posllh ~= 4800, and the MON answers of the
+    receiver monitor; the size of rbUartIn_p too (RINGBUFFER_SIZE) */
+#define SCRATCHPAD_BUF_SIZE  8192
+
+/*  reusable output buffer of jsonize(), 64 eph + 64 alm are ~35 KB */
+#define JSON_BUF_SIZE        (96 * 1024)
+
+/*  largest ubx frame handed to the parsers (hdr + payload + cksum) */
+#define UBX_MAX_FRAME_SIZE   1024
 
 #endif
@@ -28,6 +28,7 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include <time.h>
 
 
 #define MAX_SV	64
@@ -89,6 +90,7 @@ struct gps_almanac {
 	int wna;
 	int n_sv;
 	struct gps_almanac_sv svs[MAX_SV];
+	unsigned int gen[MAX_SV];	/* gps_assist_data.gen of the last change */
 };
 
 
@@ -140,6 +142,23 @@ struct gps_ephemeris_sv {
 struct gps_ephemeris {
 	int n_sv;
 	struct gps_ephemeris_sv svs[MAX_SV];
+	unsigned int gen[MAX_SV];	/* gps_assist_data.gen of the last change */
+};
+
+
+/* Reference position */
+struct gps_ref_pos {	/* WSG84 ellipsoid */
+	double latitude;	/* deg */
+	double longitude;	/* deg */
+	double altitude;	/* m above ellipsoid */
+};
+
+
+/* Reference time */
+struct gps_ref_time {
+	int wn;			/* GPS week number */
+	double tow;		/* in seconds */
+	time_t when;		/* Local time when ref_time was acquired */
 };
 
 
@@ -148,20 +167,40 @@ struct gps_ephemeris {
 #define GPS_FIELD_UTC		(1<<1)
 #define GPS_FIELD_ALMANAC	(1<<2)
 #define GPS_FIELD_EPHEMERIS	(1<<3)
+#define GPS_FIELD_REFPOS	(1<<4)
+#define GPS_FIELD_REFTIME	(1<<5)
 
 struct gps_assist_data {
 	int fields;
+	unsigned int gen;		/* bumped whenever the content changes */
+	unsigned int gen_ionosphere;	/* gen of the last change of each part */
+	unsigned int gen_utc;
 	struct gps_ionosphere_model	ionosphere;
 	struct gps_utc_model		utc;
 	struct gps_almanac		almanac;
 	struct gps_ephemeris		ephemeris;
+	struct gps_ref_pos		ref_pos;
+	struct gps_ref_time		ref_time;
 };
 
 
 /* GPS Subframe utility methods (see gps.c for details) */
+#define GPS_SF_WORDS	10
+
+/* Parity of 30 bit words. The LEA-6T checks and strips it from AID-EPH,
+ * AID-ALM and RXM-SFRB alike, so nothing this program reads carries it:
+ * these are for 30 bit sources only (RXM-SFRBX of later receivers, raw
+ * navigation bits), bench_parity checks them */
+int gps_parity_check_word(uint32_t word, uint32_t prev);
+int gps_parity_check_subframes(const uint32_t *words, int n_sf, uint16_t *fail);
+uint32_t gps_word_data(uint32_t word, uint32_t prev);
+
 int gps_unpack_sf123(uint32_t *sf, struct gps_ephemeris_sv *eph);
 int gps_unpack_sf45_almanac(uint32_t *sf, struct gps_almanac_sv *alm);
 
+int gps_check_ephemeris(const struct gps_ephemeris_sv *eph);
+int gps_check_almanac(const struct gps_almanac_sv *alm);
+
 
 #ifdef __cplusplus
 }
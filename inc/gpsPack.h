@@ -0,0 +1,233 @@
+/*
+ * gpsPack.h
+ *
+ * Header for the bit packed in-memory representation of the GPS assist data
+ *
+ * Every field of an ionosphere, UTC, almanac or ephemeris record keeps
+ * only its broadcast width (see gps.h), records being runs of 32 bit
+ * words. The widths are given once, in the GPS_PACK_*_FIELDS tables
+ * below; the record layouts, the inline accessors and the conversions
+ * from and to the plain structs are all generated from them.
+ *
+ *   struct gps_pack (header, fixed size)
+ *     gens, fields, counts, wna, packed iono and utc, ref_pos, ref_time
+ *   w[], variable size
+ *     n_alm almanac records, n_eph ephemeris records,
+ *     n_alm + n_eph u32 gens (gps_almanac.gen / gps_ephemeris.gen)
+ *
+ * A full set of 64 SVs takes ~6.6 KB instead of ~12 KB, 32 SVs ~3.4 KB.
+ * The representation is lossless: gps_unpack(gps_pack(x)) == x for any x
+ * whose fields are within their broadcast widths (gps_pack() refuses the
+ * others). It is an in-memory format, native endian, not meant for the
+ * wire (see gpsWire.h for that).
+ *
+ */
+
+#ifndef __GPS_PACK_H__
+#define __GPS_PACK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "gps.h"
+
+
+/* Field tables: X(name, bits, is_signed), in record order */
+#define GPS_PACK_IONO_FIELDS(X) \
+    X(alpha_0,      8, 1)   X(alpha_1,      8, 1) \
+    X(alpha_2,      8, 1)   X(alpha_3,      8, 1) \
+    X(beta_0,       8, 1)   X(beta_1,       8, 1) \
+    X(beta_2,       8, 1)   X(beta_3,       8, 1)
+
+#define GPS_PACK_UTC_FIELDS(X) \
+    X(a0,          32, 1)   X(a1,          24, 1) \
+    X(delta_t_ls,   8, 1)   X(t_ot,         8, 0) \
+    X(wn_t,         8, 0)   X(wn_lsf,       8, 0) \
+    X(dn,           8, 0)   X(delta_t_lsf,  8, 1)
+
+#define GPS_PACK_ALM_FIELDS(X) \
+    X(sv_id,        7, 0)   X(sv_health,    8, 0) \
+    X(e,           16, 0)   X(t_oa,         8, 0) \
+    X(ksii,        16, 1)   X(omega_dot,   16, 1) \
+    X(a_powhalf,   24, 0)   X(omega_0,     24, 1) \
+    X(w,           24, 1)   X(m_0,         24, 1) \
+    X(a_f0,        11, 1)   X(a_f1,        11, 1)
+
+#define GPS_PACK_EPH_FIELDS(X) \
+    X(sv_id,        7, 0)   X(code_on_l2,   2, 0) \
+    X(week_no,     10, 0)   X(l2_p_flag,    1, 0) \
+    X(sv_ura,       4, 0)   X(sv_health,    6, 0) \
+    X(t_gd,         8, 1)   X(iodc,        10, 0) \
+    X(t_oc,        16, 0)   X(a_f2,         8, 1) \
+    X(a_f1,        16, 1)   X(a_f0,        22, 1) \
+    X(c_rs,        16, 1)   X(delta_n,     16, 1) \
+    X(m_0,         32, 1)   X(c_uc,        16, 1) \
+    X(e,           32, 0)   X(c_us,        16, 1) \
+    X(a_powhalf,   32, 0)   X(t_oe,        16, 0) \
+    X(fit_flag,     1, 0)   X(c_ic,        16, 1) \
+    X(omega_0,     32, 1)   X(c_is,        16, 1) \
+    X(i_0,         32, 1)   X(c_rc,        16, 1) \
+    X(w,           32, 1)   X(omega_dot,   24, 1) \
+    X(idot,        14, 1)   X(_rsvd1,      23, 0) \
+    X(_rsvd2,      24, 0)   X(_rsvd3,      24, 0) \
+    X(_rsvd4,      16, 0)   X(aodo,         5, 0)
+
+
+/*
+ * Record layouts: one char per bit, so that offsetof() gives the bit
+ * offset of a field and sizeof() the bits of a record. Never instantiated.
+ */
+#define _GPS_PACK_LAYOUT(name, bits, sgn)   char name[bits];
+
+struct gps_pack_iono_layout { GPS_PACK_IONO_FIELDS(_GPS_PACK_LAYOUT) };
+struct gps_pack_utc_layout  { GPS_PACK_UTC_FIELDS(_GPS_PACK_LAYOUT)  };
+struct gps_pack_alm_layout  { GPS_PACK_ALM_FIELDS(_GPS_PACK_LAYOUT)  };
+struct gps_pack_eph_layout  { GPS_PACK_EPH_FIELDS(_GPS_PACK_LAYOUT)  };
+
+#define GPS_PACK_WORDS(layout)      ((sizeof(struct layout) + 31) / 32)
+
+#define GPS_PACK_IONO_WORDS GPS_PACK_WORDS(gps_pack_iono_layout)
+#define GPS_PACK_UTC_WORDS  GPS_PACK_WORDS(gps_pack_utc_layout)
+#define GPS_PACK_ALM_WORDS  GPS_PACK_WORDS(gps_pack_alm_layout)
+#define GPS_PACK_EPH_WORDS  GPS_PACK_WORDS(gps_pack_eph_layout)
+
+struct gps_pack_iono { uint32_t w[GPS_PACK_IONO_WORDS]; };
+struct gps_pack_utc  { uint32_t w[GPS_PACK_UTC_WORDS];  };
+struct gps_pack_alm  { uint32_t w[GPS_PACK_ALM_WORDS];  };
+struct gps_pack_eph  { uint32_t w[GPS_PACK_EPH_WORDS];  };
+
+
+struct gps_pack {
+    uint32_t size;                  /* bytes, w[] included */
+    uint32_t gen;
+    uint32_t gen_ionosphere;
+    uint32_t gen_utc;
+    uint8_t  fields;
+    uint8_t  n_alm;
+    uint8_t  n_eph;
+    uint8_t  wna;
+    struct gps_pack_iono ionosphere;
+    struct gps_pack_utc  utc;
+    struct gps_ref_pos   ref_pos;
+    struct gps_ref_time  ref_time;
+    uint32_t w[];
+};
+
+#define GPS_PACK_SIZE(n_alm, n_eph) \
+    (sizeof(struct gps_pack) + 4 * ((n_alm) * (GPS_PACK_ALM_WORDS + 1) + \
+                                    (n_eph) * (GPS_PACK_EPH_WORDS + 1)))
+#define GPS_PACK_MAX_SIZE   GPS_PACK_SIZE(MAX_SV, MAX_SV)
+
+
+/*
+ * Bit access, LSB first within 32 bit words. With off and bits constant
+ * (as in the generated accessors) this folds to a load or two and shifts.
+ */
+static inline uint32_t _gps_pack_get(const uint32_t *w, unsigned off, unsigned bits, int sgn)
+{
+    const uint32_t *p = w + (off >> 5);
+    unsigned sh = off & 31;
+    uint64_t v = p[0] >> sh;
+    uint32_t m = (uint32_t)((1ULL << bits) - 1);
+
+    if(sh + bits > 32){
+        v |= (uint64_t)p[1] << (32 - sh);
+    }
+    if(sgn){
+        uint32_t s = 1u << (bits - 1);
+        return (((uint32_t)v & m) ^ s) - s;
+    }
+    return (uint32_t)v & m;
+}
+
+static inline void _gps_pack_set(uint32_t *w, unsigned off, unsigned bits, uint32_t v)
+{
+    uint32_t *p = w + (off >> 5);
+    unsigned sh = off & 31;
+    uint64_t m = ((1ULL << bits) - 1) << sh;
+    uint64_t x = (uint64_t)v << sh;
+
+    p[0] = (p[0] & ~(uint32_t)m) | ((uint32_t)x & (uint32_t)m);
+    if(sh + bits > 32){
+        p[1] = (p[1] & ~(uint32_t)(m >> 32)) | ((uint32_t)(x >> 32) & (uint32_t)(m >> 32));
+    }
+}
+
+
+/*
+ * Generated accessors, e.g.
+ *   int32_t  gps_pack_eph_m_0(const struct gps_pack_eph *r);
+ *   void     gps_pack_eph_set_m_0(struct gps_pack_eph *r, int32_t v);
+ *   uint32_t gps_pack_alm_e(const struct gps_pack_alm *r);
+ */
+#define _GPS_PACK_T0    uint32_t
+#define _GPS_PACK_T1    int32_t
+
+#define _GPS_PACK_ACCESSORS(rec, name, bits, sgn)                                   \
+static inline _GPS_PACK_T##sgn gps_pack_##rec##_##name(const struct gps_pack_##rec *r) \
+{                                                                                   \
+    return (_GPS_PACK_T##sgn)_gps_pack_get(r->w,                                    \
+            offsetof(struct gps_pack_##rec##_layout, name), bits, sgn);             \
+}                                                                                   \
+static inline void gps_pack_##rec##_set_##name(struct gps_pack_##rec *r, _GPS_PACK_T##sgn v) \
+{                                                                                   \
+    _gps_pack_set(r->w, offsetof(struct gps_pack_##rec##_layout, name), bits, (uint32_t)v); \
+}
+
+#define _GPS_PACK_IONO_ACC(n, b, s) _GPS_PACK_ACCESSORS(iono, n, b, s)
+#define _GPS_PACK_UTC_ACC(n, b, s)  _GPS_PACK_ACCESSORS(utc, n, b, s)
+#define _GPS_PACK_ALM_ACC(n, b, s)  _GPS_PACK_ACCESSORS(alm, n, b, s)
+#define _GPS_PACK_EPH_ACC(n, b, s)  _GPS_PACK_ACCESSORS(eph, n, b, s)
+
+GPS_PACK_IONO_FIELDS(_GPS_PACK_IONO_ACC)
+GPS_PACK_UTC_FIELDS(_GPS_PACK_UTC_ACC)
+GPS_PACK_ALM_FIELDS(_GPS_PACK_ALM_ACC)
+GPS_PACK_EPH_FIELDS(_GPS_PACK_EPH_ACC)
+
+
+/* Records of a packed set */
+static inline struct gps_pack_alm *gps_pack_alm_sv(const struct gps_pack *p, int i)
+{
+    return (struct gps_pack_alm *)(p->w + i * GPS_PACK_ALM_WORDS);
+}
+
+static inline struct gps_pack_eph *gps_pack_eph_sv(const struct gps_pack *p, int i)
+{
+    return (struct gps_pack_eph *)(p->w + p->n_alm * GPS_PACK_ALM_WORDS + i * GPS_PACK_EPH_WORDS);
+}
+
+static inline uint32_t *gps_pack_alm_gens(const struct gps_pack *p)
+{
+    return (uint32_t *)(p->w + p->n_alm * GPS_PACK_ALM_WORDS + p->n_eph * GPS_PACK_EPH_WORDS);
+}
+
+static inline uint32_t *gps_pack_eph_gens(const struct gps_pack *p)
+{
+    return gps_pack_alm_gens(p) + p->n_alm;
+}
+
+
+/* Methods */
+int gps_pack_iono_from(struct gps_pack_iono *r, const struct gps_ionosphere_model *s);
+void gps_pack_iono_to(struct gps_ionosphere_model *s, const struct gps_pack_iono *r);
+int gps_pack_utc_from(struct gps_pack_utc *r, const struct gps_utc_model *s);
+void gps_pack_utc_to(struct gps_utc_model *s, const struct gps_pack_utc *r);
+int gps_pack_alm_from(struct gps_pack_alm *r, const struct gps_almanac_sv *s);
+void gps_pack_alm_to(struct gps_almanac_sv *s, const struct gps_pack_alm *r);
+int gps_pack_eph_from(struct gps_pack_eph *r, const struct gps_ephemeris_sv *s);
+void gps_pack_eph_to(struct gps_ephemeris_sv *s, const struct gps_pack_eph *r);
+
+size_t gps_pack_size(const struct gps_assist_data *gps);
+int gps_pack(struct gps_pack *p, size_t size, const struct gps_assist_data *gps);
+int gps_unpack(struct gps_assist_data *gps, const struct gps_pack *p);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GPS_PACK_H__ */
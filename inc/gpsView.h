@@ -0,0 +1,144 @@
+/*
+ * gpsView.h
+ *
+ * Header for the engineering units view of the GPS assist data
+ *
+ * struct gps_assist_data keeps the broadcast integers. The view holds the
+ * same data as doubles in seconds, metres and radians (the Klobuchar
+ * coefficients stay per semi-circle, as the model is defined that way),
+ * refreshed per SV from the generation counters of the store.
+ *
+ * Every field is described once below with the scale of its LSB and a
+ * unit factor; those tables generate the view structs and the conversions
+ * in both directions, so there is no 2^-n to get wrong anywhere else.
+ *
+ */
+
+#ifndef __GPS_VIEW_H__
+#define __GPS_VIEW_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gps.h"
+#include "orbit.h"
+
+
+/*  X(field, LSB scale, unit factor)  ->  value = raw * scale * unit */
+
+#define GPS_IONO_FIELDS(X)                      \
+    X(alpha_0,      0x1p-30,    1.0)            \
+    X(alpha_1,      0x1p-27,    1.0)            \
+    X(alpha_2,      0x1p-24,    1.0)            \
+    X(alpha_3,      0x1p-24,    1.0)            \
+    X(beta_0,       0x1p11,     1.0)            \
+    X(beta_1,       0x1p14,     1.0)            \
+    X(beta_2,       0x1p16,     1.0)            \
+    X(beta_3,       0x1p16,     1.0)
+
+#define GPS_UTC_FIELDS(X)                       \
+    X(a0,           0x1p-30,    1.0)            \
+    X(a1,           0x1p-50,    1.0)            \
+    X(delta_t_ls,   1.0,        1.0)            \
+    X(t_ot,         0x1p12,     1.0)            \
+    X(wn_t,         1.0,        1.0)            \
+    X(wn_lsf,       1.0,        1.0)            \
+    X(dn,           1.0,        1.0)            \
+    X(delta_t_lsf,  1.0,        1.0)
+
+#define GPS_ALM_FIELDS(X)                       \
+    X(e,            0x1p-21,    1.0)            \
+    X(t_oa,         0x1p12,     1.0)            \
+    X(ksii,         0x1p-19,    GPS_PI)         \
+    X(omega_dot,    0x1p-38,    GPS_PI)         \
+    X(a_powhalf,    0x1p-11,    1.0)            \
+    X(omega_0,      0x1p-23,    GPS_PI)         \
+    X(w,            0x1p-23,    GPS_PI)         \
+    X(m_0,          0x1p-23,    GPS_PI)         \
+    X(a_f0,         0x1p-20,    1.0)            \
+    X(a_f1,         0x1p-38,    1.0)
+
+#define GPS_EPH_FIELDS(X)                       \
+    X(week_no,      1.0,        1.0)            \
+    X(t_gd,         0x1p-31,    1.0)            \
+    X(t_oc,         0x1p4,      1.0)            \
+    X(a_f2,         0x1p-55,    1.0)            \
+    X(a_f1,         0x1p-43,    1.0)            \
+    X(a_f0,         0x1p-31,    1.0)            \
+    X(c_rs,         0x1p-5,     1.0)            \
+    X(delta_n,      0x1p-43,    GPS_PI)         \
+    X(m_0,          0x1p-31,    GPS_PI)         \
+    X(c_uc,         0x1p-29,    1.0)            \
+    X(e,            0x1p-33,    1.0)            \
+    X(c_us,         0x1p-29,    1.0)            \
+    X(a_powhalf,    0x1p-19,    1.0)            \
+    X(t_oe,         0x1p4,      1.0)            \
+    X(c_ic,         0x1p-29,    1.0)            \
+    X(omega_0,      0x1p-31,    GPS_PI)         \
+    X(c_is,         0x1p-29,    1.0)            \
+    X(i_0,          0x1p-31,    GPS_PI)         \
+    X(c_rc,         0x1p-5,     1.0)            \
+    X(w,            0x1p-31,    GPS_PI)         \
+    X(omega_dot,    0x1p-43,    GPS_PI)         \
+    X(idot,         0x1p-43,    GPS_PI)
+
+
+#define GPS_VIEW_MEMBER(f, lsb, unit)   double f;
+#define GPS_VIEW_ALIGN                  __attribute__((aligned(64)))
+
+struct gps_iono_view {
+    GPS_IONO_FIELDS(GPS_VIEW_MEMBER)
+};
+
+struct gps_utc_view {
+    GPS_UTC_FIELDS(GPS_VIEW_MEMBER)
+};
+
+struct gps_alm_view_sv {
+    int sv_id;
+    int sv_health;
+    GPS_ALM_FIELDS(GPS_VIEW_MEMBER)
+} GPS_VIEW_ALIGN;
+
+struct gps_eph_view_sv {
+    int sv_id;
+    int sv_health;
+    int iodc;
+    GPS_EPH_FIELDS(GPS_VIEW_MEMBER)
+} GPS_VIEW_ALIGN;
+
+struct gps_assist_view {
+    unsigned int gen;               /* store generation reflected       */
+    unsigned int gen_ionosphere;
+    unsigned int gen_utc;
+    struct gps_iono_view iono;
+    struct gps_utc_view  utc;
+
+    int n_alm;
+    unsigned int alm_gen[MAX_SV];
+    struct gps_alm_view_sv alm[MAX_SV];
+
+    int n_eph;
+    unsigned int eph_gen[MAX_SV];
+    struct gps_eph_view_sv eph[MAX_SV];
+};
+
+
+/* Methods */
+void gps_view_init(struct gps_assist_view *v);
+int  gps_view_refresh(struct gps_assist_view *v, const struct gps_assist_data *gps);
+
+void gps_iono_from_raw(struct gps_iono_view *v, const struct gps_ionosphere_model *raw);
+void gps_iono_to_raw(struct gps_ionosphere_model *raw, const struct gps_iono_view *v);
+void gps_utc_from_raw(struct gps_utc_view *v, const struct gps_utc_model *raw);
+void gps_utc_to_raw(struct gps_utc_model *raw, const struct gps_utc_view *v);
+void gps_alm_from_raw(struct gps_alm_view_sv *v, const struct gps_almanac_sv *raw);
+void gps_eph_from_raw(struct gps_eph_view_sv *v, const struct gps_ephemeris_sv *raw);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GPS_VIEW_H__ */
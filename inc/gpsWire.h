@@ -0,0 +1,90 @@
+/*
+ * gpsWire.h
+ *
+ * Header for the compact binary wire format of the GPS assist data
+ *
+ * Little endian, byte aligned, fixed width records. Every field gets the
+ * bytes its broadcast width needs (see gps.h), nothing more.
+ *
+ *   header (24 bytes)
+ *     u32  magic      "GPAD"
+ *     u8   version    GPS_WIRE_VERSION
+ *     u8   sections   GPS_FIELD_* bits of the sections that follow
+ *     u16  flags      GPS_WIRE_DELTA
+ *     u32  gen        generation of the encoded data
+ *     u32  base_gen   generation a delta applies to, 0 for a full set
+ *     u32  fields     gps_assist_data.fields
+ *     u32  length     total length, header included
+ *
+ *   sections, in this order, each only if its bit is set in 'sections'
+ *     ionosphere   8 bytes
+ *     utc         13 bytes
+ *     almanac      u8 wna, u64 sv presence bitmap, 24 bytes per SV
+ *     ephemeris    u64 sv presence bitmap, 64 bytes per SV
+ *     ref_pos      s32 lat (1e-7 deg), s32 lon (1e-7 deg), s32 alt (mm)
+ *     ref_time     u16 wn, u32 tow (ms), s64 when
+ *
+ * Almanac and ephemeris records are ordered by sv_id, bit n of the
+ * presence bitmap standing for sv_id n. The layout of each record is the
+ * field table of the version (gps_wire_schema()).
+ *
+ * A delta against a base generation carries only the sections and SVs
+ * that differ from the base; it can only be applied on top of that base.
+ * SVs are never removed by a delta. The reserved bits of subframe 1
+ * (_rsvd1.._rsvd4) are not carried.
+ *
+ */
+
+#ifndef __GPS_WIRE_H__
+#define __GPS_WIRE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "gps.h"
+
+
+#define GPS_WIRE_MAGIC      0x44415047      /* "GPAD" */
+#define GPS_WIRE_VERSION    1
+#define GPS_WIRE_HDR_LEN    24
+
+#define GPS_WIRE_DELTA      (1<<0)
+
+/* worst case size of a full set */
+#define GPS_WIRE_MAX_LEN    (GPS_WIRE_HDR_LEN + 8 + 13 + 9 + 24 * MAX_SV + 8 + 64 * MAX_SV + 12 + 14)
+
+#define GPS_WIRE_EBASE      -2              /* delta doesn't apply to this base */
+
+
+/* One field of a record: where it lives in the struct, how it is sent */
+struct gps_wire_field {
+    const char *name;
+    uint16_t    offset;
+    uint8_t     bytes;
+    uint8_t     is_signed;
+};
+
+enum gps_wire_record {
+    GPS_WIRE_REC_IONO = 0,
+    GPS_WIRE_REC_UTC,
+    GPS_WIRE_REC_ALM,
+    GPS_WIRE_REC_EPH,
+    GPS_WIRE_NREC,
+};
+
+
+/* Methods */
+int gps_wire_encode(uint8_t *buf, int size, const struct gps_assist_data *gps,
+                    const struct gps_assist_data *base);
+int gps_wire_decode(struct gps_assist_data *gps, const uint8_t *buf, int len);
+const struct gps_wire_field *gps_wire_schema(enum gps_wire_record rec, int *n_fields);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GPS_WIRE_H__ */
@@ -3,6 +3,10 @@
  *
  * Header to deal with jsonizing of data
  *
+ * The serializers append to a caller supplied buffer and never allocate.
+ * Field keys come from the field tables of gpsView.h, numbers are
+ * formatted with digit pair lookups.
+ *
  */
 
 #ifndef __JSON_H__
@@ -12,6 +16,39 @@
 extern "C" {
 #endif
 
+#include <stddef.h>
+
+#include "gps.h"
+#include "ubx.h"
+
+
+struct json_buf {
+    char   *buf;
+    size_t  size;
+    size_t  len;
+    int     overflow;       /* set once something didn't fit */
+};
+
+
+void json_buf_init(struct json_buf *jb, char *buf, size_t size);
+void json_buf_reset(struct json_buf *jb);
+const char *json_buf_str(struct json_buf *jb);
+
+int json_assist_data(struct json_buf *jb, const struct gps_assist_data *gps);
+int json_almanac_sv(struct json_buf *jb, const struct gps_almanac_sv *alm);
+int json_ephemeris_sv(struct json_buf *jb, const struct gps_ephemeris_sv *eph);
+int json_nav_posllh(struct json_buf *jb, const struct ubx_nav_posllh *fix);
+int json_ubx_frame(struct json_buf *jb, const void *frame, int len);
+
+/* low level appenders, for other serializers */
+void json_put_raw(struct json_buf *jb, const char *s, size_t n);
+void json_put_int(struct json_buf *jb, long long v);
+void json_put_fixed(struct json_buf *jb, long long v, int decimals);
+void json_put_double(struct json_buf *jb, double d, int decimals);
+void json_put_real(struct json_buf *jb, double d, int digits);
+
+#define json_put_lit(jb, s)    json_put_raw((jb), (s), sizeof(s) - 1)
+
 
 char *jsonize(void *ptr);
 
@@ -21,4 +58,3 @@ char *jsonize(void *ptr);
 #endif
 
 #endif /* __JSON_H__ */
-
@@ -3,16 +3,17 @@
 
 #include <pthread.h>
 
-/* linked list struct. Has a head pointer */
-#pragma pack(1)
+#include "config.h"
+
+/* linked list struct. Has a head pointer. Filled by one thread, drained by
+ * another: it sits on its own cache line, size can be read without the lock */
 typedef struct llist
 {
+  pthread_mutex_t mutex;
   struct lnode *head;
   unsigned int size;
-  pthread_mutex_t mutex;
 
-}list;
-#pragma pack()
+} CACHE_ALIGNED list;
 
 /* Function pointer types to be passed to linked list library functions  */
 typedef void (*list_op)(void *);
@@ -0,0 +1,170 @@
+/*
+ * metrics.h
+ *
+ * Header for the metrics registry and its exporter
+ *
+ * Every metric is declared once in the lists below. Counters and
+ * histograms are kept per thread: a thread gets a slot of its own, on its
+ * own cache lines, the first time it counts something, and from then on
+ * only plain (relaxed atomic) loads and stores of its slot, no lock and no
+ * read-modify-write. The exporter sums the slots when it renders.
+ * Histograms have log2 buckets: a value v lands in bucket ceil(log2 v),
+ * the values above 2^(b-1) up to 2^b, exported as le="2^b".
+ * Gauges are single values, set by whoever owns them.
+ *
+ * metricsServer_f() renders the registry in the Prometheus text
+ * exposition format to every client connecting to METRICS_SOCK_PATH
+ * (plain text, or an HTTP/1.0 answer if the client sent a GET) and
+ * rewrites METRICS_FILE_PATH every METRICS_FILE_PERIOD seconds, for the
+ * node exporter's textfile collector.
+ *
+ */
+
+#ifndef __metrics_h__
+#define __metrics_h__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "config.h"
+
+
+#define METRICS_PREFIX          "bbbrf_"
+#define METRICS_MAX_THREADS     16      // more share one slot, atomically
+#define METRICS_HIST_BUCKETS    64
+#define METRICS_TEXT_SIZE       16384
+
+
+/*
+ * Metric lists
+ *   X(ID, name, labels, help)
+ *   X(ID, name, labels, help, scale, lo, hi)    histograms: the value times
+ *                                               scale is in the base unit,
+ *                                               buckets lo..hi are exported
+ * Entries sharing a name are one family and must follow each other.
+ */
+#define METRICS_COUNTERS(X) \
+    X(UART_RX_BYTES,        "uart_rx_bytes_total",          "",                     \
+      "Bytes read from the receiver")                                               \
+    X(UART_TX_BYTES,        "uart_tx_bytes_total",          "",                     \
+      "Bytes of commands written to the receiver")                                  \
+    X(UBX_FRAMES,           "ubx_frames_total",             "",                     \
+      "UBX frames with a valid checksum")                                           \
+    X(UBX_CKSUM_ERRORS,     "ubx_checksum_errors_total",    "",                     \
+      "UBX frames dropped for a bad checksum")                                      \
+    X(RB_UART_IN_DROPPED,   "ringbuffer_dropped_bytes_total", "{buffer=\"uart_in\"}", \
+      "Bytes dropped because a ring buffer was full")                               \
+    X(RB_UBX_MSG_DROPPED,   "ringbuffer_dropped_bytes_total", "{buffer=\"ubx_msg\"}", \
+      "Bytes dropped because a ring buffer was full")                               \
+    X(POLL_THROTTLED,       "poll_throttled_total",         "",                     \
+      "Times the polls were held back for the receiver's TX buffer")                \
+    X(REFCLOCK_SAMPLES,     "refclock_samples_total",       "",                     \
+      "Samples stored in the NTP SHM refclock")                                     \
+    X(RAW_EPOCHS,           "rxm_raw_epochs_total",         "",                     \
+      "RXM-RAW epochs written to the column store")                                 \
+    X(RAW_DROPPED,          "rxm_raw_dropped_total",        "",                     \
+      "RXM-RAW epochs dropped, the writer's queue was full or the file failed")     \
+    X(RAW_STORED_BYTES,     "rxm_raw_stored_bytes_total",   "",                     \
+      "Bytes of column store chunks written")                                       \
+    X(NAV_FIXES,            "nav_fixes_total",              "",                     \
+      "Navigation epochs added to the fix history")                                 \
+    X(NAV_DROPPED,          "nav_dropped_total",            "",                     \
+      "Navigation epochs left out of the history, no week yet or not newer")
+
+#define METRICS_HISTOGRAMS(X) \
+    X(CONTROL_CYCLE_NS,     "control_cycle_seconds",        "",                     \
+      "Time to poll, collect and dispatch one assist data set", 1e-9, 21, 37)       \
+    X(UART_READ_BYTES,      "uart_read_bytes",              "",                     \
+      "Bytes returned by one read of the serial port", 1, 0, 8)                     \
+    X(REFCLOCK_NS,          "refclock_latency_seconds",     "",                     \
+      "Time from the read of a TIM-TP to its NTP SHM sample", 1e-9, 7, 23)         \
+    X(RAW_FLUSH_NS,         "rxm_raw_flush_seconds",        "",                     \
+      "Time to encode and write one chunk of the column store", 1e-9, 15, 29)
+
+#define METRICS_GAUGES(X) \
+    X(ASSIST_GENERATION,    "assist_generation",            "",                     \
+      "Generation of the assist data set")                                          \
+    X(ASSIST_UPDATED,       "assist_updated_timestamp_seconds", "",                 \
+      "Unix time the assist data set last changed")                                 \
+    X(RX_TX_PENDING,        "receiver_tx_pending_bytes",    "",                     \
+      "Bytes waiting in the receiver's TX buffer for our port (MON-TXBUF)")         \
+    X(RX_TX_USAGE,          "receiver_tx_usage_percent",    "",                     \
+      "Receiver TX buffer usage of our port (MON-TXBUF)")                           \
+    X(RX_TX_PEAK,           "receiver_tx_peak_usage_percent", "",                   \
+      "Receiver TX buffer peak usage of our port (MON-TXBUF)")                      \
+    X(RX_TX_ERRORS,         "receiver_tx_errors",           "",                     \
+      "Receiver TX buffer error flags (MON-TXBUF)")                                 \
+    X(RX_RX_USAGE,          "receiver_rx_usage_percent",    "",                     \
+      "Receiver RX buffer usage of our port (MON-RXBUF)")                           \
+    X(RX_PARITY_ERRORS,     "receiver_port_errors",         "{type=\"parity\"}",    \
+      "Errors the receiver counted on our port (MON-IO)")                           \
+    X(RX_FRAMING_ERRORS,    "receiver_port_errors",         "{type=\"framing\"}",   \
+      "Errors the receiver counted on our port (MON-IO)")                           \
+    X(RX_OVERRUN_ERRORS,    "receiver_port_errors",         "{type=\"overrun\"}",   \
+      "Errors the receiver counted on our port (MON-IO)")                           \
+    X(RX_SKIPPED,           "receiver_skipped_messages",    "",                     \
+      "Messages the receiver skipped on our port (MON-MSGPP)")                      \
+    X(POLL_HELD,            "poll_held",                    "",                     \
+      "1 while the polls are held back for the receiver's TX buffer")               \
+    X(TIMEPULSE_QERR,       "timepulse_quantization_error_picoseconds", "",         \
+      "Quantization error of the next time pulse (TIM-TP)")                         \
+    X(SURVEY_IN_ACTIVE,     "survey_in_active",             "",                     \
+      "1 while the survey-in runs (TIM-SVIN)")                                      \
+    X(SURVEY_IN_VALID,      "survey_in_valid",              "",                     \
+      "1 once the survey-in position is valid (TIM-SVIN)")                          \
+    X(SURVEY_IN_DURATION,   "survey_in_duration_seconds",   "",                     \
+      "Time the survey-in has run (TIM-SVIN)")                                      \
+    X(NAV_FIX_TYPE,         "nav_fix_type",                 "",                     \
+      "GPS fix type of the last navigation solution (NAV-SOL)")                     \
+    X(NAV_NUM_SV,           "nav_satellites_used",          "",                     \
+      "SVs used in the last navigation solution (NAV-SOL)")                         \
+    X(NAV_SV_TRACKED,       "nav_satellites_tracked",       "",                     \
+      "GPS SVs the receiver tracks (NAV-SVINFO)")                                   \
+    X(POLL_EPH_SVS,         "poll_plan_ephemeris_svs",      "",                     \
+      "SVs the ephemeris polls ask for")
+
+
+#define _METRICS_ENUM(id, ...)  METRIC_##id,
+
+enum metricsCounter_e { METRICS_COUNTERS(_METRICS_ENUM)   METRICS_N_COUNTERS };
+enum metricsHist_e    { METRICS_HISTOGRAMS(_METRICS_ENUM) METRICS_N_HISTOGRAMS };
+enum metricsGauge_e   { METRICS_GAUGES(_METRICS_ENUM)     METRICS_N_GAUGES };
+
+
+typedef struct metricsHist_s
+{
+    uint64_t count;                 // only filled in when summed
+    uint64_t sum;
+    uint64_t bucket[METRICS_HIST_BUCKETS];
+}metricsHist_t;
+
+// written by its thread only, unless shared
+typedef struct metricsSlot_s
+{
+    int shared;
+    uint64_t counter[METRICS_N_COUNTERS];
+    struct metricsHist_s hist[METRICS_N_HISTOGRAMS];
+} CACHE_ALIGNED metricsSlot_t;
+
+
+typedef struct metricsServer_s
+{
+    int listenFd;
+    const char *filePath;           // NULL: no file
+    int period;                     // seconds between two file writes
+    char text[METRICS_TEXT_SIZE];
+}metricsServer_t;
+
+
+void metrics_add(enum metricsCounter_e id, uint64_t n);
+void metrics_observe(enum metricsHist_e id, uint64_t v);
+void metrics_set(enum metricsGauge_e id, int64_t v);
+
+uint64_t metrics_counter(enum metricsCounter_e id);
+int metrics_render(char *buf, size_t size);
+
+struct metricsServer_s *metricsServer_init(const char *sockPath, const char *filePath, int period);
+void metricsServer_deinit(struct metricsServer_s *ms);
+void *metricsServer_f(void *arg);
+
+#endif
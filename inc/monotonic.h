@@ -0,0 +1,25 @@
+/*
+ * monotonic.h
+ *
+ * CLOCK_MONOTONIC in ns, the clock every thread stamps, times and
+ * schedules with. One clock for all of them: their stamps are compared
+ * with each other (trace.h, shmPub.h).
+ *
+ */
+
+#ifndef __monotonic_h__
+#define __monotonic_h__
+
+#include <stdint.h>
+#include <time.h>
+
+
+static inline uint64_t monotonicNs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+#endif
@@ -0,0 +1,130 @@
+/*
+ * navHist.h
+ *
+ * Header for the navigation stream and its history
+ *
+ * The receiver sends NAV-POSLLH, SOL, VELNED and TIMEUTC every
+ * navigation epoch (prepNavMsgs(), NAV_RATE_HZ, from control_f's first
+ * cycle of assist data on). serial_f hands every
+ * frame to nav_frame(), which puts the messages of an epoch (the same
+ * iTOW) together into a struct navFix_s and appends it to the history as
+ * soon as the four are in, or the next epoch starts. The POSLLH also goes
+ * to the fix section of the shm region and to the pubServer's FIX
+ * subscribers as it comes, and on to control_f, which polls it too.
+ *
+ * The history is a ring of NAV_HIST_SIZE fixes in the shm region
+ * (shmPub.h), so a local reader queries it in place, without a copy of
+ * its own or a call into the process; the pubServer answers GET HIST from
+ * it too. The fixes are in time order: navHist_find() is a binary search,
+ * navHist_buckets() takes min / max / mean of each value over buckets of a
+ * span. Neither allocates anything. serial_f is the only writer and never
+ * waits for a reader: it claims the slot it's about to overwrite first,
+ * a reader takes a fix only if it wasn't claimed by the time the copy was
+ * done.
+ *
+ */
+
+#ifndef __navHist_h__
+#define __navHist_h__
+
+#include <stdint.h>
+
+#include "config.h"
+
+
+// what a fix was made of
+#define NAV_HAVE_POSLLH     (1<<0)
+#define NAV_HAVE_SOL        (1<<1)
+#define NAV_HAVE_VELNED     (1<<2)
+#define NAV_HAVE_TIMEUTC    (1<<3)
+#define NAV_HAVE_ALL        0x0f
+
+/*
+ * Values of a fix
+ *   X(ID, name, decimals, message)  the message's field, an integer of
+ *                                   10^-decimals units (deg, m, m/s)
+ */
+#define NAV_HIST_VALUES(X) \
+    X(LAT,      lat,        7, NAV_HAVE_POSLLH)    \
+    X(LON,      lon,        7, NAV_HAVE_POSLLH)    \
+    X(HEIGHT,   height,     3, NAV_HAVE_POSLLH)    \
+    X(HMSL,     hmsl,       3, NAV_HAVE_POSLLH)    \
+    X(HACC,     hacc,       3, NAV_HAVE_POSLLH)    \
+    X(VACC,     vacc,       3, NAV_HAVE_POSLLH)    \
+    X(NUM_SV,   num_sv,     0, NAV_HAVE_SOL)       \
+    X(PDOP,     pdop,       2, NAV_HAVE_SOL)       \
+    X(VEL_N,    vel_n,      2, NAV_HAVE_VELNED)    \
+    X(VEL_E,    vel_e,      2, NAV_HAVE_VELNED)    \
+    X(VEL_D,    vel_d,      2, NAV_HAVE_VELNED)    \
+    X(GSPEED,   gspeed,     2, NAV_HAVE_VELNED)    \
+    X(HEADING,  heading,    5, NAV_HAVE_VELNED)    \
+    X(SACC,     sacc,       2, NAV_HAVE_VELNED)
+
+#define _NAV_ENUM(id, ...)  NAV_##id,
+
+enum navVal_e { NAV_HIST_VALUES(_NAV_ENUM) NAV_N_VALS };
+
+
+typedef struct navFix_s
+{
+    int64_t timeMs;                 // GPS time, ms since the GPS epoch
+    int64_t utcMs;                  // unix time of TIMEUTC, 0 if it wasn't valid
+    uint8_t have;                   // NAV_HAVE_*
+    uint8_t gpsFix;                 // NAV-SOL's
+    uint8_t flags;
+    uint8_t reserved;
+    int32_t val[NAV_N_VALS];
+}navFix_t;
+
+typedef struct navHist_s
+{
+    uint64_t claimed;               // the writer is at fix claimed - 1
+    uint64_t count;                 // fixes written, fix k in fix[k % NAV_HIST_SIZE]
+    struct navFix_s fix[NAV_HIST_SIZE] __attribute__((aligned(64)));
+}navHist_t;
+
+// a bucket of navHist_buckets(), n[v] fixes had value v
+typedef struct navBucket_s
+{
+    int64_t startMs;
+    uint32_t fixes;
+    uint32_t n[NAV_N_VALS];
+    int32_t min[NAV_N_VALS];
+    int32_t max[NAV_N_VALS];
+    double mean[NAV_N_VALS];
+}navBucket_t;
+
+
+// serial_f's
+struct shmPubRegion_s;
+struct pubServer_s;
+
+typedef struct nav_s
+{
+    struct navHist_s *hist;         // NULL: no history
+    struct shmPubRegion_s *pub;     // NULL: the fix isn't published
+    struct pubServer_s *server;
+    struct navFix_s pending;        // the epoch being put together
+    uint32_t itow;
+    uint32_t lastItow;
+    int week;                       // of the last NAV-SOL, 0 none yet
+    int64_t lastMs;
+    uint32_t fixes;
+}nav_t;
+
+
+// serial_f
+void nav_init(struct nav_s *nav, struct navHist_s *hist, struct shmPubRegion_s *pub,
+              struct pubServer_s *server);
+int nav_frame(struct nav_s *nav, const uint8_t *frame, int len);
+void navHist_append(struct navHist_s *h, const struct navFix_s *fix);
+
+// readers, any thread or process
+int navHist_span(const struct navHist_s *h, uint64_t *first, uint64_t *end);
+int navHist_read(const struct navHist_s *h, uint64_t i, struct navFix_s *fix);
+uint64_t navHist_find(const struct navHist_s *h, int64_t ms);
+int navHist_last(const struct navHist_s *h, struct navFix_s *fix);
+int navHist_buckets(const struct navHist_s *h, int64_t fromMs, int64_t toMs, int64_t bucketMs,
+                    struct navBucket_s *b, int maxBuckets);
+
+#endif
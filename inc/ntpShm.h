@@ -0,0 +1,72 @@
+/*
+ * ntpShm.h
+ *
+ * Header for the NTP shared memory reference clock
+ *
+ * The segment ntpd's refclock_shm (driver 28) and chrony's SHM refclock
+ * read: SysV shared memory at key NTP_SHM_KEY + unit, struct
+ * ntpShmTime_s laid out as theirs. Each sample is a clock time (what the
+ * receiver says the time was) and a receive time (CLOCK_REALTIME of the
+ * same instant here).
+ *
+ * The writer uses mode 1: valid goes to 0 and count moves before the
+ * fields are written, count moves again and valid goes to 1 after, a
+ * reader takes the sample if count didn't move while it copied and
+ * clears valid (ntpShm_read(), the same as the daemons do).
+ *
+ *   chrony:  refclock SHM 0 refid GPS precision 1e-3 offset <delay>
+ *   ntpd:    server 127.127.28.0
+ *
+ * Units 0 and 1 are created mode 0600 (a root daemon only, as ntpd does),
+ * the others 0666.
+ *
+ */
+
+#ifndef __ntpShm_h__
+#define __ntpShm_h__
+
+#include <stdint.h>
+#include <time.h>
+
+
+#define NTP_SHM_KEY         0x4e545030      // "NTP0"
+
+#define NTP_SHM_LEAP_NONE   0
+#define NTP_SHM_LEAP_ADD    1
+#define NTP_SHM_LEAP_DEL    2
+#define NTP_SHM_LEAP_NOSYNC 3
+
+
+typedef struct ntpShmTime_s
+{
+    int mode;
+    volatile int count;
+    time_t clockTimeStampSec;
+    int clockTimeStampUSec;
+    time_t receiveTimeStampSec;
+    int receiveTimeStampUSec;
+    int leap;
+    int precision;                  // log2 seconds
+    int nsamples;
+    volatile int valid;
+    unsigned clockTimeStampNSec;
+    unsigned receiveTimeStampNSec;
+    int dummy[8];
+}ntpShmTime_t;
+
+typedef struct ntpShmSample_s
+{
+    struct timespec clock;
+    struct timespec receive;
+    int leap;
+    int precision;
+}ntpShmSample_t;
+
+
+struct ntpShmTime_s *ntpShm_attach(int unit);
+void ntpShm_detach(struct ntpShmTime_s *shm);
+void ntpShm_store(struct ntpShmTime_s *shm, const struct ntpShmSample_s *s);
+int ntpShm_read(struct ntpShmTime_s *shm, struct ntpShmSample_s *s);
+int ntpShm_remove(int unit);
+
+#endif
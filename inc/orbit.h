@@ -0,0 +1,100 @@
+/*
+ * orbit.h
+ *
+ * Header for the broadcast ephemeris orbit engine
+ *
+ * The engine keeps the ephemerides of all SVs in a structure of arrays
+ * (one array per scaled parameter) so that a whole epoch is propagated
+ * by straight loops over the SVs.
+ *
+ */
+
+#ifndef __ORBIT_H__
+#define __ORBIT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+#include "gps.h"
+
+
+/* WGS-84 / IS-GPS-200 constants */
+#define GPS_PI          3.1415926535898
+#define GPS_MU          3.986005e14         /* m^3 / s^2                */
+#define GPS_OMEGA_E     7.2921151467e-5     /* rad / s                  */
+#define GPS_F_REL       -4.442807633e-10    /* s / m^(1/2)              */
+#define GPS_HALF_WEEK   302400.0            /* s                        */
+
+#define ORBIT_ALIGN     __attribute__((aligned(64)))
+
+
+/* Per-SV constants, scaled once from the raw integer fields */
+struct orbit_engine {
+    int n_sv;
+
+    /* cache keys: an slot is only rescaled when one of those changes */
+    int sv_id[MAX_SV];
+    int iodc[MAX_SV];
+    int t_oe_raw[MAX_SV];
+    int week_no[MAX_SV];
+
+    double toe[MAX_SV]        ORBIT_ALIGN;  /* s                        */
+    double toc[MAX_SV]        ORBIT_ALIGN;  /* s                        */
+    double a[MAX_SV]          ORBIT_ALIGN;  /* m                        */
+    double n[MAX_SV]          ORBIT_ALIGN;  /* corrected mean motion    */
+    double e[MAX_SV]          ORBIT_ALIGN;
+    double sqrt_1me2[MAX_SV]  ORBIT_ALIGN;  /* sqrt(1 - e^2)            */
+    double m_0[MAX_SV]        ORBIT_ALIGN;  /* rad                      */
+    double sin_w[MAX_SV]      ORBIT_ALIGN;
+    double cos_w[MAX_SV]      ORBIT_ALIGN;
+    double omega_0[MAX_SV]    ORBIT_ALIGN;  /* rad, Earth rotation at toe removed */
+    double omega_dot[MAX_SV]  ORBIT_ALIGN;  /* rad / s, Earth rotation removed */
+    double sin_i0[MAX_SV]     ORBIT_ALIGN;
+    double cos_i0[MAX_SV]     ORBIT_ALIGN;
+    double idot[MAX_SV]       ORBIT_ALIGN;  /* rad / s                  */
+    double c_rs[MAX_SV]       ORBIT_ALIGN;
+    double c_rc[MAX_SV]       ORBIT_ALIGN;
+    double c_us[MAX_SV]       ORBIT_ALIGN;
+    double c_uc[MAX_SV]       ORBIT_ALIGN;
+    double c_is[MAX_SV]       ORBIT_ALIGN;
+    double c_ic[MAX_SV]       ORBIT_ALIGN;
+    double af0[MAX_SV]        ORBIT_ALIGN;
+    double af1[MAX_SV]        ORBIT_ALIGN;
+    double af2[MAX_SV]        ORBIT_ALIGN;
+    double t_gd[MAX_SV]       ORBIT_ALIGN;
+    double rel[MAX_SV]        ORBIT_ALIGN;  /* F * e * sqrt(A)          */
+};
+
+
+/* Propagated state of every engine slot at one epoch (ECEF, WGS-84) */
+struct orbit_state {
+    double t;                               /* GPS time of week, s      */
+    int    n_sv;
+    int    sv_id[MAX_SV];
+
+    double x[MAX_SV]          ORBIT_ALIGN;  /* m                        */
+    double y[MAX_SV]          ORBIT_ALIGN;
+    double z[MAX_SV]          ORBIT_ALIGN;
+    double vx[MAX_SV]         ORBIT_ALIGN;  /* m / s                    */
+    double vy[MAX_SV]         ORBIT_ALIGN;
+    double vz[MAX_SV]         ORBIT_ALIGN;
+    double clk_bias[MAX_SV]   ORBIT_ALIGN;  /* s, relativity and T_GD applied */
+    double clk_drift[MAX_SV]  ORBIT_ALIGN;  /* s / s                    */
+};
+
+
+/* Methods */
+void orbit_engine_init(struct orbit_engine *oe);
+int  orbit_engine_load(struct orbit_engine *oe, const struct gps_ephemeris *eph);
+int  orbit_engine_slot(const struct orbit_engine *oe, int sv_id);
+void orbit_propagate(const struct orbit_engine *oe, double t, struct orbit_state *st);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ORBIT_H__ */
@@ -2,16 +2,30 @@
 #ifndef __post_h__
 #define __post_h__
 
+#include <stdint.h>
+
 typedef struct post_s
 {
     char *postAddress;
     char *postData;
 }post_t;
 
+// counters since post_initialize()
+typedef struct postStats_s
+{
+    uint64_t queued;
+    uint64_t dropped;       // pushed out of a full queue
+    uint64_t sent;          // payloads acknowledged with a 2xx
+    uint64_t failed;        // payloads given up on
+    uint64_t requests;
+    uint64_t connects;      // new connections, the rest were reused
+}postStats_t;
+
 
 // function prototypes
 int post_initialize(void);
 int post2Server(struct post_s *post_p);
 int postCleanup(void);
+void post_getStats(struct postStats_s *stats);
 
 #endif
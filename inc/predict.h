@@ -0,0 +1,63 @@
+/*
+ * predict.h
+ *
+ * Header for the almanac based visibility / Doppler predictor
+ *
+ */
+
+#ifndef __PREDICT_H__
+#define __PREDICT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "gps.h"
+#include "gpsView.h"
+
+
+#define PREDICT_ELEV_MASK   0.0         /* deg, usable above it        */
+#define PREDICT_HORIZON     7200.0      /* s, how far ahead to look    */
+#define PREDICT_STEP        300.0       /* s, sampling of the horizon  */
+
+#define GPS_L1_FREQ         1575.42e6   /* Hz                          */
+#define GPS_C               299792458.0 /* m / s                       */
+
+/* sv_predict.flags */
+#define PREDICT_VISIBLE     (1<<0)      /* above the mask now          */
+#define PREDICT_RISING      (1<<1)      /* elevation increasing        */
+#define PREDICT_USABLE      (1<<2)      /* above the mask within horizon */
+#define PREDICT_UNHEALTHY   (1<<3)
+
+
+struct sv_predict {
+    int    sv_id;
+    int    flags;
+    double elev;            /* deg                                      */
+    double azim;            /* deg, from north clockwise                */
+    double doppler;         /* Hz on L1, static receiver                */
+    double rise_in;         /* s until above the mask, 0 if visible,
+                               -1 if not within PREDICT_HORIZON         */
+};
+
+struct predict_set {
+    double tow;             /* GPS time of week the prediction is for   */
+    int    n_sv;
+    int    n_usable;
+    struct sv_predict sv[MAX_SV];
+};
+
+
+/* Methods */
+int predict_from_almanac(const struct gps_assist_view *view, const struct gps_ref_pos *pos,
+                         double tow, struct predict_set *ps);
+int predict_from_assist(const struct gps_assist_data *gps, const struct gps_assist_view *view,
+                        struct predict_set *ps);
+int predict_poll_order(const struct predict_set *ps, int *sv_ids, int max, int usable_only);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PREDICT_H__ */
@@ -0,0 +1,96 @@
+/*
+ * pubServer.h
+ *
+ * Header for the unix socket server publishing the assist data
+ *
+ * Clients talk one command per line on SOCK_PATH:
+ *
+ *   GET ASSIST     current assist data set
+ *   GET FIX        last NAV-POSLLH fix
+ *   GET SV <id>    almanac and ephemeris of one SV
+ *   GET HIST <s> <b>  the last s seconds of fixes in buckets of b seconds,
+ *                  min / max / mean of each value (navHist.h)
+ *   SUB ASSIST     push the assist data set on every change
+ *   SUB FIX        push every new fix
+ *   SUB ALL        both of the above
+ *   UNSUB          stop pushing
+ *
+ * Every answer and every pushed update is a single JSON object on one
+ * line. All clients are served by one epoll thread; updates are encoded
+ * once and the same buffer is queued to every subscriber. A client that
+ * lets PUB_CLIENT_QUEUE updates pile up is disconnected, the publishing
+ * side never waits for anyone.
+ *
+ */
+
+#ifndef __pubServer_h__
+#define __pubServer_h__
+
+#include <stddef.h>
+#include <pthread.h>
+
+#include "gps.h"
+#include "ubx.h"
+#include "navHist.h"
+
+
+#define PUB_MAX_CLIENTS     32
+#define PUB_CLIENT_QUEUE    16      // pending messages per client
+#define PUB_CLIENT_INBUF    128     // longest command line
+
+#define PUB_SUB_ASSIST      (1<<0)
+#define PUB_SUB_FIX         (1<<1)
+
+
+// encoded message, shared by every client it is queued to
+typedef struct pubMsg_s
+{
+    int    refs;
+    size_t len;
+    char   data[];
+}pubMsg_t;
+
+typedef struct pubClient_s
+{
+    int    fd;                      // -1: free slot
+    int    subs;                    // PUB_SUB_*
+    int    pollOut;                 // EPOLLOUT armed
+    char   in[PUB_CLIENT_INBUF];
+    int    inLen;
+    struct pubMsg_s *out[PUB_CLIENT_QUEUE];
+    int    outHead;
+    int    outCnt;
+    size_t outOff;                  // bytes of out[outHead] already sent
+}pubClient_t;
+
+typedef struct pubServer_s
+{
+    int listenFd;
+    int epollFd;
+    int eventFd;                    // publishers wake the loop through it
+
+    // staging area written by the publishers, under mutex
+    pthread_mutex_t mutex;
+    struct gps_assist_data stageAssist;
+    struct ubx_nav_posllh  stageFix;
+    int stageAssistNew;
+    int stageFixNew;
+
+    // owned by the server thread
+    const struct navHist_s *hist;   // NULL: no GET HIST
+    struct gps_assist_data assist;
+    struct pubMsg_s *assistMsg;
+    struct pubMsg_s *fixMsg;
+    struct pubClient_s clients[PUB_MAX_CLIENTS];
+}pubServer_t;
+
+
+struct pubServer_s *pubServer_init(const char *path);
+void pubServer_deinit(struct pubServer_s *ps);
+void *pubServer_f(void *arg);
+
+void pubServer_setHistory(struct pubServer_s *ps, const struct navHist_s *hist);
+void pubServer_publishAssist(struct pubServer_s *ps, const struct gps_assist_data *gps);
+void pubServer_publishFix(struct pubServer_s *ps, const struct ubx_nav_posllh *fix);
+
+#endif
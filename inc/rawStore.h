@@ -0,0 +1,172 @@
+/*
+ * rawStore.h
+ *
+ * Header for the RXM-RAW column store
+ *
+ * The receiver sends RXM-RAW every measurement (prepRawMsgs(), at the
+ * rate rawStore_rateMs() gives the line, once control_f's first cycle of
+ * assist data is in). serial_f hands each frame to
+ * rawStore_frame(): a copy into the next slot of a single producer /
+ * single consumer queue and a release store, no lock, no system call. A
+ * full queue drops the epoch and counts it, serial_f never waits on the
+ * writer. rawStore_f(), a thread of its own, reads the measurements in
+ * place in the slots (ubx_rxm_raw_get() / _block()) into the columns of
+ * the chunk it builds.
+ *
+ * Files: RAW_STORE_DIR/rxmraw-<week>-<day>.col and .idx, a pair per GPS
+ * day (day 0 is Sunday):
+ *
+ *   .col  struct rawFileHdr_s, then the chunks: struct rawChunkHdr_s and
+ *         its columns back to back, colBytes[] bytes each
+ *   .idx  a struct rawIndex_s per chunk, appended once the chunk is
+ *         written; a chunk without its entry (a crash or an error in
+ *         between) isn't. The writer cuts such a chunk and a torn entry
+ *         off when it opens the day again, before it appends.
+ *
+ * When the day rolls over, the files of the days before the last
+ * RAW_KEEP_DAYS are deleted, whatever their age; a store left alone
+ * keeps them until its first roll over. RAW_KEEP_DAYS 0 leaves retention
+ * to the operator.
+ *
+ * A chunk holds up to RAW_CHUNK_EPOCHS epochs, or RAW_FLUSH_S seconds of
+ * them, a row per measurement, sorted by SV then time. The columns (enum
+ * rawCol_e) are streams of 64 bit values: the time in ms since the GPS
+ * epoch, the SV, pseudorange, carrier phase and Doppler as the bits of
+ * their R8 / R4, C/N0, quality and loss of lock indicators. Each value is
+ * stored as its difference to the previous row's (order 1), or as the
+ * change of that difference (order 2: time, pseudorange and carrier
+ * phase, near linear along an SV), in zigzag LEB128 varints; the first
+ * row's are to 0. Everything is little endian.
+ *
+ * Readers (rawRead.c) binary search the index for a time and read the
+ * chunks they want, nothing else.
+ *
+ */
+
+#ifndef __rawStore_h__
+#define __rawStore_h__
+
+#include <stdint.h>
+
+#include "config.h"
+
+
+#define RAW_FILE_MAGIC      "UBXRAWC1"
+#define RAW_FILE_VERSION    1
+#define RAW_CHUNK_MAGIC     0x4b4e4843      // "CHNK"
+
+#define RAW_CHUNK_ROWS      (RAW_CHUNK_EPOCHS * 32)
+#define RAW_CHUNK_MAX       (sizeof(struct rawChunkHdr_s) + RAW_N_COLS * RAW_CHUNK_ROWS * 10)
+
+#define GPS_DAY_MS          86400000LL
+#define GPS_WEEK_MS         604800000LL
+
+enum rawCol_e { RAW_COL_TIME, RAW_COL_SV, RAW_COL_PR, RAW_COL_CP, RAW_COL_DO,
+                RAW_COL_CNO, RAW_COL_QI, RAW_COL_LLI, RAW_N_COLS };
+
+// delta order of each column: 1 the difference, 2 its change
+#define RAW_COL_ORDERS      { 2, 1, 2, 2, 1, 1, 1, 1 }
+
+
+typedef struct rawFileHdr_s
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t nCols;
+}rawFileHdr_t;
+
+typedef struct rawChunkHdr_s
+{
+    uint32_t magic;
+    uint32_t rows;
+    uint32_t epochs;
+    uint32_t reserved;
+    int64_t firstMs;                // first and last epoch, ms since the GPS epoch
+    int64_t lastMs;
+    uint32_t colBytes[RAW_N_COLS];
+}rawChunkHdr_t;
+
+typedef struct rawIndex_s
+{
+    int64_t firstMs;
+    int64_t lastMs;
+    uint64_t offset;                // of the chunk header in the .col
+    uint32_t rows;
+    uint32_t bytes;                 // header included
+}rawIndex_t;
+
+
+typedef struct rawSlot_s
+{
+    uint32_t len;
+    uint8_t frame[UBX_MAX_FRAME_SIZE];
+}rawSlot_t;
+
+typedef struct rawStore_s
+{
+    uint32_t head CACHE_ALIGNED;    // serial_f's
+
+    uint32_t tail CACHE_ALIGNED;    // the writer's, from here on
+    const char *dir;
+    int colFd;
+    int idxFd;
+    int64_t fileDay;                // GPS day of the open files, -1 none
+    int64_t lastDay;                // of the last ones opened, -1 none
+    int keepDays;                   // RAW_KEEP_DAYS
+    uint64_t offset;                // end of the .col
+
+    // the chunk being built
+    int64_t chunkDay;
+    int64_t firstMs;
+    int64_t lastMs;
+    uint64_t startNs;
+    int epochs;
+    int rows;
+    uint64_t *col[RAW_N_COLS];      // RAW_CHUNK_ROWS values each
+    uint32_t *order;                // rows by SV
+    uint8_t *out;                   // RAW_CHUNK_MAX, the encoded chunk
+
+    struct rawSlot_s slot[RAW_QUEUE_FRAMES] CACHE_ALIGNED;
+}rawStore_t;
+
+
+// a chunk as readers get it
+typedef struct rawColumns_s
+{
+    int rows;
+    int64_t timeMs[RAW_CHUNK_ROWS];
+    uint8_t sv[RAW_CHUNK_ROWS];
+    double pr[RAW_CHUNK_ROWS];
+    double cp[RAW_CHUNK_ROWS];
+    float dop[RAW_CHUNK_ROWS];
+    int8_t cno[RAW_CHUNK_ROWS];
+    int8_t qi[RAW_CHUNK_ROWS];
+    uint8_t lli[RAW_CHUNK_ROWS];
+}rawColumns_t;
+
+typedef struct rawReader_s
+{
+    int colFd;
+    int nChunks;
+    struct rawIndex_s *index;
+    uint8_t *buf;                   // RAW_CHUNK_MAX
+    uint64_t *vals;                 // RAW_CHUNK_ROWS
+}rawReader_t;
+
+
+// rawStore.c
+struct rawStore_s *rawStore_init(const char *dir);
+int rawStore_rateMs(int bps);
+int rawStore_frame(struct rawStore_s *rs, const uint8_t *frame, int len);
+int rawStore_poll(struct rawStore_s *rs);
+int rawStore_flush(struct rawStore_s *rs);
+void *rawStore_f(void *arg);
+
+// rawRead.c
+int rawStore_path(char *buf, int size, const char *dir, int64_t day, const char *ext);
+int rawRead_open(struct rawReader_s *rd, const char *dir, int64_t day);
+void rawRead_close(struct rawReader_s *rd);
+int rawRead_find(const struct rawReader_s *rd, int64_t ms);
+int rawRead_chunk(struct rawReader_s *rd, int i, struct rawColumns_s *c);
+
+#endif
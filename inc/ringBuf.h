@@ -1,8 +1,12 @@
 #ifndef __ringBuf_h__
 #define __ringBuf_h__
 
+#include <pthread.h>
 
-#define RINGBUFFER_SIZE       5000
+#include "config.h"
+
+
+#define RINGBUFFER_SIZE       SCRATCHPAD_BUF_SIZE     // read whole into the scratchpad
 
 #define BUF_EMPTY               0
 #define BUF_FULL                1
@@ -10,16 +14,16 @@
 //TODO:  change struct ringbuffer_s to void * in function parameters
 //       remove structure definition from headerfile
 
-#pragma pack(1)
+// the lock and indices share a line that both sides take anyway, the data
+// starts on the next one; fill is also read without the lock (atomically)
 typedef struct ringbuffer_s {
-    unsigned char buffer[RINGBUFFER_SIZE];
+    pthread_mutex_t mutex;
     unsigned int size;
     unsigned int fill;
     unsigned char *read;
     unsigned char *write;
-    pthread_mutex_t mutex;
+    unsigned char buffer[RINGBUFFER_SIZE] CACHE_ALIGNED;
 }ringbuffer_t;
-#pragma pack()
 
 
 
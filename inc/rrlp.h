@@ -43,7 +43,42 @@ extern "C" {
 
 struct rrlp_assist_req {
 	uint32_t req_elems;
-	uint64_t eph_svs;
+	uint64_t eph_svs;	/* bit n: RRLP satelliteID n, i.e. PRN n+1 */
+};
+
+
+/* Encoded PDUs */
+#define RRLP_PDU_MAX_LEN	242	/* octets, what fits one RR APDU */
+#define RRLP_MAX_PDUS		32	/* a full set of 64 SVs needs 30 */
+#define RRLP_ARENA_SIZE		(RRLP_MAX_PDUS * RRLP_PDU_MAX_LEN)
+#define RRLP_CACHE_ENTRIES	8
+
+	/* PDUs are built with referenceNumber 0, patch a copy per session */
+#define RRLP_PDU_SET_REF(pdu, ref) \
+	(((uint8_t *)(pdu))[0] = (((uint8_t *)(pdu))[0] & 0x1f) | (((ref) & 7) << 5))
+
+struct rrlp_arena {
+	uint8_t *buf;
+	int size;
+	int used;
+};
+
+
+/* Batch mode: many requests in, one encoded answer per distinct request */
+#define RRLP_BATCH_MAX_ANSWERS	64
+
+struct rrlp_answer {
+	struct rrlp_assist_req req;
+	int n_reqs;			/* requests sharing this answer */
+	int n_pdus;			/* -1: couldn't be encoded */
+	void *pdu[RRLP_MAX_PDUS];
+	int len[RRLP_MAX_PDUS];
+};
+
+struct rrlp_batch {
+	struct rrlp_arena arena;	/* caller supplied, where the PDUs go */
+	int n_answers;
+	struct rrlp_answer answer[RRLP_BATCH_MAX_ANSWERS];
 };
 
 
@@ -51,10 +86,23 @@ struct rrlp_assist_req {
 int rrlp_decode_assistance_request(struct rrlp_assist_req *ar,
 	void *req, int req_len);
 
+void rrlp_arena_init(struct rrlp_arena *arena, void *buf, int size);
+
+int rrlp_gps_assist_pdus_arena(
+	struct gps_assist_data *gps_ad, struct rrlp_assist_req *req,
+	struct rrlp_arena *arena,
+	void **o_pdu, int *o_len, int o_max_pdus);
+
 int rrlp_gps_assist_pdus(
 	struct gps_assist_data *gps_ad, struct rrlp_assist_req *req,
 	void **o_pdu, int *o_len, int o_max_pdus);
 
+void rrlp_cache_stats(unsigned long *hits, unsigned long *misses);
+
+void rrlp_batch_init(struct rrlp_batch *batch, void *arena_buf, int arena_size);
+int rrlp_batch_serve(struct gps_assist_data *gps_ad, struct rrlp_batch *batch,
+	void * const *reqs, const int *req_lens, int n_reqs, int *answer_of);
+
 
 #ifdef __cplusplus
 }
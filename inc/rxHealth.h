@@ -0,0 +1,69 @@
+/*
+ * rxHealth.h
+ *
+ * Header for the receiver monitor
+ *
+ * serial_f frames what it reads off the port as it comes in and hands
+ * the frames over (rxHealth_frame()) for the MON answers of the receiver,
+ * which it asks for itself:
+ *
+ *   MON-TXBUF               a probe after each window of polls
+ *   MON-IO / RXBUF / MSGPP  as polls start going out, at most every
+ *                           RX_HEALTH_PERIOD seconds
+ *
+ * Our port's share of them goes out as gauges (metrics.h).
+ *
+ * The probe closes the window: the receiver answers it after the polls
+ * before it, so its answer comes in once theirs are through the TX
+ * buffer, and tells how full they had it. The next window only opens
+ * then; it shrinks by half when the usage got to RX_HEALTH_HIGH % or the
+ * buffer reported an error, and the polls are held until a probe finds it
+ * at RX_HEALTH_LOW % or below, after which it grows back one poll per
+ * probe up to RX_HEALTH_WINDOW. A receiver that leaves RX_HEALTH_GIVE_UP
+ * probes in a row unanswered isn't throttled until it answers one again.
+ *
+ * serial_f only.
+ *
+ */
+
+#ifndef __rxHealth_h__
+#define __rxHealth_h__
+
+#include <stdint.h>
+
+#include "config.h"
+#include "ubx.h"
+
+
+typedef struct rxHealth_s
+{
+    int port;                       // index of ours in the MON messages
+
+    // our port's TX buffer, from the last MON-TXBUF
+    int txPending;
+    int txUsage;
+    int txPeak;
+    int txErrors;
+    uint32_t reports;               // MON-TXBUF answers so far
+    uint64_t reportNs;
+
+    // throttle
+    int windowSize;                 // polls between two probes, 1..RX_HEALTH_WINDOW
+    int window;                     // polls left before the next probe
+    int held;                       // 1: over RX_HEALTH_HIGH, until RX_HEALTH_LOW
+    int unanswered;                 // probes in a row without an answer
+    uint64_t probeNs;               // 0: no probe out
+
+    // the others
+    uint8_t slowDue;                // bit n: the n-th of them still to ask for
+    uint64_t slowNs;                // when they were last asked for
+}rxHealth_t;
+
+
+void rxHealth_init(struct rxHealth_s *h, int port);
+void rxHealth_frame(struct rxHealth_s *h, uint8_t *frame, int len);
+int rxHealth_next(struct rxHealth_s *h, int queued, uint8_t *buf, int size);
+int rxHealth_mayPoll(const struct rxHealth_s *h);
+void rxHealth_sent(struct rxHealth_s *h);
+
+#endif
@@ -1,23 +1,31 @@
 #ifndef __serialPort_h__
 #define __serialPort_h__
 
+#include <stdint.h>
 
+#include "config.h"
 
-#pragma pack(1)
+
+// fd and settings are read by every thread; ticksBtwReceive is written by
+// serial_f on each loop and gets a line of its own, use the accessors
 typedef struct serialPort_s
 {
     int fd;
     int baudRate;
     int parity;
-    uint8_t ticksBtwReceive; 
+
+    uint8_t ticksBtwReceive CACHE_ALIGNED;
 
 }serialPort_t;
 
-#pragma pack()
+#define serialPort_ticks(sp)          __atomic_load_n(&(sp)->ticksBtwReceive, __ATOMIC_RELAXED)
+#define serialPort_setTicks(sp, v)    __atomic_store_n(&(sp)->ticksBtwReceive, (v), __ATOMIC_RELAXED)
 
 struct serialPort_s *serialPort_init(char *path, int baudrate, int parity);
 int serialPort_deinit(struct serialPort_s *sp);
 int serialPort_isRxSilent(struct serialPort_s *sp);
+int serialPort_speed(int bps);
+int serialPort_bps(const struct serialPort_s *sp);
 
 
 
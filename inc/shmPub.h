@@ -0,0 +1,110 @@
+/*
+ * shmPub.h
+ *
+ * Header for the shared memory publication of the last fix, the assist
+ * data and the timing messages, and for the reader side used by
+ * co-located processes
+ *
+ * The region (shm_open(SHM_PUB_NAME)) has a fixed layout: a header and
+ * one section per kind of data, each on its own cache lines and guarded
+ * by its own sequence counter. The writer makes the counter odd, copies,
+ * and makes it even again; a reader copies between two loads of the
+ * counter and retries if it was odd or moved. Readers never make a
+ * syscall or take a lock, and the writer never waits for a reader. Each
+ * section has a single writer: the control thread for the assist data,
+ * serial_f for the others as the messages come in. The history of fixes
+ * is a ring of its own (navHist.h), read in place with navHist_*().
+ *
+ */
+
+#ifndef __shmPub_h__
+#define __shmPub_h__
+
+#include <stdint.h>
+
+#include "gps.h"
+#include "ubx.h"
+#include "navHist.h"
+
+
+#define SHM_PUB_MAGIC       0x42555053      // "SPUB"
+#define SHM_PUB_VERSION     3
+
+#define SHM_PUB_ALIGN       __attribute__((aligned(64)))
+
+
+typedef struct shmPubHdr_s
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t size;                  // sizeof(struct shmPubRegion_s)
+    uint32_t writerPid;
+} SHM_PUB_ALIGN shmPubHdr_t;
+
+typedef struct shmPubFix_s
+{
+    uint32_t seq;                   // odd while being written, 0: never written
+    uint32_t count;                 // fixes written so far
+    uint64_t updatedNs;             // CLOCK_MONOTONIC of the update
+    struct ubx_nav_posllh fix;
+} SHM_PUB_ALIGN shmPubFix_t;
+
+typedef struct shmPubAssist_s
+{
+    uint32_t seq;
+    uint32_t count;
+    uint64_t updatedNs;
+    struct gps_assist_data gps;
+} SHM_PUB_ALIGN shmPubAssist_t;
+
+// the last of each timing message, zeros until there is one
+typedef struct shmPubTimeData_s
+{
+    struct ubx_tim_tp tp;           // the pulse to come, with its quantization error
+    struct ubx_tim_tm2 tm2;         // the last time mark
+    struct ubx_tim_svin svin;       // the survey-in
+}shmPubTimeData_t;
+
+typedef struct shmPubTime_s
+{
+    uint32_t seq;
+    uint32_t count;
+    uint64_t updatedNs;
+    struct shmPubTimeData_s time;
+} SHM_PUB_ALIGN shmPubTime_t;
+
+typedef struct shmPubRegion_s
+{
+    struct shmPubHdr_s    hdr;
+    struct shmPubFix_s    fix;
+    struct shmPubAssist_s assist;
+    struct shmPubTime_s   time;
+    struct navHist_s      hist SHM_PUB_ALIGN;
+}shmPubRegion_t;
+
+
+typedef struct shmPubReader_s
+{
+    int fd;
+    const struct shmPubRegion_s *region;
+}shmPubReader_t;
+
+
+/* writer side, the control thread and serial_f */
+struct shmPubRegion_s *shmPub_create(const char *name);
+void shmPub_destroy(struct shmPubRegion_s *region, const char *name);
+void shmPub_writeFix(struct shmPubRegion_s *region, const struct ubx_nav_posllh *fix);
+int  shmPub_writeAssist(struct shmPubRegion_s *region, const struct gps_assist_data *gps);
+void shmPub_writeTime(struct shmPubRegion_s *region, const struct shmPubTimeData_s *time);
+
+/* reader side, see shmRead.c */
+int  shmPub_open(struct shmPubReader_s *rd, const char *name);
+void shmPub_close(struct shmPubReader_s *rd);
+uint32_t shmPub_fixSeq(const struct shmPubReader_s *rd);
+uint32_t shmPub_assistSeq(const struct shmPubReader_s *rd);
+uint32_t shmPub_timeSeq(const struct shmPubReader_s *rd);
+int  shmPub_readFix(const struct shmPubReader_s *rd, struct ubx_nav_posllh *fix, uint64_t *updatedNs);
+int  shmPub_readAssist(const struct shmPubReader_s *rd, struct gps_assist_data *gps, uint64_t *updatedNs);
+int  shmPub_readTime(const struct shmPubReader_s *rd, struct shmPubTimeData_s *time, uint64_t *updatedNs);
+
+#endif
@@ -0,0 +1,73 @@
+/*
+ * svTrack.h
+ *
+ * Header for the table of the SVs the receiver tracks
+ *
+ * The receiver sends NAV-SVINFO every NAV_SVINFO_S (prepNavMsgs(), along
+ * with the other NAV messages). serial_f hands every frame to
+ * svTrack_frame(), which writes the channels of a NAV-SVINFO into a table
+ * of the GPS SVs, in place: flags, quality, C/N0, elevation and azimuth of
+ * the SVs on a channel, and the NAV-SVINFO each has been tracked since.
+ * SVs that have left the channels are cleared.
+ *
+ * control_f takes a copy with svTrack_read() for its poll plan
+ * (trackSvPollPlan(), ubx.c): ephemerides are only polled for the SVs the
+ * receiver tracks and has one of, the ones tracked the shortest first. The
+ * table is guarded by a sequence counter the way the sections of the shm
+ * region are (shmPub.h), serial_f never waits for control_f.
+ *
+ */
+
+#ifndef __svTrack_h__
+#define __svTrack_h__
+
+#include <stdint.h>
+
+
+#define SV_TRACK_N_SV       33          // GPS SV n in sv[n], 1..32
+
+// NAV-SVINFO flags
+#define SVINFO_SV_USED      0x01
+#define SVINFO_DIFF_CORR    0x02
+#define SVINFO_ORBIT_AVAIL  0x04
+#define SVINFO_ORBIT_EPH    0x08
+#define SVINFO_UNHEALTHY    0x10
+#define SVINFO_ORBIT_ALM    0x20
+
+
+typedef struct svTrackSv_s
+{
+    uint8_t flags;                  // NAV-SVINFO's, all 0 off the channels
+    uint8_t quality;                // 0 idle .. 7 code and carrier locked
+    uint8_t cno;                    // dBHz
+    int8_t elev;                    // deg
+    int16_t azim;                   // deg
+    uint8_t chn;
+    uint8_t tracked;                // quality of at least SV_TRACK_MIN_QUALITY, healthy
+    uint32_t since;                 // the update it has been tracked from
+}svTrackSv_t;
+
+typedef struct svTrackTable_s
+{
+    uint32_t updates;               // NAV-SVINFOs taken, 0: none yet
+    uint32_t itow;                  // of the last one
+    uint64_t updatedNs;             // CLOCK_MONOTONIC of the last one
+    int nTracked;
+    struct svTrackSv_s sv[SV_TRACK_N_SV];
+}svTrackTable_t;
+
+typedef struct svTrack_s
+{
+    uint32_t seq;                   // odd while serial_f writes
+    struct svTrackTable_s table;
+}svTrack_t;
+
+
+// serial_f
+void svTrack_init(struct svTrack_s *t);
+int svTrack_frame(struct svTrack_s *t, const uint8_t *frame, int len);
+
+// any thread
+int svTrack_read(const struct svTrack_s *t, struct svTrackTable_s *table, uint64_t maxAgeNs);
+
+#endif
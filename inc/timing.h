@@ -0,0 +1,59 @@
+/*
+ * timing.h
+ *
+ * Header for the timing messages: TIM-TP, TIM-TM2, TIM-SVIN
+ *
+ * serial_f hands every frame over as it is read (timing_frame()), with
+ * the CLOCK_REALTIME its read returned at, before anything else is done
+ * with the chunk. The three messages go to the timing section of the
+ * shared memory region (shmPub.h) as they come.
+ *
+ * TIM-TP comes in shortly after a pulse and gives the time of the next
+ * one, with the quantization error of that pulse. So a TIM-TP also tells
+ * that the pulse the previous one gave has just been. That pulse's time
+ * is the sample for the NTP SHM refclock (ntpShm.h), and the read time is
+ * its receive time. It is a serial sample: the daemon's offset takes out
+ * the time the message takes to come after the pulse, its precision is
+ * the jitter of the serial line, not that of the pulse. TIM-TP in GPS time
+ * goes to UTC with the leap seconds of the last AID-HUI
+ * (timing_setUtc(), control_f), or TIMING_LEAP_SECONDS before there is
+ * one; the leap indicator is set on the day of an announced leap second.
+ *
+ */
+
+#ifndef __timing_h__
+#define __timing_h__
+
+#include <stdint.h>
+#include <time.h>
+
+#include "config.h"
+#include "gps.h"
+#include "ubx.h"
+#include "ntpShm.h"
+#include "shmPub.h"
+
+
+#define GPS_EPOCH_UNIX      315964800       // 1980-01-06 00:00:00 UTC
+#define GPS_WEEK_SECONDS    604800
+
+
+typedef struct timing_s
+{
+    struct ntpShmTime_s *shm;       // NULL: no refclock
+    struct shmPubRegion_s *pub;     // NULL: not published
+    struct shmPubTimeData_s data;   // the last of each message
+    int havePulse;                  // data.tp is a pulse still to come
+    uint32_t samples;
+
+    // control_f's: delta_t_ls, delta_t_lsf, wn_lsf, dn and a valid bit
+    uint64_t utc CACHE_ALIGNED;
+}timing_t;
+
+
+void timing_init(struct timing_s *t, struct ntpShmTime_s *shm, struct shmPubRegion_s *pub);
+int timing_frame(struct timing_s *t, const uint8_t *frame, int len, const struct timespec *readTs);
+void timing_setUtc(struct timing_s *t, const struct gps_utc_model *utc);
+int timing_pulseUtc(const struct timing_s *t, const struct ubx_tim_tp *tp, struct timespec *ts);
+
+#endif
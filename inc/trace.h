@@ -0,0 +1,73 @@
+/*
+ * trace.h
+ *
+ * Header for the per frame latency trace
+ *
+ * Every UBX frame control_f finds gets a record of CLOCK_MONOTONIC
+ * timestamps, one per stage of the pipeline:
+ *
+ *   READ        serial_f read the chunk holding its last byte off the port
+ *   FRAMED      serial_f's framer returned it, checksum checked
+ *   QUEUED      control_f's scan of the scratchpad put it into rbUbxMsg_p
+ *   DISPATCHED  it came out of rbUbxMsg_p and went to its ubx_parse_dt handler
+ *   PUBLISHED   the set it updated went to the shm region and the socket
+ *
+ * serial_f stamps every read (trace_read()) and every frame its framer
+ * returns into rbUartIn_p (trace_framed()), with the offset of the frame's
+ * last byte in the stream of bytes through the ring. control_f follows
+ * the same stream as it reads the ring into the scratchpad
+ * (trace_uartRead()), so a frame's offset there gives the serial_f record,
+ * and the times, it came in with. The serial_f records are a ring written
+ * by serial_f only, the frame records one written by control_f only; both
+ * keep the last TRACE_CHUNKS / TRACE_FRAMES entries.
+ *
+ * trace_dump() writes the frame records in the Chrome trace event format
+ * (chrome://tracing, ui.perfetto.dev): a track per stage, each frame a
+ * slice from the stage before to its own, serial_f's reads as instants.
+ *
+ */
+
+#ifndef __trace_h__
+#define __trace_h__
+
+#include <stdint.h>
+
+#include "config.h"
+
+
+#define TRACE_CHUNKS        1024        // powers of two
+#define TRACE_FRAMES        1024
+
+enum traceStage_e { TRACE_READ, TRACE_FRAMED, TRACE_QUEUED, TRACE_DISPATCHED, TRACE_PUBLISHED, TRACE_N_STAGES };
+
+
+// a frame serial_f put into rbUartIn_p
+typedef struct traceChunk_s
+{
+    uint64_t readNs;                    // the read of its last byte
+    uint64_t framedNs;                  // the framer returned it
+    uint64_t end;                       // stream offset after its last byte
+    int len;
+}traceChunk_t;
+
+typedef struct traceFrame_s
+{
+    uint64_t ns[TRACE_N_STAGES];        // 0: not (yet) there
+    uint32_t seq;
+    uint16_t len;
+    uint8_t msgClass;
+    uint8_t msgId;
+    int16_t sv;                         // AID-ALM / EPH, -1 otherwise
+}traceFrame_t;
+
+
+void trace_read(void);
+void trace_framed(int len);
+void trace_uartRead(int len);
+int trace_frame(const void *frame, int pos, int len);
+void trace_queued(int seq);
+void trace_dispatched(void);
+void trace_published(void);
+int trace_dump(const char *path);
+
+#endif
@@ -0,0 +1,52 @@
+/*
+ * txSched.h
+ *
+ * Header for the poll scheduler
+ *
+ * Every command serial_f writes is booked with the bytes its answer takes
+ * on the line (txSched_answerSize(): an ACK for a CFG, the payload of the
+ * schema for a poll, 32 of them for an AID-ALM / EPH of every SV). The
+ * answers are laid end to end on the line at its baud rate, 10 bits a
+ * byte, which tells when the last one is through. The bytes still to come
+ * are the least of what that leaves and of what was asked minus what was
+ * read: answers shorter than booked, or lost, don't hold the line forever.
+ *
+ * A queued command is admitted while its answer fits, next to the ones
+ * still to come, in TX_SCHED_BUDGET bytes (under the receiver's TX
+ * buffer) and in the room left in rbUartIn_p. With nothing to come it
+ * goes whatever its size, it would never fit otherwise. Periodic frames
+ * the receiver sends on its own (TIM-TP) are booked as they are read
+ * (txSched_unsolicited()), so they don't pass for answers.
+ *
+ * serial_f only, but for txSched_drainedNs(): control_f waits on it for
+ * the answers rather than for a fixed time.
+ *
+ */
+
+#ifndef __txSched_h__
+#define __txSched_h__
+
+#include <stdint.h>
+
+#include "config.h"
+
+
+typedef struct txSched_s
+{
+    uint64_t nsPerByte;
+    uint64_t asked;                 // answer bytes booked so far
+    uint64_t read;                  // bytes read off the port so far
+    uint64_t lineFreeNs;            // when the last booked answer is through
+}txSched_t;
+
+
+void txSched_init(struct txSched_s *ts, int bps);
+int txSched_answerSize(const void *cmd);
+int txSched_pending(struct txSched_s *ts);
+int txSched_admit(struct txSched_s *ts, const void *cmd, int ringFree);
+void txSched_sent(struct txSched_s *ts, const void *cmd);
+void txSched_read(struct txSched_s *ts, int len);
+void txSched_unsolicited(struct txSched_s *ts, int len);
+uint64_t txSched_drainedNs(const struct txSched_s *ts);
+
+#endif
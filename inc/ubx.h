@@ -28,7 +28,12 @@ extern "C" {
 #endif
 
 #include <stdint.h>
+#include "config.h"
 #include "list.h"
+#include "ubxSchema.h"
+
+struct predict_set;
+struct svTrackTable_s;
 
 /* Constants used in UBX */
 
@@ -141,66 +146,7 @@ struct ubx_hdr {
 } __attribute__((packed));
 
 
-/* Payload formats (some of them) */
-struct ubx_nav_posllh {
-	uint32_t itow;
-	int32_t  lon;	/* scaling 1e-7 */
-	int32_t  lat;	/* scaling 1e-7 */
-	int32_t  height;/* mm */
-	int32_t  hsl;	/* mm */
-	uint32_t hacc;	/* mm */
-	uint32_t vacc;	/* mm */
-} __attribute__((packed));
-
-struct ubx_aid_ini {
-	int32_t  x;
-	int32_t  y;
-	int32_t  z;
-	uint32_t posacc;
-	uint16_t tm_cfg;
-	uint16_t wn;
-	uint32_t tow;
-	int32_t  tow_ns;
-	uint32_t tacc_ms;
-	uint32_t tacc_ns;
-	int32_t  clkd;
-	uint32_t clkdacc;
-	uint32_t flags;
-} __attribute__((packed));
-
-struct ubx_aid_hui {
-	uint32_t health;
-	double   utc_a1;
-	double   utc_a0;
-	int32_t  utc_tot;
-	int16_t  utc_wnt;
-	int16_t  utc_ls;
-	int16_t  utc_wnf;
-	int16_t  utc_dn;
-	int16_t  utc_lsf;
-	int16_t  utc_spare;
-	float    klob_a0;
-	float    klob_a1;
-	float    klob_a2;
-	float    klob_a3;
-	float    klob_b0;
-	float    klob_b1;
-	float    klob_b2;
-	float    klob_b3;
-	uint32_t flags;
-} __attribute__((packed));
-
-struct ubx_aid_alm {
-	uint32_t sv_id;
-	uint32_t gps_week;
-	uint32_t alm_words[8];	/* Present only if 'gps_week' != 0 */
-} __attribute__((packed));
-
-struct ubx_aid_eph {
-	uint32_t sv_id;
-	uint32_t present;
-	uint32_t eph_words[24];	/* Present only if 'present' != 0 */
-} __attribute__((packed));
+/* Payload formats: generated from the schema, see ubxSchema.h */
 
 
 /* Message handler */
@@ -220,27 +166,55 @@ struct ubx_dispatch_entry {
 
 
 /* Methods */
+void ubx_checksum(const uint8_t *data, int len, uint8_t *cksum);
+int ubx_frame_encode(void *buf, int size, uint8_t msg_class, uint8_t msg_id,
+	const void *payload, int payload_len);
 int ubx_msg_dispatch(struct ubx_dispatch_entry *dt, void *msg, int len, void *userdata);
 
 /* -------------------  ADDITIONS  --------------- */
 
+#define UBX_AID_N_SV    33  // GPS PRN n in almAck[n] / ephAck[n], 1..32
+
 typedef struct ubxAidAck_s
 {
-    uint8_t almAck[32];
-    uint8_t almBuf;      // hack, ublox protocol says that alm/eph id
-    uint8_t ephAck[32];  // can be larger than 32, i.e. 56, 63
-    uint8_t ephBuf;
+    uint8_t almAck[UBX_AID_N_SV];
+    uint8_t ephAck[UBX_AID_N_SV];
     uint8_t huiAck;
     uint8_t iniAck;
     uint8_t posllhAck;
 }ubxAidAck_t;
 
+// SV selection for the aid polls, filled from the visibility prediction and,
+// for the ephemerides, from the SVs tracked once there are any
+typedef struct svPollPlan_s
+{
+    uint8_t valid;       // 0: nothing predicted or tracked yet, poll every SV
+    uint8_t nEph;
+    uint8_t ephSv[32];   // SVs worth an ephemeris, most useful first
+    uint8_t nAlm;
+    uint8_t almSv[32];   // almanac poll order, predicted SVs first
+}svPollPlan_t;
+
+// frames a byte stream as it comes, chunk by chunk
+typedef struct ubxFramer_s
+{
+    int len;             // bytes of the frame so far
+    int need;            // its full length, once the header is in
+    uint32_t frames;
+    uint32_t cksumErrors;
+    uint8_t buf[UBX_MAX_FRAME_SIZE];
+    int replayPos;       // bytes of a false start, looked at again first
+    int replayLen;
+    uint8_t replay[UBX_MAX_FRAME_SIZE];
+}ubxFramer_t;
+
 // Structure definitions
 typedef struct msgStrmCheck_s
 {
     uint8_t ubxComEnable;
     struct  ubxAidAck_s ubxAidAck;
     uint8_t ubxCfgAck[8];
+    struct  svPollPlan_s svPlan;
 }msgStrmCheck_t;
 
 // function prototype additions
@@ -252,10 +226,17 @@ int getUbx_MsgLength(void *msg);
 int getUbx_MsgClass(void *msg);
 int getUbx_MsgId(void *msg);
 int prepNmeaSilencerMsgs(struct llist *ll);
+int prepTimingMsgs(struct llist *ll);
+int prepRawMsgs(struct llist *ll, int measRateMs);
+int prepNavMsgs(struct llist *ll, int measRateMs);
 int parseUartInput_4_UbxMsg(void *msg, int bytesLeftInBuffer);
+void ubxFramer_init(struct ubxFramer_s *fr);
+int ubxFramer_push(struct ubxFramer_s *fr, const uint8_t *data, int len, int *used);
 int updateValidUbxMsgList(void *ptr, struct msgStrmCheck_s *msgChk);
 int prepAidMissingPollMsgs(struct llist *ll, struct msgStrmCheck_s *msgChk);
-int prepAidPollMsgs(struct llist *ll);
+int prepAidPollMsgs(struct llist *ll, struct msgStrmCheck_s *msgChk);
+int updateSvPollPlan(struct msgStrmCheck_s *msgChk, struct predict_set *ps);
+int trackSvPollPlan(struct msgStrmCheck_s *msgChk, const struct svTrackTable_s *sky);
 int areThereMissingMessages(struct msgStrmCheck_s *msgChk);
 
 
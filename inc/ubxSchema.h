@@ -0,0 +1,368 @@
+/*
+ * ubxSchema.h
+ *
+ * Header for the UBX message schema
+ *
+ * Each message payload is described once, as a field list:
+ *   F(type, name, decimals)     a scalar
+ *   A(type, name, count)        a fixed array
+ * with types U1 I1 X1 U2 I2 U4 I4 X4 R4 R8 as in the u-blox protocol
+ * specification, and decimals the power of ten the integer is scaled by
+ * (1e-7 deg, mm, ...) for the JSON output. From this, and the message
+ * lists below, are generated:
+ *
+ *   struct ubx_<name>                   packed payload layout
+ *   ubx_<name>_get(payload, len)        length checked zero-copy view,
+ *                                       NULL if len doesn't fit the schema
+ *   ubx_<name>_encode(buf, size, msg)   complete frame, sync to checksum
+ *   ubx_<name>_json(jb, msg)            JSON object of the fields
+ *
+ * Messages with an optional tail (AID-ALM / AID-EPH without data) give
+ * the short length they are also accepted with. Messages made of a header
+ * and a repeated block (NAV-SVINFO, RXM-RAW) give the header field holding
+ * the block count; their block is UBX_SCHEMA_<CLASS>_<ID>_BLOCK, struct
+ * ubx_<name>_block, reached with ubx_<name>_block(msg, i). Messages made
+ * of the repeated block alone (MON-IO, a block per port) give the most
+ * blocks they carry; their struct is the block, ubx_<name>_get() returns
+ * the first one and ubx_<name>_count(len) the number of them.
+ *
+ * Adding a message is adding its field list and a line to a message list.
+ *
+ */
+
+#ifndef __UBX_SCHEMA_H__
+#define __UBX_SCHEMA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/* Payload schemas */
+#define UBX_SCHEMA_NAV_POSLLH(F, A) \
+    F(U4, itow,       0)    \
+    F(I4, lon,        7)    \
+    F(I4, lat,        7)    \
+    F(I4, height,     3)    \
+    F(I4, hmsl,       3)    \
+    F(U4, hacc,       3)    \
+    F(U4, vacc,       3)
+
+#define UBX_SCHEMA_NAV_SOL(F, A) \
+    F(U4, itow,       0)    \
+    F(I4, ftow,       0)    \
+    F(I2, week,       0)    \
+    F(U1, gps_fix,    0)    \
+    F(X1, flags,      0)    \
+    F(I4, ecef_x,     2)    \
+    F(I4, ecef_y,     2)    \
+    F(I4, ecef_z,     2)    \
+    F(U4, pacc,       2)    \
+    F(I4, ecef_vx,    2)    \
+    F(I4, ecef_vy,    2)    \
+    F(I4, ecef_vz,    2)    \
+    F(U4, sacc,       2)    \
+    F(U2, pdop,       2)    \
+    F(U1, reserved1,  0)    \
+    F(U1, num_sv,     0)    \
+    F(U4, reserved2,  0)
+
+#define UBX_SCHEMA_NAV_VELNED(F, A) \
+    F(U4, itow,       0)    \
+    F(I4, vel_n,      2)    \
+    F(I4, vel_e,      2)    \
+    F(I4, vel_d,      2)    \
+    F(U4, speed,      2)    \
+    F(U4, gspeed,     2)    \
+    F(I4, heading,    5)    \
+    F(U4, sacc,       2)    \
+    F(U4, cacc,       5)
+
+#define UBX_SCHEMA_NAV_TIMEUTC(F, A) \
+    F(U4, itow,       0)    \
+    F(U4, tacc,       0)    \
+    F(I4, nano,       0)    \
+    F(U2, year,       0)    \
+    F(U1, month,      0)    \
+    F(U1, day,        0)    \
+    F(U1, hour,       0)    \
+    F(U1, min,        0)    \
+    F(U1, sec,        0)    \
+    F(X1, valid,      0)
+
+#define UBX_SCHEMA_NAV_SVINFO(F, A) \
+    F(U4, itow,       0)    \
+    F(U1, num_ch,     0)    \
+    F(X1, global_flags, 0)  \
+    F(U2, reserved2,  0)
+
+#define UBX_SCHEMA_NAV_SVINFO_BLOCK(F, A) \
+    F(U1, chn,        0)    \
+    F(U1, svid,       0)    \
+    F(X1, flags,      0)    \
+    F(X1, quality,    0)    \
+    F(U1, cno,        0)    \
+    F(I1, elev,       0)    \
+    F(I2, azim,       0)    \
+    F(I4, pr_res,     2)
+
+#define UBX_SCHEMA_TIM_TP(F, A) \
+    F(U4, tow_ms,     0)    \
+    F(U4, tow_sub_ms, 0)    \
+    F(I4, q_err,      0)    \
+    F(U2, week,       0)    \
+    F(X1, flags,      0)    \
+    F(U1, reserved1,  0)
+
+#define UBX_SCHEMA_TIM_TM2(F, A) \
+    F(U1, ch,         0)    \
+    F(X1, flags,      0)    \
+    F(U2, count,      0)    \
+    F(U2, wn_r,       0)    \
+    F(U2, wn_f,       0)    \
+    F(U4, tow_ms_r,   0)    \
+    F(U4, tow_sub_ms_r, 0)  \
+    F(U4, tow_ms_f,   0)    \
+    F(U4, tow_sub_ms_f, 0)  \
+    F(U4, acc_est,    0)
+
+#define UBX_SCHEMA_TIM_SVIN(F, A) \
+    F(U4, dur,        0)    \
+    F(I4, mean_x,     2)    \
+    F(I4, mean_y,     2)    \
+    F(I4, mean_z,     2)    \
+    F(U4, mean_v,     0)    \
+    F(U4, obs,        0)    \
+    F(U1, valid,      0)    \
+    F(U1, active,     0)    \
+    F(U2, reserved1,  0)
+
+#define UBX_SCHEMA_RXM_RAW(F, A) \
+    F(I4, itow,       0)    \
+    F(I2, week,       0)    \
+    F(U1, num_sv,     0)    \
+    F(U1, reserved1,  0)
+
+#define UBX_SCHEMA_RXM_RAW_BLOCK(F, A) \
+    F(R8, cp_mes,     0)    \
+    F(R8, pr_mes,     0)    \
+    F(R4, do_mes,     0)    \
+    F(U1, sv,         0)    \
+    F(I1, mes_qi,     0)    \
+    F(I1, cno,        0)    \
+    F(U1, lli,        0)
+
+#define UBX_SCHEMA_CFG_RATE(F, A) \
+    F(U2, meas_rate,  0)    \
+    F(U2, nav_rate,   0)    \
+    F(U2, time_ref,   0)
+
+#define UBX_SCHEMA_MON_IO(F, A) \
+    F(U4, rx_bytes,   0)    \
+    F(U4, tx_bytes,   0)    \
+    F(U2, parity_errs, 0)   \
+    F(U2, framing_errs, 0)  \
+    F(U2, overrun_errs, 0)  \
+    F(U2, break_cond, 0)    \
+    F(U1, rx_busy,    0)    \
+    F(U1, tx_busy,    0)    \
+    F(U2, reserved1,  0)
+
+#define UBX_SCHEMA_MON_MSGPP(F, A) \
+    A(U2, msg1,       8)    \
+    A(U2, msg2,       8)    \
+    A(U2, msg3,       8)    \
+    A(U2, msg4,       8)    \
+    A(U2, msg5,       8)    \
+    A(U2, msg6,       8)    \
+    A(U4, skipped,    6)    /* per port */
+
+#define UBX_SCHEMA_MON_RXBUF(F, A) \
+    A(U2, pending,    6)    \
+    A(U1, usage,      6)    \
+    A(U1, peak_usage, 6)
+
+#define UBX_SCHEMA_MON_TXBUF(F, A) \
+    A(U2, pending,    6)    \
+    A(U1, usage,      6)    \
+    A(U1, peak_usage, 6)    \
+    F(U1, t_usage,    0)    \
+    F(U1, t_peak_usage, 0)  \
+    F(X1, errors,     0)    \
+    F(U1, reserved1,  0)
+
+#define UBX_SCHEMA_AID_INI(F, A) \
+    F(I4, x,          2)    \
+    F(I4, y,          2)    \
+    F(I4, z,          2)    \
+    F(U4, posacc,     2)    \
+    F(U2, tm_cfg,     0)    \
+    F(U2, wn,         0)    \
+    F(U4, tow,        0)    \
+    F(I4, tow_ns,     0)    \
+    F(U4, tacc_ms,    0)    \
+    F(U4, tacc_ns,    0)    \
+    F(I4, clkd,       0)    \
+    F(U4, clkdacc,    0)    \
+    F(X4, flags,      0)
+
+#define UBX_SCHEMA_AID_HUI(F, A) \
+    F(X4, health,     0)    \
+    F(R8, utc_a1,     0)    \
+    F(R8, utc_a0,     0)    \
+    F(I4, utc_tot,    0)    \
+    F(I2, utc_wnt,    0)    \
+    F(I2, utc_ls,     0)    \
+    F(I2, utc_wnf,    0)    \
+    F(I2, utc_dn,     0)    \
+    F(I2, utc_lsf,    0)    \
+    F(I2, utc_spare,  0)    \
+    F(R4, klob_a0,    0)    \
+    F(R4, klob_a1,    0)    \
+    F(R4, klob_a2,    0)    \
+    F(R4, klob_a3,    0)    \
+    F(R4, klob_b0,    0)    \
+    F(R4, klob_b1,    0)    \
+    F(R4, klob_b2,    0)    \
+    F(R4, klob_b3,    0)    \
+    F(X4, flags,      0)
+
+#define UBX_SCHEMA_AID_ALM(F, A) \
+    F(U4, sv_id,      0)    \
+    F(U4, gps_week,   0)    \
+    A(U4, alm_words,  8)    /* Present only if 'gps_week' != 0 */
+
+#define UBX_SCHEMA_AID_EPH(F, A) \
+    F(U4, sv_id,      0)    \
+    F(U4, present,    0)    \
+    A(U4, eph_words, 24)    /* Present only if 'present' != 0 */
+
+
+/*
+ * Message lists
+ *   X(CLASS, ID, name, short_len)   fixed layout, short_len 0 if none
+ *   X(CLASS, ID, name, count)       header + count repeated blocks
+ *   X(CLASS, ID, name, max)         repeated blocks only, up to max
+ */
+#define UBX_MESSAGES(X) \
+    X(NAV, POSLLH, nav_posllh, 0)   \
+    X(NAV, SOL,    nav_sol,    0)   \
+    X(NAV, VELNED, nav_velned, 0)   \
+    X(NAV, TIMEUTC, nav_timeutc, 0) \
+    X(TIM, TP,     tim_tp,     0)   \
+    X(TIM, TM2,    tim_tm2,    0)   \
+    X(TIM, SVIN,   tim_svin,   0)   \
+    X(AID, INI,    aid_ini,    0)   \
+    X(AID, HUI,    aid_hui,    0)   \
+    X(AID, ALM,    aid_alm,    8)   \
+    X(AID, EPH,    aid_eph,    8)   \
+    X(MON, MSGPP,  mon_msgpp,  0)   \
+    X(MON, RXBUF,  mon_rxbuf,  0)   \
+    X(MON, TXBUF,  mon_txbuf,  0)   \
+    X(CFG, RATE,   cfg_rate,   0)
+
+#define UBX_BLOCK_MESSAGES(X) \
+    X(NAV, SVINFO, nav_svinfo, num_ch) \
+    X(RXM, RAW,    rxm_raw,    num_sv)
+
+#define UBX_ARRAY_MESSAGES(X) \
+    X(MON, IO,     mon_io,     6)
+
+
+/* Generated payload structs */
+#define UBX_T_U1    uint8_t
+#define UBX_T_I1    int8_t
+#define UBX_T_X1    uint8_t
+#define UBX_T_U2    uint16_t
+#define UBX_T_I2    int16_t
+#define UBX_T_U4    uint32_t
+#define UBX_T_I4    int32_t
+#define UBX_T_X4    uint32_t
+#define UBX_T_R4    float
+#define UBX_T_R8    double
+
+#define _UBX_DECL_F(t, name, dec)   UBX_T_##t name;
+#define _UBX_DECL_A(t, name, n)     UBX_T_##t name[n];
+
+#define _UBX_STRUCT(K, I, name, x) \
+    struct ubx_##name { UBX_SCHEMA_##K##_##I(_UBX_DECL_F, _UBX_DECL_A) } __attribute__((packed));
+#define _UBX_BLOCK_STRUCT(K, I, name, count) \
+    _UBX_STRUCT(K, I, name, count) \
+    struct ubx_##name##_block { UBX_SCHEMA_##K##_##I##_BLOCK(_UBX_DECL_F, _UBX_DECL_A) } __attribute__((packed));
+
+UBX_MESSAGES(_UBX_STRUCT)
+UBX_BLOCK_MESSAGES(_UBX_BLOCK_STRUCT)
+UBX_ARRAY_MESSAGES(_UBX_STRUCT)
+
+
+/* Generated zero-copy views: a compare or two, no copy */
+#define _UBX_GET(K, I, name, short_len) \
+static inline const struct ubx_##name *ubx_##name##_get(const void *pl, int len) \
+{ \
+    return ((len == (int)sizeof(struct ubx_##name)) | \
+            ((short_len) && (len == (short_len)))) ? (const struct ubx_##name *)pl : NULL; \
+}
+
+#define _UBX_BLOCK_GET(K, I, name, count) \
+static inline const struct ubx_##name *ubx_##name##_get(const void *pl, int len) \
+{ \
+    const struct ubx_##name *m = (const struct ubx_##name *)pl; \
+    if(len < (int)sizeof(struct ubx_##name)) \
+        return NULL; \
+    return (len == (int)(sizeof(struct ubx_##name) + \
+                         m->count * sizeof(struct ubx_##name##_block))) ? m : NULL; \
+} \
+static inline const struct ubx_##name##_block *ubx_##name##_block(const struct ubx_##name *m, int i) \
+{ \
+    return (const struct ubx_##name##_block *)(m + 1) + i; \
+}
+
+#define _UBX_ARRAY_GET(K, I, name, max) \
+static inline const struct ubx_##name *ubx_##name##_get(const void *pl, int len) \
+{ \
+    return ((len > 0) && (len <= (max) * (int)sizeof(struct ubx_##name)) && \
+            (len % sizeof(struct ubx_##name) == 0)) ? (const struct ubx_##name *)pl : NULL; \
+} \
+static inline int ubx_##name##_count(int len) \
+{ \
+    return len / sizeof(struct ubx_##name); \
+}
+
+UBX_MESSAGES(_UBX_GET)
+UBX_BLOCK_MESSAGES(_UBX_BLOCK_GET)
+UBX_ARRAY_MESSAGES(_UBX_ARRAY_GET)
+
+
+/* Generated encoders and serializers (ubxSchema.c) */
+struct json_buf;
+
+#define _UBX_PROTOS(K, I, name, x) \
+int ubx_##name##_encode(void *buf, int size, const struct ubx_##name *m); \
+int ubx_##name##_json(struct json_buf *jb, const struct ubx_##name *m);
+#define _UBX_BLOCK_PROTOS(K, I, name, count) \
+int ubx_##name##_encode(void *buf, int size, const struct ubx_##name *m, \
+                        const struct ubx_##name##_block *blocks); \
+int ubx_##name##_json(struct json_buf *jb, const struct ubx_##name *m);
+
+#define _UBX_ARRAY_PROTOS(K, I, name, max) \
+int ubx_##name##_encode(void *buf, int size, const struct ubx_##name *m, int n); \
+int ubx_##name##_json(struct json_buf *jb, const struct ubx_##name *m, int n);
+
+UBX_MESSAGES(_UBX_PROTOS)
+UBX_BLOCK_MESSAGES(_UBX_BLOCK_PROTOS)
+UBX_ARRAY_MESSAGES(_UBX_ARRAY_PROTOS)
+
+
+/* Any message of the lists, by class / id */
+int ubx_schema_check(int msg_class, int msg_id, const void *pl, int len);
+int ubx_schema_json(struct json_buf *jb, const void *frame, int len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __UBX_SCHEMA_H__ */
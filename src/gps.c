@@ -26,13 +26,154 @@
 #define GET_FIELD_U(w, nb, pos) (((w) >> (pos)) & ((1<<(nb))-1))
 #define GET_FIELD_S(w, nb, pos) (((int)((w) << (32-(nb)-(pos)))) >> (32-(nb)))
 
+
+/*
+ * Parity (IS-GPS-200 20.3.5.2, (32,26) Hamming code)
+ *
+ * Contribution of each data byte d1..d24 to the six parity bits
+ * D25..D30 (D25 in bit 5). Generated from the parity equations.
+ */
+static const uint8_t gps_parity_tbl[3][256] = {
+	/* d1..d8 */
+	{
+		0x00, 0x0d, 0x1a, 0x17, 0x37, 0x3a, 0x2d, 0x20, 0x2f, 0x22, 0x35, 0x38, 0x18, 0x15, 0x02, 0x0f,
+		0x1c, 0x11, 0x06, 0x0b, 0x2b, 0x26, 0x31, 0x3c, 0x33, 0x3e, 0x29, 0x24, 0x04, 0x09, 0x1e, 0x13,
+		0x3b, 0x36, 0x21, 0x2c, 0x0c, 0x01, 0x16, 0x1b, 0x14, 0x19, 0x0e, 0x03, 0x23, 0x2e, 0x39, 0x34,
+		0x27, 0x2a, 0x3d, 0x30, 0x10, 0x1d, 0x0a, 0x07, 0x08, 0x05, 0x12, 0x1f, 0x3f, 0x32, 0x25, 0x28,
+		0x34, 0x39, 0x2e, 0x23, 0x03, 0x0e, 0x19, 0x14, 0x1b, 0x16, 0x01, 0x0c, 0x2c, 0x21, 0x36, 0x3b,
+		0x28, 0x25, 0x32, 0x3f, 0x1f, 0x12, 0x05, 0x08, 0x07, 0x0a, 0x1d, 0x10, 0x30, 0x3d, 0x2a, 0x27,
+		0x0f, 0x02, 0x15, 0x18, 0x38, 0x35, 0x22, 0x2f, 0x20, 0x2d, 0x3a, 0x37, 0x17, 0x1a, 0x0d, 0x00,
+		0x13, 0x1e, 0x09, 0x04, 0x24, 0x29, 0x3e, 0x33, 0x3c, 0x31, 0x26, 0x2b, 0x0b, 0x06, 0x11, 0x1c,
+		0x2a, 0x27, 0x30, 0x3d, 0x1d, 0x10, 0x07, 0x0a, 0x05, 0x08, 0x1f, 0x12, 0x32, 0x3f, 0x28, 0x25,
+		0x36, 0x3b, 0x2c, 0x21, 0x01, 0x0c, 0x1b, 0x16, 0x19, 0x14, 0x03, 0x0e, 0x2e, 0x23, 0x34, 0x39,
+		0x11, 0x1c, 0x0b, 0x06, 0x26, 0x2b, 0x3c, 0x31, 0x3e, 0x33, 0x24, 0x29, 0x09, 0x04, 0x13, 0x1e,
+		0x0d, 0x00, 0x17, 0x1a, 0x3a, 0x37, 0x20, 0x2d, 0x22, 0x2f, 0x38, 0x35, 0x15, 0x18, 0x0f, 0x02,
+		0x1e, 0x13, 0x04, 0x09, 0x29, 0x24, 0x33, 0x3e, 0x31, 0x3c, 0x2b, 0x26, 0x06, 0x0b, 0x1c, 0x11,
+		0x02, 0x0f, 0x18, 0x15, 0x35, 0x38, 0x2f, 0x22, 0x2d, 0x20, 0x37, 0x3a, 0x1a, 0x17, 0x00, 0x0d,
+		0x25, 0x28, 0x3f, 0x32, 0x12, 0x1f, 0x08, 0x05, 0x0a, 0x07, 0x10, 0x1d, 0x3d, 0x30, 0x27, 0x2a,
+		0x39, 0x34, 0x23, 0x2e, 0x0e, 0x03, 0x14, 0x19, 0x16, 0x1b, 0x0c, 0x01, 0x21, 0x2c, 0x3b, 0x36,
+	},
+	/* d9..d16 */
+	{
+		0x00, 0x0e, 0x1f, 0x11, 0x3e, 0x30, 0x21, 0x2f, 0x3d, 0x33, 0x22, 0x2c, 0x03, 0x0d, 0x1c, 0x12,
+		0x38, 0x36, 0x27, 0x29, 0x06, 0x08, 0x19, 0x17, 0x05, 0x0b, 0x1a, 0x14, 0x3b, 0x35, 0x24, 0x2a,
+		0x31, 0x3f, 0x2e, 0x20, 0x0f, 0x01, 0x10, 0x1e, 0x0c, 0x02, 0x13, 0x1d, 0x32, 0x3c, 0x2d, 0x23,
+		0x09, 0x07, 0x16, 0x18, 0x37, 0x39, 0x28, 0x26, 0x34, 0x3a, 0x2b, 0x25, 0x0a, 0x04, 0x15, 0x1b,
+		0x23, 0x2d, 0x3c, 0x32, 0x1d, 0x13, 0x02, 0x0c, 0x1e, 0x10, 0x01, 0x0f, 0x20, 0x2e, 0x3f, 0x31,
+		0x1b, 0x15, 0x04, 0x0a, 0x25, 0x2b, 0x3a, 0x34, 0x26, 0x28, 0x39, 0x37, 0x18, 0x16, 0x07, 0x09,
+		0x12, 0x1c, 0x0d, 0x03, 0x2c, 0x22, 0x33, 0x3d, 0x2f, 0x21, 0x30, 0x3e, 0x11, 0x1f, 0x0e, 0x00,
+		0x2a, 0x24, 0x35, 0x3b, 0x14, 0x1a, 0x0b, 0x05, 0x17, 0x19, 0x08, 0x06, 0x29, 0x27, 0x36, 0x38,
+		0x07, 0x09, 0x18, 0x16, 0x39, 0x37, 0x26, 0x28, 0x3a, 0x34, 0x25, 0x2b, 0x04, 0x0a, 0x1b, 0x15,
+		0x3f, 0x31, 0x20, 0x2e, 0x01, 0x0f, 0x1e, 0x10, 0x02, 0x0c, 0x1d, 0x13, 0x3c, 0x32, 0x23, 0x2d,
+		0x36, 0x38, 0x29, 0x27, 0x08, 0x06, 0x17, 0x19, 0x0b, 0x05, 0x14, 0x1a, 0x35, 0x3b, 0x2a, 0x24,
+		0x0e, 0x00, 0x11, 0x1f, 0x30, 0x3e, 0x2f, 0x21, 0x33, 0x3d, 0x2c, 0x22, 0x0d, 0x03, 0x12, 0x1c,
+		0x24, 0x2a, 0x3b, 0x35, 0x1a, 0x14, 0x05, 0x0b, 0x19, 0x17, 0x06, 0x08, 0x27, 0x29, 0x38, 0x36,
+		0x1c, 0x12, 0x03, 0x0d, 0x22, 0x2c, 0x3d, 0x33, 0x21, 0x2f, 0x3e, 0x30, 0x1f, 0x11, 0x00, 0x0e,
+		0x15, 0x1b, 0x0a, 0x04, 0x2b, 0x25, 0x34, 0x3a, 0x28, 0x26, 0x37, 0x39, 0x16, 0x18, 0x09, 0x07,
+		0x2d, 0x23, 0x32, 0x3c, 0x13, 0x1d, 0x0c, 0x02, 0x10, 0x1e, 0x0f, 0x01, 0x2e, 0x20, 0x31, 0x3f,
+	},
+	/* d17..d24 */
+	{
+		0x00, 0x13, 0x25, 0x36, 0x0b, 0x18, 0x2e, 0x3d, 0x16, 0x05, 0x33, 0x20, 0x1d, 0x0e, 0x38, 0x2b,
+		0x2c, 0x3f, 0x09, 0x1a, 0x27, 0x34, 0x02, 0x11, 0x3a, 0x29, 0x1f, 0x0c, 0x31, 0x22, 0x14, 0x07,
+		0x19, 0x0a, 0x3c, 0x2f, 0x12, 0x01, 0x37, 0x24, 0x0f, 0x1c, 0x2a, 0x39, 0x04, 0x17, 0x21, 0x32,
+		0x35, 0x26, 0x10, 0x03, 0x3e, 0x2d, 0x1b, 0x08, 0x23, 0x30, 0x06, 0x15, 0x28, 0x3b, 0x0d, 0x1e,
+		0x32, 0x21, 0x17, 0x04, 0x39, 0x2a, 0x1c, 0x0f, 0x24, 0x37, 0x01, 0x12, 0x2f, 0x3c, 0x0a, 0x19,
+		0x1e, 0x0d, 0x3b, 0x28, 0x15, 0x06, 0x30, 0x23, 0x08, 0x1b, 0x2d, 0x3e, 0x03, 0x10, 0x26, 0x35,
+		0x2b, 0x38, 0x0e, 0x1d, 0x20, 0x33, 0x05, 0x16, 0x3d, 0x2e, 0x18, 0x0b, 0x36, 0x25, 0x13, 0x00,
+		0x07, 0x14, 0x22, 0x31, 0x0c, 0x1f, 0x29, 0x3a, 0x11, 0x02, 0x34, 0x27, 0x1a, 0x09, 0x3f, 0x2c,
+		0x26, 0x35, 0x03, 0x10, 0x2d, 0x3e, 0x08, 0x1b, 0x30, 0x23, 0x15, 0x06, 0x3b, 0x28, 0x1e, 0x0d,
+		0x0a, 0x19, 0x2f, 0x3c, 0x01, 0x12, 0x24, 0x37, 0x1c, 0x0f, 0x39, 0x2a, 0x17, 0x04, 0x32, 0x21,
+		0x3f, 0x2c, 0x1a, 0x09, 0x34, 0x27, 0x11, 0x02, 0x29, 0x3a, 0x0c, 0x1f, 0x22, 0x31, 0x07, 0x14,
+		0x13, 0x00, 0x36, 0x25, 0x18, 0x0b, 0x3d, 0x2e, 0x05, 0x16, 0x20, 0x33, 0x0e, 0x1d, 0x2b, 0x38,
+		0x14, 0x07, 0x31, 0x22, 0x1f, 0x0c, 0x3a, 0x29, 0x02, 0x11, 0x27, 0x34, 0x09, 0x1a, 0x2c, 0x3f,
+		0x38, 0x2b, 0x1d, 0x0e, 0x33, 0x20, 0x16, 0x05, 0x2e, 0x3d, 0x0b, 0x18, 0x25, 0x36, 0x00, 0x13,
+		0x0d, 0x1e, 0x28, 0x3b, 0x06, 0x15, 0x23, 0x30, 0x1b, 0x08, 0x3e, 0x2d, 0x10, 0x03, 0x35, 0x26,
+		0x21, 0x32, 0x04, 0x17, 0x2a, 0x39, 0x0f, 0x1c, 0x37, 0x24, 0x12, 0x01, 0x3c, 0x2f, 0x19, 0x0a,
+	},
+};
+
+	/* contribution of D29* and D30* of the previous word */
+#define GPS_PARITY_D29S		0x29
+#define GPS_PARITY_D30S		0x16
+
+/* Parity mismatch bits of a 30 bit word (D1 in bit 29 ... D30 in bit 0),
+ * given the previous word of the stream. 0 when the parity is correct */
+static inline uint32_t
+_gps_parity_syndrome(uint32_t word, uint32_t prev)
+{
+	uint32_t d29s = (prev >> 1) & 1;
+	uint32_t d30s = prev & 1;
+	uint32_t d = ((word >> 6) ^ (0xffffff * d30s)) & 0xffffff;
+	uint32_t s;
+
+	s = gps_parity_tbl[0][d >> 16] ^
+	    gps_parity_tbl[1][(d >> 8) & 0xff] ^
+	    gps_parity_tbl[2][d & 0xff];
+	s ^= (GPS_PARITY_D29S * d29s) ^ (GPS_PARITY_D30S * d30s);
+
+	return s ^ (word & 0x3f);
+}
+
+/*
+ * Checks the parity of one 30 bit word.
+ * Returns 0 if valid, -1 otherwise
+ */
+int
+gps_parity_check_word(uint32_t word, uint32_t prev)
+{
+	return _gps_parity_syndrome(word, prev) ? -1 : 0;
+}
+
+/*
+ * Returns the 24 data bits of a 30 bit word, with the D30* complement
+ * removed, i.e. in the format the unpack functions below expect
+ */
+uint32_t
+gps_word_data(uint32_t word, uint32_t prev)
+{
+	return ((word >> 6) ^ (0xffffff * (prev & 1))) & 0xffffff;
+}
+
+/*
+ * Checks the parity of n_sf complete subframes (10 words each, starting
+ * with the TLM word) in one pass. Word 10 of every subframe is built to
+ * end with D29 = D30 = 0, so each subframe is checked independently.
+ *
+ * fail[i] gets bit j set when word j of subframe i failed (fail may be
+ * NULL). Returns the total number of failed words
+ */
+int
+gps_parity_check_subframes(const uint32_t *words, int n_sf, uint16_t *fail)
+{
+	int i, j, n = 0;
+
+	for (i=0; i<n_sf; i++) {
+		const uint32_t *sf = &words[i * GPS_SF_WORDS];
+		uint32_t prev = 0, m = 0;
+
+		for (j=0; j<GPS_SF_WORDS; j++) {
+			m |= (_gps_parity_syndrome(sf[j], prev) != 0) << j;
+			prev = sf[j];
+		}
+
+		n += __builtin_popcount(m);
+		if (fail)
+			fail[i] = m;
+	}
+
+	return n;
+}
+
+
 /*
  * Unpacks GPS Subframe 1,2,3 payloads (3 * 8 words)
  *
  * Note: eph->sv_id is not filled here since not present in those subframes
  *
- * (no parity bit checking is done, only the lower 24 bits of each word
- *  are used)
+ * (only the lower 24 bits of each word are used, words from a source that
+ *  still carries parity go through gps_parity_check_subframes() and
+ *  gps_word_data() first)
  */
 int
 gps_unpack_sf123(uint32_t *sf, struct gps_ephemeris_sv *eph)
@@ -102,8 +243,7 @@ gps_unpack_sf123(uint32_t *sf, struct gps_ephemeris_sv *eph)
 /*
  * Unpacks GPS Subframe 4 or 5 Almanac pages payload (8 words)
  *
- * (no parity bit checking is done, only the lower 24 bits of each word
- *  are used)
+ * (only the lower 24 bits of each word are used, see gps_unpack_sf123)
  */
 int
 gps_unpack_sf45_almanac(uint32_t *sf, struct gps_almanac_sv *alm)
@@ -123,6 +263,52 @@ gps_unpack_sf45_almanac(uint32_t *sf, struct gps_almanac_sv *alm)
 	                   GET_FIELD_U(sf[7], 3,  2);
 	alm->a_f1	= GET_FIELD_S(sf[7], 11,  5);
 
+	/* Data ID of an almanac page is always 01 */
+	if (GET_FIELD_U(sf[0], 2, 22) != 1)
+		return -1;
+
+	return 0;
+}
+
+
+/*
+ * Range checks of decoded data, against the limits of IS-GPS-200 and of
+ * the GPS constellation. Receivers delivering parity stripped words
+ * (u-blox AID-EPH, AID-ALM, RXM-SFRB) leave this as the last line of
+ * defense before the data is stored.
+ *
+ * Return 0 if plausible, -1 otherwise
+ */
+
+	/* sqrt(A) of the GPS MEO orbits, 5153.7 m^(1/2) nominal */
+#define SQRTA_MIN	5000.0
+#define SQRTA_MAX	5300.0
+#define ECC_MAX		0.03
+#define TOE_MAX		37799	/* 604784 s / 2^4 */
+
+int
+gps_check_ephemeris(const struct gps_ephemeris_sv *eph)
+{
+	if ((eph->a_powhalf < (unsigned int)(SQRTA_MIN * (1 << 19))) ||
+	    (eph->a_powhalf > (unsigned int)(SQRTA_MAX * (1 << 19))))
+		return -1;
+	if (eph->e > (unsigned int)(ECC_MAX * 0x1p33))
+		return -1;
+	if ((eph->t_oe > TOE_MAX) || (eph->t_oc > TOE_MAX))
+		return -1;
+
+	return 0;
+}
+
+int
+gps_check_almanac(const struct gps_almanac_sv *alm)
+{
+	if ((alm->a_powhalf < (int)(SQRTA_MIN * (1 << 11))) ||
+	    (alm->a_powhalf > (int)(SQRTA_MAX * (1 << 11))))
+		return -1;
+	if (alm->e > (int)(ECC_MAX * (1 << 21)))
+		return -1;
+
 	return 0;
 }
 
@@ -0,0 +1,208 @@
+/*
+ * gpsPack.c
+ *
+ * Bit packed in-memory representation of the GPS assist data (see gpsPack.h)
+ *
+ * The conversions walk tables generated from the same GPS_PACK_*_FIELDS
+ * lists as the inline accessors: for each field, where it lives in the
+ * plain struct, its bit offset in the record, its width and signedness.
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "gps.h"
+#include "gpsPack.h"
+
+
+struct pack_field {
+    uint16_t offset;        /* in the plain struct */
+    uint16_t bit;           /* in the packed record */
+    uint8_t  bits;
+    uint8_t  is_signed;
+};
+
+#define PF_IONO(n, b, s)    { offsetof(struct gps_ionosphere_model, n), offsetof(struct gps_pack_iono_layout, n), b, s },
+#define PF_UTC(n, b, s)     { offsetof(struct gps_utc_model, n),        offsetof(struct gps_pack_utc_layout, n),  b, s },
+#define PF_ALM(n, b, s)     { offsetof(struct gps_almanac_sv, n),       offsetof(struct gps_pack_alm_layout, n),  b, s },
+#define PF_EPH(n, b, s)     { offsetof(struct gps_ephemeris_sv, n),     offsetof(struct gps_pack_eph_layout, n),  b, s },
+
+static const struct pack_field ionoFields_G[] = { GPS_PACK_IONO_FIELDS(PF_IONO) };
+static const struct pack_field utcFields_G[]  = { GPS_PACK_UTC_FIELDS(PF_UTC)   };
+static const struct pack_field almFields_G[]  = { GPS_PACK_ALM_FIELDS(PF_ALM)   };
+static const struct pack_field ephFields_G[]  = { GPS_PACK_EPH_FIELDS(PF_EPH)   };
+
+#define NFIELDS(t)  ((int)(sizeof(t) / sizeof((t)[0])))
+
+
+/* Does v fit in the field? Plain struct members are all 32 bits wide */
+static int fits(const struct pack_field *f, int32_t v)
+{
+    if(f->bits == 32){
+        return 1;
+    }
+    if(f->is_signed){
+        return v >= -(1 << (f->bits - 1)) && v < (1 << (f->bits - 1));
+    }
+    return (uint32_t)v < (1u << f->bits);
+}
+
+static int packRecord(uint32_t *w, int n_words, const void *s,
+                      const struct pack_field *f, int n)
+{
+    memset(w, 0, n_words * sizeof(uint32_t));
+
+    for(int i=0; i < n; i++){
+        int32_t v = *(const int32_t *)((const char *)s + f[i].offset);
+
+        if(!fits(&f[i], v)){
+            return -1;
+        }
+        _gps_pack_set(w, f[i].bit, f[i].bits, (uint32_t)v);
+    }
+    return 0;
+}
+
+static void unpackRecord(void *s, const uint32_t *w, const struct pack_field *f, int n)
+{
+    for(int i=0; i < n; i++){
+        *(int32_t *)((char *)s + f[i].offset) =
+            (int32_t)_gps_pack_get(w, f[i].bit, f[i].bits, f[i].is_signed);
+    }
+}
+
+
+/* Single records, the _from() ones return -1 if a field is out of range */
+int gps_pack_iono_from(struct gps_pack_iono *r, const struct gps_ionosphere_model *s)
+{
+    return packRecord(r->w, GPS_PACK_IONO_WORDS, s, ionoFields_G, NFIELDS(ionoFields_G));
+}
+
+void gps_pack_iono_to(struct gps_ionosphere_model *s, const struct gps_pack_iono *r)
+{
+    unpackRecord(s, r->w, ionoFields_G, NFIELDS(ionoFields_G));
+}
+
+int gps_pack_utc_from(struct gps_pack_utc *r, const struct gps_utc_model *s)
+{
+    return packRecord(r->w, GPS_PACK_UTC_WORDS, s, utcFields_G, NFIELDS(utcFields_G));
+}
+
+void gps_pack_utc_to(struct gps_utc_model *s, const struct gps_pack_utc *r)
+{
+    unpackRecord(s, r->w, utcFields_G, NFIELDS(utcFields_G));
+}
+
+int gps_pack_alm_from(struct gps_pack_alm *r, const struct gps_almanac_sv *s)
+{
+    return packRecord(r->w, GPS_PACK_ALM_WORDS, s, almFields_G, NFIELDS(almFields_G));
+}
+
+void gps_pack_alm_to(struct gps_almanac_sv *s, const struct gps_pack_alm *r)
+{
+    unpackRecord(s, r->w, almFields_G, NFIELDS(almFields_G));
+}
+
+int gps_pack_eph_from(struct gps_pack_eph *r, const struct gps_ephemeris_sv *s)
+{
+    return packRecord(r->w, GPS_PACK_EPH_WORDS, s, ephFields_G, NFIELDS(ephFields_G));
+}
+
+void gps_pack_eph_to(struct gps_ephemeris_sv *s, const struct gps_pack_eph *r)
+{
+    unpackRecord(s, r->w, ephFields_G, NFIELDS(ephFields_G));
+}
+
+
+/* Bytes gps_pack() needs for this set */
+size_t gps_pack_size(const struct gps_assist_data *gps)
+{
+    return GPS_PACK_SIZE(gps->almanac.n_sv, gps->ephemeris.n_sv);
+}
+
+/*
+ * Packs gps into p (size bytes available). Returns the bytes used, or -1
+ * if p is too small or a field doesn't fit its broadcast width.
+ */
+int gps_pack(struct gps_pack *p, size_t size, const struct gps_assist_data *gps)
+{
+    int n_alm = gps->almanac.n_sv;
+    int n_eph = gps->ephemeris.n_sv;
+    size_t need;
+
+    if(n_alm < 0 || n_alm > MAX_SV || n_eph < 0 || n_eph > MAX_SV ||
+       (unsigned)gps->almanac.wna > 0xff){
+        return -1;
+    }
+    need = GPS_PACK_SIZE(n_alm, n_eph);
+    if(size < need){
+        return -1;
+    }
+
+    memset(p, 0, sizeof(struct gps_pack));
+    p->size           = need;
+    p->gen            = gps->gen;
+    p->gen_ionosphere = gps->gen_ionosphere;
+    p->gen_utc        = gps->gen_utc;
+    p->fields         = gps->fields;
+    p->n_alm          = n_alm;
+    p->n_eph          = n_eph;
+    p->wna            = gps->almanac.wna;
+    p->ref_pos        = gps->ref_pos;
+    p->ref_time       = gps->ref_time;
+
+    if(gps_pack_iono_from(&p->ionosphere, &gps->ionosphere) ||
+       gps_pack_utc_from(&p->utc, &gps->utc)){
+        return -1;
+    }
+    for(int i=0; i < n_alm; i++){
+        if(gps_pack_alm_from(gps_pack_alm_sv(p, i), &gps->almanac.svs[i])){
+            return -1;
+        }
+    }
+    for(int i=0; i < n_eph; i++){
+        if(gps_pack_eph_from(gps_pack_eph_sv(p, i), &gps->ephemeris.svs[i])){
+            return -1;
+        }
+    }
+    memcpy(gps_pack_alm_gens(p), gps->almanac.gen, n_alm * sizeof(uint32_t));
+    memcpy(gps_pack_eph_gens(p), gps->ephemeris.gen, n_eph * sizeof(uint32_t));
+
+    return need;
+}
+
+/* Expands p back into gps. Returns 0, or -1 if p is inconsistent */
+int gps_unpack(struct gps_assist_data *gps, const struct gps_pack *p)
+{
+    if(p->n_alm > MAX_SV || p->n_eph > MAX_SV ||
+       p->size != GPS_PACK_SIZE(p->n_alm, p->n_eph)){
+        return -1;
+    }
+
+    memset(gps, 0, sizeof(struct gps_assist_data));
+    gps->fields         = p->fields;
+    gps->gen            = p->gen;
+    gps->gen_ionosphere = p->gen_ionosphere;
+    gps->gen_utc        = p->gen_utc;
+    gps->ref_pos        = p->ref_pos;
+    gps->ref_time       = p->ref_time;
+
+    gps_pack_iono_to(&gps->ionosphere, &p->ionosphere);
+    gps_pack_utc_to(&gps->utc, &p->utc);
+
+    gps->almanac.wna  = p->wna;
+    gps->almanac.n_sv = p->n_alm;
+    for(int i=0; i < p->n_alm; i++){
+        gps_pack_alm_to(&gps->almanac.svs[i], gps_pack_alm_sv(p, i));
+    }
+    gps->ephemeris.n_sv = p->n_eph;
+    for(int i=0; i < p->n_eph; i++){
+        gps_pack_eph_to(&gps->ephemeris.svs[i], gps_pack_eph_sv(p, i));
+    }
+    memcpy(gps->almanac.gen, gps_pack_alm_gens(p), p->n_alm * sizeof(uint32_t));
+    memcpy(gps->ephemeris.gen, gps_pack_eph_gens(p), p->n_eph * sizeof(uint32_t));
+
+    return 0;
+}
@@ -0,0 +1,108 @@
+/*
+ * gpsView.c
+ *
+ * Engineering units view of the GPS assist data (see gpsView.h)
+ *
+ * All scale factors are powers of two, so both directions are a single
+ * exact multiplication by a constant folded at compile time.
+ *
+ */
+
+#include <string.h>
+
+#include "gps.h"
+#include "gpsView.h"
+
+
+#define FROM_RAW(f, lsb, unit)  v->f = (double)raw->f * ((lsb) * (unit));
+#define TO_RAW(f, lsb, unit)    raw->f = (int)(v->f * (1.0 / ((lsb) * (unit))));
+
+
+void gps_iono_from_raw(struct gps_iono_view *v, const struct gps_ionosphere_model *raw)
+{
+    GPS_IONO_FIELDS(FROM_RAW)
+}
+
+void gps_iono_to_raw(struct gps_ionosphere_model *raw, const struct gps_iono_view *v)
+{
+    GPS_IONO_FIELDS(TO_RAW)
+}
+
+void gps_utc_from_raw(struct gps_utc_view *v, const struct gps_utc_model *raw)
+{
+    GPS_UTC_FIELDS(FROM_RAW)
+}
+
+void gps_utc_to_raw(struct gps_utc_model *raw, const struct gps_utc_view *v)
+{
+    GPS_UTC_FIELDS(TO_RAW)
+}
+
+void gps_alm_from_raw(struct gps_alm_view_sv *v, const struct gps_almanac_sv *raw)
+{
+    v->sv_id     = raw->sv_id;
+    v->sv_health = raw->sv_health;
+    GPS_ALM_FIELDS(FROM_RAW)
+}
+
+void gps_eph_from_raw(struct gps_eph_view_sv *v, const struct gps_ephemeris_sv *raw)
+{
+    v->sv_id     = raw->sv_id;
+    v->sv_health = raw->sv_health;
+    v->iodc      = raw->iodc;
+    GPS_EPH_FIELDS(FROM_RAW)
+}
+
+
+void gps_view_init(struct gps_assist_view *v)
+{
+    memset(v, 0, sizeof(struct gps_assist_view));
+}
+
+
+/*
+ * Brings the view up to date with the store, converting only the parts
+ * whose generation moved. Returns the number of converted entries.
+ */
+int gps_view_refresh(struct gps_assist_view *v, const struct gps_assist_data *gps)
+{
+    int n = 0;
+
+    if(v->gen == gps->gen){
+        return 0;
+    }
+
+    if(v->gen_ionosphere != gps->gen_ionosphere){
+        gps_iono_from_raw(&v->iono, &gps->ionosphere);
+        v->gen_ionosphere = gps->gen_ionosphere;
+        n++;
+    }
+
+    if(v->gen_utc != gps->gen_utc){
+        gps_utc_from_raw(&v->utc, &gps->utc);
+        v->gen_utc = gps->gen_utc;
+        n++;
+    }
+
+    for(int i=0; i < gps->almanac.n_sv; i++){
+        if(v->alm_gen[i] != gps->almanac.gen[i]){
+            gps_alm_from_raw(&v->alm[i], &gps->almanac.svs[i]);
+            v->alm_gen[i] = gps->almanac.gen[i];
+            n++;
+        }
+    }
+    v->n_alm = gps->almanac.n_sv;
+
+    for(int i=0; i < gps->ephemeris.n_sv; i++){
+        if(v->eph_gen[i] != gps->ephemeris.gen[i]){
+            gps_eph_from_raw(&v->eph[i], &gps->ephemeris.svs[i]);
+            v->eph_gen[i] = gps->ephemeris.gen[i];
+            n++;
+        }
+    }
+    v->n_eph = gps->ephemeris.n_sv;
+
+    v->gen = gps->gen;
+
+    return n;
+}
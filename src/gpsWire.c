@@ -0,0 +1,486 @@
+/*
+ * gpsWire.c
+ *
+ * Compact binary wire format of the GPS assist data (see gpsWire.h)
+ *
+ * Records are driven by the field tables below: one entry per struct
+ * member, giving the number of little endian bytes it takes on the wire
+ * and whether it has to be sign extended when read back.
+ *
+ */
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "gps.h"
+#include "gpsWire.h"
+
+
+#define WF(type, f, bytes, sgn)  { #f, offsetof(struct type, f), bytes, sgn }
+
+static const struct gps_wire_field ionoFields_G[] = {
+    WF(gps_ionosphere_model, alpha_0,     1, 1),
+    WF(gps_ionosphere_model, alpha_1,     1, 1),
+    WF(gps_ionosphere_model, alpha_2,     1, 1),
+    WF(gps_ionosphere_model, alpha_3,     1, 1),
+    WF(gps_ionosphere_model, beta_0,      1, 1),
+    WF(gps_ionosphere_model, beta_1,      1, 1),
+    WF(gps_ionosphere_model, beta_2,      1, 1),
+    WF(gps_ionosphere_model, beta_3,      1, 1),
+};
+
+static const struct gps_wire_field utcFields_G[] = {
+    WF(gps_utc_model, a0,                 4, 1),
+    WF(gps_utc_model, a1,                 3, 1),
+    WF(gps_utc_model, delta_t_ls,         1, 1),
+    WF(gps_utc_model, t_ot,               1, 0),
+    WF(gps_utc_model, wn_t,               1, 0),
+    WF(gps_utc_model, wn_lsf,             1, 0),
+    WF(gps_utc_model, dn,                 1, 0),
+    WF(gps_utc_model, delta_t_lsf,        1, 1),
+};
+
+static const struct gps_wire_field almFields_G[] = {
+    WF(gps_almanac_sv, sv_health,         1, 0),
+    WF(gps_almanac_sv, e,                 2, 0),
+    WF(gps_almanac_sv, t_oa,              1, 0),
+    WF(gps_almanac_sv, ksii,              2, 1),
+    WF(gps_almanac_sv, omega_dot,         2, 1),
+    WF(gps_almanac_sv, a_powhalf,         3, 0),
+    WF(gps_almanac_sv, omega_0,           3, 1),
+    WF(gps_almanac_sv, w,                 3, 1),
+    WF(gps_almanac_sv, m_0,               3, 1),
+    WF(gps_almanac_sv, a_f0,              2, 1),
+    WF(gps_almanac_sv, a_f1,              2, 1),
+};
+
+static const struct gps_wire_field ephFields_G[] = {
+    WF(gps_ephemeris_sv, code_on_l2,      1, 0),
+    WF(gps_ephemeris_sv, week_no,         2, 0),
+    WF(gps_ephemeris_sv, l2_p_flag,       1, 0),
+    WF(gps_ephemeris_sv, sv_ura,          1, 0),
+    WF(gps_ephemeris_sv, sv_health,       1, 0),
+    WF(gps_ephemeris_sv, t_gd,            1, 1),
+    WF(gps_ephemeris_sv, iodc,            2, 0),
+    WF(gps_ephemeris_sv, t_oc,            2, 0),
+    WF(gps_ephemeris_sv, a_f2,            1, 1),
+    WF(gps_ephemeris_sv, a_f1,            2, 1),
+    WF(gps_ephemeris_sv, a_f0,            3, 1),
+    WF(gps_ephemeris_sv, c_rs,            2, 1),
+    WF(gps_ephemeris_sv, delta_n,         2, 1),
+    WF(gps_ephemeris_sv, m_0,             4, 1),
+    WF(gps_ephemeris_sv, c_uc,            2, 1),
+    WF(gps_ephemeris_sv, e,               4, 0),
+    WF(gps_ephemeris_sv, c_us,            2, 1),
+    WF(gps_ephemeris_sv, a_powhalf,       4, 0),
+    WF(gps_ephemeris_sv, t_oe,            2, 0),
+    WF(gps_ephemeris_sv, fit_flag,        1, 0),
+    WF(gps_ephemeris_sv, c_ic,            2, 1),
+    WF(gps_ephemeris_sv, omega_0,         4, 1),
+    WF(gps_ephemeris_sv, c_is,            2, 1),
+    WF(gps_ephemeris_sv, i_0,             4, 1),
+    WF(gps_ephemeris_sv, c_rc,            2, 1),
+    WF(gps_ephemeris_sv, w,               4, 1),
+    WF(gps_ephemeris_sv, omega_dot,       3, 1),
+    WF(gps_ephemeris_sv, idot,            2, 1),
+    WF(gps_ephemeris_sv, aodo,            1, 0),
+};
+
+#define NFIELDS(t)  ((int)(sizeof(t) / sizeof((t)[0])))
+
+static const struct {
+    const struct gps_wire_field *f;
+    int n;
+} schema_G[GPS_WIRE_NREC] = {
+    [GPS_WIRE_REC_IONO] = { ionoFields_G, NFIELDS(ionoFields_G) },
+    [GPS_WIRE_REC_UTC]  = { utcFields_G,  NFIELDS(utcFields_G)  },
+    [GPS_WIRE_REC_ALM]  = { almFields_G,  NFIELDS(almFields_G)  },
+    [GPS_WIRE_REC_EPH]  = { ephFields_G,  NFIELDS(ephFields_G)  },
+};
+
+#define IONO_LEN    8
+#define UTC_LEN     13
+#define ALM_LEN     24
+#define EPH_LEN     64
+#define REFPOS_LEN  12
+#define REFTIME_LEN 14
+
+#define SECTIONS    (GPS_FIELD_IONOSPHERE | GPS_FIELD_UTC | GPS_FIELD_ALMANAC | \
+                     GPS_FIELD_EPHEMERIS | GPS_FIELD_REFPOS | GPS_FIELD_REFTIME)
+
+
+const struct gps_wire_field *gps_wire_schema(enum gps_wire_record rec, int *n_fields)
+{
+    if((unsigned)rec >= GPS_WIRE_NREC){
+        return NULL;
+    }
+    if(n_fields){
+        *n_fields = schema_G[rec].n;
+    }
+    return schema_G[rec].f;
+}
+
+
+// Little endian helpers
+static inline uint8_t *put_le(uint8_t *p, uint64_t v, int bytes)
+{
+    for(int i=0; i < bytes; i++){
+        *p++ = (uint8_t)(v >> (8 * i));
+    }
+    return p;
+}
+
+static inline uint64_t get_le(const uint8_t *p, int bytes)
+{
+    uint64_t v = 0;
+
+    for(int i=0; i < bytes; i++){
+        v |= (uint64_t)p[i] << (8 * i);
+    }
+    return v;
+}
+
+static inline int64_t sign_extend(uint64_t v, int bytes)
+{
+    int shift = 64 - 8 * bytes;
+
+    return (int64_t)(v << shift) >> shift;
+}
+
+
+static uint8_t *put_record(uint8_t *p, enum gps_wire_record rec, const void *s)
+{
+    const struct gps_wire_field *f = schema_G[rec].f;
+
+    for(int i=0; i < schema_G[rec].n; i++){
+        const int *v = (const int *)((const char *)s + f[i].offset);
+        p = put_le(p, (uint32_t)*v, f[i].bytes);
+    }
+    return p;
+}
+
+static const uint8_t *get_record(const uint8_t *p, enum gps_wire_record rec, void *s)
+{
+    const struct gps_wire_field *f = schema_G[rec].f;
+
+    for(int i=0; i < schema_G[rec].n; i++){
+        int *v = (int *)((char *)s + f[i].offset);
+        uint64_t raw = get_le(p, f[i].bytes);
+
+        *v = f[i].is_signed ? (int)sign_extend(raw, f[i].bytes) : (int)raw;
+        p += f[i].bytes;
+    }
+    return p;
+}
+
+
+static int popcount64(uint64_t v)
+{
+    return __builtin_popcountll(v);
+}
+
+static int alm_slot(const struct gps_almanac *alm, int sv_id)
+{
+    for(int i=0; i < alm->n_sv; i++){
+        if(alm->svs[i].sv_id == sv_id){
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int eph_slot(const struct gps_ephemeris *eph, int sv_id)
+{
+    for(int i=0; i < eph->n_sv; i++){
+        if(eph->svs[i].sv_id == sv_id){
+            return i;
+        }
+    }
+    return -1;
+}
+
+
+/* sv_id -> slot map of the SVs of a section, and their presence bitmap */
+static uint64_t alm_index(const struct gps_almanac *alm, const struct gps_almanac *base,
+                          int8_t idx[MAX_SV])
+{
+    uint64_t map = 0;
+
+    for(int i=0; i < alm->n_sv && i < MAX_SV; i++){
+        int id = alm->svs[i].sv_id;
+        int b;
+
+        if((id < 0) || (id >= MAX_SV)){
+            continue;
+        }
+        if(base){
+            b = alm_slot(base, id);
+            if((b >= 0) && !memcmp(&base->svs[b], &alm->svs[i], sizeof(alm->svs[i]))){
+                continue;
+            }
+        }
+        idx[id] = i;
+        map |= 1ULL << id;
+    }
+    return map;
+}
+
+static int eph_same(const struct gps_ephemeris_sv *a, const struct gps_ephemeris_sv *b)
+{
+    const struct gps_wire_field *f = ephFields_G;
+
+    for(int i=0; i < NFIELDS(ephFields_G); i++){
+        if(*(const int *)((const char *)a + f[i].offset) !=
+           *(const int *)((const char *)b + f[i].offset)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static uint64_t eph_index(const struct gps_ephemeris *eph, const struct gps_ephemeris *base,
+                          int8_t idx[MAX_SV])
+{
+    uint64_t map = 0;
+
+    for(int i=0; i < eph->n_sv && i < MAX_SV; i++){
+        int id = eph->svs[i].sv_id;
+        int b;
+
+        if((id < 0) || (id >= MAX_SV)){
+            continue;
+        }
+        if(base){
+            b = eph_slot(base, id);
+            if((b >= 0) && eph_same(&base->svs[b], &eph->svs[i])){
+                continue;
+            }
+        }
+        idx[id] = i;
+        map |= 1ULL << id;
+    }
+    return map;
+}
+
+
+/*
+ * Encodes gps into buf. With a base, only what differs from it is encoded
+ * (a delta from base->gen to gps->gen).
+ * Returns the encoded length, or -1 if buf is too small.
+ */
+int gps_wire_encode(uint8_t *buf, int size, const struct gps_assist_data *gps,
+                    const struct gps_assist_data *base)
+{
+    int sections = gps->fields & SECTIONS;
+    uint64_t almMap = 0, ephMap = 0;
+    int8_t almIdx[MAX_SV], ephIdx[MAX_SV];
+    uint8_t *p = buf;
+    int len = GPS_WIRE_HDR_LEN;
+
+    if(base){
+        if(!memcmp(&gps->ionosphere, &base->ionosphere, sizeof(gps->ionosphere)) &&
+           (base->fields & GPS_FIELD_IONOSPHERE)){
+            sections &= ~GPS_FIELD_IONOSPHERE;
+        }
+        if(!memcmp(&gps->utc, &base->utc, sizeof(gps->utc)) &&
+           (base->fields & GPS_FIELD_UTC)){
+            sections &= ~GPS_FIELD_UTC;
+        }
+        if(!memcmp(&gps->ref_pos, &base->ref_pos, sizeof(gps->ref_pos)) &&
+           (base->fields & GPS_FIELD_REFPOS)){
+            sections &= ~GPS_FIELD_REFPOS;
+        }
+        if(!memcmp(&gps->ref_time, &base->ref_time, sizeof(gps->ref_time)) &&
+           (base->fields & GPS_FIELD_REFTIME)){
+            sections &= ~GPS_FIELD_REFTIME;
+        }
+    }
+
+    if(sections & GPS_FIELD_ALMANAC){
+        almMap = alm_index(&gps->almanac, base ? &base->almanac : NULL, almIdx);
+        if(!almMap && base && (gps->almanac.wna == base->almanac.wna)){
+            sections &= ~GPS_FIELD_ALMANAC;
+        }
+    }
+    if(sections & GPS_FIELD_EPHEMERIS){
+        ephMap = eph_index(&gps->ephemeris, base ? &base->ephemeris : NULL, ephIdx);
+        if(!ephMap && base){
+            sections &= ~GPS_FIELD_EPHEMERIS;
+        }
+    }
+
+    // size it all up front, so the buffer is never overrun
+    len += (sections & GPS_FIELD_IONOSPHERE) ? IONO_LEN : 0;
+    len += (sections & GPS_FIELD_UTC) ? UTC_LEN : 0;
+    len += (sections & GPS_FIELD_ALMANAC) ? 9 + ALM_LEN * popcount64(almMap) : 0;
+    len += (sections & GPS_FIELD_EPHEMERIS) ? 8 + EPH_LEN * popcount64(ephMap) : 0;
+    len += (sections & GPS_FIELD_REFPOS) ? REFPOS_LEN : 0;
+    len += (sections & GPS_FIELD_REFTIME) ? REFTIME_LEN : 0;
+    if(len > size){
+        return -1;
+    }
+
+    p = put_le(p, GPS_WIRE_MAGIC, 4);
+    p = put_le(p, GPS_WIRE_VERSION, 1);
+    p = put_le(p, sections, 1);
+    p = put_le(p, base ? GPS_WIRE_DELTA : 0, 2);
+    p = put_le(p, gps->gen, 4);
+    p = put_le(p, base ? base->gen : 0, 4);
+    p = put_le(p, (uint32_t)gps->fields, 4);
+    p = put_le(p, len, 4);
+
+    if(sections & GPS_FIELD_IONOSPHERE){
+        p = put_record(p, GPS_WIRE_REC_IONO, &gps->ionosphere);
+    }
+    if(sections & GPS_FIELD_UTC){
+        p = put_record(p, GPS_WIRE_REC_UTC, &gps->utc);
+    }
+    if(sections & GPS_FIELD_ALMANAC){
+        p = put_le(p, gps->almanac.wna, 1);
+        p = put_le(p, almMap, 8);
+        for(uint64_t m = almMap; m; m &= m - 1){
+            int id = __builtin_ctzll(m);
+            p = put_record(p, GPS_WIRE_REC_ALM, &gps->almanac.svs[almIdx[id]]);
+        }
+    }
+    if(sections & GPS_FIELD_EPHEMERIS){
+        p = put_le(p, ephMap, 8);
+        for(uint64_t m = ephMap; m; m &= m - 1){
+            int id = __builtin_ctzll(m);
+            p = put_record(p, GPS_WIRE_REC_EPH, &gps->ephemeris.svs[ephIdx[id]]);
+        }
+    }
+    if(sections & GPS_FIELD_REFPOS){
+        p = put_le(p, (uint32_t)(int32_t)lround(gps->ref_pos.latitude * 1e7), 4);
+        p = put_le(p, (uint32_t)(int32_t)lround(gps->ref_pos.longitude * 1e7), 4);
+        p = put_le(p, (uint32_t)(int32_t)lround(gps->ref_pos.altitude * 1e3), 4);
+    }
+    if(sections & GPS_FIELD_REFTIME){
+        p = put_le(p, gps->ref_time.wn, 2);
+        p = put_le(p, (uint32_t)llround(gps->ref_time.tow * 1e3), 4);
+        p = put_le(p, (uint64_t)(int64_t)gps->ref_time.when, 8);
+    }
+
+    return (int)(p - buf);
+}
+
+
+/*
+ * Decodes buf into gps. A full set replaces the content of gps, a delta is
+ * applied on top of it and requires gps->gen to be the base generation.
+ * gps is not touched unless buf is well formed.
+ * Returns the decoded length, -1 if malformed, GPS_WIRE_EBASE if a delta
+ * doesn't apply.
+ */
+int gps_wire_decode(struct gps_assist_data *gps, const uint8_t *buf, int len)
+{
+    const uint8_t *p = buf + GPS_WIRE_HDR_LEN;
+    int sections, flags, expect = GPS_WIRE_HDR_LEN;
+    unsigned int gen, baseGen;
+    uint64_t almMap = 0, ephMap = 0;
+
+    if((len < GPS_WIRE_HDR_LEN) || (get_le(buf, 4) != GPS_WIRE_MAGIC) ||
+       (buf[4] != GPS_WIRE_VERSION) || (get_le(buf + 20, 4) != (uint32_t)len)){
+        return -1;
+    }
+    sections = buf[5];
+    flags    = get_le(buf + 6, 2);
+    gen      = get_le(buf + 8, 4);
+    baseGen  = get_le(buf + 12, 4);
+
+    if(sections & ~SECTIONS){
+        return -1;
+    }
+
+    // walk the section lengths first
+    expect += (sections & GPS_FIELD_IONOSPHERE) ? IONO_LEN : 0;
+    expect += (sections & GPS_FIELD_UTC) ? UTC_LEN : 0;
+    if(sections & GPS_FIELD_ALMANAC){
+        if(expect + 9 > len){
+            return -1;
+        }
+        almMap  = get_le(buf + expect + 1, 8);
+        expect += 9 + ALM_LEN * popcount64(almMap);
+    }
+    if(sections & GPS_FIELD_EPHEMERIS){
+        if(expect + 8 > len){
+            return -1;
+        }
+        ephMap  = get_le(buf + expect, 8);
+        expect += 8 + EPH_LEN * popcount64(ephMap);
+    }
+    expect += (sections & GPS_FIELD_REFPOS) ? REFPOS_LEN : 0;
+    expect += (sections & GPS_FIELD_REFTIME) ? REFTIME_LEN : 0;
+    if(expect != len){
+        return -1;
+    }
+
+    if(flags & GPS_WIRE_DELTA){
+        if(gps->gen != baseGen){
+            return GPS_WIRE_EBASE;
+        }
+    }else{
+        memset(gps, 0, sizeof(struct gps_assist_data));
+    }
+
+    gps->fields = get_le(buf + 16, 4);
+    gps->gen    = gen;
+
+    if(sections & GPS_FIELD_IONOSPHERE){
+        p = get_record(p, GPS_WIRE_REC_IONO, &gps->ionosphere);
+        gps->gen_ionosphere = gen;
+    }
+    if(sections & GPS_FIELD_UTC){
+        p = get_record(p, GPS_WIRE_REC_UTC, &gps->utc);
+        gps->gen_utc = gen;
+    }
+    if(sections & GPS_FIELD_ALMANAC){
+        struct gps_almanac *alm = &gps->almanac;
+
+        alm->wna = p[0];
+        p += 9;
+        for(uint64_t m = almMap; m; m &= m - 1){
+            int id = __builtin_ctzll(m);
+            int i  = alm_slot(alm, id);
+
+            if(i < 0){
+                i = alm->n_sv++;
+            }
+            p = get_record(p, GPS_WIRE_REC_ALM, &alm->svs[i]);
+            alm->svs[i].sv_id = id;
+            alm->gen[i] = gen;
+        }
+    }
+    if(sections & GPS_FIELD_EPHEMERIS){
+        struct gps_ephemeris *eph = &gps->ephemeris;
+
+        p += 8;
+        for(uint64_t m = ephMap; m; m &= m - 1){
+            int id = __builtin_ctzll(m);
+            int i  = eph_slot(eph, id);
+
+            if(i < 0){
+                i = eph->n_sv++;
+            }
+            p = get_record(p, GPS_WIRE_REC_EPH, &eph->svs[i]);
+            eph->svs[i].sv_id = id;
+            eph->gen[i] = gen;
+        }
+    }
+    if(sections & GPS_FIELD_REFPOS){
+        gps->ref_pos.latitude  = (int32_t)get_le(p, 4) * 1e-7;
+        gps->ref_pos.longitude = (int32_t)get_le(p + 4, 4) * 1e-7;
+        gps->ref_pos.altitude  = (int32_t)get_le(p + 8, 4) * 1e-3;
+        p += REFPOS_LEN;
+    }
+    if(sections & GPS_FIELD_REFTIME){
+        gps->ref_time.wn   = get_le(p, 2);
+        gps->ref_time.tow  = get_le(p + 2, 4) * 1e-3;
+        gps->ref_time.when = (time_t)(int64_t)get_le(p + 6, 8);
+        p += REFTIME_LEN;
+    }
+
+    return (int)(p - buf);
+}
@@ -0,0 +1,389 @@
+/*
+ * json.c
+ *
+ * Streaming JSON serializer for the GPS assist data, nav fixes and raw
+ * UBX frames
+ *
+ * Everything is appended to a struct json_buf the caller owns; nothing is
+ * allocated and no printf is involved. Keys are string literals generated
+ * from the field tables of gpsView.h, copied with a single memcpy each.
+ * Assist data fields are written as their raw broadcast integers, which is
+ * exact; the tables in gpsView.h give their scale.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "config.h"
+#include "gps.h"
+#include "gpsView.h"
+#include "ubx.h"
+#include "json.h"
+
+
+static const char digitPairs_G[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+static const char hexDigits_G[] = "0123456789abcdef";
+
+static const long long pow10_G[] = {
+    1LL, 10LL, 100LL, 1000LL, 10000LL, 100000LL, 1000000LL, 10000000LL,
+    100000000LL, 1000000000LL, 10000000000LL, 100000000000LL,
+    1000000000000LL, 10000000000000LL, 100000000000000LL, 1000000000000000LL,
+    10000000000000000LL, 100000000000000000LL,
+};
+
+
+void json_buf_init(struct json_buf *jb, char *buf, size_t size)
+{
+    jb->buf      = buf;
+    jb->size     = size;
+    jb->len      = 0;
+    jb->overflow = 0;
+}
+
+void json_buf_reset(struct json_buf *jb)
+{
+    jb->len      = 0;
+    jb->overflow = 0;
+}
+
+// NUL terminates the buffer (there is always room left for it)
+const char *json_buf_str(struct json_buf *jb)
+{
+    if(jb->size == 0){
+        return "";
+    }
+    jb->buf[jb->len] = '\0';
+    return jb->buf;
+}
+
+
+void json_put_raw(struct json_buf *jb, const char *s, size_t n)
+{
+    if(jb->len + n >= jb->size){
+        jb->overflow = 1;
+        return;
+    }
+    memcpy(jb->buf + jb->len, s, n);
+    jb->len += n;
+}
+
+// writes the decimal digits of v backwards, ending at 'end'
+static char *format_u64(char *end, unsigned long long v)
+{
+    while(v >= 100){
+        unsigned int r = (unsigned int)(v % 100);
+        v /= 100;
+        end -= 2;
+        memcpy(end, &digitPairs_G[r * 2], 2);
+    }
+    if(v >= 10){
+        end -= 2;
+        memcpy(end, &digitPairs_G[v * 2], 2);
+    }else{
+        *--end = '0' + (char)v;
+    }
+    return end;
+}
+
+void json_put_int(struct json_buf *jb, long long v)
+{
+    char tmp[24];
+    char *end = tmp + sizeof(tmp);
+    char *p;
+
+    if(v < 0){
+        p = format_u64(end, 0ULL - (unsigned long long)v);
+        *--p = '-';
+    }else{
+        p = format_u64(end, (unsigned long long)v);
+    }
+    json_put_raw(jb, p, end - p);
+}
+
+// v / 10^decimals, exactly
+void json_put_fixed(struct json_buf *jb, long long v, int decimals)
+{
+    char tmp[32];
+    char *end = tmp + sizeof(tmp);
+    unsigned long long a, ip, fp;
+    char *p;
+
+    if(decimals <= 0){
+        json_put_int(jb, v);
+        return;
+    }
+
+    a  = (v < 0) ? 0ULL - (unsigned long long)v : (unsigned long long)v;
+    ip = a / pow10_G[decimals];
+    fp = a % pow10_G[decimals];
+
+    p = format_u64(end, fp + pow10_G[decimals]);   // leading 1 keeps the zeros
+    *p = '.';
+    p = format_u64(p, ip);
+    if(v < 0){
+        *--p = '-';
+    }
+    json_put_raw(jb, p, end - p);
+}
+
+void json_put_double(struct json_buf *jb, double d, int decimals)
+{
+    if(!isfinite(d)){
+        json_put_lit(jb, "null");
+        return;
+    }
+    if(decimals > 11){
+        decimals = 11;
+    }
+    while((decimals > 0) && (fabs(d) * pow10_G[decimals] > 9e18)){
+        decimals--;
+    }
+    if(fabs(d) > 9e18){
+        json_put_lit(jb, "null");
+        return;
+    }
+    json_put_fixed(jb, llround(d * pow10_G[decimals]), decimals);
+}
+
+
+// d with 'digits' significant digits, in exponent notation (floats of UBX payloads)
+void json_put_real(struct json_buf *jb, double d, int digits)
+{
+    long long m;
+    int e;
+
+    if(!isfinite(d)){
+        json_put_lit(jb, "null");
+        return;
+    }
+    if(d == 0.0){
+        json_put_lit(jb, "0");
+        return;
+    }
+    if(digits < 1){
+        digits = 1;
+    }else if(digits > 17){
+        digits = 17;
+    }
+
+    e = (int)floor(log10(fabs(d)));
+    m = llround(fabs(d) * pow(10.0, digits - 1 - e));
+    if(m >= pow10_G[digits]){
+        m /= 10;
+        e++;
+    }
+    while((digits > 1) && (m % 10 == 0)){
+        m /= 10;
+        digits--;
+    }
+    json_put_fixed(jb, (d < 0) ? -m : m, digits - 1);
+    if(e){
+        json_put_lit(jb, "e");
+        json_put_int(jb, e);
+    }
+}
+
+
+/* ",\"field\":value" for every field of a table; the comma is skipped
+ * for the first member of an object */
+#define JSON_KEY(f) \
+    json_put_raw(jb, ",\"" #f "\":" + first, sizeof(",\"" #f "\":") - 1 - first); \
+    first = 0;
+
+#define JSON_FIELD(f, lsb, unit) \
+    JSON_KEY(f) json_put_int(jb, (long long)p->f);
+
+#define JSON_INT(f) \
+    JSON_KEY(f) json_put_int(jb, (long long)p->f);
+
+
+static void json_iono(struct json_buf *jb, const struct gps_ionosphere_model *p)
+{
+    int first = 1;
+
+    json_put_lit(jb, "{");
+    GPS_IONO_FIELDS(JSON_FIELD)
+    json_put_lit(jb, "}");
+}
+
+static void json_utc(struct json_buf *jb, const struct gps_utc_model *p)
+{
+    int first = 1;
+
+    json_put_lit(jb, "{");
+    GPS_UTC_FIELDS(JSON_FIELD)
+    json_put_lit(jb, "}");
+}
+
+int json_almanac_sv(struct json_buf *jb, const struct gps_almanac_sv *p)
+{
+    int first = 0;
+
+    json_put_lit(jb, "{\"sv_id\":");
+    json_put_int(jb, p->sv_id);
+    JSON_INT(sv_health)
+    GPS_ALM_FIELDS(JSON_FIELD)
+    json_put_lit(jb, "}");
+
+    return jb->overflow ? -1 : 0;
+}
+
+int json_ephemeris_sv(struct json_buf *jb, const struct gps_ephemeris_sv *p)
+{
+    int first = 0;
+
+    json_put_lit(jb, "{\"sv_id\":");
+    json_put_int(jb, p->sv_id);
+    JSON_INT(code_on_l2)
+    JSON_INT(l2_p_flag)
+    JSON_INT(sv_ura)
+    JSON_INT(sv_health)
+    JSON_INT(iodc)
+    JSON_INT(fit_flag)
+    JSON_INT(aodo)
+    GPS_EPH_FIELDS(JSON_FIELD)
+    json_put_lit(jb, "}");
+
+    return jb->overflow ? -1 : 0;
+}
+
+
+/* Whole assist data set, only the parts flagged in gps->fields */
+int json_assist_data(struct json_buf *jb, const struct gps_assist_data *gps)
+{
+    json_put_lit(jb, "{\"fields\":");
+    json_put_int(jb, gps->fields);
+    json_put_lit(jb, ",\"gen\":");
+    json_put_int(jb, gps->gen);
+
+    if(gps->fields & GPS_FIELD_IONOSPHERE){
+        json_put_lit(jb, ",\"ionosphere\":");
+        json_iono(jb, &gps->ionosphere);
+    }
+
+    if(gps->fields & GPS_FIELD_UTC){
+        json_put_lit(jb, ",\"utc\":");
+        json_utc(jb, &gps->utc);
+    }
+
+    if(gps->fields & GPS_FIELD_REFPOS){
+        json_put_lit(jb, ",\"ref_pos\":{\"latitude\":");
+        json_put_double(jb, gps->ref_pos.latitude, 7);
+        json_put_lit(jb, ",\"longitude\":");
+        json_put_double(jb, gps->ref_pos.longitude, 7);
+        json_put_lit(jb, ",\"altitude\":");
+        json_put_double(jb, gps->ref_pos.altitude, 3);
+        json_put_lit(jb, "}");
+    }
+
+    if(gps->fields & GPS_FIELD_REFTIME){
+        json_put_lit(jb, ",\"ref_time\":{\"wn\":");
+        json_put_int(jb, gps->ref_time.wn);
+        json_put_lit(jb, ",\"tow\":");
+        json_put_double(jb, gps->ref_time.tow, 3);
+        json_put_lit(jb, ",\"when\":");
+        json_put_int(jb, (long long)gps->ref_time.when);
+        json_put_lit(jb, "}");
+    }
+
+    if(gps->fields & GPS_FIELD_ALMANAC){
+        json_put_lit(jb, ",\"almanac\":{\"wna\":");
+        json_put_int(jb, gps->almanac.wna);
+        json_put_lit(jb, ",\"svs\":[");
+        for(int i=0; i < gps->almanac.n_sv; i++){
+            if(i){ json_put_lit(jb, ","); }
+            json_almanac_sv(jb, &gps->almanac.svs[i]);
+        }
+        json_put_lit(jb, "]}");
+    }
+
+    if(gps->fields & GPS_FIELD_EPHEMERIS){
+        json_put_lit(jb, ",\"ephemeris\":[");
+        for(int i=0; i < gps->ephemeris.n_sv; i++){
+            if(i){ json_put_lit(jb, ","); }
+            json_ephemeris_sv(jb, &gps->ephemeris.svs[i]);
+        }
+        json_put_lit(jb, "]");
+    }
+
+    json_put_lit(jb, "}");
+
+    return jb->overflow ? -1 : 0;
+}
+
+
+// the fields of the NAV-POSLLH schema, scaled to deg and m
+int json_nav_posllh(struct json_buf *jb, const struct ubx_nav_posllh *fix)
+{
+    return ubx_nav_posllh_json(jb, fix);
+}
+
+
+/* {"class":c,"id":i,"len":n,"payload":"hex"} of a complete UBX frame */
+int json_ubx_frame(struct json_buf *jb, const void *frame, int len)
+{
+    const struct ubx_hdr *hdr = frame;
+    const uint8_t *pl = (const uint8_t *)frame + sizeof(struct ubx_hdr);
+    int pl_len = hdr->payload_len;
+    char *out;
+
+    if(len < (int)sizeof(struct ubx_hdr) + pl_len){
+        return -1;
+    }
+
+    json_put_lit(jb, "{\"class\":");
+    json_put_int(jb, hdr->msg_class);
+    json_put_lit(jb, ",\"id\":");
+    json_put_int(jb, hdr->msg_id);
+    json_put_lit(jb, ",\"len\":");
+    json_put_int(jb, pl_len);
+    json_put_lit(jb, ",\"payload\":\"");
+
+    if(jb->len + 2 * pl_len >= jb->size){
+        jb->overflow = 1;
+        return -1;
+    }
+    out = jb->buf + jb->len;
+    for(int i=0; i < pl_len; i++){
+        out[2*i]     = hexDigits_G[pl[i] >> 4];
+        out[2*i + 1] = hexDigits_G[pl[i] & 0xf];
+    }
+    jb->len += 2 * pl_len;
+
+    json_put_lit(jb, "\"}");
+
+    return jb->overflow ? -1 : 0;
+}
+
+
+/*
+ * Serializes a struct gps_assist_data into a per-thread buffer that is
+ * reused on every call. The string stays valid until the next call from
+ * the same thread. Returns NULL if it doesn't fit in JSON_BUF_SIZE.
+ */
+char *jsonize(void *ptr)
+{
+    static __thread char buf[JSON_BUF_SIZE];
+    struct json_buf jb;
+
+    json_buf_init(&jb, buf, sizeof(buf));
+    if(json_assist_data(&jb, (const struct gps_assist_data *)ptr) < 0){
+        return NULL;
+    }
+    json_buf_str(&jb);
+
+    return buf;
+}
@@ -23,7 +23,11 @@ static node* create_node(void *data);
  * initialize parameters   */
 list* create_list(void)
 {
-  list *l = malloc(sizeof(list));
+  list *l = NULL;
+
+  if(posix_memalign((void **)&l, CACHE_LINE_SIZE, sizeof(list)) != 0){
+    return NULL;
+  }
   l->head = NULL;
   l->size = 0;
   pthread_mutex_init(&(l->mutex),NULL);
@@ -76,7 +80,7 @@ void push_front(list* llist, void* data)
 
   // set the prev and next pointers to the new node
   llist->head = n;
-  llist->size++;
+  __atomic_store_n(&llist->size, llist->size + 1, __ATOMIC_RELEASE);
   pthread_mutex_unlock(&(llist->mutex));
 
 }
@@ -113,7 +117,7 @@ void push_back(list* llist, void *data)
     prev->next = n;
   }
 
-  llist->size++;
+  __atomic_store_n(&llist->size, llist->size + 1, __ATOMIC_RELEASE);
   pthread_mutex_unlock(&(llist->mutex));
 }
 
@@ -153,7 +157,7 @@ int remove_front(list *llist, list_op free_func)
   free_func(head->data);
   free(head);
 
-  llist->size--;
+  __atomic_store_n(&llist->size, llist->size - 1, __ATOMIC_RELEASE);
   pthread_mutex_unlock(&(llist->mutex));
 
   return 0;
@@ -194,7 +198,7 @@ int remove_back(list* llist, list_op free_func)
   free_func(tbr->data);
   free(tbr);
 
-  llist->size--;
+  __atomic_store_n(&llist->size, llist->size - 1, __ATOMIC_RELEASE);
   pthread_mutex_unlock(&(llist->mutex));
 
   return 0;
@@ -273,11 +277,8 @@ int is_empty(list* llist)
  */
 int size(list *llist)
 {
-  int size = 0;
-  pthread_mutex_lock(&(llist->mutex));
-  size = llist->size;
-  pthread_mutex_unlock(&(llist->mutex));
-  return size;
+  // polled by serial_f on every loop, no need to take the lock for it
+  return __atomic_load_n(&llist->size, __ATOMIC_ACQUIRE);
 }
 
 
@@ -312,7 +313,7 @@ void empty_list(list *llist, list_op free_func)
 
     // reset the head and size
     llist->head = NULL;
-    llist->size = 0;
+    __atomic_store_n(&llist->size, 0, __ATOMIC_RELEASE);
   }
 
   pthread_mutex_unlock(&(llist->mutex));
@@ -324,7 +325,7 @@ void empty_list(list *llist, list_op free_func)
 int payloadLen_2_index(list *llist, int len )
 {
     uint8_t *array = NULL;
-    int sum,i = 0;
+    int sum = 0, i = 0;
     int index = -1;
     pthread_mutex_lock(&(llist->mutex));
 
@@ -7,15 +7,32 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <pthread.h>
+#include <time.h>
 
 #include "gps.h"
 #include "ubx.h"
 #include "ubx-parse.h"
 #include "config.h"
+#include "monotonic.h"
 #include "serial.h"
 #include "debug.h"
 #include "ringBuf.h"
 #include "list.h"
+#include "predict.h"
+#include "gpsView.h"
+#include "pubServer.h"
+#include "shmPub.h"
+#include "post.h"
+#include "json.h"
+#include "metrics.h"
+#include "trace.h"
+#include "rxHealth.h"
+#include "txSched.h"
+#include "ntpShm.h"
+#include "timing.h"
+#include "rawStore.h"
+#include "navHist.h"
+#include "svTrack.h"
 
 
 /* Global Definitions   */
@@ -24,25 +41,38 @@ FILE *fpDbg_G;
 int  dbgLevel_G;
 
 /* Structure Definitions */
-#pragma pack(1)
+// the pointers are set up once and only read afterwards, by every thread;
+// msgChk is control_f's and starts on a line of its own
 typedef struct monitor_s
 {
     struct llist* llistTxCommands;
     struct ringbuffer_s * rbUartIn_p;
     struct ringbuffer_s * rbUbxMsg_p;
     struct serialPort_s * serialPort_p;
-    struct msgStrmCheck_s msgChk; 
+    struct pubServer_s * pubServer_p;
+    struct shmPubRegion_s * shmPub_p;
+    struct rawStore_s * rawStore_p;
 
-}monitor_t;
+    struct msgStrmCheck_s msgChk CACHE_ALIGNED;
+    struct txSched_s txSched CACHE_ALIGNED;     // serial_f's
+    struct timing_s timing CACHE_ALIGNED;       // serial_f's, but for timing_setUtc()
+    struct nav_s nav CACHE_ALIGNED;             // serial_f's
+    struct svTrack_s svTrack CACHE_ALIGNED;     // serial_f's, control_f reads a copy
 
-#pragma pack()
+}monitor_t;
 
 
-static struct monitor_s * prep_monitoringStruct(void);
-static int setDbgLogs(void);
+static struct monitor_s * prep_monitoringStruct(char *serialPath, int baudRate);
+static int setDbgLogs(const char *logPath);
 static void freeNode(void *data);
+static void queueAnswers(struct monitor_s *mon_p, uint8_t *scratchpad);
 static void getMissingMessages(struct monitor_s * mon_p, uint8_t *scratchpad);
+static void waitAnswers(struct monitor_s *mon_p);
 static int silenceNmea(struct monitor_s *mon_p);
+static int dispatchUbxMsgs(struct monitor_s *mon_p, struct gps_assist_data *gps);
+static void updatePollPlan(struct monitor_s *mon_p, struct gps_assist_data *gps,
+                           const struct gps_assist_view *view);
+static void uploadAssist(struct gps_assist_data *gps);
 
 
 //static int do_rrlp(struct gps_assist_data *gps)
@@ -64,25 +94,32 @@ static int silenceNmea(struct monitor_s *mon_p);
 //}
 
 
-static int setDbgLogs(void)
+static int setDbgLogs(const char *logPath)
 {
-    fpDbg_G     = fopen(DBG_LOG_MSG_PATH, "w+");
+    fpDbg_G     = fopen(logPath, "w+");
     dbgLevel_G  = LOG_INFO;
     LOG(LOG_INFO, "Initialized Log Messages");
 
     return 0;
 }
   
-static struct monitor_s * prep_monitoringStruct(void)
+static struct monitor_s * prep_monitoringStruct(char *serialPath, int baudRate)
 {
     struct monitor_s *mon = NULL;
 
-    mon = (struct monitor_s *)malloc(sizeof(struct monitor_s));
+    if(posix_memalign((void **)&mon, CACHE_LINE_SIZE, sizeof(struct monitor_s)) != 0){
+        return NULL;
+    }
 
     mon->llistTxCommands = create_list();
     mon->rbUartIn_p = ringbuffer_init();
     mon->rbUbxMsg_p = ringbuffer_init();
-    mon->serialPort_p = serialPort_init(SERIAL_PORT, SERIAL_BAUD_RATE, NO_PARITY);
+    mon->serialPort_p = serialPort_init(serialPath, baudRate, NO_PARITY);
+    txSched_init(&(mon->txSched), serialPort_bps(mon->serialPort_p));
+    svTrack_init(&(mon->svTrack));
+    mon->pubServer_p = NULL;
+    mon->shmPub_p = NULL;
+    mon->rawStore_p = NULL;
 
     // clean all acknowledgments and disable message sending
     memset( &(mon->msgChk), 0, sizeof( struct msgStrmCheck_s));
@@ -96,25 +133,16 @@ static void freeNode(void *data)
     free( (uint8_t *)data);
 }
 
-static void getMissingMessages(struct monitor_s * mon_p, uint8_t *scratchpad)
+/*
+ * Reads what serial_f framed into rbUartIn_p to the scratchpad, queues
+ * every valid message of it into rbUbxMsg_p and acks it.
+ */
+static void queueAnswers(struct monitor_s *mon_p, uint8_t *scratchpad)
 {
-    //struct ubx_hdr *ubxMsg_p = NULL;
-    int rb_size = 0;
+    int rb_size = ringbuffer_currentSize(mon_p->rbUartIn_p);
 
-    memset(scratchpad, 0, sizeof(uint8_t) * SCRATCHPAD_BUF_SIZE);
-
-    prepAidMissingPollMsgs(mon_p->llistTxCommands, &(mon_p->msgChk));
-
-    while( size(mon_p->llistTxCommands) ){
-        LOG(LOG_INFO, "number of commands in txlist: %d",size(mon_p->llistTxCommands));
-        sleep(2);
-    }
-    LOG(LOG_INFO, "missing requests all sent now");
-
-    // we have sent all missing commands, now read from ringbuffer
-    rb_size = ringbuffer_currentSize(mon_p->rbUartIn_p);
     ringbuffer_read(mon_p->rbUartIn_p, scratchpad, rb_size);
-    LOG(LOG_INFO, "read incoming values from ringbuffer to scratchpad");
+    trace_uartRead(rb_size);
 
     /* Parse Each Message */
     for(int i=0; i < rb_size; )
@@ -122,26 +150,68 @@ static void getMissingMessages(struct monitor_s * mon_p, uint8_t *scratchpad)
         int rv;
         rv = parseUartInput_4_UbxMsg(scratchpad + i, rb_size - i);
         if(rv < 0){
+            if(rv == -3){
+                metrics_add(METRIC_UBX_CKSUM_ERRORS, 1);
+            }
             i++;	/* Invalid message: try one byte later */
         }else{
             /* got a valid message, copy it to ring buffer */
-            ringbuffer_write(mon_p->rbUbxMsg_p, scratchpad + i, rv);
+            int seq = trace_frame(scratchpad + i, i, rv);
+
+            metrics_add(METRIC_UBX_FRAMES, 1);
+            if(ringbuffer_write(mon_p->rbUbxMsg_p, scratchpad + i, rv) == 0){
+                metrics_add(METRIC_RB_UBX_MSG_DROPPED, rv);
+            }else{
+                trace_queued(seq);
+            }
             updateValidUbxMsgList(scratchpad + i, &(mon_p->msgChk) );
             // increment the pointer 
             i += rv; 
         }
     }
 
+    //FIXME:  if there are any remaining data left in the buffer, then
+    //       they will all be cleared away below!!
     // clear scratchpad 
     memset(scratchpad, 0, SCRATCHPAD_BUF_SIZE); 
 }
 
+static void getMissingMessages(struct monitor_s * mon_p, uint8_t *scratchpad)
+{
+    memset(scratchpad, 0, sizeof(uint8_t) * SCRATCHPAD_BUF_SIZE);
+
+    prepAidMissingPollMsgs(mon_p->llistTxCommands, &(mon_p->msgChk));
+
+    LOG(LOG_INFO, "number of commands in txlist: %d",size(mon_p->llistTxCommands));
+    waitAnswers(mon_p);
+    LOG(LOG_INFO, "missing requests all sent now");
+
+    // we have sent all missing commands, now read from ringbuffer
+    queueAnswers(mon_p, scratchpad);
+    LOG(LOG_INFO, "read incoming values from ringbuffer to scratchpad");
+}
+
+
+// until every queued command is out and the scheduler has their answers in
+static void waitAnswers(struct monitor_s *mon_p)
+{
+    uint64_t now, end;
+
+    while( size(mon_p->llistTxCommands) ){
+        usleep(50 * 1000);
+    }
+    while( (now = monotonicNs()) < (end = txSched_drainedNs(&(mon_p->txSched))) ){
+        usleep( (end - now > 100000000ULL) ? 100000 : (end - now) / 1000 + 1 );
+    }
+}
+
 
 static int silenceNmea(struct monitor_s *mon_p)
 {
     do{
         // prepare nmea silencer commands
         prepNmeaSilencerMsgs(mon_p->llistTxCommands);
+        prepTimingMsgs(mon_p->llistTxCommands);
         // wait until all commands are issued
         while( size(mon_p->llistTxCommands) ){ sleep(1); }
 
@@ -160,68 +230,130 @@ static int silenceNmea(struct monitor_s *mon_p)
 
 static void getAidMessages(struct monitor_s * mon_p, uint8_t *scratchpad)
 {
-    int rb_size = 0;
     // ublox lea-6t is configured, now poll for AID messages
-    prepAidPollMsgs(mon_p->llistTxCommands);
+    prepAidPollMsgs(mon_p->llistTxCommands, &(mon_p->msgChk));
 
 
-    // after the last command is sent, in 2 seconds,
-    // all data should be available
-    while( size(mon_p->llistTxCommands)){ 
-        LOG(LOG_INFO, "%d msgs left in tx list", size(mon_p->llistTxCommands));
-        sleep(2);
-    }
+    LOG(LOG_INFO, "%d msgs left in tx list", size(mon_p->llistTxCommands));
+    waitAnswers(mon_p);
 
     // we have sent all aid poll commands, now read from ringbuffer
-    rb_size = ringbuffer_currentSize(mon_p->rbUartIn_p);
-    ringbuffer_read(mon_p->rbUartIn_p, scratchpad, rb_size); 
+    queueAnswers(mon_p, scratchpad);
+}
 
-    /* Parse each message */
-    for(int i=0; i < rb_size; )
-    {
-        int rv;
-        rv = parseUartInput_4_UbxMsg(scratchpad + i, rb_size - i);
-        if(rv < 0){
-            i++;	/* Invalid message: try one byte later */
-        }else{
-            /* got a valid message, copy it to ring buffer */
-            ringbuffer_write(mon_p->rbUbxMsg_p, scratchpad + i, rv);
-            updateValidUbxMsgList(scratchpad + i, &(mon_p->msgChk) );
-            // increment the pointer 
-            i += rv; 
+
+
+// hand every validated message waiting in rbUbxMsg_p to the ubx parsers
+static int dispatchUbxMsgs(struct monitor_s *mon_p, struct gps_assist_data *gps)
+{
+    uint8_t frame[UBX_MAX_FRAME_SIZE];
+    struct ubx_hdr *hdr = (struct ubx_hdr *)frame;
+    int len, n = 0;
+
+    while( ringbuffer_currentSize(mon_p->rbUbxMsg_p) >= sizeof(struct ubx_hdr) ){
+
+        ringbuffer_read(mon_p->rbUbxMsg_p, frame, sizeof(struct ubx_hdr));
+        len = hdr->payload_len + 2;
+
+        if(sizeof(struct ubx_hdr) + len > UBX_MAX_FRAME_SIZE){
+            // too large for us, drop it
+            LOG(LOG_WARN, "dropping %d bytes ubx message", len);
+            while(len > 0){
+                int chunk = (len > UBX_MAX_FRAME_SIZE) ? UBX_MAX_FRAME_SIZE : len;
+                ringbuffer_read(mon_p->rbUbxMsg_p, frame, chunk);
+                len -= chunk;
+            }
+            trace_dispatched();
+            continue;
         }
+
+        ringbuffer_read(mon_p->rbUbxMsg_p, frame + sizeof(struct ubx_hdr), len);
+        ubx_msg_dispatch(ubx_parse_dt, frame, sizeof(struct ubx_hdr) + len, gps);
+        trace_dispatched();
+        n++;
     }
 
-    //FIXME:  if there are any remaining data left in the buffer, then
-    //       they will all be cleared away below!!
-    // clear scratchpad 
-    memset(scratchpad, 0, SCRATCHPAD_BUF_SIZE); 
+    // local clients get the new set (no-op if nothing changed)
+    shmPub_writeAssist(mon_p->shmPub_p, gps);
+    pubServer_publishAssist(mon_p->pubServer_p, gps);
+    trace_published();
 
+    return n;
 }
 
 
+// predict which SVs are worth polling from the almanac and the last fix,
+// then keep the ephemerides to what the receiver tracks, once it tells
+static void updatePollPlan(struct monitor_s *mon_p, struct gps_assist_data *gps,
+                           const struct gps_assist_view *view)
+{
+    static struct predict_set ps;
+    static struct svTrackTable_s sky;
+
+    // no almanac, fix or time yet: keep polling every SV
+    if(predict_from_assist(gps, view, &ps) >= 0){
+        updateSvPollPlan(&(mon_p->msgChk), &ps);
+    }
+    if(svTrack_read(&(mon_p->svTrack), &sky, SV_TRACK_MAX_AGE_S * 1000000000ULL) >= 0){
+        trackSvPollPlan(&(mon_p->msgChk), &sky);
+    }
+}
+
+
+// queue the set for the backend once per generation, never waits on it
+static void uploadAssist(struct gps_assist_data *gps)
+{
+    static unsigned int lastGen = 0;
+    struct post_s post;
+
+    if( (POST_SERVER_URL[0] == '\0') || (gps->gen == lastGen) ){
+        return;
+    }
+
+    post.postAddress = POST_SERVER_URL;
+    post.postData    = jsonize(gps);
+    if(post.postData && (post2Server(&post) >= 0)){
+        lastGen = gps->gen;
+    }
+}
+
 
 static void *control_f(void *arg)
 {
     struct monitor_s *mon_p = (struct monitor_s *)arg;
 	struct gps_assist_data gps;
+    static struct gps_assist_view gpsView;   // engineering units of gps, the predictor's input
     uint8_t scratchpad[SCRATCHPAD_BUF_SIZE];
+    unsigned int lastGen = 0;
+    int streamsOn = 0;
+    uint64_t t0;
 
     memset(scratchpad, 0, sizeof(uint8_t) * SCRATCHPAD_BUF_SIZE);
 	memset(&gps, 0x00, sizeof(gps));
+    gps_view_init(&gpsView);
 
     silenceNmea(mon_p);
 
 
     while(1){
         
+        t0 = monotonicNs();
         LOG(LOG_INFO, "asking for aid messages");
         getAidMessages(mon_p, scratchpad);
+        dispatchUbxMsgs(mon_p, &gps);
+        gps_view_refresh(&gpsView, &gps);
+        updatePollPlan(mon_p, &gps, &gpsView);
+        if(gps.fields & GPS_FIELD_UTC){
+            timing_setUtc(&(mon_p->timing), &gps.utc);
+        }
 
         for(int j = 0; j < 3;j++){
             if( areThereMissingMessages(&(mon_p->msgChk)) ){
                 LOG(LOG_INFO, "seems like there are missing messages");
                 getMissingMessages(mon_p, scratchpad);
+                dispatchUbxMsgs(mon_p, &gps);
+                gps_view_refresh(&gpsView, &gps);
+                updatePollPlan(mon_p, &gps, &gpsView);
             }else{
                 LOG(LOG_INFO,"........................");
                 LOG(LOG_INFO,"allright, ALL Messages are HERE");
@@ -230,6 +362,29 @@ static void *control_f(void *arg)
             }
         }
 
+        uploadAssist(&gps);
+
+        // the streams take a share of the line, only once the assist data is in
+        if( !streamsOn ){
+            int measMs = 1000;          // the receiver's default
+
+            if(mon_p->rawStore_p){
+                measMs = rawStore_rateMs(serialPort_bps(mon_p->serialPort_p));
+                prepRawMsgs(mon_p->llistTxCommands, measMs);
+            }
+            prepNavMsgs(mon_p->llistTxCommands, measMs);
+            streamsOn = 1;
+        }
+
+        metrics_observe(METRIC_CONTROL_CYCLE_NS, monotonicNs() - t0);
+        if(gps.gen != lastGen){
+            lastGen = gps.gen;
+            metrics_set(METRIC_ASSIST_GENERATION, gps.gen);
+            metrics_set(METRIC_ASSIST_UPDATED, time(NULL));
+        }
+        if(TRACE_FILE_PATH[0] != '\0'){
+            trace_dump(TRACE_FILE_PATH);
+        }
 
         sleep(20);
 
@@ -245,47 +400,99 @@ void *serial_f(void *arg)
     struct monitor_s *mon_p = (struct monitor_s *)arg;
     struct ubx_hdr *ubxMsg_p = NULL;
     uint8_t uartRxBuf[UART_RX_BUF_SIZE];
-    uint8_t pauseBtwSend = 0;
+    uint8_t monPoll[16];
+    struct rxHealth_s health;
+    struct txSched_s *sched_p = &(mon_p->txSched);
+    struct ubxFramer_s framer;
+    struct timespec arrival;
     int payloadLen = 0;
-    int r,t;
+    int r,t,n;
+    int p,used,flen;
+    uint32_t cksumErrors = 0;
 
     memset(uartRxBuf, 0, sizeof(uint8_t) * UART_RX_BUF_SIZE);
+    rxHealth_init(&health, RX_HEALTH_PORT);
+    ubxFramer_init(&framer);
 
     while(1){
 
         //if( mon_p->msgChk->ubxComEnable ){
         if( 1 ){
 
-            if( (0 < size(mon_p->llistTxCommands)) && (pauseBtwSend >= 2)  ){
+            // the receiver monitor's own polls go first, they aren't queued
+            n = rxHealth_next(&health, size(mon_p->llistTxCommands), monPoll, sizeof(monPoll));
+            if(n > 0){
+                t = write(mon_p->serialPort_p->fd, monPoll, n);
+                if(t > 0){
+                    metrics_add(METRIC_UART_TX_BYTES, t);
+                    txSched_sent(sched_p, monPoll);
+                }
+            }else if( (0 < size(mon_p->llistTxCommands)) && rxHealth_mayPoll(&health) &&
+                      txSched_admit(sched_p, front(mon_p->llistTxCommands),
+                                    RINGBUFFER_SIZE - ringbuffer_currentSize(mon_p->rbUartIn_p)) ){
                 ubxMsg_p = front(mon_p->llistTxCommands);
                 payloadLen = getUbx_MsgLength(ubxMsg_p);
 
                 // send ubx message via serial port, note that +2 is due to acknowledge bytes
                 t = write(mon_p->serialPort_p->fd,(uint8_t *) ubxMsg_p, sizeof(struct ubx_hdr) + payloadLen + 2);
+                if(t > 0){
+                    metrics_add(METRIC_UART_TX_BYTES, t);
+                }
                 if(t == sizeof(struct ubx_hdr) + payloadLen + 2){
+                    // booked before the node goes, control_f waits on both
+                    txSched_sent(sched_p, ubxMsg_p);
                     // get rid of the processed node
                     remove_front(mon_p->llistTxCommands, freeNode);
+                    rxHealth_sent(&health);
                 }
-                pauseBtwSend = 0;
             }
-            pauseBtwSend += 1;
         }
 
         r = read(mon_p->serialPort_p->fd, uartRxBuf, 100);
         if(0 < r){
-            ringbuffer_write(mon_p->rbUartIn_p, uartRxBuf, r);
-            mon_p->serialPort_p->ticksBtwReceive = 0;
+            // the receive time of a timepulse sample, before anything else
+            clock_gettime(CLOCK_REALTIME, &arrival);
+            trace_read();
+            txSched_read(sched_p, r);
+            for(p = 0; (flen = ubxFramer_push(&framer, uartRxBuf + p, r - p, &used)) > 0; p += used){
+                // the streams go to their consumers, only answers to control_f
+                if( timing_frame(&(mon_p->timing), framer.buf, flen, &arrival) ||
+                    rawStore_frame(mon_p->rawStore_p, framer.buf, flen) ||
+                    nav_frame(&(mon_p->nav), framer.buf, flen) ||
+                    svTrack_frame(&(mon_p->svTrack), framer.buf, flen) ){
+                    txSched_unsolicited(sched_p, flen);
+                    continue;
+                }
+                rxHealth_frame(&health, framer.buf, flen);
+                if(ringbuffer_write(mon_p->rbUartIn_p, framer.buf, flen) == 0){
+                    metrics_add(METRIC_RB_UART_IN_DROPPED, flen);
+                }else{
+                    trace_framed(flen);
+                }
+            }
+            if(framer.cksumErrors != cksumErrors){
+                metrics_add(METRIC_UBX_CKSUM_ERRORS, framer.cksumErrors - cksumErrors);
+                cksumErrors = framer.cksumErrors;
+            }
+            metrics_add(METRIC_UART_RX_BYTES, r);
+            metrics_observe(METRIC_UART_READ_BYTES, r);
+            serialPort_setTicks(mon_p->serialPort_p, 0);
+
+            // the bytes themselves only when debugging, at RXM-RAW rates
+            // printing every read would hold up this thread
+            if(LOG_DBG <= dbgLevel_G){
+                char hex[2 * UART_RX_BUF_SIZE + 1];
 
-            printf("incoming %d bytes: ", r);
-            for(int ii=0; ii < r; ii++){ 
-                printf("%02X", uartRxBuf[ii]);
+                for(int ii=0; ii < r; ii++){
+                    snprintf(hex + 2 * ii, 3, "%02X", uartRxBuf[ii]);
+                }
+                LOG(LOG_DBG, "incoming %d bytes: %s", r, hex);
             }
-            printf("\n");
 
             memset(uartRxBuf, 0, sizeof(uint8_t)*UART_RX_BUF_SIZE);
 
         }else{
-            mon_p->serialPort_p->ticksBtwReceive += 1;
+            serialPort_setTicks(mon_p->serialPort_p, serialPort_ticks(mon_p->serialPort_p) + 1);
         }
 
     } // end of while(1)
@@ -298,10 +505,66 @@ int main(int argc, char *argv[])
 
     struct monitor_s *mon_p = NULL;
     pthread_t idThreadSerial[2]; // wr, rd
+    pthread_t idThreadPub;
+    pthread_t idThreadMetrics;
+    pthread_t idThreadRaw;
+    struct metricsServer_s *metrics_p;
+    char *serialPath = SERIAL_PORT;
+    const char *logPath = DBG_LOG_MSG_PATH;
+    int baudRate = SERIAL_BAUD_RATE;
+    int opt;
+
+
+    // -d / -b / -l: another serial device, baud rate or log, e.g. a simulated receiver
+    while((opt = getopt(argc, argv, "d:b:l:")) != -1){
+        switch(opt){
+        case 'd':
+            serialPath = optarg;
+            break;
+        case 'b':
+            baudRate = serialPort_speed(atoi(optarg));
+            if(baudRate == 0){
+                fprintf(stderr, "unsupported baud rate %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'l':
+            logPath = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-d serial device] [-b baud rate] [-l log file]\n", argv[0]);
+            return 1;
+        }
+    }
 
-
-    mon_p = prep_monitoringStruct();
-    setDbgLogs();
+    mon_p = prep_monitoringStruct(serialPath, baudRate);
+    setDbgLogs(logPath);
+
+    // local consumers on SOCK_PATH, the rest runs without it if it fails
+    mon_p->pubServer_p = pubServer_init(SOCK_PATH);
+    mon_p->shmPub_p = shmPub_create(SHM_PUB_NAME);
+    timing_init(&(mon_p->timing), (TIMING_SHM_UNIT >= 0) ? ntpShm_attach(TIMING_SHM_UNIT) : NULL,
+                mon_p->shmPub_p);
+    // the fix history lives in the shm region, GET HIST reads it there
+    nav_init(&(mon_p->nav), mon_p->shmPub_p ? &(mon_p->shmPub_p->hist) : NULL, mon_p->shmPub_p,
+             mon_p->pubServer_p);
+    pubServer_setHistory(mon_p->pubServer_p, mon_p->nav.hist);
+    if(mon_p->pubServer_p){
+        pthread_create(&idThreadPub, NULL, pubServer_f, (void *)mon_p->pubServer_p);
+    }
+    if(RAW_STORE_DIR[0] != '\0'){
+        mon_p->rawStore_p = rawStore_init(RAW_STORE_DIR);
+        if(mon_p->rawStore_p){
+            pthread_create(&idThreadRaw, NULL, rawStore_f, (void *)mon_p->rawStore_p);
+        }
+    }
+    metrics_p = metricsServer_init(METRICS_SOCK_PATH, METRICS_FILE_PATH, METRICS_FILE_PERIOD);
+    if(metrics_p){
+        pthread_create(&idThreadMetrics, NULL, metricsServer_f, (void *)metrics_p);
+    }
+    if(POST_SERVER_URL[0] != '\0'){
+        post_initialize();
+    }
     
     pthread_create(&idThreadSerial[0], NULL, control_f, (void *)mon_p);
     pthread_create(&idThreadSerial[1], NULL, serial_f,  (void *)mon_p);
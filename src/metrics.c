@@ -0,0 +1,380 @@
+/*
+ * metrics.c
+ *
+ * Metrics registry and its Prometheus text exporter (see metrics.h)
+ *
+ * The counting side never takes a lock: a thread only writes its own slot,
+ * the exporter only reads. A histogram's count is the sum of its buckets
+ * as read, so a scrape is always consistent in itself; its sum may be an
+ * observation or two apart.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "config.h"
+#include "debug.h"
+#include "json.h"
+#include "metrics.h"
+
+
+#define METRICS_CLIENT_WAIT_MS  100     // for a request line before answering
+
+
+typedef struct metricsRegistry_s
+{
+    struct metricsSlot_s slot[METRICS_MAX_THREADS + 1];    // the last is shared
+    int nSlots;
+    int64_t gauge[METRICS_N_GAUGES];
+}metricsRegistry_t;
+
+static struct metricsRegistry_s metrics_G;
+static __thread struct metricsSlot_s *slot_T;
+
+
+/* Counting side */
+static struct metricsSlot_s *slotGet(void)
+{
+    int i;
+
+    if(slot_T == NULL){
+        i = __atomic_fetch_add(&metrics_G.nSlots, 1, __ATOMIC_RELAXED);
+        if(i >= METRICS_MAX_THREADS){
+            i = METRICS_MAX_THREADS;
+            __atomic_store_n(&metrics_G.slot[i].shared, 1, __ATOMIC_RELAXED);
+        }
+        slot_T = &metrics_G.slot[i];
+    }
+    return slot_T;
+}
+
+static inline void slotAdd(struct metricsSlot_s *s, uint64_t *c, uint64_t n)
+{
+    if(s->shared){
+        __atomic_fetch_add(c, n, __ATOMIC_RELAXED);
+    }else{
+        __atomic_store_n(c, __atomic_load_n(c, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+    }
+}
+
+void metrics_add(enum metricsCounter_e id, uint64_t n)
+{
+    struct metricsSlot_s *s = slotGet();
+
+    slotAdd(s, &s->counter[id], n);
+}
+
+void metrics_observe(enum metricsHist_e id, uint64_t v)
+{
+    struct metricsSlot_s *s = slotGet();
+    struct metricsHist_s *h = &s->hist[id];
+    int b = (v > 1) ? 64 - __builtin_clzll(v - 1) : 0;
+
+    if(b >= METRICS_HIST_BUCKETS){
+        b = METRICS_HIST_BUCKETS - 1;
+    }
+
+    slotAdd(s, &h->bucket[b], 1);
+    slotAdd(s, &h->sum, v);
+}
+
+void metrics_set(enum metricsGauge_e id, int64_t v)
+{
+    __atomic_store_n(&metrics_G.gauge[id], v, __ATOMIC_RELAXED);
+}
+
+
+/* Reading side */
+static int slotCount(void)
+{
+    int n = __atomic_load_n(&metrics_G.nSlots, __ATOMIC_RELAXED);
+
+    // the shared slot is last, and only in use once the others are taken
+    return (n > METRICS_MAX_THREADS) ? METRICS_MAX_THREADS + 1 : n;
+}
+
+uint64_t metrics_counter(enum metricsCounter_e id)
+{
+    uint64_t sum = 0;
+    int n = slotCount();
+
+    for(int i=0; i < n; i++){
+        sum += __atomic_load_n(&metrics_G.slot[i].counter[id], __ATOMIC_RELAXED);
+    }
+    return sum;
+}
+
+static void histSum(enum metricsHist_e id, struct metricsHist_s *h)
+{
+    int n = slotCount();
+
+    memset(h, 0, sizeof(struct metricsHist_s));
+    for(int i=0; i < n; i++){
+        const struct metricsHist_s *s = &metrics_G.slot[i].hist[id];
+
+        for(int b=0; b < METRICS_HIST_BUCKETS; b++){
+            h->bucket[b] += __atomic_load_n(&s->bucket[b], __ATOMIC_RELAXED);
+        }
+        h->sum += __atomic_load_n(&s->sum, __ATOMIC_RELAXED);
+    }
+    for(int b=0; b < METRICS_HIST_BUCKETS; b++){
+        h->count += h->bucket[b];
+    }
+}
+
+
+// "# HELP" and "# TYPE" once per family
+static void putFamily(struct json_buf *jb, const char **last, const char *name,
+                      const char *help, const char *type)
+{
+    if(*last && !strcmp(*last, name)){
+        return;
+    }
+    *last = name;
+    json_put_lit(jb, "# HELP " METRICS_PREFIX);
+    json_put_raw(jb, name, strlen(name));
+    json_put_lit(jb, " ");
+    json_put_raw(jb, help, strlen(help));
+    json_put_lit(jb, "\n# TYPE " METRICS_PREFIX);
+    json_put_raw(jb, name, strlen(name));
+    json_put_lit(jb, " ");
+    json_put_raw(jb, type, strlen(type));
+    json_put_lit(jb, "\n");
+}
+
+static void putSample(struct json_buf *jb, const char *name, const char *suffix,
+                      const char *labels, const char *le)
+{
+    json_put_lit(jb, METRICS_PREFIX);
+    json_put_raw(jb, name, strlen(name));
+    json_put_raw(jb, suffix, strlen(suffix));
+    if(le){
+        // le joins the labels of the entry, if any
+        size_t n = strlen(labels);
+
+        json_put_lit(jb, "{");
+        if(n){
+            json_put_raw(jb, labels + 1, n - 2);
+            json_put_lit(jb, ",");
+        }
+        json_put_lit(jb, "le=\"");
+        json_put_raw(jb, le, strlen(le));
+        json_put_lit(jb, "\"}");
+    }else{
+        json_put_raw(jb, labels, strlen(labels));
+    }
+    json_put_lit(jb, " ");
+}
+
+static void putHist(struct json_buf *jb, const char *name, const char *labels,
+                    enum metricsHist_e id, double scale, int lo, int hi)
+{
+    struct metricsHist_s h;
+    char num[32];
+    uint64_t cum = 0;
+
+    histSum(id, &h);
+    for(int b=0; b < lo; b++){
+        cum += h.bucket[b];
+    }
+    for(int b=lo; b <= hi; b++){
+        // bucket b holds values up to 2^b, le is inclusive
+        cum += h.bucket[b];
+        snprintf(num, sizeof(num), "%.12g", (double)(1ULL << b) * scale);
+        putSample(jb, name, "_bucket", labels, num);
+        json_put_int(jb, cum);
+        json_put_lit(jb, "\n");
+    }
+    putSample(jb, name, "_bucket", labels, "+Inf");
+    json_put_int(jb, h.count);
+    json_put_lit(jb, "\n");
+    putSample(jb, name, "_sum", labels, NULL);
+    json_put_raw(jb, num, snprintf(num, sizeof(num), "%.12g", (double)h.sum * scale));
+    json_put_lit(jb, "\n");
+    putSample(jb, name, "_count", labels, NULL);
+    json_put_int(jb, h.count);
+    json_put_lit(jb, "\n");
+}
+
+/*
+ * The whole registry in the Prometheus text format, NUL terminated.
+ * Returns its length, -1 if it doesn't fit.
+ */
+int metrics_render(char *buf, size_t size)
+{
+    struct json_buf jb;
+    const char *last = NULL;
+
+    json_buf_init(&jb, buf, size);
+
+#define _METRICS_PUT_COUNTER(id, name, labels, help) \
+    putFamily(&jb, &last, name, help, "counter"); \
+    putSample(&jb, name, "", labels, NULL); \
+    json_put_int(&jb, metrics_counter(METRIC_##id)); \
+    json_put_lit(&jb, "\n");
+
+#define _METRICS_PUT_HIST(id, name, labels, help, scale, lo, hi) \
+    putFamily(&jb, &last, name, help, "histogram"); \
+    putHist(&jb, name, labels, METRIC_##id, scale, lo, hi);
+
+#define _METRICS_PUT_GAUGE(id, name, labels, help) \
+    putFamily(&jb, &last, name, help, "gauge"); \
+    putSample(&jb, name, "", labels, NULL); \
+    json_put_int(&jb, __atomic_load_n(&metrics_G.gauge[METRIC_##id], __ATOMIC_RELAXED)); \
+    json_put_lit(&jb, "\n");
+
+    METRICS_COUNTERS(_METRICS_PUT_COUNTER)
+    METRICS_HISTOGRAMS(_METRICS_PUT_HIST)
+    METRICS_GAUGES(_METRICS_PUT_GAUGE)
+
+    json_buf_str(&jb);
+    return jb.overflow ? -1 : (int)jb.len;
+}
+
+
+/* Exporter */
+
+// rendered to a temporary and renamed over, a reader never sees half a file
+static int writeFile(struct metricsServer_s *ms, int len)
+{
+    char tmp[256];
+    int fd, ok;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", ms->filePath);
+    fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0){
+        return -1;
+    }
+    ok = (write(fd, ms->text, len) == len);
+    close(fd);
+    if(!ok || (rename(tmp, ms->filePath) < 0)){
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// one answer per connection, then close
+static void serveClient(struct metricsServer_s *ms, int fd, int len)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    char req[128];
+    char hdr[128];
+    int http = 0;
+    ssize_t n;
+
+    if(poll(&pfd, 1, METRICS_CLIENT_WAIT_MS) > 0){
+        n = read(fd, req, sizeof(req));
+        http = (n >= 4) && !memcmp(req, "GET ", 4);
+    }
+    if(http){
+        n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 200 OK\r\n"
+                     "Content-Type: text/plain; version=0.0.4\r\n"
+                     "Content-Length: %d\r\n\r\n", len);
+        if(write(fd, hdr, n) != n){
+            close(fd);
+            return;
+        }
+    }
+    if(write(fd, ms->text, len) != len){
+        LOG(LOG_WARN, "metrics: short write to client %d", fd);
+    }
+    close(fd);
+}
+
+
+struct metricsServer_s *metricsServer_init(const char *sockPath, const char *filePath, int period)
+{
+    struct metricsServer_s *ms = NULL;
+    struct sockaddr_un addr;
+    struct timeval tv = { 1, 0 };
+
+    ms = (struct metricsServer_s *)calloc(1, sizeof(struct metricsServer_s));
+    if(ms == NULL){
+        return NULL;
+    }
+    ms->filePath = (filePath && filePath[0]) ? filePath : NULL;
+    ms->period   = (period > 0) ? period : 1;
+    ms->listenFd = -1;
+
+    // a scraper going away mid write must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+
+    if(sockPath && sockPath[0]){
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, sockPath, sizeof(addr.sun_path) - 1);
+        unlink(sockPath);
+
+        ms->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if((ms->listenFd < 0) ||
+           (setsockopt(ms->listenFd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) < 0) ||
+           (bind(ms->listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+           (listen(ms->listenFd, 4) < 0)){
+            LOG(LOG_ERR, "metrics: cannot listen on %s: %s", sockPath, strerror(errno));
+            metricsServer_deinit(ms);
+            return NULL;
+        }
+        LOG(LOG_INFO, "metrics: listening on %s", sockPath);
+    }
+
+    return ms;
+}
+
+void metricsServer_deinit(struct metricsServer_s *ms)
+{
+    if(ms->listenFd >= 0){ close(ms->listenFd); }
+    free(ms);
+}
+
+
+void *metricsServer_f(void *arg)
+{
+    struct metricsServer_s *ms = (struct metricsServer_s *)arg;
+    struct pollfd pfd = { ms->listenFd, POLLIN, 0 };
+    struct timespec now;
+    time_t nextFile = 0;
+    int len, fd, wait;
+
+    while(1){
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if(ms->filePath && (now.tv_sec >= nextFile)){
+            len = metrics_render(ms->text, sizeof(ms->text));
+            if((len >= 0) && (writeFile(ms, len) < 0)){
+                LOG(LOG_WARN, "metrics: cannot write %s: %s", ms->filePath, strerror(errno));
+            }
+            nextFile = now.tv_sec + ms->period;
+        }
+        wait = ms->filePath ? (int)(nextFile - now.tv_sec) * 1000 : -1;
+
+        if(poll(&pfd, 1, wait) <= 0){
+            // timeout (or EINTR): time for the file
+            continue;
+        }
+        fd = accept4(ms->listenFd, NULL, NULL, SOCK_CLOEXEC);
+        if(fd < 0){
+            continue;
+        }
+        len = metrics_render(ms->text, sizeof(ms->text));
+        if(len < 0){
+            LOG(LOG_ERR, "metrics: more than %d bytes of metrics", METRICS_TEXT_SIZE);
+            close(fd);
+            continue;
+        }
+        serveClient(ms, fd, len);
+    }
+
+    return NULL;
+}
@@ -0,0 +1,327 @@
+/*
+ * navHist.c
+ *
+ * Navigation stream into the history ring, and the ring's queries (see
+ * navHist.h)
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "config.h"
+#include "metrics.h"
+#include "ubx.h"
+#include "shmPub.h"
+#include "pubServer.h"
+#include "navHist.h"
+
+
+#define NAV_WEEK_MS         604800000LL
+#define NAV_HIST_MASK       (NAV_HIST_SIZE - 1)
+
+// NAV-TIMEUTC valid flags
+#define TIMEUTC_VALID_UTC   0x04
+
+typedef char navHist_size_check[(NAV_HIST_SIZE & NAV_HIST_MASK) ? -1 : 1];
+
+
+// days from 1970-01-01 to y-m-d of the proleptic Gregorian calendar
+static int64_t civilDays(int y, int m, int d)
+{
+    int era, yoe, doy;
+
+    y -= (m <= 2);
+    era = (y >= 0 ? y : y - 399) / 400;
+    yoe = y - era * 400;
+    doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    return (int64_t)era * 146097 + yoe * 365 + yoe / 4 - yoe / 100 + doy - 719468;
+}
+
+
+/* serial_f */
+
+void nav_init(struct nav_s *nav, struct navHist_s *hist, struct shmPubRegion_s *pub,
+              struct pubServer_s *server)
+{
+    memset(nav, 0, sizeof(struct nav_s));
+    nav->hist   = hist;
+    nav->pub    = pub;
+    nav->server = server;
+}
+
+void navHist_append(struct navHist_s *h, const struct navFix_s *fix)
+{
+    uint64_t k = h->count;
+
+    // readers drop the slot from here on, before it changes
+    __atomic_store_n(&h->claimed, k + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&h->fix[k & NAV_HIST_MASK], fix, sizeof(struct navFix_s));
+    __atomic_store_n(&h->count, k + 1, __ATOMIC_RELEASE);
+}
+
+// the epoch put together so far into the history, if it comes after the last
+static void commit(struct nav_s *nav)
+{
+    struct navFix_s *f = &nav->pending;
+    int week = nav->week;
+
+    // a new week's POSLLH before its SOL
+    if( !(f->have & NAV_HAVE_SOL) && (nav->itow < nav->lastItow) ){
+        week++;
+    }
+    f->timeMs = week * NAV_WEEK_MS + nav->itow;
+
+    // no week yet, or the answer to a poll of an epoch already in
+    if( (nav->week == 0) || (f->timeMs <= nav->lastMs) ){
+        metrics_add(METRIC_NAV_DROPPED, 1);
+    }else{
+        if(nav->hist){
+            navHist_append(nav->hist, f);
+        }
+        nav->lastMs   = f->timeMs;
+        nav->lastItow = nav->itow;
+        nav->fixes++;
+        metrics_add(METRIC_NAV_FIXES, 1);
+    }
+    memset(f, 0, sizeof(struct navFix_s));
+}
+
+/*
+ * Every frame read off the port. Returns 1 if it was one of the streamed
+ * NAV messages, 0 if not; a NAV-POSLLH is taken but returns 0, control_f
+ * wants it as well.
+ */
+int nav_frame(struct nav_s *nav, const uint8_t *frame, int len)
+{
+    const struct ubx_hdr *hdr = (const struct ubx_hdr *)frame;
+    const uint8_t *pl = frame + sizeof(struct ubx_hdr);
+    struct navFix_s *f = &nav->pending;
+    const struct ubx_nav_posllh *pos = NULL;
+    const struct ubx_nav_sol *sol = NULL;
+    const struct ubx_nav_velned *vel = NULL;
+    const struct ubx_nav_timeutc *utc = NULL;
+    uint32_t itow;
+
+    if(hdr->msg_class != UBX_CLASS_NAV){
+        return 0;
+    }
+    switch(hdr->msg_id){
+    case UBX_NAV_POSLLH:
+        if( (pos = ubx_nav_posllh_get(pl, hdr->payload_len)) == NULL ){
+            return 0;
+        }
+        itow = pos->itow;
+        break;
+    case UBX_NAV_SOL:
+        if( (sol = ubx_nav_sol_get(pl, hdr->payload_len)) == NULL ){
+            return 1;
+        }
+        itow = sol->itow;
+        break;
+    case UBX_NAV_VELNED:
+        if( (vel = ubx_nav_velned_get(pl, hdr->payload_len)) == NULL ){
+            return 1;
+        }
+        itow = vel->itow;
+        break;
+    case UBX_NAV_TIMEUTC:
+        if( (utc = ubx_nav_timeutc_get(pl, hdr->payload_len)) == NULL ){
+            return 1;
+        }
+        itow = utc->itow;
+        break;
+    default:
+        return 0;
+    }
+
+    if( f->have && (itow != nav->itow) ){
+        commit(nav);
+    }
+    nav->itow = itow;
+
+    if(pos){
+        f->have |= NAV_HAVE_POSLLH;
+        f->val[NAV_LAT]    = pos->lat;
+        f->val[NAV_LON]    = pos->lon;
+        f->val[NAV_HEIGHT] = pos->height;
+        f->val[NAV_HMSL]   = pos->hmsl;
+        f->val[NAV_HACC]   = pos->hacc;
+        f->val[NAV_VACC]   = pos->vacc;
+        shmPub_writeFix(nav->pub, pos);
+        pubServer_publishFix(nav->server, pos);
+    }else if(sol){
+        f->have |= NAV_HAVE_SOL;
+        f->gpsFix  = sol->gps_fix;
+        f->flags   = sol->flags;
+        f->val[NAV_NUM_SV] = sol->num_sv;
+        f->val[NAV_PDOP]   = sol->pdop;
+        nav->week = sol->week;
+        metrics_set(METRIC_NAV_FIX_TYPE, sol->gps_fix);
+        metrics_set(METRIC_NAV_NUM_SV, sol->num_sv);
+    }else if(vel){
+        f->have |= NAV_HAVE_VELNED;
+        f->val[NAV_VEL_N]   = vel->vel_n;
+        f->val[NAV_VEL_E]   = vel->vel_e;
+        f->val[NAV_VEL_D]   = vel->vel_d;
+        f->val[NAV_GSPEED]  = vel->gspeed;
+        f->val[NAV_HEADING] = vel->heading;
+        f->val[NAV_SACC]    = vel->sacc;
+    }else{
+        f->have |= NAV_HAVE_TIMEUTC;
+        if(utc->valid & TIMEUTC_VALID_UTC){
+            f->utcMs = (civilDays(utc->year, utc->month, utc->day) * 86400 +
+                        utc->hour * 3600 + utc->min * 60 + utc->sec) * 1000LL + utc->nano / 1000000;
+        }
+    }
+
+    if(f->have == NAV_HAVE_ALL){
+        commit(nav);
+    }
+    return (pos == NULL);
+}
+
+
+/* Readers */
+
+// fix i, if it's still there once copied
+static inline int copyFix(const struct navHist_s *h, uint64_t i, struct navFix_s *fix)
+{
+    memcpy(fix, &h->fix[i & NAV_HIST_MASK], sizeof(struct navFix_s));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    // writing fix i + NAV_HIST_SIZE claims up to it, overwriting i
+    return (i + NAV_HIST_SIZE >= __atomic_load_n(&h->claimed, __ATOMIC_RELAXED)) ? 0 : -1;
+}
+
+// fixes first..end - 1 are in the ring. Returns end - first
+int navHist_span(const struct navHist_s *h, uint64_t *first, uint64_t *end)
+{
+    *end   = __atomic_load_n(&h->count, __ATOMIC_ACQUIRE);
+    *first = (*end > NAV_HIST_SIZE) ? *end - NAV_HIST_SIZE : 0;
+    return *end - *first;
+}
+
+// fix i. -1 if it isn't in the ring (any more)
+int navHist_read(const struct navHist_s *h, uint64_t i, struct navFix_s *fix)
+{
+    if(i >= __atomic_load_n(&h->count, __ATOMIC_ACQUIRE)){
+        return -1;
+    }
+    return copyFix(h, i, fix);
+}
+
+int navHist_last(const struct navHist_s *h, struct navFix_s *fix)
+{
+    uint64_t end;
+
+    do{
+        end = __atomic_load_n(&h->count, __ATOMIC_ACQUIRE);
+        if(end == 0){
+            return -1;
+        }
+    }while(copyFix(h, end - 1, fix) < 0);
+    return 0;
+}
+
+/*
+ * The first fix at or after ms, the end of the ring if none. A slot
+ * overwritten during the search can only be the oldest, the answer is then
+ * the oldest there is.
+ */
+uint64_t navHist_find(const struct navHist_s *h, int64_t ms)
+{
+    uint64_t lo, hi, mid, oldest;
+
+    navHist_span(h, &lo, &hi);
+    while(lo < hi){
+        mid = lo + (hi - lo) / 2;
+        if(h->fix[mid & NAV_HIST_MASK].timeMs < ms){
+            lo = mid + 1;
+        }else{
+            hi = mid;
+        }
+    }
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    oldest = __atomic_load_n(&h->claimed, __ATOMIC_RELAXED);
+    oldest = (oldest > NAV_HIST_SIZE) ? oldest - NAV_HIST_SIZE : 0;
+    return (lo < oldest) ? oldest : lo;
+}
+
+static void bucketStart(struct navBucket_s *b, int64_t startMs, int64_t *sum)
+{
+    memset(b, 0, sizeof(struct navBucket_s));
+    b->startMs = startMs;
+    memset(sum, 0, NAV_N_VALS * sizeof(int64_t));
+}
+
+static void bucketEnd(struct navBucket_s *b, const int64_t *sum)
+{
+    for(int v=0; v < NAV_N_VALS; v++){
+        b->mean[v] = b->n[v] ? (double)sum[v] / b->n[v] : 0;
+    }
+}
+
+/*
+ * The fixes of [fromMs, toMs) in buckets of bucketMs from fromMs on: per
+ * value min, max and mean of the fixes that had it. Empty buckets are
+ * left out. Returns the buckets, -1 if the span needs more than
+ * maxBuckets.
+ */
+int navHist_buckets(const struct navHist_s *h, int64_t fromMs, int64_t toMs, int64_t bucketMs,
+                    struct navBucket_s *b, int maxBuckets)
+{
+    static const uint8_t valHave[NAV_N_VALS] = {
+#define _NAV_HAVE(id, name, dec, have)  have,
+        NAV_HIST_VALUES(_NAV_HAVE)
+#undef _NAV_HAVE
+    };
+    struct navFix_s f;
+    int64_t sum[NAV_N_VALS], start;
+    uint64_t i, end = __atomic_load_n(&h->count, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    if( (bucketMs <= 0) || (toMs <= fromMs) || ((toMs - fromMs + bucketMs - 1) / bucketMs > maxBuckets) ){
+        return -1;
+    }
+
+    for(i = navHist_find(h, fromMs); i < end; i++){
+        if(copyFix(h, i, &f) < 0){
+            continue;                   // gone meanwhile, it was among the oldest
+        }
+        if(f.timeMs >= toMs){
+            break;
+        }
+        if(f.timeMs < fromMs){
+            continue;
+        }
+        start = fromMs + (f.timeMs - fromMs) / bucketMs * bucketMs;
+        if( (n == 0) || (b[n - 1].startMs != start) ){
+            if(n > 0){
+                bucketEnd(&b[n - 1], sum);
+            }
+            bucketStart(&b[n++], start, sum);
+        }
+
+        b[n - 1].fixes++;
+        for(int v=0; v < NAV_N_VALS; v++){
+            uint32_t k;
+
+            if( !(f.have & valHave[v]) ){
+                continue;
+            }
+            k = b[n - 1].n[v]++;
+            if( (k == 0) || (f.val[v] < b[n - 1].min[v]) ){
+                b[n - 1].min[v] = f.val[v];
+            }
+            if( (k == 0) || (f.val[v] > b[n - 1].max[v]) ){
+                b[n - 1].max[v] = f.val[v];
+            }
+            sum[v] += f.val[v];
+        }
+    }
+    if(n > 0){
+        bucketEnd(&b[n - 1], sum);
+    }
+    return n;
+}
@@ -0,0 +1,108 @@
+/*
+ * ntpShm.c
+ *
+ * NTP shared memory reference clock, writer and reader (see ntpShm.h)
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include "config.h"
+#include "debug.h"
+#include "ntpShm.h"
+
+
+// Attaches the segment of unit, creating it if needed. NULL on failure
+struct ntpShmTime_s *ntpShm_attach(int unit)
+{
+    struct ntpShmTime_s *shm;
+    int id;
+
+    id = shmget(NTP_SHM_KEY + unit, sizeof(struct ntpShmTime_s),
+                IPC_CREAT | ((unit < 2) ? 0600 : 0666));
+    if(id < 0){
+        LOG(LOG_ERR, "ntpShm: shmget unit %d: %s", unit, strerror(errno));
+        return NULL;
+    }
+    shm = shmat(id, NULL, 0);
+    if(shm == (void *)-1){
+        LOG(LOG_ERR, "ntpShm: shmat unit %d: %s", unit, strerror(errno));
+        return NULL;
+    }
+
+    // a segment left by an earlier writer keeps its count, readers go on
+    shm->mode      = 1;
+    shm->nsamples  = 3;
+    shm->valid     = 0;
+    LOG(LOG_INFO, "ntpShm: refclock on unit %d, key %#x", unit, NTP_SHM_KEY + unit);
+    return shm;
+}
+
+void ntpShm_detach(struct ntpShmTime_s *shm)
+{
+    if(shm){
+        shmdt(shm);
+    }
+}
+
+// marks the segment of unit for removal, once the last one detaches
+int ntpShm_remove(int unit)
+{
+    int id = shmget(NTP_SHM_KEY + unit, 0, 0);
+
+    return (id < 0) ? -1 : shmctl(id, IPC_RMID, NULL);
+}
+
+
+void ntpShm_store(struct ntpShmTime_s *shm, const struct ntpShmSample_s *s)
+{
+    shm->valid = 0;
+    __atomic_store_n(&shm->count, shm->count + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    shm->clockTimeStampSec    = s->clock.tv_sec;
+    shm->clockTimeStampUSec   = s->clock.tv_nsec / 1000;
+    shm->clockTimeStampNSec   = s->clock.tv_nsec;
+    shm->receiveTimeStampSec  = s->receive.tv_sec;
+    shm->receiveTimeStampUSec = s->receive.tv_nsec / 1000;
+    shm->receiveTimeStampNSec = s->receive.tv_nsec;
+    shm->leap      = s->leap;
+    shm->precision = s->precision;
+
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&shm->count, shm->count + 1, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->valid, 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Takes the sample as the daemons do: 1 and the sample if there was a new
+ * one, 0 if not, -1 if it changed while it was read (the writer's next
+ * store will do).
+ */
+int ntpShm_read(struct ntpShmTime_s *shm, struct ntpShmSample_s *s)
+{
+    int count;
+
+    if(!__atomic_load_n(&shm->valid, __ATOMIC_ACQUIRE)){
+        return 0;
+    }
+    count = __atomic_load_n(&shm->count, __ATOMIC_ACQUIRE);
+
+    s->clock.tv_sec     = shm->clockTimeStampSec;
+    s->clock.tv_nsec    = shm->clockTimeStampNSec;
+    s->receive.tv_sec   = shm->receiveTimeStampSec;
+    s->receive.tv_nsec  = shm->receiveTimeStampNSec;
+    s->leap      = shm->leap;
+    s->precision = shm->precision;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if(__atomic_load_n(&shm->count, __ATOMIC_RELAXED) != count){
+        return -1;
+    }
+    shm->valid = 0;
+    return 1;
+}
@@ -0,0 +1,285 @@
+/*
+ * orbit.c
+ *
+ * Broadcast ephemeris orbit engine (IS-GPS-200 20.3.3.4.3)
+ *
+ * orbit_engine_load() converts the raw subframe integers of every SV into
+ * doubles once and keeps them until the SV's IODC/toe changes.
+ * orbit_propagate() then evaluates all SVs at one epoch. Every stage is a
+ * plain loop over the SVs without data dependent branches, so the compiler
+ * can vectorize the arithmetic. There are seven transcendental calls per SV:
+ *
+ *   - Kepler's equation is solved from E0 = M + e.sin(M) (one sin) with
+ *     exactly two Newton steps (e < 0.03 converges to below 1e-15 rad), each
+ *     evaluating sin/cos of its starting E. The sin/cos of the final E are
+ *     corrected to first order from the second pair instead of evaluated.
+ *   - sin/cos of the argument of perigee and of i0 are precomputed, the
+ *     harmonic corrections (< 1e-4 rad) are applied with short series.
+ *   - only the longitude of the ascending node needs a full sin/cos.
+ *
+ * bench_orbit times a day of epochs and checks against a direct
+ * IS-GPS-200 implementation.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+
+#include "gps.h"
+#include "orbit.h"
+
+
+/* Scale factors of the ephemeris fields (see gps.h) */
+#define P2_4    0x1p4
+#define P2_5    0x1p-5
+#define P2_19   0x1p-19
+#define P2_29   0x1p-29
+#define P2_31   0x1p-31
+#define P2_33   0x1p-33
+#define P2_43   0x1p-43
+#define P2_55   0x1p-55
+
+/* 2 pi in two parts, k * TWO_PI_HI is exact for any k of a week */
+#define TWO_PI_HI   6.28125
+#define TWO_PI_LO   1.9353071795864769253e-3
+
+
+static inline double wrap_half_week(double dt)
+{
+    if(dt > GPS_HALF_WEEK){
+        dt -= 2.0 * GPS_HALF_WEEK;
+    }else if(dt < -GPS_HALF_WEEK){
+        dt += 2.0 * GPS_HALF_WEEK;
+    }
+    return dt;
+}
+
+/*
+ * Longitude of the node at toe, Omega_0 - Omega_e.toe. The Earth rotation
+ * term reaches 44 rad in a week: it is reduced by whole turns before it
+ * rounds, a double at 30 rad is only good to 4e-15 rad, 0.1 um at the
+ * orbit's radius.
+ */
+static double node_at_toe(double omega_0, double toe)
+{
+    double p  = GPS_OMEGA_E * toe;
+    double pe = fma(GPS_OMEGA_E, toe, -p);         /* p + pe is exact */
+    double k  = nearbyint(p / (2.0 * M_PI));
+    double r  = (p - k * TWO_PI_HI) - k * TWO_PI_LO;
+
+    return omega_0 - (r + pe);
+}
+
+
+static void scale_sv(struct orbit_engine *oe, int k, const struct gps_ephemeris_sv *eph)
+{
+    double sqrt_a, a, e, w, i0;
+
+    sqrt_a = (double)eph->a_powhalf * P2_19;
+    a      = sqrt_a * sqrt_a;
+    e      = (double)eph->e * P2_33;
+    w      = (double)eph->w * P2_31 * GPS_PI;
+    i0     = (double)eph->i_0 * P2_31 * GPS_PI;
+
+    oe->sv_id[k]     = eph->sv_id;
+    oe->iodc[k]      = eph->iodc;
+    oe->t_oe_raw[k]  = eph->t_oe;
+    oe->week_no[k]   = eph->week_no;
+
+    oe->toe[k]       = (double)eph->t_oe * P2_4;
+    oe->toc[k]       = (double)eph->t_oc * P2_4;
+    oe->a[k]         = a;
+    oe->n[k]         = sqrt(GPS_MU / (a * a * a)) + (double)eph->delta_n * P2_43 * GPS_PI;
+    oe->e[k]         = e;
+    oe->sqrt_1me2[k] = sqrt(1.0 - e * e);
+    oe->m_0[k]       = (double)eph->m_0 * P2_31 * GPS_PI;
+    oe->sin_w[k]     = sin(w);
+    oe->cos_w[k]     = cos(w);
+    oe->omega_dot[k] = (double)eph->omega_dot * P2_43 * GPS_PI - GPS_OMEGA_E;
+    oe->omega_0[k]   = node_at_toe((double)eph->omega_0 * P2_31 * GPS_PI, oe->toe[k]);
+    oe->sin_i0[k]    = sin(i0);
+    oe->cos_i0[k]    = cos(i0);
+    oe->idot[k]      = (double)eph->idot * P2_43 * GPS_PI;
+    oe->c_rs[k]      = (double)eph->c_rs * P2_5;
+    oe->c_rc[k]      = (double)eph->c_rc * P2_5;
+    oe->c_us[k]      = (double)eph->c_us * P2_29;
+    oe->c_uc[k]      = (double)eph->c_uc * P2_29;
+    oe->c_is[k]      = (double)eph->c_is * P2_29;
+    oe->c_ic[k]      = (double)eph->c_ic * P2_29;
+    oe->af0[k]       = (double)eph->a_f0 * P2_31;
+    oe->af1[k]       = (double)eph->a_f1 * P2_43;
+    oe->af2[k]       = (double)eph->a_f2 * P2_55;
+    oe->t_gd[k]      = (double)eph->t_gd * P2_31;
+    oe->rel[k]       = GPS_F_REL * e * sqrt_a;
+}
+
+
+void orbit_engine_init(struct orbit_engine *oe)
+{
+    memset(oe, 0, sizeof(struct orbit_engine));
+
+    for(int k=0; k < MAX_SV; k++){
+        oe->sv_id[k] = -1;
+    }
+}
+
+
+/*
+ * Mirrors the ephemeris set into the engine. Engine slot k holds
+ * eph->svs[k]; slots whose (sv_id, IODC, toe, week) did not change keep
+ * their scaled constants. Returns the number of rescaled slots.
+ */
+int orbit_engine_load(struct orbit_engine *oe, const struct gps_ephemeris *eph)
+{
+    int n, changed = 0;
+
+    n = eph->n_sv;
+    if(n > MAX_SV){
+        n = MAX_SV;
+    }
+
+    for(int k=0; k < n; k++){
+        const struct gps_ephemeris_sv *sv = &eph->svs[k];
+
+        if( (oe->sv_id[k]    == sv->sv_id) &&
+            (oe->iodc[k]     == sv->iodc)  &&
+            (oe->t_oe_raw[k] == sv->t_oe)  &&
+            (oe->week_no[k]  == sv->week_no) ){
+            continue;
+        }
+        scale_sv(oe, k, sv);
+        changed++;
+    }
+
+    for(int k=n; k < oe->n_sv; k++){
+        oe->sv_id[k] = -1;
+    }
+    oe->n_sv = n;
+
+    return changed;
+}
+
+
+int orbit_engine_slot(const struct orbit_engine *oe, int sv_id)
+{
+    for(int k=0; k < oe->n_sv; k++){
+        if(oe->sv_id[k] == sv_id){
+            return k;
+        }
+    }
+    return -1;
+}
+
+
+/* Evaluates position, velocity and clock of every engine slot at GPS time
+ * of week t (seconds). Week crossovers within half a week are handled. */
+void orbit_propagate(const struct orbit_engine *oe, double t, struct orbit_state *st)
+{
+    const int n = oe->n_sv;
+    double tk[MAX_SV], m[MAX_SV], ek[MAX_SV];
+    double sin_e[MAX_SV], cos_e[MAX_SV];
+    double sin_o[MAX_SV], cos_o[MAX_SV];
+    double d;
+
+    st->t    = t;
+    st->n_sv = n;
+    memcpy(st->sv_id, oe->sv_id, sizeof(int) * n);
+
+    /* mean anomaly and first guess of the eccentric anomaly */
+    for(int k=0; k < n; k++){
+        tk[k] = wrap_half_week(t - oe->toe[k]);
+        m[k]  = oe->m_0[k] + oe->n[k] * tk[k];
+    }
+    for(int k=0; k < n; k++){
+        ek[k] = m[k] + oe->e[k] * sin(m[k]);
+    }
+
+    /* two fixed Newton steps on E - e.sin(E) = M */
+    for(int k=0; k < n; k++){
+        sin_e[k] = sin(ek[k]);
+        cos_e[k] = cos(ek[k]);
+        ek[k]   -= (ek[k] - oe->e[k] * sin_e[k] - m[k]) / (1.0 - oe->e[k] * cos_e[k]);
+    }
+    for(int k=0; k < n; k++){
+        double s = sin(ek[k]);
+        double c = cos(ek[k]);
+
+        d        = (ek[k] - oe->e[k] * s - m[k]) / (1.0 - oe->e[k] * c);
+        ek[k]   -= d;
+        sin_e[k] = s - d * c;
+        cos_e[k] = c + d * s;
+    }
+
+    /* right ascension of the ascending node */
+    for(int k=0; k < n; k++){
+        double o = oe->omega_0[k] + oe->omega_dot[k] * tk[k];
+        sin_o[k] = sin(o);
+        cos_o[k] = cos(o);
+    }
+
+    for(int k=0; k < n; k++){
+        double e = oe->e[k];
+        double one_m_ecos = 1.0 - e * cos_e[k];
+        double inv = 1.0 / one_m_ecos;
+
+        /* true anomaly, argument of latitude phi = v + w */
+        double sin_v = oe->sqrt_1me2[k] * sin_e[k] * inv;
+        double cos_v = (cos_e[k] - e) * inv;
+        double sin_p = sin_v * oe->cos_w[k] + cos_v * oe->sin_w[k];
+        double cos_p = cos_v * oe->cos_w[k] - sin_v * oe->sin_w[k];
+        double sin_2p = 2.0 * sin_p * cos_p;
+        double cos_2p = cos_p * cos_p - sin_p * sin_p;
+
+        /* second harmonic corrections */
+        double du = oe->c_us[k] * sin_2p + oe->c_uc[k] * cos_2p;
+        double dr = oe->c_rs[k] * sin_2p + oe->c_rc[k] * cos_2p;
+        double di = oe->c_is[k] * sin_2p + oe->c_ic[k] * cos_2p + oe->idot[k] * tk[k];
+
+        double du2 = du * du, di2 = di * di;
+        double s_du = du * (1.0 - du2 * (1.0 / 6.0));
+        double c_du = 1.0 - du2 * 0.5;
+        double s_di = di * (1.0 - di2 * (1.0 / 6.0));
+        double c_di = 1.0 - di2 * 0.5;
+
+        double sin_u = sin_p * c_du + cos_p * s_du;
+        double cos_u = cos_p * c_du - sin_p * s_du;
+        double sin_i = oe->sin_i0[k] * c_di + oe->cos_i0[k] * s_di;
+        double cos_i = oe->cos_i0[k] * c_di - oe->sin_i0[k] * s_di;
+        double r     = oe->a[k] * one_m_ecos + dr;
+
+        /* position in the orbital plane, then ECEF */
+        double xp = r * cos_u;
+        double yp = r * sin_u;
+
+        st->x[k] = xp * cos_o[k] - yp * cos_i * sin_o[k];
+        st->y[k] = xp * sin_o[k] + yp * cos_i * cos_o[k];
+        st->z[k] = yp * sin_i;
+
+        /* rates */
+        double e_dot = oe->n[k] * inv;
+        double v_dot = e_dot * oe->sqrt_1me2[k] * inv;
+        double u_dot = v_dot * (1.0 + 2.0 * (oe->c_us[k] * cos_2p - oe->c_uc[k] * sin_2p));
+        double r_dot = oe->a[k] * e * sin_e[k] * e_dot +
+                       2.0 * v_dot * (oe->c_rs[k] * cos_2p - oe->c_rc[k] * sin_2p);
+        double i_dot = oe->idot[k] +
+                       2.0 * v_dot * (oe->c_is[k] * cos_2p - oe->c_ic[k] * sin_2p);
+        double o_dot = oe->omega_dot[k];
+
+        double xp_dot = r_dot * cos_u - yp * u_dot;
+        double yp_dot = r_dot * sin_u + xp * u_dot;
+
+        st->vx[k] = -xp * o_dot * sin_o[k] + xp_dot * cos_o[k] - yp_dot * sin_o[k] * cos_i -
+                    yp * (o_dot * cos_o[k] * cos_i - i_dot * sin_o[k] * sin_i);
+        st->vy[k] =  xp * o_dot * cos_o[k] + xp_dot * sin_o[k] + yp_dot * cos_o[k] * cos_i -
+                    yp * (o_dot * sin_o[k] * cos_i + i_dot * cos_o[k] * sin_i);
+        st->vz[k] =  yp_dot * sin_i + yp * i_dot * cos_i;
+
+        /* clock, including the relativistic term and the group delay */
+        double tc = wrap_half_week(t - oe->toc[k]);
+
+        st->clk_bias[k]  = oe->af0[k] + (oe->af1[k] + oe->af2[k] * tc) * tc +
+                           oe->rel[k] * sin_e[k] - oe->t_gd[k];
+        st->clk_drift[k] = oe->af1[k] + 2.0 * oe->af2[k] * tc +
+                           oe->rel[k] * cos_e[k] * e_dot;
+    }
+}
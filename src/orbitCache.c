@@ -0,0 +1,223 @@
+/*
+ * orbitCache.c
+ *
+ * Chebyshev orbit interpolation cache (see orbitCache.h)
+ *
+ * A window is fitted from OCACHE_NCOEF evaluations of the orbit engine at
+ * the Chebyshev nodes of the window. A single fit pass propagates all SVs
+ * at once, so every SV missing that window gets it for the price of one.
+ *
+ * A window is only valid for the (sv_id, IODE) it was fitted on: as soon
+ * as ocache_update() loads a new IODE for an SV, its windows stop matching
+ * and are refitted on the next query.
+ *
+ */
+
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+
+#include "gps.h"
+#include "orbit.h"
+#include "orbitCache.h"
+
+
+/* cos(pi * i * (j + 1/2) / N), computed once */
+static double chebCos_G[OCACHE_NCOEF][OCACHE_NCOEF];
+static int    chebInit_G = 0;
+
+
+static void cheb_tables(void)
+{
+    if(chebInit_G){
+        return;
+    }
+    for(int i=0; i < OCACHE_NCOEF; i++){
+        for(int j=0; j < OCACHE_NCOEF; j++){
+            chebCos_G[i][j] = cos(M_PI * i * (j + 0.5) / OCACHE_NCOEF);
+        }
+    }
+    chebInit_G = 1;
+}
+
+
+static inline int window_index(double t)
+{
+    return (int)floor(t / OCACHE_WINDOW);
+}
+
+static inline int window_slot(int index)
+{
+    return ((index % OCACHE_SLOTS) + OCACHE_SLOTS) % OCACHE_SLOTS;
+}
+
+
+static inline int window_valid(const struct ocache_window *w,
+                               const struct orbit_engine *oe, int k, int index)
+{
+    return (w->index == index) &&
+           (w->sv_id == oe->sv_id[k]) &&
+           (w->iode  == (oe->iodc[k] & 0xff));
+}
+
+
+/*
+ * Fits window 'index' for every engine slot that doesn't hold it yet. The
+ * nodes are propagated one at a time and summed into the coefficients, so
+ * a single orbit_state on the stack does.
+ */
+static void fit_window(struct orbit_cache *oc, int index)
+{
+    struct orbit_state st;
+    struct orbit_engine *oe = &oc->oe;
+    double t0 = index * OCACHE_WINDOW;
+    int s = window_slot(index);
+    uint8_t fit[MAX_SV];
+
+    for(int k=0; k < oe->n_sv; k++){
+        struct ocache_window *w = &oc->win[k][s];
+
+        fit[k] = !window_valid(w, oe, k, index);
+        if(fit[k]){
+            memset(w->c, 0, sizeof(w->c));
+        }
+    }
+
+    for(int j=0; j < OCACHE_NCOEF; j++){
+        // node x_j = cos(pi (j + 1/2) / N) mapped onto [t0, t0 + WINDOW]
+        double x = chebCos_G[1][j];
+        orbit_propagate(oe, t0 + (x + 1.0) * 0.5 * OCACHE_WINDOW, &st);
+
+        for(int k=0; k < oe->n_sv; k++){
+            struct ocache_window *w = &oc->win[k][s];
+
+            if(!fit[k]){
+                continue;
+            }
+            for(int i=0; i < OCACHE_NCOEF; i++){
+                double f = chebCos_G[i][j];
+                w->c[OCACHE_X][i]   += st.x[k] * f;
+                w->c[OCACHE_Y][i]   += st.y[k] * f;
+                w->c[OCACHE_Z][i]   += st.z[k] * f;
+                w->c[OCACHE_CLK][i] += st.clk_bias[k] * f;
+            }
+        }
+    }
+
+    for(int k=0; k < oe->n_sv; k++){
+        struct ocache_window *w = &oc->win[k][s];
+
+        if(!fit[k]){
+            continue;
+        }
+        for(int i=0; i < OCACHE_NCOEF; i++){
+            double g = (i == 0 ? 1.0 : 2.0) / OCACHE_NCOEF;
+            for(int a=0; a < OCACHE_NAXIS; a++){
+                w->c[a][i] *= g;
+            }
+        }
+        w->sv_id = oe->sv_id[k];
+        w->iode  = oe->iodc[k] & 0xff;
+        w->index = index;
+    }
+
+    oc->fits++;
+}
+
+
+void ocache_init(struct orbit_cache *oc)
+{
+    cheb_tables();
+    memset(oc, 0, sizeof(struct orbit_cache));
+    orbit_engine_init(&oc->oe);
+
+    for(int k=0; k < MAX_SV; k++){
+        for(int s=0; s < OCACHE_SLOTS; s++){
+            oc->win[k][s].sv_id = -1;
+        }
+        oc->slot[k] = -1;
+    }
+}
+
+
+/* Loads a new ephemeris set; returns the number of SVs whose parameters
+ * changed (their windows are implicitly invalidated) */
+int ocache_update(struct orbit_cache *oc, const struct gps_ephemeris *eph)
+{
+    int changed;
+
+    changed = orbit_engine_load(&oc->oe, eph);
+
+    for(int i=0; i < MAX_SV; i++){
+        oc->slot[i] = -1;
+    }
+    for(int k=0; k < oc->oe.n_sv; k++){
+        int sv_id = oc->oe.sv_id[k];
+        if((0 <= sv_id) && (sv_id < MAX_SV)){
+            oc->slot[sv_id] = k;
+        }
+    }
+
+    return changed;
+}
+
+
+/*
+ * Position (m), velocity (m/s) and clock bias/drift (s, s/s) of sv_id at
+ * GPS time of week t. vel and clk may be NULL.
+ * Returns 0 on success, -1 if the SV has no ephemeris.
+ */
+int ocache_query(struct orbit_cache *oc, int sv_id, double t,
+                 double pos[3], double vel[3], double clk[2])
+{
+    struct ocache_window *w;
+    double x, tn[OCACHE_NCOEF], dtn[OCACHE_NCOEF];
+    int k, index;
+
+    if((sv_id < 0) || (MAX_SV <= sv_id)){
+        return -1;
+    }
+    k = oc->slot[sv_id];
+    if(k < 0){
+        return -1;
+    }
+
+    index = window_index(t);
+    w = &oc->win[k][window_slot(index)];
+    if(window_valid(w, &oc->oe, k, index)){
+        oc->hits++;
+    }else{
+        fit_window(oc, index);
+    }
+
+    // T_i(x) and dT_i/dx by the three-term recurrences
+    x = 2.0 * (t - index * OCACHE_WINDOW) / OCACHE_WINDOW - 1.0;
+    tn[0]  = 1.0;  tn[1]  = x;
+    dtn[0] = 0.0;  dtn[1] = 1.0;
+    for(int i=2; i < OCACHE_NCOEF; i++){
+        tn[i]  = 2.0 * x * tn[i-1] - tn[i-2];
+        dtn[i] = 2.0 * tn[i-1] + 2.0 * x * dtn[i-1] - dtn[i-2];
+    }
+
+    // the four axes are accumulated side by side to keep the adds independent
+    double p[OCACHE_NAXIS]  = { 0.0 };
+    double dp[OCACHE_NAXIS] = { 0.0 };
+
+    for(int i=0; i < OCACHE_NCOEF; i++){
+        for(int a=0; a < OCACHE_NAXIS; a++){
+            p[a]  += w->c[a][i] * tn[i];
+            dp[a] += w->c[a][i] * dtn[i];
+        }
+    }
+
+    for(int a=0; a < OCACHE_CLK; a++){
+        pos[a] = p[a];
+        if(vel){ vel[a] = dp[a] * (2.0 / OCACHE_WINDOW); }
+    }
+    if(clk){
+        clk[0] = p[OCACHE_CLK];
+        clk[1] = dp[OCACHE_CLK] * (2.0 / OCACHE_WINDOW);
+    }
+
+    return 0;
+}
@@ -0,0 +1,638 @@
+/*
+ * post.c
+ *
+ * HTTP uploader behind post2Server()
+ *
+ * post2Server() only copies the payload into a bounded queue and returns;
+ * POST_WORKERS threads drain the queue over a pool of keep-alive
+ * connections. A worker takes every payload waiting for the same address
+ * (up to POST_BATCH_MAX) and sends them as one JSON array, a lone payload
+ * included, so a slow backend gets fewer, larger requests instead of a
+ * growing backlog, and always the same shape of body.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include "config.h"
+#include "debug.h"
+#include "post.h"
+
+
+#define POST_HOST_LEN   128
+#define POST_PATH_LEN   256
+#define POST_HDR_LEN    1024
+#define POST_RESP_LEN   4096
+
+
+typedef struct postEntry_s
+{
+    char  *address;
+    char  *data;
+    size_t len;
+}postEntry_t;
+
+typedef struct postConn_s
+{
+    int  fd;                        // -1: no connection
+    int  inUse;
+    char host[POST_HOST_LEN];
+    char port[8];
+}postConn_t;
+
+typedef struct postUrl_s
+{
+    char host[POST_HOST_LEN];
+    char port[8];
+    char path[POST_PATH_LEN];
+}postUrl_t;
+
+
+static pthread_mutex_t postMutex_G = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  postCond_G  = PTHREAD_COND_INITIALIZER;
+
+static struct postEntry_s postQueue_G[POST_QUEUE_SIZE];
+static int postHead_G;
+static int postCount_G;
+static int postStop_G;
+static int postRunning_G;
+
+static struct postConn_s postPool_G[POST_POOL_SIZE];
+static struct postStats_s postStats_G;
+static pthread_t postWorkers_G[POST_WORKERS];
+
+
+static void statAdd(uint64_t *counter, int n)
+{
+    pthread_mutex_lock(&postMutex_G);
+    *counter += n;
+    pthread_mutex_unlock(&postMutex_G);
+}
+
+static void entryFree(struct postEntry_s *e)
+{
+    free(e->address);
+    free(e->data);
+    memset(e, 0, sizeof(struct postEntry_s));
+}
+
+
+// http://host[:port][/path]
+static int parseUrl(const char *url, struct postUrl_s *u)
+{
+    const char *h, *p, *c;
+    size_t hl;
+
+    if(strncmp(url, "http://", 7)){
+        return -1;
+    }
+    h = url + 7;
+    p = strchr(h, '/');
+    if(p == NULL){
+        p = h + strlen(h);
+    }
+    c = memchr(h, ':', p - h);
+    hl = (c ? c : p) - h;
+    if((hl == 0) || (hl >= POST_HOST_LEN) || (strlen(p) >= POST_PATH_LEN)){
+        return -1;
+    }
+
+    memcpy(u->host, h, hl);
+    u->host[hl] = '\0';
+    if(c){
+        size_t pl = p - c - 1;
+        if((pl == 0) || (pl >= sizeof(u->port))){
+            return -1;
+        }
+        memcpy(u->port, c + 1, pl);
+        u->port[pl] = '\0';
+    }else{
+        strcpy(u->port, "80");
+    }
+    strcpy(u->path, *p ? p : "/");
+
+    return 0;
+}
+
+
+static int connectTo(const struct postUrl_s *u)
+{
+    struct addrinfo hints, *res, *ai;
+    struct timeval tv = { POST_TIMEOUT_MS / 1000, (POST_TIMEOUT_MS % 1000) * 1000 };
+    int fd = -1, one = 1;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(u->host, u->port, &hints, &res) != 0){
+        return -1;
+    }
+
+    for(ai = res; ai; ai = ai->ai_next){
+        fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+        if(fd < 0){
+            continue;
+        }
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0){
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(res);
+
+    return fd;
+}
+
+
+/* Takes an idle pooled connection to the host, or a free slot for a new
+ * one (fd -1). NULL if every slot is busy, the caller then goes without */
+static struct postConn_s *poolGet(const struct postUrl_s *u)
+{
+    struct postConn_s *idle = NULL, *free_ = NULL;
+
+    pthread_mutex_lock(&postMutex_G);
+    for(int i=0; i < POST_POOL_SIZE; i++){
+        struct postConn_s *c = &postPool_G[i];
+
+        if(c->inUse){
+            continue;
+        }
+        if((c->fd >= 0) && !strcmp(c->host, u->host) && !strcmp(c->port, u->port)){
+            idle = c;
+            break;
+        }
+        if((free_ == NULL) || (c->fd < 0)){
+            free_ = c;
+        }
+    }
+    if(idle == NULL && free_ != NULL){
+        // reuse the slot for this host
+        if(free_->fd >= 0){
+            close(free_->fd);
+            free_->fd = -1;
+        }
+        strcpy(free_->host, u->host);
+        strcpy(free_->port, u->port);
+        idle = free_;
+    }
+    if(idle){
+        idle->inUse = 1;
+    }
+    pthread_mutex_unlock(&postMutex_G);
+
+    return idle;
+}
+
+static void poolPut(struct postConn_s *c, int keep)
+{
+    pthread_mutex_lock(&postMutex_G);
+    if(!keep && (c->fd >= 0)){
+        close(c->fd);
+        c->fd = -1;
+    }
+    c->inUse = 0;
+    pthread_mutex_unlock(&postMutex_G);
+}
+
+
+static int sendAll(int fd, struct iovec *iov, int cnt)
+{
+    struct msghdr msg;
+    ssize_t n;
+
+    while(cnt){
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = iov;
+        msg.msg_iovlen = cnt;
+        n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        while(cnt && ((size_t)n >= iov->iov_len)){
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if(cnt){
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 0;
+}
+
+// what was read of a response and not consumed yet
+typedef struct respBuf_s
+{
+    int  fd;
+    int  len;                       // bytes in buf
+    int  pos;                       // first unconsumed one
+    char buf[POST_RESP_LEN + 1];
+}respBuf_t;
+
+// reads more, keeping the unconsumed bytes; -1 on a broken connection
+// or when they already fill the buffer
+static int respFill(struct respBuf_s *rb)
+{
+    ssize_t n;
+
+    if(rb->pos){
+        rb->len -= rb->pos;
+        memmove(rb->buf, rb->buf + rb->pos, rb->len);
+        rb->pos = 0;
+    }
+    if(rb->len == POST_RESP_LEN){
+        return -1;
+    }
+    do{
+        n = read(rb->fd, rb->buf + rb->len, POST_RESP_LEN - rb->len);
+    }while((n < 0) && (errno == EINTR));
+    if(n <= 0){
+        return -1;
+    }
+    rb->len += n;
+    rb->buf[rb->len] = '\0';
+    return 0;
+}
+
+// the next CRLF terminated line, NUL terminated in place
+static char *respLine(struct respBuf_s *rb)
+{
+    char *eol, *line;
+
+    while((eol = memmem(rb->buf + rb->pos, rb->len - rb->pos, "\r\n", 2)) == NULL){
+        if(respFill(rb) < 0){
+            return NULL;
+        }
+    }
+    *eol = '\0';
+    line = rb->buf + rb->pos;
+    rb->pos = eol + 2 - rb->buf;
+    return line;
+}
+
+static int respSkip(struct respBuf_s *rb, long n)
+{
+    while(n > 0){
+        long avail = rb->len - rb->pos;
+
+        if(avail == 0){
+            rb->len = rb->pos = 0;
+            if(respFill(rb) < 0){
+                return -1;
+            }
+            continue;
+        }
+        if(avail > n){
+            avail = n;
+        }
+        rb->pos += avail;
+        n -= avail;
+    }
+    return 0;
+}
+
+// chunk-size [; ext] CRLF, chunk data CRLF, ..., 0 CRLF, trailers, CRLF
+static int skipChunked(struct respBuf_s *rb)
+{
+    char *line, *e;
+    long size;
+
+    while(1){
+        if((line = respLine(rb)) == NULL){
+            return -1;
+        }
+        size = strtol(line, &e, 16);
+        if((e == line) || (size < 0) || ((*e != '\0') && (*e != ';') && (*e != ' ') && (*e != '\t'))){
+            return -1;
+        }
+        if(size == 0){
+            break;
+        }
+        if((respSkip(rb, size) < 0) || ((line = respLine(rb)) == NULL) || (*line != '\0')){
+            return -1;
+        }
+    }
+    do{
+        if((line = respLine(rb)) == NULL){
+            return -1;
+        }
+    }while(*line != '\0');
+
+    return 0;
+}
+
+/* Reads one response. Returns the status code, or -1 on a broken
+ * connection; *keep tells if the connection may be used again */
+static int readResponse(int fd, int *keep)
+{
+    struct respBuf_s rb;
+    char *end = NULL, *h;
+    long bodyLen = -1;
+    int status, chunked = 0;
+
+    *keep = 0;
+    rb.fd  = fd;
+    rb.len = rb.pos = 0;
+    rb.buf[0] = '\0';
+    while((end = strstr(rb.buf, "\r\n\r\n")) == NULL){
+        if(respFill(&rb) < 0){
+            return -1;
+        }
+    }
+    *end = '\0';
+    rb.pos = end + 4 - rb.buf;
+
+    if(sscanf(rb.buf, "HTTP/1.%*d %d", &status) != 1){
+        return -1;
+    }
+    if((h = strcasestr(rb.buf, "\r\ncontent-length:")) != NULL){
+        bodyLen = strtol(h + 17, NULL, 10);
+    }
+    if(strcasestr(rb.buf, "\r\ntransfer-encoding: chunked")){
+        chunked = 1;
+    }
+    *keep = (strcasestr(rb.buf, "\r\nconnection: close") == NULL) && (rb.buf[7] == '1');
+
+    // drop the body
+    if(chunked){
+        if(skipChunked(&rb) < 0){
+            return -1;
+        }
+    }else if(bodyLen < 0){
+        // body runs until close
+        *keep = 0;
+    }else if(respSkip(&rb, bodyLen) < 0){
+        return -1;
+    }
+
+    return status;
+}
+
+
+/* One request with the batch as body, a JSON array of the payloads
+ * however many there are. Returns the HTTP status, or -1 */
+static int postBatch(const struct postUrl_s *u, struct postEntry_s *batch, int n)
+{
+    struct iovec iov[2 + 2 * POST_BATCH_MAX];
+    char hdr[POST_HDR_LEN];
+    size_t bodyLen = 0;
+    struct postConn_s *c;
+    int cnt, status = -1, keep = 0;
+
+    for(int i=0; i < n; i++){
+        bodyLen += batch[i].len;
+    }
+    bodyLen += n + 1;                   // '[', ','s and ']'
+
+    cnt = 1;
+    iov[0].iov_base = hdr;
+    iov[0].iov_len  = snprintf(hdr, sizeof(hdr),
+                               "POST %s HTTP/1.1\r\n"
+                               "Host: %s:%s\r\n"
+                               "Content-Type: application/json\r\n"
+                               "Content-Length: %zu\r\n"
+                               "X-Batch-Count: %d\r\n"
+                               "\r\n", u->path, u->host, u->port, bodyLen, n);
+    for(int i=0; i < n; i++){
+        iov[cnt].iov_base = (i == 0) ? "[" : ",";
+        iov[cnt].iov_len  = 1;
+        cnt++;
+        iov[cnt].iov_base = batch[i].data;
+        iov[cnt].iov_len  = batch[i].len;
+        cnt++;
+    }
+    iov[cnt].iov_base = "]";
+    iov[cnt].iov_len  = 1;
+    cnt++;
+
+    c = poolGet(u);
+
+    // a pooled connection may have been closed by the server meanwhile,
+    // so a failure on it gets one more try on a fresh one
+    for(int attempt = 0; attempt < 2; attempt++){
+        struct iovec tx[2 + 2 * POST_BATCH_MAX];
+        int reused = (c != NULL) && (c->fd >= 0);
+        int fd;
+
+        if(reused){
+            fd = c->fd;
+        }else{
+            fd = connectTo(u);
+            if(fd < 0){
+                LOG(LOG_WARN, "post: cannot connect to %s:%s", u->host, u->port);
+                break;
+            }
+            statAdd(&postStats_G.connects, 1);
+            if(c){
+                c->fd = fd;
+            }
+        }
+
+        memcpy(tx, iov, cnt * sizeof(struct iovec));
+        statAdd(&postStats_G.requests, 1);
+        if((sendAll(fd, tx, cnt) == 0) && ((status = readResponse(fd, &keep)) > 0)){
+            if(c == NULL){
+                close(fd);
+            }
+            break;
+        }
+
+        // broken connection
+        status = -1;
+        keep   = 0;
+        close(fd);
+        if(c){
+            c->fd = -1;
+        }
+        if(!reused){
+            break;
+        }
+    }
+
+    if(c){
+        poolPut(c, keep);
+    }
+
+    return status;
+}
+
+
+static void *postWorker_f(void *arg)
+{
+    struct postEntry_s batch[POST_BATCH_MAX];
+    struct postUrl_s url;
+    int n, status;
+
+    while(1){
+        size_t bytes = 0;
+
+        pthread_mutex_lock(&postMutex_G);
+        while(!postStop_G && (postCount_G == 0)){
+            pthread_cond_wait(&postCond_G, &postMutex_G);
+        }
+        if(postCount_G == 0){
+            pthread_mutex_unlock(&postMutex_G);
+            break;
+        }
+
+        // everything queued for the same address, in order
+        n = 0;
+        while((postCount_G > 0) && (n < POST_BATCH_MAX)){
+            struct postEntry_s *e = &postQueue_G[postHead_G];
+
+            if(n && (strcmp(e->address, batch[0].address) ||
+                     (bytes + e->len > POST_BATCH_BYTES))){
+                break;
+            }
+            bytes += e->len;
+            batch[n++] = *e;
+            memset(e, 0, sizeof(struct postEntry_s));
+            postHead_G = (postHead_G + 1) % POST_QUEUE_SIZE;
+            postCount_G--;
+        }
+        pthread_mutex_unlock(&postMutex_G);
+
+        if(parseUrl(batch[0].address, &url) < 0){
+            LOG(LOG_ERR, "post: bad address %s", batch[0].address);
+            status = -1;
+        }else{
+            status = postBatch(&url, batch, n);
+        }
+
+        if((status >= 200) && (status < 300)){
+            statAdd(&postStats_G.sent, n);
+        }else{
+            LOG(LOG_WARN, "post: %d payloads to %s failed (%d)", n, batch[0].address, status);
+            statAdd(&postStats_G.failed, n);
+        }
+
+        for(int i=0; i < n; i++){
+            entryFree(&batch[i]);
+        }
+    }
+
+    return NULL;
+}
+
+
+int post_initialize(void)
+{
+    if(postRunning_G){
+        return 0;
+    }
+
+    memset(&postStats_G, 0, sizeof(postStats_G));
+    for(int i=0; i < POST_POOL_SIZE; i++){
+        postPool_G[i].fd    = -1;
+        postPool_G[i].inUse = 0;
+    }
+    postHead_G  = 0;
+    postCount_G = 0;
+    postStop_G  = 0;
+
+    for(int i=0; i < POST_WORKERS; i++){
+        if(pthread_create(&postWorkers_G[i], NULL, postWorker_f, NULL) != 0){
+            LOG(LOG_ERR, "post: cannot start worker %d", i);
+            return -1;
+        }
+    }
+    postRunning_G = 1;
+
+    return 0;
+}
+
+
+/*
+ * Queues a copy of the payload for upload and returns right away.
+ * Returns 0, 1 if the queue was full and the oldest payload was dropped
+ * for this one, or -1 on error.
+ */
+int post2Server(struct post_s *post_p)
+{
+    struct postEntry_s e;
+    int rv = 0;
+
+    if(!postRunning_G || (post_p == NULL) || !post_p->postAddress || !post_p->postData){
+        return -1;
+    }
+
+    e.address = strdup(post_p->postAddress);
+    e.data    = strdup(post_p->postData);
+    e.len     = strlen(post_p->postData);
+    if((e.address == NULL) || (e.data == NULL)){
+        entryFree(&e);
+        return -1;
+    }
+
+    pthread_mutex_lock(&postMutex_G);
+    if(postCount_G == POST_QUEUE_SIZE){
+        entryFree(&postQueue_G[postHead_G]);
+        postHead_G = (postHead_G + 1) % POST_QUEUE_SIZE;
+        postCount_G--;
+        postStats_G.dropped++;
+        rv = 1;
+    }
+    postQueue_G[(postHead_G + postCount_G) % POST_QUEUE_SIZE] = e;
+    postCount_G++;
+    postStats_G.queued++;
+    pthread_cond_signal(&postCond_G);
+    pthread_mutex_unlock(&postMutex_G);
+
+    return rv;
+}
+
+
+// Sends what is still queued, then stops the workers and the pool
+int postCleanup(void)
+{
+    if(!postRunning_G){
+        return 0;
+    }
+
+    pthread_mutex_lock(&postMutex_G);
+    postStop_G = 1;
+    pthread_cond_broadcast(&postCond_G);
+    pthread_mutex_unlock(&postMutex_G);
+
+    for(int i=0; i < POST_WORKERS; i++){
+        pthread_join(postWorkers_G[i], NULL);
+    }
+    for(int i=0; i < POST_POOL_SIZE; i++){
+        if(postPool_G[i].fd >= 0){
+            close(postPool_G[i].fd);
+            postPool_G[i].fd = -1;
+        }
+    }
+    postRunning_G = 0;
+
+    return 0;
+}
+
+
+void post_getStats(struct postStats_s *stats)
+{
+    pthread_mutex_lock(&postMutex_G);
+    memcpy(stats, &postStats_G, sizeof(struct postStats_s));
+    pthread_mutex_unlock(&postMutex_G);
+}
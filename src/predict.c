@@ -0,0 +1,249 @@
+/*
+ * predict.c
+ *
+ * Almanac based visibility and Doppler prediction
+ *
+ * Satellite positions come from the almanac Keplerian elements (no
+ * harmonic corrections, a few km of error, irrelevant for elevation),
+ * read in engineering units from the view of the assist data (gpsView.h).
+ * The receiver is assumed static at the last NAV-POSLLH fix.
+ *
+ */
+
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "gps.h"
+#include "orbit.h"
+#include "gpsView.h"
+#include "predict.h"
+
+
+#define WGS84_A     6378137.0
+#define WGS84_E2    6.69437999014e-3
+
+#define DEG2RAD     (M_PI / 180.0)
+#define RAD2DEG     (180.0 / M_PI)
+
+#define ALM_I_REF   (0.30 * GPS_PI) /* rad, i = 0.30 semi-circles + ksii */
+
+
+struct rx_frame {
+    double x, y, z;             /* ECEF of the receiver */
+    double en[3], nn[3], un[3]; /* local east / north / up unit vectors */
+};
+
+
+static void rx_frame_init(struct rx_frame *rx, const struct gps_ref_pos *pos)
+{
+    double lat = pos->latitude * DEG2RAD;
+    double lon = pos->longitude * DEG2RAD;
+    double sl = sin(lat), cl = cos(lat);
+    double so = sin(lon), co = cos(lon);
+    double n = WGS84_A / sqrt(1.0 - WGS84_E2 * sl * sl);
+
+    rx->x = (n + pos->altitude) * cl * co;
+    rx->y = (n + pos->altitude) * cl * so;
+    rx->z = (n * (1.0 - WGS84_E2) + pos->altitude) * sl;
+
+    rx->en[0] = -so;       rx->en[1] = co;        rx->en[2] = 0.0;
+    rx->nn[0] = -sl * co;  rx->nn[1] = -sl * so;  rx->nn[2] = cl;
+    rx->un[0] = cl * co;   rx->un[1] = cl * so;   rx->un[2] = sl;
+}
+
+
+/* ECEF position of an almanac SV at time of week t, from its view (s, m, rad) */
+static void alm_position(const struct gps_alm_view_sv *a, double t, double p[3])
+{
+    double sma = a->a_powhalf * a->a_powhalf;
+    double e   = a->e;
+    double tk  = t - a->t_oa;
+    double m, ek, v, u, r, o, i;
+
+    if(tk > GPS_HALF_WEEK){
+        tk -= 2.0 * GPS_HALF_WEEK;
+    }else if(tk < -GPS_HALF_WEEK){
+        tk += 2.0 * GPS_HALF_WEEK;
+    }
+
+    m  = a->m_0 + sqrt(GPS_MU / (sma * sma * sma)) * tk;
+    ek = m;
+    for(int it=0; it < 4; it++){
+        ek -= (ek - e * sin(ek) - m) / (1.0 - e * cos(ek));
+    }
+
+    v = atan2(sqrt(1.0 - e * e) * sin(ek), cos(ek) - e);
+    u = v + a->w;
+    r = sma * (1.0 - e * cos(ek));
+    i = ALM_I_REF + a->ksii;
+    o = a->omega_0 + (a->omega_dot - GPS_OMEGA_E) * tk - GPS_OMEGA_E * a->t_oa;
+
+    p[0] = r * (cos(u) * cos(o) - sin(u) * cos(i) * sin(o));
+    p[1] = r * (cos(u) * sin(o) + sin(u) * cos(i) * cos(o));
+    p[2] = r * sin(u) * sin(i);
+}
+
+
+/* Elevation / azimuth (deg) of an ECEF point, and the line of sight */
+static double look_angles(const struct rx_frame *rx, const double p[3],
+                          double *azim, double los[3])
+{
+    double d[3] = { p[0] - rx->x, p[1] - rx->y, p[2] - rx->z };
+    double rng = sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    double e, n, u;
+
+    for(int j=0; j < 3; j++){
+        los[j] = d[j] / rng;
+    }
+    e = los[0] * rx->en[0] + los[1] * rx->en[1] + los[2] * rx->en[2];
+    n = los[0] * rx->nn[0] + los[1] * rx->nn[1] + los[2] * rx->nn[2];
+    u = los[0] * rx->un[0] + los[1] * rx->un[1] + los[2] * rx->un[2];
+
+    if(azim){
+        *azim = atan2(e, n) * RAD2DEG;
+        if(*azim < 0.0){
+            *azim += 360.0;
+        }
+    }
+    return asin(u) * RAD2DEG;
+}
+
+
+/*
+ * Predicts elevation, azimuth, Doppler and rise time of every almanac SV
+ * of the view seen from pos at GPS time of week tow.
+ * Returns the number of SVs usable within PREDICT_HORIZON.
+ */
+int predict_from_almanac(const struct gps_assist_view *view, const struct gps_ref_pos *pos,
+                         double tow, struct predict_set *ps)
+{
+    struct rx_frame rx;
+
+    memset(ps, 0, sizeof(struct predict_set));
+    rx_frame_init(&rx, pos);
+    ps->tow  = tow;
+    ps->n_sv = (view->n_alm < MAX_SV) ? view->n_alm : MAX_SV;
+
+    for(int k=0; k < ps->n_sv; k++){
+        const struct gps_alm_view_sv *a = &view->alm[k];
+        struct sv_predict *sp = &ps->sv[k];
+        double p0[3], p1[3], los[3], rr;
+
+        sp->sv_id   = a->sv_id;
+        sp->rise_in = -1.0;
+
+        alm_position(a, tow, p0);
+        alm_position(a, tow + 1.0, p1);
+        sp->elev = look_angles(&rx, p0, &sp->azim, los);
+
+        // range rate from the 1 s position difference (receiver fixed in ECEF)
+        rr = (p1[0] - p0[0]) * los[0] + (p1[1] - p0[1]) * los[1] + (p1[2] - p0[2]) * los[2];
+        sp->doppler = -rr * GPS_L1_FREQ / GPS_C;
+
+        if(look_angles(&rx, p1, NULL, los) > sp->elev){
+            sp->flags |= PREDICT_RISING;
+        }
+        if(a->sv_health){
+            sp->flags |= PREDICT_UNHEALTHY;
+        }
+
+        if(sp->elev > PREDICT_ELEV_MASK){
+            sp->flags  |= PREDICT_VISIBLE;
+            sp->rise_in = 0.0;
+        }else{
+            for(double dt = PREDICT_STEP; dt <= PREDICT_HORIZON; dt += PREDICT_STEP){
+                alm_position(a, tow + dt, p1);
+                if(look_angles(&rx, p1, NULL, los) > PREDICT_ELEV_MASK){
+                    sp->rise_in = dt;
+                    break;
+                }
+            }
+        }
+
+        if((sp->rise_in >= 0.0) && !(sp->flags & PREDICT_UNHEALTHY)){
+            sp->flags |= PREDICT_USABLE;
+            ps->n_usable++;
+        }
+    }
+
+    return ps->n_usable;
+}
+
+
+/* Runs the prediction for "now", using the last fix and the reference
+ * time, from the almanac of view (refreshed from gps by the caller).
+ * Returns -1 when the almanac, position or time is still missing. */
+int predict_from_assist(const struct gps_assist_data *gps, const struct gps_assist_view *view,
+                        struct predict_set *ps)
+{
+    const int need = GPS_FIELD_ALMANAC | GPS_FIELD_REFPOS | GPS_FIELD_REFTIME;
+    double tow;
+
+    if((gps->fields & need) != need){
+        return -1;
+    }
+
+    tow = gps->ref_time.tow + difftime(time(NULL), gps->ref_time.when);
+    tow = fmod(tow, 2.0 * GPS_HALF_WEEK);
+
+    return predict_from_almanac(view, &gps->ref_pos, tow, ps);
+}
+
+
+/* Poll priority: visible and rising, visible and setting (highest first),
+ * rising later (soonest first), then the rest */
+static int poll_rank(const struct sv_predict *sp)
+{
+    if(!(sp->flags & PREDICT_USABLE)){
+        return 3;
+    }
+    if(sp->flags & PREDICT_VISIBLE){
+        return (sp->flags & PREDICT_RISING) ? 0 : 1;
+    }
+    return 2;
+}
+
+static int poll_cmp(const void *a, const void *b)
+{
+    const struct sv_predict *pa = *(const struct sv_predict * const *)a;
+    const struct sv_predict *pb = *(const struct sv_predict * const *)b;
+    int ra = poll_rank(pa), rb = poll_rank(pb);
+
+    if(ra != rb){
+        return ra - rb;
+    }
+    if(ra == 2){
+        return (pa->rise_in > pb->rise_in) - (pa->rise_in < pb->rise_in);
+    }
+    return (pa->elev < pb->elev) - (pa->elev > pb->elev);
+}
+
+
+/*
+ * Fills sv_ids with the SVs in polling order, at most max of them.
+ * With usable_only, SVs that stay below the mask over the horizon (or are
+ * unhealthy) are left out. Returns the number of SVs written.
+ */
+int predict_poll_order(const struct predict_set *ps, int *sv_ids, int max, int usable_only)
+{
+    const struct sv_predict *order[MAX_SV];
+    int n = 0;
+
+    for(int k=0; k < ps->n_sv; k++){
+        if(usable_only && !(ps->sv[k].flags & PREDICT_USABLE)){
+            continue;
+        }
+        order[n++] = &ps->sv[k];
+    }
+    qsort(order, n, sizeof(order[0]), poll_cmp);
+
+    if(n > max){
+        n = max;
+    }
+    for(int k=0; k < n; k++){
+        sv_ids[k] = order[k]->sv_id;
+    }
+    return n;
+}
@@ -0,0 +1,621 @@
+/*
+ * pubServer.c
+ *
+ * Unix socket server publishing the assist data (see pubServer.h)
+ *
+ * The publishers (the control thread, serial_f for the fix) only copy new
+ * data into the staging area and poke an eventfd; encoding and all socket
+ * I/O happen in the server thread, so a slow or stuck client can never
+ * hold up the serial side.
+ *
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "config.h"
+#include "debug.h"
+#include "gps.h"
+#include "ubx.h"
+#include "json.h"
+#include "navHist.h"
+#include "pubServer.h"
+
+
+#define PUB_EPOLL_EVENTS    16
+#define PUB_SV_JSON_SIZE    2048
+
+
+static void clientClose(struct pubServer_s *ps, struct pubClient_s *cl);
+
+
+static struct pubMsg_s *msgNew(const char *data, size_t len)
+{
+    struct pubMsg_s *m = malloc(sizeof(struct pubMsg_s) + len);
+
+    if(m == NULL){
+        return NULL;
+    }
+    m->refs = 1;
+    m->len  = len;
+    memcpy(m->data, data, len);
+    return m;
+}
+
+static void msgPut(struct pubMsg_s *m)
+{
+    if(m && (--m->refs == 0)){
+        free(m);
+    }
+}
+
+// JSON object of a json_buf plus the line terminator, as a message
+static struct pubMsg_s *msgFromJson(struct json_buf *jb)
+{
+    json_put_lit(jb, "\n");
+    if(jb->overflow){
+        return NULL;
+    }
+    return msgNew(jb->buf, jb->len);
+}
+
+static struct pubMsg_s *msgError(const char *what)
+{
+    char line[128];
+    int n = snprintf(line, sizeof(line), "{\"error\":\"%s\"}\n", what);
+
+    return msgNew(line, n);
+}
+
+
+static void clientWatch(struct pubServer_s *ps, struct pubClient_s *cl, int pollOut)
+{
+    struct epoll_event ev;
+
+    if(cl->pollOut == pollOut){
+        return;
+    }
+    ev.events   = EPOLLIN | (pollOut ? EPOLLOUT : 0);
+    ev.data.ptr = cl;
+    epoll_ctl(ps->epollFd, EPOLL_CTL_MOD, cl->fd, &ev);
+    cl->pollOut = pollOut;
+}
+
+
+// gathers the whole queue into one writev, as far as the socket takes it
+static int clientFlush(struct pubServer_s *ps, struct pubClient_s *cl)
+{
+    struct iovec iov[PUB_CLIENT_QUEUE];
+    ssize_t n;
+    int cnt;
+
+    while(cl->outCnt){
+        for(cnt = 0; cnt < cl->outCnt; cnt++){
+            struct pubMsg_s *m = cl->out[(cl->outHead + cnt) % PUB_CLIENT_QUEUE];
+            size_t off = cnt ? 0 : cl->outOff;
+
+            iov[cnt].iov_base = m->data + off;
+            iov[cnt].iov_len  = m->len - off;
+        }
+
+        n = writev(cl->fd, iov, cnt);
+        if(n < 0){
+            if((errno == EAGAIN) || (errno == EWOULDBLOCK)){
+                clientWatch(ps, cl, 1);
+                return 0;
+            }
+            if(errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+
+        // release what went out completely
+        while(cl->outCnt){
+            struct pubMsg_s *m = cl->out[cl->outHead];
+            size_t left = m->len - cl->outOff;
+
+            if((size_t)n < left){
+                cl->outOff += n;
+                break;
+            }
+            n -= left;
+            msgPut(m);
+            cl->outHead = (cl->outHead + 1) % PUB_CLIENT_QUEUE;
+            cl->outCnt--;
+            cl->outOff = 0;
+        }
+    }
+
+    clientWatch(ps, cl, 0);
+    return 0;
+}
+
+// queues a reference to m; a client too slow to keep up is dropped
+static int clientQueue(struct pubServer_s *ps, struct pubClient_s *cl, struct pubMsg_s *m)
+{
+    if(m == NULL){
+        return 0;
+    }
+    if(cl->outCnt == PUB_CLIENT_QUEUE){
+        LOG(LOG_WARN, "pubServer: client %d too slow, dropping it", cl->fd);
+        clientClose(ps, cl);
+        return -1;
+    }
+    m->refs++;
+    cl->out[(cl->outHead + cl->outCnt) % PUB_CLIENT_QUEUE] = m;
+    cl->outCnt++;
+    return 0;
+}
+
+static void clientClose(struct pubServer_s *ps, struct pubClient_s *cl)
+{
+    epoll_ctl(ps->epollFd, EPOLL_CTL_DEL, cl->fd, NULL);
+    close(cl->fd);
+    while(cl->outCnt){
+        msgPut(cl->out[cl->outHead]);
+        cl->outHead = (cl->outHead + 1) % PUB_CLIENT_QUEUE;
+        cl->outCnt--;
+    }
+    memset(cl, 0, sizeof(struct pubClient_s));
+    cl->fd = -1;
+}
+
+
+static struct pubMsg_s *svMsg(struct pubServer_s *ps, int svId)
+{
+    static char buf[PUB_SV_JSON_SIZE];
+    const struct gps_assist_data *gps = &ps->assist;
+    struct json_buf jb;
+    int found = 0;
+
+    json_buf_init(&jb, buf, sizeof(buf));
+    json_put_lit(&jb, "{\"sv_id\":");
+    json_put_int(&jb, svId);
+
+    for(int i=0; i < gps->almanac.n_sv; i++){
+        if(gps->almanac.svs[i].sv_id == svId){
+            json_put_lit(&jb, ",\"almanac\":");
+            json_almanac_sv(&jb, &gps->almanac.svs[i]);
+            found = 1;
+            break;
+        }
+    }
+    for(int i=0; i < gps->ephemeris.n_sv; i++){
+        if(gps->ephemeris.svs[i].sv_id == svId){
+            json_put_lit(&jb, ",\"ephemeris\":");
+            json_ephemeris_sv(&jb, &gps->ephemeris.svs[i]);
+            found = 1;
+            break;
+        }
+    }
+    json_put_lit(&jb, "}");
+
+    if(!found){
+        return msgError("unknown sv");
+    }
+    return msgFromJson(&jb);
+}
+
+// the last seconds of the history in buckets of bucketS, min / max / mean of each value
+static struct pubMsg_s *histMsg(struct pubServer_s *ps, int seconds, int bucketS)
+{
+    static const char *names[NAV_N_VALS] = {
+#define _NAV_NAME(id, name, dec, have)  #name,
+        NAV_HIST_VALUES(_NAV_NAME)
+#undef _NAV_NAME
+    };
+    static const int decimals[NAV_N_VALS] = {
+#define _NAV_DEC(id, name, dec, have)   dec,
+        NAV_HIST_VALUES(_NAV_DEC)
+#undef _NAV_DEC
+    };
+    static struct navBucket_s b[NAV_HIST_BUCKETS];
+    static char buf[JSON_BUF_SIZE];
+    struct navFix_s last;
+    struct json_buf jb;
+    struct pubMsg_s *m;
+    int64_t toMs, fromMs;
+    int n;
+
+    if( (ps->hist == NULL) || (navHist_last(ps->hist, &last) < 0) ){
+        return msgError("no history");
+    }
+    toMs   = last.timeMs + 1;
+    fromMs = toMs - (int64_t)seconds * 1000;
+    n = navHist_buckets(ps->hist, fromMs, toMs, (int64_t)bucketS * 1000, b, NAV_HIST_BUCKETS);
+    if(n < 0){
+        return msgError("bad span");
+    }
+
+    json_buf_init(&jb, buf, sizeof(buf));
+    json_put_lit(&jb, "{\"hist\":{\"from_ms\":");
+    json_put_int(&jb, fromMs);
+    json_put_lit(&jb, ",\"to_ms\":");
+    json_put_int(&jb, toMs);
+    json_put_lit(&jb, ",\"bucket_ms\":");
+    json_put_int(&jb, (int64_t)bucketS * 1000);
+    json_put_lit(&jb, ",\"buckets\":[");
+    for(int i=0; i < n; i++){
+        json_put_raw(&jb, ",{\"t_ms\":" + (i ? 0 : 1), sizeof(",{\"t_ms\":") - (i ? 1 : 2));
+        json_put_int(&jb, b[i].startMs);
+        json_put_lit(&jb, ",\"fixes\":");
+        json_put_int(&jb, b[i].fixes);
+        for(int v=0; v < NAV_N_VALS; v++){
+            if(b[i].n[v] == 0){
+                continue;
+            }
+            json_put_lit(&jb, ",\"");
+            json_put_raw(&jb, names[v], strlen(names[v]));
+            json_put_lit(&jb, "\":[");
+            json_put_fixed(&jb, b[i].min[v], decimals[v]);
+            json_put_lit(&jb, ",");
+            json_put_fixed(&jb, b[i].max[v], decimals[v]);
+            json_put_lit(&jb, ",");
+            json_put_fixed(&jb, llround(b[i].mean[v] * 10), decimals[v] + 1);
+            json_put_lit(&jb, "]");
+        }
+        json_put_lit(&jb, "}");
+    }
+    json_put_lit(&jb, "]}}");
+
+    if((m = msgFromJson(&jb)) == NULL){
+        return msgError("too large");
+    }
+    return m;
+}
+
+static void clientCommand(struct pubServer_s *ps, struct pubClient_s *cl, char *line)
+{
+    struct pubMsg_s *m = NULL;
+    int svId, seconds, bucketS;
+
+    if(!strcmp(line, "GET ASSIST")){
+        clientQueue(ps, cl, ps->assistMsg);
+        return;
+    }else if(!strcmp(line, "GET FIX")){
+        if(ps->fixMsg){
+            clientQueue(ps, cl, ps->fixMsg);
+            return;
+        }
+        m = msgError("no fix");
+    }else if(sscanf(line, "GET SV %d", &svId) == 1){
+        m = svMsg(ps, svId);
+    }else if(sscanf(line, "GET HIST %d %d", &seconds, &bucketS) == 2){
+        m = histMsg(ps, seconds, bucketS);
+    }else if(!strcmp(line, "SUB ASSIST") || !strcmp(line, "SUB FIX") || !strcmp(line, "SUB ALL")){
+        int subs = (line[4] == 'A') ? PUB_SUB_ASSIST : PUB_SUB_FIX;
+
+        if(line[5] == 'L'){
+            subs = PUB_SUB_ASSIST | PUB_SUB_FIX;
+        }
+        cl->subs |= subs;
+        // start with the current state
+        if((subs & PUB_SUB_ASSIST) && (clientQueue(ps, cl, ps->assistMsg) < 0)){
+            return;
+        }
+        if(subs & PUB_SUB_FIX){
+            clientQueue(ps, cl, ps->fixMsg);
+        }
+        return;
+    }else if(!strcmp(line, "UNSUB")){
+        cl->subs = 0;
+        return;
+    }else{
+        m = msgError("unknown command");
+    }
+
+    clientQueue(ps, cl, m);
+    msgPut(m);
+}
+
+static void clientRead(struct pubServer_s *ps, struct pubClient_s *cl)
+{
+    ssize_t n;
+    char *nl;
+
+    for(;;){
+        n = read(cl->fd, cl->in + cl->inLen, PUB_CLIENT_INBUF - cl->inLen);
+        if(n == 0){
+            clientClose(ps, cl);
+            return;
+        }
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            if((errno != EAGAIN) && (errno != EWOULDBLOCK)){
+                clientClose(ps, cl);
+                return;
+            }
+            break;
+        }
+        cl->inLen += n;
+
+        // run every complete line
+        while((nl = memchr(cl->in, '\n', cl->inLen)) != NULL){
+            int lineLen = nl - cl->in;
+
+            *nl = '\0';
+            if(lineLen && (cl->in[lineLen - 1] == '\r')){
+                cl->in[lineLen - 1] = '\0';
+            }
+            clientCommand(ps, cl, cl->in);
+            if(cl->fd < 0){
+                return;
+            }
+            cl->inLen -= lineLen + 1;
+            memmove(cl->in, nl + 1, cl->inLen);
+        }
+        if(cl->inLen == PUB_CLIENT_INBUF){
+            LOG(LOG_WARN, "pubServer: command too long, dropping client %d", cl->fd);
+            clientClose(ps, cl);
+            return;
+        }
+    }
+
+    if(clientFlush(ps, cl) < 0){
+        clientClose(ps, cl);
+    }
+}
+
+
+static void acceptClients(struct pubServer_s *ps)
+{
+    struct epoll_event ev;
+    int fd;
+
+    while((fd = accept4(ps->listenFd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0){
+        struct pubClient_s *cl = NULL;
+
+        for(int i=0; i < PUB_MAX_CLIENTS; i++){
+            if(ps->clients[i].fd < 0){
+                cl = &ps->clients[i];
+                break;
+            }
+        }
+        if(cl == NULL){
+            LOG(LOG_WARN, "pubServer: too many clients");
+            close(fd);
+            continue;
+        }
+
+        memset(cl, 0, sizeof(struct pubClient_s));
+        cl->fd = fd;
+        ev.events   = EPOLLIN;
+        ev.data.ptr = cl;
+        epoll_ctl(ps->epollFd, EPOLL_CTL_ADD, fd, &ev);
+    }
+}
+
+
+// encodes what the publishers staged and queues it to the subscribers
+static void publishStaged(struct pubServer_s *ps)
+{
+    static char buf[JSON_BUF_SIZE];
+    struct ubx_nav_posllh fix;
+    struct json_buf jb;
+    struct pubMsg_s *m;
+    int newAssist, newFix;
+    uint64_t cnt;
+
+    if(read(ps->eventFd, &cnt, sizeof(cnt)) < 0){
+        // nothing pending
+    }
+
+    pthread_mutex_lock(&ps->mutex);
+    newAssist = ps->stageAssistNew;
+    newFix    = ps->stageFixNew;
+    if(newAssist){
+        memcpy(&ps->assist, &ps->stageAssist, sizeof(struct gps_assist_data));
+    }
+    fix = ps->stageFix;
+    ps->stageAssistNew = ps->stageFixNew = 0;
+    pthread_mutex_unlock(&ps->mutex);
+
+    json_buf_init(&jb, buf, sizeof(buf));
+
+    if(newAssist){
+        json_assist_data(&jb, &ps->assist);
+        if((m = msgFromJson(&jb)) != NULL){
+            msgPut(ps->assistMsg);
+            ps->assistMsg = m;
+        }
+        json_buf_reset(&jb);
+    }
+    if(newFix){
+        json_nav_posllh(&jb, &fix);
+        if((m = msgFromJson(&jb)) != NULL){
+            msgPut(ps->fixMsg);
+            ps->fixMsg = m;
+        }
+    }
+
+    for(int i=0; i < PUB_MAX_CLIENTS; i++){
+        struct pubClient_s *cl = &ps->clients[i];
+
+        if(cl->fd < 0 || !cl->subs){
+            continue;
+        }
+        if(newAssist && (cl->subs & PUB_SUB_ASSIST) && (clientQueue(ps, cl, ps->assistMsg) < 0)){
+            continue;
+        }
+        if(newFix && (cl->subs & PUB_SUB_FIX) && (clientQueue(ps, cl, ps->fixMsg) < 0)){
+            continue;
+        }
+        if(clientFlush(ps, cl) < 0){
+            clientClose(ps, cl);
+        }
+    }
+}
+
+
+struct pubServer_s *pubServer_init(const char *path)
+{
+    struct pubServer_s *ps = NULL;
+    struct sockaddr_un addr;
+    struct epoll_event ev;
+    struct json_buf jb;
+    char empty[64];
+
+    ps = (struct pubServer_s *)calloc(1, sizeof(struct pubServer_s));
+    if(ps == NULL){
+        return NULL;
+    }
+    for(int i=0; i < PUB_MAX_CLIENTS; i++){
+        ps->clients[i].fd = -1;
+    }
+    pthread_mutex_init(&ps->mutex, NULL);
+
+    // a client going away mid write must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    unlink(path);
+
+    ps->listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    ps->epollFd  = epoll_create1(EPOLL_CLOEXEC);
+    ps->eventFd  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if((ps->listenFd < 0) || (ps->epollFd < 0) || (ps->eventFd < 0) ||
+       (bind(ps->listenFd, (struct sockaddr *)&addr, sizeof(addr)) < 0) ||
+       (listen(ps->listenFd, PUB_MAX_CLIENTS) < 0)){
+        LOG(LOG_ERR, "pubServer: cannot listen on %s: %s", path, strerror(errno));
+        pubServer_deinit(ps);
+        return NULL;
+    }
+
+    ev.events   = EPOLLIN;
+    ev.data.ptr = &ps->listenFd;
+    epoll_ctl(ps->epollFd, EPOLL_CTL_ADD, ps->listenFd, &ev);
+    ev.data.ptr = &ps->eventFd;
+    epoll_ctl(ps->epollFd, EPOLL_CTL_ADD, ps->eventFd, &ev);
+
+    // GET ASSIST always has something to answer
+    json_buf_init(&jb, empty, sizeof(empty));
+    json_assist_data(&jb, &ps->assist);
+    ps->assistMsg = msgFromJson(&jb);
+
+    LOG(LOG_INFO, "pubServer: listening on %s", path);
+    return ps;
+}
+
+void pubServer_deinit(struct pubServer_s *ps)
+{
+    for(int i=0; i < PUB_MAX_CLIENTS; i++){
+        if(ps->clients[i].fd >= 0){
+            clientClose(ps, &ps->clients[i]);
+        }
+    }
+    if(ps->listenFd >= 0){ close(ps->listenFd); }
+    if(ps->epollFd >= 0){ close(ps->epollFd); }
+    if(ps->eventFd >= 0){ close(ps->eventFd); }
+    msgPut(ps->assistMsg);
+    msgPut(ps->fixMsg);
+    pthread_mutex_destroy(&ps->mutex);
+    free(ps);
+}
+
+
+void *pubServer_f(void *arg)
+{
+    struct pubServer_s *ps = (struct pubServer_s *)arg;
+    struct epoll_event evs[PUB_EPOLL_EVENTS];
+    int n;
+
+    while(1){
+        n = epoll_wait(ps->epollFd, evs, PUB_EPOLL_EVENTS, -1);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            LOG(LOG_ERR, "pubServer: epoll_wait: %s", strerror(errno));
+            break;
+        }
+
+        for(int i=0; i < n; i++){
+            void *p = evs[i].data.ptr;
+            struct pubClient_s *cl = p;
+
+            if(p == &ps->listenFd){
+                acceptClients(ps);
+            }else if(p == &ps->eventFd){
+                publishStaged(ps);
+            }else if(cl->fd >= 0){
+                if(evs[i].events & (EPOLLERR | EPOLLHUP)){
+                    clientClose(ps, cl);
+                }else if(evs[i].events & EPOLLIN){
+                    clientRead(ps, cl);
+                }else if((evs[i].events & EPOLLOUT) && (clientFlush(ps, cl) < 0)){
+                    clientClose(ps, cl);
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+// called from the publishing threads: copy and wake the server, nothing more
+static void wake(struct pubServer_s *ps)
+{
+    uint64_t one = 1;
+
+    if(write(ps->eventFd, &one, sizeof(one)) < 0){
+        // counter saturated, the loop is awake anyway
+    }
+}
+
+void pubServer_publishAssist(struct pubServer_s *ps, const struct gps_assist_data *gps)
+{
+    if(ps == NULL){
+        return;
+    }
+    pthread_mutex_lock(&ps->mutex);
+    if((gps->gen == ps->stageAssist.gen) && (gps->fields == ps->stageAssist.fields) &&
+       !memcmp(&gps->ref_pos, &ps->stageAssist.ref_pos, sizeof(gps->ref_pos)) &&
+       !memcmp(&gps->ref_time, &ps->stageAssist.ref_time, sizeof(gps->ref_time))){
+        pthread_mutex_unlock(&ps->mutex);
+        return;
+    }
+    memcpy(&ps->stageAssist, gps, sizeof(struct gps_assist_data));
+    ps->stageAssistNew = 1;
+    pthread_mutex_unlock(&ps->mutex);
+    wake(ps);
+}
+
+// the fix history GET HIST answers from, set before the server runs
+void pubServer_setHistory(struct pubServer_s *ps, const struct navHist_s *hist)
+{
+    if(ps){
+        ps->hist = hist;
+    }
+}
+
+// serial_f, as each one comes in
+void pubServer_publishFix(struct pubServer_s *ps, const struct ubx_nav_posllh *fix)
+{
+    if(ps == NULL){
+        return;
+    }
+    pthread_mutex_lock(&ps->mutex);
+    memcpy(&ps->stageFix, fix, sizeof(struct ubx_nav_posllh));
+    ps->stageFixNew = 1;
+    pthread_mutex_unlock(&ps->mutex);
+    wake(ps);
+}
@@ -0,0 +1,199 @@
+/*
+ * rawRead.c
+ *
+ * Reader side of the RXM-RAW column store (see rawStore.h)
+ *
+ * A post-processing job needs only this file and the headers: open a
+ * day, find the first chunk of the time it wants, decode chunks from
+ * there on. The writer may be appending to the day at the same time,
+ * chunks that came after rawRead_open() aren't seen.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "rawStore.h"
+
+
+static const int rawColOrder_G[RAW_N_COLS] = RAW_COL_ORDERS;
+
+
+// the files of GPS day (ms since the GPS epoch / GPS_DAY_MS), the writer's too
+int rawStore_path(char *buf, int size, const char *dir, int64_t day, const char *ext)
+{
+    return snprintf(buf, size, "%s/rxmraw-%lld-%lld.%s", dir,
+                    (long long)(day / 7), (long long)(day % 7), ext);
+}
+
+// the day's files. -1 if there are none or they aren't ours
+int rawRead_open(struct rawReader_s *rd, const char *dir, int64_t day)
+{
+    struct rawFileHdr_s hdr;
+    struct stat st;
+    char path[256];
+    int fd;
+
+    memset(rd, 0, sizeof(struct rawReader_s));
+    rd->colFd = -1;
+
+    rawStore_path(path, sizeof(path), dir, day, "col");
+    rd->colFd = open(path, O_RDONLY | O_CLOEXEC);
+    if( (rd->colFd < 0) || (pread(rd->colFd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) ||
+        memcmp(hdr.magic, RAW_FILE_MAGIC, sizeof(hdr.magic)) ||
+        (hdr.version != RAW_FILE_VERSION) || (hdr.nCols != RAW_N_COLS) ){
+        rawRead_close(rd);
+        return -1;
+    }
+
+    // the index whole, a torn last entry left out
+    rawStore_path(path, sizeof(path), dir, day, "idx");
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if( (fd < 0) || (fstat(fd, &st) < 0) ){
+        if(fd >= 0){
+            close(fd);
+        }
+        rawRead_close(rd);
+        return -1;
+    }
+    rd->nChunks = st.st_size / sizeof(struct rawIndex_s);
+    rd->index   = malloc(rd->nChunks * sizeof(struct rawIndex_s) + 1);
+    rd->buf     = malloc(RAW_CHUNK_MAX);
+    rd->vals    = malloc(RAW_CHUNK_ROWS * sizeof(uint64_t));
+    if( (rd->index == NULL) || (rd->buf == NULL) || (rd->vals == NULL) ||
+        (pread(fd, rd->index, rd->nChunks * sizeof(struct rawIndex_s), 0) !=
+         (ssize_t)(rd->nChunks * sizeof(struct rawIndex_s))) ){
+        close(fd);
+        rawRead_close(rd);
+        return -1;
+    }
+    close(fd);
+
+    return 0;
+}
+
+void rawRead_close(struct rawReader_s *rd)
+{
+    if(rd->colFd >= 0){
+        close(rd->colFd);
+        rd->colFd = -1;
+    }
+    free(rd->index);
+    free(rd->buf);
+    free(rd->vals);
+    rd->index = NULL;
+    rd->buf   = NULL;
+    rd->vals  = NULL;
+    rd->nChunks = 0;
+}
+
+// the first chunk that ends at or after ms, nChunks if none
+int rawRead_find(const struct rawReader_s *rd, int64_t ms)
+{
+    int lo = 0, hi = rd->nChunks;
+
+    while(lo < hi){
+        int mid = lo + (hi - lo) / 2;
+
+        if(rd->index[mid].lastMs < ms){
+            lo = mid + 1;
+        }else{
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static const uint8_t *decodeColumn(const uint8_t *p, const uint8_t *end, uint64_t *v, int n, int ord)
+{
+    uint64_t prev = 0, prevD = 0, d, e;
+    int shift;
+
+    for(int i=0; i < n; i++){
+        e = 0;
+        shift = 0;
+        do{
+            if( (p == end) || (shift > 63) ){
+                return NULL;
+            }
+            e |= (uint64_t)(*p & 0x7f) << shift;
+            shift += 7;
+        }while(*p++ & 0x80);
+
+        e = (e >> 1) ^ -(e & 1);
+        d = (ord == 2) ? prevD + e : e;
+        prevD = d;
+        prev += d;
+        v[i] = prev;
+    }
+    return p;
+}
+
+/*
+ * Decodes chunk i into c. Returns its rows, -1 if it couldn't be read or
+ * doesn't check out.
+ */
+int rawRead_chunk(struct rawReader_s *rd, int i, struct rawColumns_s *c)
+{
+    const struct rawIndex_s *idx = &rd->index[i];
+    struct rawChunkHdr_s hdr;
+    const uint8_t *p, *end;
+    uint32_t f;
+    int n;
+
+    if( (i < 0) || (i >= rd->nChunks) || (idx->bytes > RAW_CHUNK_MAX) ||
+        (pread(rd->colFd, rd->buf, idx->bytes, idx->offset) != idx->bytes) ){
+        return -1;
+    }
+    memcpy(&hdr, rd->buf, sizeof(hdr));
+    if( (hdr.magic != RAW_CHUNK_MAGIC) || (hdr.rows != idx->rows) || (hdr.rows > RAW_CHUNK_ROWS) ){
+        return -1;
+    }
+    n = hdr.rows;
+
+    p = rd->buf + sizeof(hdr);
+    for(int col=0; col < RAW_N_COLS; col++){
+        end = p + hdr.colBytes[col];
+        if( (end > rd->buf + idx->bytes) ||
+            (decodeColumn(p, end, rd->vals, n, rawColOrder_G[col]) != end) ){
+            return -1;
+        }
+        p = end;
+
+        switch(col){
+        case RAW_COL_TIME:
+            for(int r=0; r < n; r++) c->timeMs[r] = rd->vals[r];
+            break;
+        case RAW_COL_SV:
+            for(int r=0; r < n; r++) c->sv[r] = rd->vals[r];
+            break;
+        case RAW_COL_PR:
+            memcpy(c->pr, rd->vals, n * sizeof(double));
+            break;
+        case RAW_COL_CP:
+            memcpy(c->cp, rd->vals, n * sizeof(double));
+            break;
+        case RAW_COL_DO:
+            for(int r=0; r < n; r++){
+                f = rd->vals[r];
+                memcpy(&c->dop[r], &f, sizeof(float));
+            }
+            break;
+        case RAW_COL_CNO:
+            for(int r=0; r < n; r++) c->cno[r] = rd->vals[r];
+            break;
+        case RAW_COL_QI:
+            for(int r=0; r < n; r++) c->qi[r] = rd->vals[r];
+            break;
+        case RAW_COL_LLI:
+            for(int r=0; r < n; r++) c->lli[r] = rd->vals[r];
+            break;
+        }
+    }
+    c->rows = n;
+    return n;
+}
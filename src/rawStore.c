@@ -0,0 +1,456 @@
+/*
+ * rawStore.c
+ *
+ * RXM-RAW column store, writer side (see rawStore.h)
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "monotonic.h"
+#include "debug.h"
+#include "metrics.h"
+#include "ubx.h"
+#include "rawStore.h"
+
+
+#define RAW_EPOCH_BYTES     (sizeof(struct ubx_hdr) + 8 + 12 * 24 + 2)     // 12 SVs tracked
+#define RAW_IDLE_US         20000
+
+static const int rawColOrder_G[RAW_N_COLS] = RAW_COL_ORDERS;
+
+
+static int writeAll(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    ssize_t w;
+
+    while(len > 0){
+        w = write(fd, p, len);
+        if(w < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            return -1;
+        }
+        p += w;
+        len -= w;
+    }
+    return 0;
+}
+
+
+/* serial_f */
+
+/*
+ * Measurement period for the line: RXM-RAW takes at most RAW_LINE_SHARE
+ * of its bytes, and RAW_RATE_HZ at most
+ */
+int rawStore_rateMs(int bps)
+{
+    int hz = (bps / 10) * RAW_LINE_SHARE / 100 / RAW_EPOCH_BYTES;
+
+    if(hz > RAW_RATE_HZ){
+        hz = RAW_RATE_HZ;
+    }
+    if(hz < 1){
+        hz = 1;
+    }
+    return (1000 + hz - 1) / hz;
+}
+
+/*
+ * Every frame read off the port. Returns 1 if it was an RXM-RAW, queued
+ * for the writer or, if its queue is full, dropped; 0 if not.
+ */
+int rawStore_frame(struct rawStore_s *rs, const uint8_t *frame, int len)
+{
+    struct rawSlot_s *slot;
+    uint32_t head;
+
+    if( (frame[2] != UBX_CLASS_RXM) || (frame[3] != UBX_RXM_RAW) ){
+        return 0;
+    }
+    if(rs == NULL){
+        return 1;
+    }
+
+    head = rs->head;
+    if(head - __atomic_load_n(&rs->tail, __ATOMIC_ACQUIRE) == RAW_QUEUE_FRAMES){
+        metrics_add(METRIC_RAW_DROPPED, 1);
+        return 1;
+    }
+    slot = &rs->slot[head & (RAW_QUEUE_FRAMES - 1)];
+    memcpy(slot->frame, frame, len);
+    slot->len = len;
+    __atomic_store_n(&rs->head, head + 1, __ATOMIC_RELEASE);
+
+    return 1;
+}
+
+
+/* Writer */
+
+struct rawStore_s *rawStore_init(const char *dir)
+{
+    struct rawStore_s *rs = NULL;
+    int ok;
+
+    if( (mkdir(dir, 0755) < 0) && (errno != EEXIST) ){
+        LOG(LOG_ERR, "rawStore: mkdir %s: %s", dir, strerror(errno));
+        return NULL;
+    }
+    if(posix_memalign((void **)&rs, CACHE_LINE_SIZE, sizeof(struct rawStore_s)) != 0){
+        return NULL;
+    }
+    memset(rs, 0, sizeof(struct rawStore_s));
+    rs->dir     = dir;
+    rs->colFd   = -1;
+    rs->idxFd   = -1;
+    rs->fileDay = -1;
+    rs->lastDay = -1;
+    rs->keepDays = RAW_KEEP_DAYS;
+
+    rs->order = malloc(RAW_CHUNK_ROWS * sizeof(uint32_t));
+    rs->out   = malloc(RAW_CHUNK_MAX);
+    ok = (rs->order != NULL) && (rs->out != NULL);
+    for(int c=0; c < RAW_N_COLS; c++){
+        rs->col[c] = malloc(RAW_CHUNK_ROWS * sizeof(uint64_t));
+        ok = ok && (rs->col[c] != NULL);
+    }
+    if(!ok){
+        LOG(LOG_ERR, "rawStore: out of memory");
+        return NULL;
+    }
+
+    LOG(LOG_INFO, "rawStore: RXM-RAW to %s", dir);
+    return rs;
+}
+
+static void closeDay(struct rawStore_s *rs)
+{
+    if(rs->colFd >= 0){
+        close(rs->colFd);
+        close(rs->idxFd);
+        rs->colFd = rs->idxFd = -1;
+    }
+    rs->fileDay = -1;
+}
+
+/*
+ * The day's files cut back to their last chunk written whole in both: a
+ * torn index entry (a crash in the middle of its write), entries past the
+ * end of the .col and the bytes of a chunk no entry points to. Returns
+ * the end of the .col, -1 on an error.
+ */
+static off_t repairDay(struct rawStore_s *rs, int64_t day)
+{
+    struct rawIndex_s idx;
+    struct stat st;
+    off_t colSize, idxSize, idxEnd, end;
+
+    if( (fstat(rs->colFd, &st) < 0) ){
+        return -1;
+    }
+    colSize = st.st_size;
+    if( (fstat(rs->idxFd, &st) < 0) ){
+        return -1;
+    }
+    idxSize = st.st_size;
+
+    idxEnd = idxSize - idxSize % sizeof(idx);
+    end    = (colSize >= (off_t)sizeof(struct rawFileHdr_s)) ? (off_t)sizeof(struct rawFileHdr_s) : 0;
+    while(idxEnd > 0){
+        if(pread(rs->idxFd, &idx, sizeof(idx), idxEnd - sizeof(idx)) != sizeof(idx)){
+            return -1;
+        }
+        if(idx.offset + idx.bytes <= (uint64_t)colSize){
+            end = idx.offset + idx.bytes;
+            break;
+        }
+        idxEnd -= sizeof(idx);
+    }
+
+    if( (idxEnd == idxSize) && (end == colSize) ){
+        return end;
+    }
+    LOG(LOG_WARN, "rawStore: day %lld: %lld index and %lld column bytes cut off",
+        (long long)day, (long long)(idxSize - idxEnd), (long long)(colSize - end));
+    if( (ftruncate(rs->idxFd, idxEnd) < 0) || (ftruncate(rs->colFd, end) < 0) ){
+        return -1;
+    }
+    return end;
+}
+
+// the files of the days before day - keepDays + 1, ours only
+static void pruneDays(struct rawStore_s *rs, int64_t day)
+{
+    char path[512], ext[4];
+    long long week, wday;
+    struct dirent *e;
+    DIR *d;
+    int n, removed = 0;
+
+    d = opendir(rs->dir);
+    if(d == NULL){
+        LOG(LOG_WARN, "rawStore: opendir %s: %s", rs->dir, strerror(errno));
+        return;
+    }
+    while((e = readdir(d)) != NULL){
+        n = 0;
+        if( (sscanf(e->d_name, "rxmraw-%lld-%lld.%3s%n", &week, &wday, ext, &n) != 3) ||
+            (e->d_name[n] != '\0') || (strcmp(ext, "col") && strcmp(ext, "idx")) ||
+            (wday < 0) || (wday > 6) || (week * 7 + wday > day - rs->keepDays) ){
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", rs->dir, e->d_name);
+        if(unlink(path) < 0){
+            LOG(LOG_WARN, "rawStore: unlink %s: %s", path, strerror(errno));
+        }else{
+            removed++;
+        }
+    }
+    closedir(d);
+    if(removed > 0){
+        LOG(LOG_INFO, "rawStore: %d files of the days before %lld deleted",
+            removed, (long long)(day - rs->keepDays + 1));
+    }
+}
+
+// the pair of files of day, created if needed
+static int openDay(struct rawStore_s *rs, int64_t day)
+{
+    struct rawFileHdr_s hdr;
+    char path[256];
+    off_t end;
+
+    if(rs->fileDay == day){
+        return 0;
+    }
+    closeDay(rs);
+
+    // a roll over, not a jump of the receiver's time
+    if( (rs->keepDays > 0) && (day == rs->lastDay + 1) ){
+        pruneDays(rs, day);
+    }
+
+    rawStore_path(path, sizeof(path), rs->dir, day, "col");
+    rs->colFd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(rs->colFd < 0){
+        LOG(LOG_ERR, "rawStore: open %s: %s", path, strerror(errno));
+        return -1;
+    }
+    rawStore_path(path, sizeof(path), rs->dir, day, "idx");
+    rs->idxFd = open(path, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(rs->idxFd < 0){
+        LOG(LOG_ERR, "rawStore: open %s: %s", path, strerror(errno));
+        close(rs->colFd);
+        rs->colFd = -1;
+        return -1;
+    }
+
+    end = repairDay(rs, day);
+    if(end < 0){
+        LOG(LOG_ERR, "rawStore: day %lld: %s", (long long)day, strerror(errno));
+        closeDay(rs);
+        return -1;
+    }
+    if(end == 0){
+        memset(&hdr, 0, sizeof(hdr));
+        memcpy(hdr.magic, RAW_FILE_MAGIC, sizeof(hdr.magic));
+        hdr.version = RAW_FILE_VERSION;
+        hdr.nCols   = RAW_N_COLS;
+        if(writeAll(rs->colFd, &hdr, sizeof(hdr)) < 0){
+            closeDay(rs);
+            return -1;
+        }
+        end = sizeof(hdr);
+    }
+    rs->offset  = end;
+    rs->fileDay = day;
+    rs->lastDay = day;
+    return 0;
+}
+
+static inline uint8_t *putVarint(uint8_t *p, uint64_t v)
+{
+    while(v >= 0x80){
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+static uint8_t *encodeColumn(uint8_t *p, const uint64_t *v, const uint32_t *order, int n, int ord)
+{
+    uint64_t prev = 0, prevD = 0, d, e;
+
+    for(int i=0; i < n; i++){
+        d = v[order[i]] - prev;
+        prev = v[order[i]];
+        e = (ord == 2) ? d - prevD : d;
+        prevD = d;
+        p = putVarint(p, (e << 1) ^ (uint64_t)((int64_t)e >> 63));
+    }
+    return p;
+}
+
+// writes the chunk built so far. -1 if it was lost
+int rawStore_flush(struct rawStore_s *rs)
+{
+    struct rawChunkHdr_s hdr;
+    struct rawIndex_s idx;
+    uint32_t start[257];
+    uint64_t t0 = monotonicNs();
+    uint8_t *p, *colStart;
+    int r = 0;
+
+    if(rs->epochs == 0){
+        return 0;
+    }
+
+    // rows by SV, in time within each: a counting sort keeps the order
+    memset(start, 0, sizeof(start));
+    for(int i=0; i < rs->rows; i++){
+        start[(uint8_t)rs->col[RAW_COL_SV][i] + 1]++;
+    }
+    for(int s=1; s <= 256; s++){
+        start[s] += start[s - 1];
+    }
+    for(int i=0; i < rs->rows; i++){
+        rs->order[start[(uint8_t)rs->col[RAW_COL_SV][i]]++] = i;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    p = rs->out + sizeof(hdr);
+    for(int c=0; c < RAW_N_COLS; c++){
+        colStart = p;
+        p = encodeColumn(p, rs->col[c], rs->order, rs->rows, rawColOrder_G[c]);
+        hdr.colBytes[c] = p - colStart;
+    }
+    hdr.magic   = RAW_CHUNK_MAGIC;
+    hdr.rows    = rs->rows;
+    hdr.epochs  = rs->epochs;
+    hdr.firstMs = rs->firstMs;
+    hdr.lastMs  = rs->lastMs;
+    memcpy(rs->out, &hdr, sizeof(hdr));
+
+    idx.firstMs = rs->firstMs;
+    idx.lastMs  = rs->lastMs;
+    idx.rows    = rs->rows;
+    idx.bytes   = p - rs->out;
+
+    if( (openDay(rs, rs->chunkDay) < 0) || (writeAll(rs->colFd, rs->out, idx.bytes) < 0) ){
+        LOG(LOG_ERR, "rawStore: chunk of %d epochs lost: %s", rs->epochs, strerror(errno));
+        metrics_add(METRIC_RAW_DROPPED, rs->epochs);
+        // openDay() cuts what was written of it off
+        closeDay(rs);
+        r = -1;
+    }else{
+        // only now is the chunk there for the readers
+        idx.offset = rs->offset;
+        if(writeAll(rs->idxFd, &idx, sizeof(idx)) < 0){
+            LOG(LOG_ERR, "rawStore: index, chunk of %d epochs lost: %s", rs->epochs, strerror(errno));
+            metrics_add(METRIC_RAW_DROPPED, rs->epochs);
+            closeDay(rs);
+            r = -1;
+        }else{
+            rs->offset += idx.bytes;
+            metrics_add(METRIC_RAW_EPOCHS, rs->epochs);
+            metrics_add(METRIC_RAW_STORED_BYTES, idx.bytes);
+            metrics_observe(METRIC_RAW_FLUSH_NS, monotonicNs() - t0);
+        }
+    }
+
+    rs->epochs = 0;
+    rs->rows   = 0;
+    return r;
+}
+
+// an epoch into the chunk's columns, straight out of the queue's slot
+static void epoch(struct rawStore_s *rs, const uint8_t *pl, int len)
+{
+    const struct ubx_rxm_raw *m = ubx_rxm_raw_get(pl, len);
+    const struct ubx_rxm_raw_block *b;
+    int64_t ms;
+    uint32_t dop;
+    int r;
+
+    if(m == NULL){
+        return;
+    }
+    ms = m->week * GPS_WEEK_MS + m->itow;
+    if( (rs->epochs > 0) &&
+        ((ms / GPS_DAY_MS != rs->chunkDay) || (rs->rows + m->num_sv > RAW_CHUNK_ROWS)) ){
+        rawStore_flush(rs);
+    }
+    if(rs->epochs == 0){
+        rs->chunkDay = ms / GPS_DAY_MS;
+        rs->firstMs  = ms;
+        rs->startNs  = monotonicNs();
+    }
+
+    for(int i=0; i < m->num_sv; i++){
+        b = ubx_rxm_raw_block(m, i);
+        r = rs->rows++;
+        rs->col[RAW_COL_TIME][r] = ms;
+        rs->col[RAW_COL_SV][r]   = b->sv;
+        memcpy(&rs->col[RAW_COL_PR][r], &b->pr_mes, sizeof(double));
+        memcpy(&rs->col[RAW_COL_CP][r], &b->cp_mes, sizeof(double));
+        memcpy(&dop, &b->do_mes, sizeof(float));
+        rs->col[RAW_COL_DO][r]   = dop;
+        rs->col[RAW_COL_CNO][r]  = (int64_t)b->cno;
+        rs->col[RAW_COL_QI][r]   = (int64_t)b->mes_qi;
+        rs->col[RAW_COL_LLI][r]  = b->lli;
+    }
+    rs->lastMs = ms;
+    if(++rs->epochs == RAW_CHUNK_EPOCHS){
+        rawStore_flush(rs);
+    }
+}
+
+/*
+ * Takes what is in the queue, and writes the chunk if it's due. Returns
+ * the frames taken.
+ */
+int rawStore_poll(struct rawStore_s *rs)
+{
+    uint32_t tail = rs->tail;
+    uint32_t head = __atomic_load_n(&rs->head, __ATOMIC_ACQUIRE);
+    struct rawSlot_s *slot;
+    int n = 0;
+
+    while(tail != head){
+        slot = &rs->slot[tail & (RAW_QUEUE_FRAMES - 1)];
+        epoch(rs, slot->frame + sizeof(struct ubx_hdr), slot->len - sizeof(struct ubx_hdr) - 2);
+        // the slot is serial_f's again
+        __atomic_store_n(&rs->tail, ++tail, __ATOMIC_RELEASE);
+        n++;
+    }
+    if( (rs->epochs > 0) && (monotonicNs() - rs->startNs >= RAW_FLUSH_S * 1000000000ULL) ){
+        rawStore_flush(rs);
+    }
+    return n;
+}
+
+void *rawStore_f(void *arg)
+{
+    struct rawStore_s *rs = arg;
+
+    while(1){
+        if(rawStore_poll(rs) == 0){
+            usleep(RAW_IDLE_US);
+        }
+    }
+    return NULL;
+}
@@ -17,7 +17,7 @@
 int ringbuffer_empty(struct ringbuffer_s *rb)
 {
 	/* It's empty when the read and write pointers are the same. */
-	if (0 == rb->fill) {
+	if (0 == __atomic_load_n(&rb->fill, __ATOMIC_ACQUIRE)) {
 		return 1;
 	}else {
 		return 0;
@@ -28,7 +28,7 @@ int ringbuffer_empty(struct ringbuffer_s *rb)
 int ringbuffer_full(struct ringbuffer_s *rb)
 {
 	/* It's full when the write ponter is 1 element before the read pointer*/
-	if (rb->size == rb->fill) {
+	if (rb->size == __atomic_load_n(&rb->fill, __ATOMIC_ACQUIRE)) {
 		return 1;
 	}else {
 		return 0;
@@ -37,7 +37,7 @@ int ringbuffer_full(struct ringbuffer_s *rb)
 
 int ringbuffer_currentSize(struct ringbuffer_s *rb)
 {
-	return rb->fill;
+	return __atomic_load_n(&rb->fill, __ATOMIC_ACQUIRE);
 }
 
 
@@ -63,7 +63,7 @@ int ringbuffer_read(struct ringbuffer_s *rb, unsigned char* buf, unsigned int le
 				rb->read = rb->buffer + len2; // Wrap around
 			}
 		}
-		rb->fill -= len;
+		__atomic_store_n(&rb->fill, rb->fill - len, __ATOMIC_RELEASE);
         pthread_mutex_unlock( &(rb->mutex));
 		return len;
 	} else	{
@@ -78,7 +78,7 @@ int ringbuffer_clear(struct ringbuffer_s *rb)
     
 	rb->size   = RINGBUFFER_SIZE;
 	memset(rb->buffer, 0, rb->size);
-	rb->fill   = 0;
+	__atomic_store_n(&rb->fill, 0, __ATOMIC_RELEASE);
 	rb->read   = rb->buffer;
 	rb->write  = rb->buffer;
     pthread_mutex_unlock( &(rb->mutex));
@@ -110,7 +110,7 @@ int ringbuffer_write(struct ringbuffer_s *rb, unsigned char* buf, unsigned int l
 			memcpy(rb->write, buf, len);
 			rb->write += len;
 		}
-		rb->fill += len;
+		__atomic_store_n(&rb->fill, rb->fill + len, __ATOMIC_RELEASE);
         pthread_mutex_unlock( &(rb->mutex));
 		return len;
 	}
@@ -122,9 +122,9 @@ struct ringbuffer_s * ringbuffer_init(void)
 {
 	struct ringbuffer_s *rb = NULL;
 
-    rb = (struct ringbuffer_s *)malloc(sizeof(struct ringbuffer_s));
-    if(NULL == rb){
+    if(posix_memalign((void **)&rb, CACHE_LINE_SIZE, sizeof(struct ringbuffer_s)) != 0){
         printf("error\n");
+        return NULL;
     }
 
 	rb->size   = RINGBUFFER_SIZE;
@@ -0,0 +1,944 @@
+/*
+ * rrlp.c
+ *
+ * RRLP (3GPP TS 44.031) GPS assistance data PDUs
+ *
+ * The PDUs are written directly in unaligned PER by a small bit writer,
+ * with the element layouts described by the field tables below (ranges
+ * as in the 44.031 ASN.1). Everything is built into a caller supplied
+ * arena; nothing is allocated.
+ *
+ * rrlp_gps_assist_pdus() adds a memo in front of the encoder, keyed on
+ * (assist data generation, requested elements, requested SVs). The only
+ * parts of a PDU set that depend on anything else are the reference time
+ * and location of the first PDU; both sit at fixed bit offsets and are
+ * re-stamped in place when a set is served from the memo.
+ * The memo is not thread safe.
+ *
+ * rrlp_decode_assistance_request() goes the other way, with a bounds
+ * checked bit reader over the handset's msrPositionRsp. rrlp_batch_serve()
+ * decodes a vector of requests and encodes each distinct one only once.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "gps.h"
+#include "rrlp.h"
+
+
+/* ------------------------------------------------------------------------ */
+/* Unaligned PER bit writer                                                  */
+/* ------------------------------------------------------------------------ */
+
+struct per_writer {
+	uint8_t *buf;
+	int cap;		/* bytes */
+	int len;		/* complete bytes written */
+	uint64_t acc;		/* pending bits, right aligned */
+	int n_acc;
+	int overflow;
+};
+
+static inline void
+per_init(struct per_writer *w, uint8_t *buf, int cap)
+{
+	w->buf = buf;
+	w->cap = cap;
+	w->len = 0;
+	w->acc = 0;
+	w->n_acc = 0;
+	w->overflow = 0;
+}
+
+static inline void
+per_put(struct per_writer *w, uint32_t v, int n)
+{
+	w->acc = (w->acc << n) | (v & (uint32_t)((1ULL << n) - 1));
+	w->n_acc += n;
+
+	while (w->n_acc >= 8) {
+		w->n_acc -= 8;
+		if (w->len < w->cap)
+			w->buf[w->len++] = (uint8_t)(w->acc >> w->n_acc);
+		else
+			w->overflow = 1;
+	}
+}
+
+static inline int
+per_bitpos(const struct per_writer *w)
+{
+	return w->len * 8 + w->n_acc;
+}
+
+/* Pads to a whole octet, returns the encoded length */
+static int
+per_finish(struct per_writer *w)
+{
+	if (w->n_acc)
+		per_put(w, 0, 8 - w->n_acc);
+	return w->overflow ? -1 : w->len;
+}
+
+/* Overwrites n bits at bit offset pos of an encoded buffer */
+static void
+per_patch(uint8_t *buf, int pos, uint32_t v, int n)
+{
+	while (n--) {
+		int bit = (v >> n) & 1;
+		uint8_t m = 0x80 >> (pos & 7);
+
+		buf[pos >> 3] = bit ? (buf[pos >> 3] | m) : (buf[pos >> 3] & ~m);
+		pos++;
+	}
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Unaligned PER bit reader                                                  */
+/* ------------------------------------------------------------------------ */
+
+struct per_reader {
+	const uint8_t *buf;
+	int n_bits;
+	int pos;
+	int err;		/* read past the end, sticky */
+};
+
+static inline void
+per_rinit(struct per_reader *r, const void *buf, int len)
+{
+	r->buf = buf;
+	r->n_bits = len * 8;
+	r->pos = 0;
+	r->err = 0;
+}
+
+/* Reads n <= 32 bits, 0 once past the end */
+static inline uint32_t
+per_get(struct per_reader *r, int n)
+{
+	uint32_t v = 0;
+
+	if (r->pos + n > r->n_bits) {
+		r->err = 1;
+		r->pos = r->n_bits;
+		return 0;
+	}
+
+	while (n) {
+		int off = r->pos & 7;
+		int take = 8 - off;
+
+		if (take > n)
+			take = n;
+		v = (v << take) |
+		    ((r->buf[r->pos >> 3] >> (8 - off - take)) & ((1 << take) - 1));
+		r->pos += take;
+		n -= take;
+	}
+
+	return v;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Element layouts                                                           */
+/* ------------------------------------------------------------------------ */
+
+	/* INTEGER (lb..ub), encoded as value - lb on 'bits' bits */
+struct per_field {
+	uint16_t offset;
+	uint8_t bits;
+	int64_t lb;
+	int64_t ub;
+};
+
+#define PF(type, f, lb, ub, bits)	{ offsetof(struct type, f), bits, lb, ub }
+#define PF_S(type, f, bits)	PF(type, f, -(1LL << ((bits)-1)), (1LL << ((bits)-1)) - 1, bits)
+#define PF_U(type, f, bits)	PF(type, f, 0, (1LL << (bits)) - 1, bits)
+
+#define NFIELDS(t)		((int)(sizeof(t) / sizeof((t)[0])))
+
+	/* UncompressedEphemeris */
+static const struct per_field rrlp_eph_fields[] = {
+	PF_U(gps_ephemeris_sv, code_on_l2,	2),
+	PF_U(gps_ephemeris_sv, sv_ura,		4),
+	PF_U(gps_ephemeris_sv, sv_health,	6),
+	PF_U(gps_ephemeris_sv, iodc,		10),
+	PF_U(gps_ephemeris_sv, l2_p_flag,	1),
+	PF_U(gps_ephemeris_sv, _rsvd1,		23),
+	PF_U(gps_ephemeris_sv, _rsvd2,		24),
+	PF_U(gps_ephemeris_sv, _rsvd3,		24),
+	PF_U(gps_ephemeris_sv, _rsvd4,		16),
+	PF_S(gps_ephemeris_sv, t_gd,		8),
+	PF  (gps_ephemeris_sv, t_oc,		0, 37799, 16),
+	PF_S(gps_ephemeris_sv, a_f2,		8),
+	PF_S(gps_ephemeris_sv, a_f1,		16),
+	PF_S(gps_ephemeris_sv, a_f0,		22),
+	PF_S(gps_ephemeris_sv, c_rs,		16),
+	PF_S(gps_ephemeris_sv, delta_n,		16),
+	PF_S(gps_ephemeris_sv, m_0,		32),
+	PF_S(gps_ephemeris_sv, c_uc,		16),
+	PF_U(gps_ephemeris_sv, e,		32),
+	PF_S(gps_ephemeris_sv, c_us,		16),
+	PF_U(gps_ephemeris_sv, a_powhalf,	32),
+	PF  (gps_ephemeris_sv, t_oe,		0, 37799, 16),
+	PF_U(gps_ephemeris_sv, fit_flag,	1),
+	PF_U(gps_ephemeris_sv, aodo,		5),
+	PF_S(gps_ephemeris_sv, c_ic,		16),
+	PF_S(gps_ephemeris_sv, omega_0,		32),
+	PF_S(gps_ephemeris_sv, c_is,		16),
+	PF_S(gps_ephemeris_sv, i_0,		32),
+	PF_S(gps_ephemeris_sv, c_rc,		16),
+	PF_S(gps_ephemeris_sv, w,		32),
+	PF_S(gps_ephemeris_sv, omega_dot,	24),
+	PF_S(gps_ephemeris_sv, idot,		14),
+};
+
+	/* AlmanacElement, after satelliteID */
+static const struct per_field rrlp_alm_fields[] = {
+	PF_U(gps_almanac_sv, e,			16),
+	PF_U(gps_almanac_sv, t_oa,		8),
+	PF_S(gps_almanac_sv, ksii,		16),
+	PF_S(gps_almanac_sv, omega_dot,		16),
+	PF_U(gps_almanac_sv, sv_health,		8),
+	PF_U(gps_almanac_sv, a_powhalf,		24),
+	PF_S(gps_almanac_sv, omega_0,		24),
+	PF_S(gps_almanac_sv, w,			24),
+	PF_S(gps_almanac_sv, m_0,		24),
+	PF_S(gps_almanac_sv, a_f0,		11),
+	PF_S(gps_almanac_sv, a_f1,		11),
+};
+
+	/* IonosphericModel */
+static const struct per_field rrlp_iono_fields[] = {
+	PF_S(gps_ionosphere_model, alpha_0,	8),
+	PF_S(gps_ionosphere_model, alpha_1,	8),
+	PF_S(gps_ionosphere_model, alpha_2,	8),
+	PF_S(gps_ionosphere_model, alpha_3,	8),
+	PF_S(gps_ionosphere_model, beta_0,	8),
+	PF_S(gps_ionosphere_model, beta_1,	8),
+	PF_S(gps_ionosphere_model, beta_2,	8),
+	PF_S(gps_ionosphere_model, beta_3,	8),
+};
+
+	/* UTCModel */
+static const struct per_field rrlp_utc_fields[] = {
+	PF_S(gps_utc_model, a1,			24),
+	PF_S(gps_utc_model, a0,			32),
+	PF_U(gps_utc_model, t_ot,		8),
+	PF_U(gps_utc_model, wn_t,		8),
+	PF_S(gps_utc_model, delta_t_ls,		8),
+	PF_U(gps_utc_model, wn_lsf,		8),
+	PF_S(gps_utc_model, dn,			8),
+	PF_S(gps_utc_model, delta_t_lsf,	8),
+};
+
+
+static inline int64_t
+_field_value(const void *s, const struct per_field *f)
+{
+	const int *v = (const int *)((const char *)s + f->offset);
+
+	/* unsigned 32 bit fields (e, a_powhalf) are stored in an int */
+	return (f->lb >= 0) ? (int64_t)(uint32_t)*v : (int64_t)*v;
+}
+
+static int
+_fields_in_range(const void *s, const struct per_field *f, int n)
+{
+	int i;
+
+	for (i=0; i<n; i++) {
+		int64_t v = _field_value(s, &f[i]);
+		if ((v < f[i].lb) || (v > f[i].ub))
+			return 0;
+	}
+	return 1;
+}
+
+static void
+_put_fields(struct per_writer *w, const void *s, const struct per_field *f, int n)
+{
+	int i;
+
+	for (i=0; i<n; i++)
+		per_put(w, (uint32_t)(_field_value(s, &f[i]) - f[i].lb), f[i].bits);
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Reference time / location                                                 */
+/* ------------------------------------------------------------------------ */
+
+#define RRLP_TOW23B_MAX		7560000		/* 0.08 s units in a week */
+#define RRLP_LOC_LEN		14		/* ellipsoid point, altitude, unc. ellipsoid */
+#define RRLP_LOC_UNC_K		60		/* ~3 km: the handset is somewhere in the cell */
+#define RRLP_LOC_UNC_ALT_K	60		/* ~150 m */
+#define RRLP_LOC_CONFIDENCE	68
+
+static void
+_ref_time_now(const struct gps_assist_data *gps, uint32_t *tow23b, int *week)
+{
+	double t = gps->ref_time.tow + difftime(time(NULL), gps->ref_time.when);
+	int wn = gps->ref_time.wn;
+
+	while (t >= 604800.0) {
+		t -= 604800.0;
+		wn++;
+	}
+	*tow23b = (uint32_t)(t / 0.08) % RRLP_TOW23B_MAX;
+	*week = wn & 1023;
+}
+
+	/* 3GPP TS 23.032 7.3.6 */
+static void
+_ref_loc_octets(const struct gps_ref_pos *pos, uint8_t *o)
+{
+	double lat = fabs(pos->latitude);
+	uint32_t n = (uint32_t)(lat / 90.0 * (1 << 23));
+	int32_t x = (int32_t)floor(pos->longitude / 360.0 * (1 << 24));
+	double alt = fabs(pos->altitude);
+	uint32_t a = (alt > 32767.0) ? 32767 : (uint32_t)alt;
+
+	if (n > 0x7fffff)
+		n = 0x7fffff;
+	if (pos->latitude < 0)
+		n |= 0x800000;
+	if (pos->altitude < 0)
+		a |= 0x8000;
+
+	o[0]  = 0x90;			/* type 9, spare */
+	o[1]  = n >> 16;
+	o[2]  = n >> 8;
+	o[3]  = n;
+	o[4]  = x >> 16;
+	o[5]  = x >> 8;
+	o[6]  = x;
+	o[7]  = a >> 8;
+	o[8]  = a;
+	o[9]  = RRLP_LOC_UNC_K;		/* semi-major */
+	o[10] = RRLP_LOC_UNC_K;		/* semi-minor */
+	o[11] = 0;			/* orientation */
+	o[12] = RRLP_LOC_UNC_ALT_K;
+	o[13] = RRLP_LOC_CONFIDENCE;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* PDU planning and encoding                                                 */
+/* ------------------------------------------------------------------------ */
+
+	/* Sizes in bits */
+#define BITS_PDU_HDR	(3 + 1 + 3)	/* referenceNumber, component CHOICE */
+#define BITS_AD_HDR	(1 + 6)		/* AssistanceData ext, optionals */
+#define BITS_CTRL_HDR	9		/* ControlHeader optionals */
+#define BITS_MORE	1		/* moreAssDataToBeSent */
+#define BITS_PDU_FIXED	(BITS_PDU_HDR + BITS_AD_HDR + BITS_CTRL_HDR + BITS_MORE)
+#define BITS_REF_TIME	(2 + 23 + 10)
+#define BITS_REF_LOC	(5 + 8 * RRLP_LOC_LEN)
+#define BITS_IONO	(8 * 8)
+#define BITS_UTC	(24 + 32 + 6 * 8)
+#define BITS_NAV_HDR	4		/* SIZE (1..16) */
+#define BITS_EPH	(6 + 3 + 544)	/* satelliteID, SatStatus, UncompressedEphemeris */
+#define BITS_ALM_HDR	(8 + 6)		/* WNa, SIZE (1..64) */
+#define BITS_ALM	(6 + 182)
+#define BITS_PDU_MAX	(8 * RRLP_PDU_MAX_LEN)
+
+#define MAX_NAV_ELEMS	16
+#define MAX_ALM_ELEMS	64
+
+struct rrlp_pdu_plan {
+	int hdr;		/* RRLP_AR_* of the header elements carried */
+	int eph_first, n_eph;	/* range of the eph/alm index lists */
+	int alm_first, n_alm;
+};
+
+struct rrlp_stamps {
+	int tow_bit;		/* bit offsets in the first PDU, -1 if absent */
+	int loc_bit;
+};
+
+
+static int
+_encode_pdu(struct per_writer *w, const struct gps_assist_data *gps,
+	const struct rrlp_pdu_plan *p, const int *eph_idx, const int *alm_idx,
+	int more, struct rrlp_stamps *st)
+{
+	int i;
+
+	/* PDU: referenceNumber, component: assistanceData */
+	per_put(w, 0, 3);
+	per_put(w, 0, 1);
+	per_put(w, 2, 3);
+
+	/* AssistanceData: no extension, gps-AssistData and moreAssDataToBeSent */
+	per_put(w, 0, 1);
+	per_put(w, 0x06, 6);
+
+	/* ControlHeader optionals */
+	per_put(w, !!(p->hdr & RRLP_AR_REF_TIME), 1);
+	per_put(w, !!(p->hdr & RRLP_AR_REF_LOC), 1);
+	per_put(w, 0, 1);				/* dgpsCorrections */
+	per_put(w, p->n_eph > 0, 1);
+	per_put(w, !!(p->hdr & RRLP_AR_IONO_MODEL), 1);
+	per_put(w, !!(p->hdr & RRLP_AR_UTC_MODEL), 1);
+	per_put(w, p->n_alm > 0, 1);
+	per_put(w, 0, 1);				/* acquisAssist */
+	per_put(w, 0, 1);				/* realTimeIntegrity */
+
+	if (p->hdr & RRLP_AR_REF_TIME) {
+		uint32_t tow;
+		int week;
+
+		_ref_time_now(gps, &tow, &week);
+		per_put(w, 0, 2);			/* no gsmTime, gpsTowAssist */
+		if (st)
+			st->tow_bit = per_bitpos(w);
+		per_put(w, tow, 23);
+		per_put(w, week, 10);
+	}
+
+	if (p->hdr & RRLP_AR_REF_LOC) {
+		uint8_t loc[RRLP_LOC_LEN];
+
+		_ref_loc_octets(&gps->ref_pos, loc);
+		per_put(w, RRLP_LOC_LEN - 1, 5);
+		if (st)
+			st->loc_bit = per_bitpos(w);
+		for (i=0; i<RRLP_LOC_LEN; i++)
+			per_put(w, loc[i], 8);
+	}
+
+	if (p->n_eph) {
+		per_put(w, p->n_eph - 1, 4);
+		for (i=0; i<p->n_eph; i++) {
+			const struct gps_ephemeris_sv *eph =
+				&gps->ephemeris.svs[eph_idx[p->eph_first + i]];
+
+			per_put(w, eph->sv_id - 1, 6);
+			per_put(w, 0, 3);		/* newSatelliteAndModelUC */
+			_put_fields(w, eph, rrlp_eph_fields, NFIELDS(rrlp_eph_fields));
+		}
+	}
+
+	if (p->hdr & RRLP_AR_IONO_MODEL)
+		_put_fields(w, &gps->ionosphere, rrlp_iono_fields, NFIELDS(rrlp_iono_fields));
+
+	if (p->hdr & RRLP_AR_UTC_MODEL)
+		_put_fields(w, &gps->utc, rrlp_utc_fields, NFIELDS(rrlp_utc_fields));
+
+	if (p->n_alm) {
+		per_put(w, gps->almanac.wna & 0xff, 8);
+		per_put(w, p->n_alm - 1, 6);
+		for (i=0; i<p->n_alm; i++) {
+			const struct gps_almanac_sv *alm =
+				&gps->almanac.svs[alm_idx[p->alm_first + i]];
+
+			per_put(w, alm->sv_id - 1, 6);
+			_put_fields(w, alm, rrlp_alm_fields, NFIELDS(rrlp_alm_fields));
+		}
+	}
+
+	per_put(w, more, 1);
+
+	return per_finish(w);
+}
+
+
+static int
+_rrlp_encode(struct gps_assist_data *gps, struct rrlp_assist_req *req,
+	struct rrlp_arena *arena, void **o_pdu, int *o_len, int o_max_pdus,
+	struct rrlp_stamps *st)
+{
+	struct rrlp_pdu_plan plan[RRLP_MAX_PDUS];
+	int eph_idx[MAX_SV], alm_idx[MAX_SV];
+	int n_eph = 0, n_alm = 0, n_pdus = 0;
+	int hdr = 0, e = 0, a = 0;
+	int i;
+
+	st->tow_bit = st->loc_bit = -1;
+
+	/* What is asked for and available */
+	if ((req->req_elems & RRLP_AR_REF_TIME) && (gps->fields & GPS_FIELD_REFTIME))
+		hdr |= RRLP_AR_REF_TIME;
+	if ((req->req_elems & RRLP_AR_REF_LOC) && (gps->fields & GPS_FIELD_REFPOS))
+		hdr |= RRLP_AR_REF_LOC;
+	if ((req->req_elems & RRLP_AR_IONO_MODEL) && (gps->fields & GPS_FIELD_IONOSPHERE) &&
+	    _fields_in_range(&gps->ionosphere, rrlp_iono_fields, NFIELDS(rrlp_iono_fields)))
+		hdr |= RRLP_AR_IONO_MODEL;
+	if ((req->req_elems & RRLP_AR_UTC_MODEL) && (gps->fields & GPS_FIELD_UTC) &&
+	    _fields_in_range(&gps->utc, rrlp_utc_fields, NFIELDS(rrlp_utc_fields)))
+		hdr |= RRLP_AR_UTC_MODEL;
+
+	if ((req->req_elems & RRLP_AR_EPHEMERIS) && (gps->fields & GPS_FIELD_EPHEMERIS)) {
+		for (i=0; i<gps->ephemeris.n_sv; i++) {
+			const struct gps_ephemeris_sv *eph = &gps->ephemeris.svs[i];
+
+			if ((eph->sv_id < 1) || (eph->sv_id > 64))
+				continue;
+			if (!(req->eph_svs & (1ULL << (eph->sv_id - 1))))
+				continue;
+			if (!_fields_in_range(eph, rrlp_eph_fields, NFIELDS(rrlp_eph_fields)))
+				continue;
+			eph_idx[n_eph++] = i;
+		}
+	}
+
+	if ((req->req_elems & RRLP_AR_ALMANAC) && (gps->fields & GPS_FIELD_ALMANAC)) {
+		for (i=0; i<gps->almanac.n_sv; i++) {
+			const struct gps_almanac_sv *alm = &gps->almanac.svs[i];
+
+			if ((alm->sv_id < 1) || (alm->sv_id > 64))
+				continue;
+			if (!_fields_in_range(alm, rrlp_alm_fields, NFIELDS(rrlp_alm_fields)))
+				continue;
+			alm_idx[n_alm++] = i;
+		}
+	}
+
+	/* Plan: header elements in the first PDU, then ephemerides (what a
+	 * handset needs first), then almanacs, each PDU filled up */
+	while (hdr || (e < n_eph) || (a < n_alm)) {
+		struct rrlp_pdu_plan *p;
+		int bits = BITS_PDU_FIXED;
+		int k;
+
+		if (n_pdus == RRLP_MAX_PDUS)
+			return -1;
+		p = &plan[n_pdus++];
+		memset(p, 0, sizeof(*p));
+
+		p->hdr = hdr;
+		bits += (hdr & RRLP_AR_REF_TIME)   ? BITS_REF_TIME : 0;
+		bits += (hdr & RRLP_AR_REF_LOC)    ? BITS_REF_LOC : 0;
+		bits += (hdr & RRLP_AR_IONO_MODEL) ? BITS_IONO : 0;
+		bits += (hdr & RRLP_AR_UTC_MODEL)  ? BITS_UTC : 0;
+		hdr = 0;
+
+		if ((e < n_eph) && (bits + BITS_NAV_HDR + BITS_EPH <= BITS_PDU_MAX)) {
+			k = (BITS_PDU_MAX - bits - BITS_NAV_HDR) / BITS_EPH;
+			if (k > MAX_NAV_ELEMS)
+				k = MAX_NAV_ELEMS;
+			if (k > n_eph - e)
+				k = n_eph - e;
+			p->eph_first = e;
+			p->n_eph = k;
+			e += k;
+			bits += BITS_NAV_HDR + k * BITS_EPH;
+		}
+
+		if ((e == n_eph) && (a < n_alm) && (bits + BITS_ALM_HDR + BITS_ALM <= BITS_PDU_MAX)) {
+			k = (BITS_PDU_MAX - bits - BITS_ALM_HDR) / BITS_ALM;
+			if (k > MAX_ALM_ELEMS)
+				k = MAX_ALM_ELEMS;
+			if (k > n_alm - a)
+				k = n_alm - a;
+			p->alm_first = a;
+			p->n_alm = k;
+			a += k;
+		}
+	}
+
+	if (n_pdus > o_max_pdus)
+		return -1;
+
+	/* Encode, straight into the arena */
+	for (i=0; i<n_pdus; i++) {
+		struct per_writer w;
+		int len;
+
+		per_init(&w, arena->buf + arena->used, arena->size - arena->used);
+		len = _encode_pdu(&w, gps, &plan[i], eph_idx, alm_idx,
+				i < n_pdus - 1, i ? NULL : st);
+		if (len < 0)
+			return -1;
+
+		o_pdu[i] = arena->buf + arena->used;
+		o_len[i] = len;
+		arena->used += len;
+	}
+
+	return n_pdus;
+}
+
+
+void
+rrlp_arena_init(struct rrlp_arena *arena, void *buf, int size)
+{
+	arena->buf = buf;
+	arena->size = size;
+	arena->used = 0;
+}
+
+/*
+ * Encodes the assistance data asked for in req as a set of RRLP
+ * assistanceData PDUs, built into arena (RRLP_ARENA_SIZE always fits).
+ * Returns the number of PDUs, o_pdu/o_len pointing into the arena, or -1
+ * if the arena or o_max_pdus is too small.
+ */
+int
+rrlp_gps_assist_pdus_arena(
+	struct gps_assist_data *gps_ad, struct rrlp_assist_req *req,
+	struct rrlp_arena *arena,
+	void **o_pdu, int *o_len, int o_max_pdus)
+{
+	struct rrlp_stamps st;
+
+	return _rrlp_encode(gps_ad, req, arena, o_pdu, o_len, o_max_pdus, &st);
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Memo of encoded PDU sets                                                  */
+/* ------------------------------------------------------------------------ */
+
+struct rrlp_cache_entry {
+	int valid;
+	unsigned int gen;
+	int fields;
+	uint32_t req_elems;
+	uint64_t eph_svs;
+	unsigned long last_use;
+
+	int n_pdus;
+	void *pdu[RRLP_MAX_PDUS];
+	int len[RRLP_MAX_PDUS];
+	struct rrlp_stamps st;
+
+	struct rrlp_arena arena;
+	uint8_t buf[RRLP_ARENA_SIZE];
+};
+
+static struct rrlp_cache_entry rrlp_cache[RRLP_CACHE_ENTRIES];
+static unsigned long rrlp_cache_clock;
+static unsigned long rrlp_cache_hits;
+static unsigned long rrlp_cache_misses;
+
+
+/* Brings the time and location of a memoized set up to date */
+static void
+_restamp(struct rrlp_cache_entry *ce, const struct gps_assist_data *gps)
+{
+	uint8_t *pdu = ce->pdu[0];
+
+	if (ce->st.tow_bit >= 0) {
+		uint32_t tow;
+		int week;
+
+		_ref_time_now(gps, &tow, &week);
+		per_patch(pdu, ce->st.tow_bit, tow, 23);
+		per_patch(pdu, ce->st.tow_bit + 23, week, 10);
+	}
+
+	if (ce->st.loc_bit >= 0) {
+		uint8_t loc[RRLP_LOC_LEN];
+		int i;
+
+		_ref_loc_octets(&gps->ref_pos, loc);
+		for (i=0; i<RRLP_LOC_LEN; i++)
+			per_patch(pdu, ce->st.loc_bit + 8 * i, loc[i], 8);
+	}
+}
+
+/*
+ * Same as rrlp_gps_assist_pdus_arena(), the PDUs living in an internal
+ * memo. They stay valid until RRLP_CACHE_ENTRIES other requests were
+ * served; the first PDU is updated in place by later identical requests.
+ */
+int
+rrlp_gps_assist_pdus(
+	struct gps_assist_data *gps_ad, struct rrlp_assist_req *req,
+	void **o_pdu, int *o_len, int o_max_pdus)
+{
+	struct rrlp_cache_entry *ce, *victim = &rrlp_cache[0];
+	uint64_t eph_svs = (req->req_elems & RRLP_AR_EPHEMERIS) ? req->eph_svs : 0;
+	int i, rv;
+
+	rrlp_cache_clock++;
+
+	for (i=0; i<RRLP_CACHE_ENTRIES; i++) {
+		ce = &rrlp_cache[i];
+
+		if (ce->valid &&
+		    (ce->gen == gps_ad->gen) &&
+		    (ce->fields == gps_ad->fields) &&
+		    (ce->req_elems == req->req_elems) &&
+		    (ce->eph_svs == eph_svs))
+		{
+			if (ce->n_pdus > o_max_pdus)
+				return -1;
+			_restamp(ce, gps_ad);
+			memcpy(o_pdu, ce->pdu, ce->n_pdus * sizeof(void *));
+			memcpy(o_len, ce->len, ce->n_pdus * sizeof(int));
+			ce->last_use = rrlp_cache_clock;
+			rrlp_cache_hits++;
+			return ce->n_pdus;
+		}
+
+		if (!ce->valid || (victim->valid && (ce->last_use < victim->last_use)))
+			victim = ce;
+	}
+
+	rrlp_cache_misses++;
+
+	ce = victim;
+	ce->valid = 0;
+	rrlp_arena_init(&ce->arena, ce->buf, sizeof(ce->buf));
+	rv = _rrlp_encode(gps_ad, req, &ce->arena, ce->pdu, ce->len, RRLP_MAX_PDUS, &ce->st);
+	if ((rv < 0) || (rv > o_max_pdus))
+		return -1;
+
+	ce->valid = 1;
+	ce->gen = gps_ad->gen;
+	ce->fields = gps_ad->fields;
+	ce->req_elems = req->req_elems;
+	ce->eph_svs = eph_svs;
+	ce->last_use = rrlp_cache_clock;
+	ce->n_pdus = rv;
+
+	memcpy(o_pdu, ce->pdu, rv * sizeof(void *));
+	memcpy(o_len, ce->len, rv * sizeof(int));
+
+	return rv;
+}
+
+void
+rrlp_cache_stats(unsigned long *hits, unsigned long *misses)
+{
+	*hits = rrlp_cache_hits;
+	*misses = rrlp_cache_misses;
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Assistance request decoding                                               */
+/* ------------------------------------------------------------------------ */
+
+#define RRLP_COMP_MSR_POS_RSP	1
+#define RRLP_LOC_ERR_ROOT_MAX	10	/* refBTSForEOTDNotServingBTS */
+#define RRLP_GPS_AD_MAX_LEN	40	/* maxGPSAssistanceData */
+
+	/* 49.031 10.10 Requested GPS Data, first octet */
+#define GAD_ALMANAC		0x01
+#define GAD_UTC_MODEL		0x02
+#define GAD_IONO_MODEL		0x04
+#define GAD_NAV_MODEL		0x08
+#define GAD_REF_LOC		0x20
+#define GAD_REF_TIME		0x40
+#define GAD_NAV_HDR_LEN		6	/* octets before the satellite list */
+
+static int
+_decode_gps_ad(struct rrlp_assist_req *ar, const uint8_t *o, int len)
+{
+	int n_sat, i;
+
+	if (o[0] & GAD_ALMANAC)
+		ar->req_elems |= RRLP_AR_ALMANAC;
+	if (o[0] & GAD_UTC_MODEL)
+		ar->req_elems |= RRLP_AR_UTC_MODEL;
+	if (o[0] & GAD_IONO_MODEL)
+		ar->req_elems |= RRLP_AR_IONO_MODEL;
+	if (o[0] & GAD_REF_LOC)
+		ar->req_elems |= RRLP_AR_REF_LOC;
+	if (o[0] & GAD_REF_TIME)
+		ar->req_elems |= RRLP_AR_REF_TIME;
+
+	if (!(o[0] & GAD_NAV_MODEL))
+		return 0;
+
+	ar->req_elems |= RRLP_AR_EPHEMERIS;
+	ar->eph_svs = ~0ULL;
+
+	/* Without the navigation model data, the handset wants everything */
+	if (len < GAD_NAV_HDR_LEN)
+		return 0;
+
+	/*
+	 * GPS week, GPS_Toe and T-Toe limit are ignored: our store only
+	 * ever has the current ephemeris of each SV. The satellites the
+	 * handset lists already have one, leave them out.
+	 */
+	n_sat = o[5] >> 4;
+	if (len < GAD_NAV_HDR_LEN + 2 * n_sat)
+		return -1;
+
+	for (i=0; i<n_sat; i++)
+		ar->eph_svs &= ~(1ULL << (o[GAD_NAV_HDR_LEN + 2 * i] & 0x3f));
+
+	return 0;
+}
+
+/*
+ * Decodes the GPS assistance data a handset asks for in the locationError
+ * of an msrPositionRsp. Returns 0 (ar->req_elems is 0 when nothing was
+ * asked for) or -1 if the PDU is malformed, truncated or something else.
+ * Never reads outside of req[0..req_len-1].
+ */
+int
+rrlp_decode_assistance_request(struct rrlp_assist_req *ar,
+	void *req, int req_len)
+{
+	struct per_reader r;
+	uint8_t gad[RRLP_GPS_AD_MAX_LEN];
+	uint32_t opt;
+	int n, i;
+
+	ar->req_elems = 0;
+	ar->eph_svs = 0;
+
+	if (!req || (req_len <= 0))
+		return -1;
+
+	per_rinit(&r, req, req_len);
+
+	/* PDU: referenceNumber, component CHOICE */
+	per_get(&r, 3);
+	if (per_get(&r, 1) || (per_get(&r, 3) != RRLP_COMP_MSR_POS_RSP))
+		return -1;
+
+	/*
+	 * MsrPosition-Rsp: ext bit, 7 optionals. Anything before the
+	 * locationError carries measurements, not a request. Extension
+	 * additions only come after the root, no need to look at them.
+	 */
+	per_get(&r, 1);
+	opt = per_get(&r, 7);
+	if ((opt & 0x7c) || !(opt & 0x02))
+		return -1;
+
+	/* LocationError: ext bit, additionalAssistanceData present */
+	per_get(&r, 1);
+	opt = per_get(&r, 1);
+
+	/* LocErrorReason, extensible ENUMERATED */
+	if (per_get(&r, 1)) {
+		if (per_get(&r, 1))
+			return -1;		/* not a small number */
+		per_get(&r, 6);
+	} else if (per_get(&r, 4) > RRLP_LOC_ERR_ROOT_MAX)
+		return -1;
+
+	if (!opt)
+		return r.err ? -1 : 0;
+
+	/* AdditionalAssistanceData: ext bit, gps / extensionContainer */
+	per_get(&r, 1);
+	opt = per_get(&r, 2);
+	if (!(opt & 0x02))
+		return r.err ? -1 : 0;
+
+	/* GPSAssistanceData ::= OCTET STRING (SIZE (1..40)) */
+	n = per_get(&r, 6) + 1;
+	if (n > RRLP_GPS_AD_MAX_LEN)
+		return -1;
+	for (i=0; i<n; i++)
+		gad[i] = per_get(&r, 8);
+
+	if (r.err)
+		return -1;
+
+	return _decode_gps_ad(ar, gad, n);
+}
+
+
+/* ------------------------------------------------------------------------ */
+/* Batch mode                                                                */
+/* ------------------------------------------------------------------------ */
+
+#define BATCH_HASH_SIZE		(2 * RRLP_BATCH_MAX_ANSWERS)	/* power of 2 */
+
+static inline unsigned int
+_req_hash(const struct rrlp_assist_req *ar)
+{
+	uint64_t h = ar->eph_svs ^ ((uint64_t)ar->req_elems << 58);
+
+	h *= 0x9e3779b97f4a7c15ULL;
+	return (unsigned int)(h >> 32) & (BATCH_HASH_SIZE - 1);
+}
+
+void
+rrlp_batch_init(struct rrlp_batch *batch, void *arena_buf, int arena_size)
+{
+	rrlp_arena_init(&batch->arena, arena_buf, arena_size);
+	batch->n_answers = 0;
+}
+
+/*
+ * Decodes the n_reqs requests and groups them on identical
+ * rrlp_assist_req, encoding each distinct answer once into the batch
+ * arena (which is reset first). answer_of[i] is the index into
+ * batch->answer serving request i, or -1 if it couldn't be decoded, there
+ * were more than RRLP_BATCH_MAX_ANSWERS distinct ones, or its answer
+ * didn't fit in the arena.
+ * Returns the number of requests served.
+ */
+int
+rrlp_batch_serve(struct gps_assist_data *gps_ad, struct rrlp_batch *batch,
+	void * const *reqs, const int *req_lens, int n_reqs, int *answer_of)
+{
+	int8_t slot[BATCH_HASH_SIZE];
+	int i, served = 0;
+
+	batch->arena.used = 0;
+	batch->n_answers = 0;
+	memset(slot, -1, sizeof(slot));
+
+	/* Decode and group */
+	for (i=0; i<n_reqs; i++) {
+		struct rrlp_assist_req ar;
+		unsigned int h;
+
+		answer_of[i] = -1;
+
+		if (rrlp_decode_assistance_request(&ar, reqs[i], req_lens[i]) ||
+		    !ar.req_elems)
+			continue;
+
+		for (h=_req_hash(&ar); slot[h] >= 0; h=(h+1) & (BATCH_HASH_SIZE - 1)) {
+			struct rrlp_assist_req *o = &batch->answer[slot[h]].req;
+
+			if ((o->req_elems == ar.req_elems) && (o->eph_svs == ar.eph_svs))
+				break;
+		}
+
+		if (slot[h] < 0) {
+			struct rrlp_answer *a;
+
+			if (batch->n_answers == RRLP_BATCH_MAX_ANSWERS)
+				continue;
+
+			slot[h] = batch->n_answers++;
+			a = &batch->answer[slot[h]];
+			a->req = ar;
+			a->n_reqs = 0;
+		}
+
+		answer_of[i] = slot[h];
+		batch->answer[slot[h]].n_reqs++;
+	}
+
+	/* Encode each distinct request once */
+	for (i=0; i<batch->n_answers; i++) {
+		struct rrlp_answer *a = &batch->answer[i];
+		int used = batch->arena.used;
+
+		a->n_pdus = rrlp_gps_assist_pdus_arena(gps_ad, &a->req,
+				&batch->arena, a->pdu, a->len, RRLP_MAX_PDUS);
+		if (a->n_pdus < 0)
+			batch->arena.used = used;	/* drop the partial set */
+		else
+			served += a->n_reqs;
+	}
+
+	for (i=0; i<n_reqs; i++)
+		if ((answer_of[i] >= 0) && (batch->answer[answer_of[i]].n_pdus < 0))
+			answer_of[i] = -1;
+
+	return served;
+}
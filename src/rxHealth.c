@@ -0,0 +1,189 @@
+/*
+ * rxHealth.c
+ *
+ * Receiver monitor: MON-TXBUF / RXBUF / IO / MSGPP and the poll throttle
+ * (see rxHealth.h)
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "monotonic.h"
+#include "debug.h"
+#include "metrics.h"
+#include "ubx.h"
+#include "rxHealth.h"
+
+
+// the ones asked for every RX_HEALTH_PERIOD, a bit each in slowDue
+static const uint8_t slowIds_G[] = { UBX_MON_IO, UBX_MON_RXBUF, UBX_MON_MSGPP };
+
+// MON-TXBUF errors: bits 0..5 a target hit its limit, 6 mem, 7 alloc
+#define TXBUF_ERR_MEM       0x40
+#define TXBUF_ERR_ALLOC     0x80
+
+
+/* Answers */
+
+static void onTxbuf(struct ubx_hdr *hdr, void *payload, int len, void *userdata)
+{
+    struct rxHealth_s *h = userdata;
+    const struct ubx_mon_txbuf *m = ubx_mon_txbuf_get(payload, len);
+    int p = h->port;
+
+    h->txPending = m->pending[p];
+    h->txUsage   = m->usage[p];
+    h->txPeak    = m->peak_usage[p];
+    h->txErrors  = m->errors;
+    h->reports++;
+    h->reportNs  = monotonicNs();
+
+    metrics_set(METRIC_RX_TX_PENDING, h->txPending);
+    metrics_set(METRIC_RX_TX_USAGE, h->txUsage);
+    metrics_set(METRIC_RX_TX_PEAK, h->txPeak);
+    metrics_set(METRIC_RX_TX_ERRORS, h->txErrors);
+
+    // the probe is answered: size the next window on what it found
+    h->probeNs    = 0;
+    h->unanswered = 0;
+    if( (h->txUsage >= RX_HEALTH_HIGH) ||
+        (h->txErrors & ((1 << p) | TXBUF_ERR_MEM | TXBUF_ERR_ALLOC)) ){
+        h->windowSize = (h->windowSize > 1) ? h->windowSize / 2 : 1;
+        if(!h->held){
+            LOG(LOG_INFO, "rxHealth: TX buffer at %d%% (errors %02x), holding the polls",
+                h->txUsage, h->txErrors);
+            metrics_add(METRIC_POLL_THROTTLED, 1);
+        }
+        h->held = 1;
+    }else if(h->txUsage <= RX_HEALTH_LOW){
+        if(h->windowSize < RX_HEALTH_WINDOW){
+            h->windowSize++;
+        }
+        if(h->held){
+            LOG(LOG_INFO, "rxHealth: TX buffer down to %d%%, window of %d polls",
+                h->txUsage, h->windowSize);
+        }
+        h->held = 0;
+    }
+    h->window = h->windowSize;
+    metrics_set(METRIC_POLL_HELD, h->held);
+}
+
+static void onRxbuf(struct ubx_hdr *hdr, void *payload, int len, void *userdata)
+{
+    struct rxHealth_s *h = userdata;
+    const struct ubx_mon_rxbuf *m = ubx_mon_rxbuf_get(payload, len);
+
+    metrics_set(METRIC_RX_RX_USAGE, m->usage[h->port]);
+}
+
+static void onIo(struct ubx_hdr *hdr, void *payload, int len, void *userdata)
+{
+    struct rxHealth_s *h = userdata;
+    const struct ubx_mon_io *m = ubx_mon_io_get(payload, len);
+
+    if(h->port >= ubx_mon_io_count(len)){
+        return;
+    }
+    m += h->port;
+    metrics_set(METRIC_RX_PARITY_ERRORS, m->parity_errs);
+    metrics_set(METRIC_RX_FRAMING_ERRORS, m->framing_errs);
+    metrics_set(METRIC_RX_OVERRUN_ERRORS, m->overrun_errs);
+}
+
+static void onMsgpp(struct ubx_hdr *hdr, void *payload, int len, void *userdata)
+{
+    struct rxHealth_s *h = userdata;
+    const struct ubx_mon_msgpp *m = ubx_mon_msgpp_get(payload, len);
+
+    metrics_set(METRIC_RX_SKIPPED, m->skipped[h->port]);
+}
+
+// ubx_msg_dispatch() checks the lengths against the schema first
+static struct ubx_dispatch_entry monDt_G[] = {
+    UBX_DISPATCH(MON, TXBUF, onTxbuf),
+    UBX_DISPATCH(MON, RXBUF, onRxbuf),
+    UBX_DISPATCH(MON, IO,    onIo),
+    UBX_DISPATCH(MON, MSGPP, onMsgpp),
+    { 0, 0, NULL }
+};
+
+
+/* serial_f */
+
+void rxHealth_init(struct rxHealth_s *h, int port)
+{
+    memset(h, 0, sizeof(struct rxHealth_s));
+    h->port       = port;
+    h->windowSize = (RX_HEALTH_WINDOW + 1) / 2;
+    h->window     = h->windowSize;
+}
+
+// every frame read off the port, as it comes
+void rxHealth_frame(struct rxHealth_s *h, uint8_t *frame, int len)
+{
+    if(frame[2] == UBX_CLASS_MON){
+        ubx_msg_dispatch(monDt_G, frame, len, h);
+    }
+}
+
+/*
+ * A MON poll to write before the next queued command, its length in buf,
+ * 0 if none is due. queued: commands waiting to go out.
+ */
+int rxHealth_next(struct rxHealth_s *h, int queued, uint8_t *buf, int size)
+{
+    uint64_t now = monotonicNs();
+
+    // polls are going out again: time for the others
+    if( (queued > 0) && (h->slowDue == 0) &&
+        ((h->slowNs == 0) || (now - h->slowNs >= RX_HEALTH_PERIOD * 1000000000ULL)) ){
+        h->slowDue = (1 << sizeof(slowIds_G)) - 1;
+        h->slowNs  = now;
+    }
+    for(unsigned i=0; i < sizeof(slowIds_G); i++){
+        if(h->slowDue & (1 << i)){
+            h->slowDue &= ~(1 << i);
+            return ubx_frame_encode(buf, size, UBX_CLASS_MON, slowIds_G[i], NULL, 0);
+        }
+    }
+
+    if( h->probeNs && (now - h->probeNs >= RX_HEALTH_TIMEOUT_MS * 1000000ULL) ){
+        if(++h->unanswered == RX_HEALTH_GIVE_UP){
+            LOG(LOG_WARN, "rxHealth: no MON-TXBUF answers, polls not throttled");
+        }
+        h->probeNs = 0;
+    }
+    if( h->probeNs || (queued == 0) ){
+        return 0;
+    }
+    if( (h->window > 0) && !h->held ){
+        return 0;
+    }
+    if( h->held && (now - h->reportNs < RX_HEALTH_HOLD_MS * 1000000ULL) ){
+        return 0;
+    }
+
+    h->probeNs = now;
+    return ubx_frame_encode(buf, size, UBX_CLASS_MON, UBX_MON_TXBUF, NULL, 0);
+}
+
+// whether the next queued command may go out now
+int rxHealth_mayPoll(const struct rxHealth_s *h)
+{
+    if(h->unanswered >= RX_HEALTH_GIVE_UP){
+        return 1;
+    }
+    return !h->held && (h->window > 0);
+}
+
+// a queued command went out
+void rxHealth_sent(struct rxHealth_s *h)
+{
+    if(h->window > 0){
+        h->window--;
+    }
+}
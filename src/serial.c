@@ -28,8 +28,7 @@ struct serialPort_s *serialPort_init(char *path, int baudRate, int parity)
     struct serialPort_s *sp = NULL;
     int ret;
 
-    sp = (struct serialPort_s *)malloc(sizeof(struct serialPort_s));
-    if(NULL == sp){
+    if(posix_memalign((void **)&sp, CACHE_LINE_SIZE, sizeof(struct serialPort_s)) != 0){
         return NULL;
     }
 
@@ -41,7 +40,7 @@ struct serialPort_s *serialPort_init(char *path, int baudRate, int parity)
     }
     sp->baudRate = baudRate;
     sp->parity   = parity;
-    sp->ticksBtwReceive = 0;
+    serialPort_setTicks(sp, 0);
 
     ret = set_interface_attribs(sp->fd, sp->baudRate, sp->parity);
     if(-1 == ret){
@@ -59,9 +58,9 @@ int serialPort_isRxSilent(struct serialPort_s *sp)
 
     while(1){
 
-        tick1 = sp->ticksBtwReceive;
+        tick1 = serialPort_ticks(sp);
         sleep(4);
-        tick2 = sp->ticksBtwReceive;
+        tick2 = serialPort_ticks(sp);
 
         if(overlapLimit - tick1 > 10)
         {
@@ -76,6 +75,36 @@ int serialPort_isRxSilent(struct serialPort_s *sp)
     } // while(1)
 }
 
+static const struct {
+    int speed;
+    int bps;
+} speeds_G[] = {
+    { B4800, 4800 }, { B9600, 9600 }, { B19200, 19200 }, { B38400, 38400 },
+    { B57600, 57600 }, { B115200, 115200 }, { B230400, 230400 },
+};
+
+// termios speed of a baud rate, 0 if the receiver has none such
+int serialPort_speed(int bps)
+{
+    for(unsigned i=0; i < sizeof(speeds_G) / sizeof(speeds_G[0]); i++){
+        if(speeds_G[i].bps == bps){
+            return speeds_G[i].speed;
+        }
+    }
+    return 0;
+}
+
+// the port's baud rate
+int serialPort_bps(const struct serialPort_s *sp)
+{
+    for(unsigned i=0; i < sizeof(speeds_G) / sizeof(speeds_G[0]); i++){
+        if(speeds_G[i].speed == sp->baudRate){
+            return speeds_G[i].bps;
+        }
+    }
+    return 9600;
+}
+
 int serialPort_deinit(struct serialPort_s *sp)
 {
     close(sp->fd);
@@ -114,6 +143,9 @@ static int set_interface_attribs (int fd, int speed, int parity)
     // Disable software flow control:
     tty.c_iflag &= ~(IXON | IXOFF | IXANY);
 
+    // No CR/NL translation, stripping or break handling of binary input:
+    tty.c_iflag &= ~(IGNBRK | BRKINT | PARMRK | ISTRIP | INLCR | IGNCR | ICRNL);
+
     // Configure line as raw input:
     tty.c_lflag &= ~(ICANON | ECHO | ECHOE | ISIG);
 
@@ -0,0 +1,135 @@
+/*
+ * shmPub.c
+ *
+ * Writer side of the shared memory publication (see shmPub.h)
+ *
+ * There is a single writer per section, the control thread or serial_f
+ * for the timing one, so the sequence counters need no read-modify-write,
+ * only ordering.
+ *
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "monotonic.h"
+#include "debug.h"
+#include "gps.h"
+#include "ubx.h"
+#include "shmPub.h"
+
+
+static inline void seqWriteBegin(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqWriteEnd(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+
+struct shmPubRegion_s *shmPub_create(const char *name)
+{
+    struct shmPubRegion_s *region;
+    int fd;
+
+    fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){
+        LOG(LOG_ERR, "shmPub: shm_open %s: %s", name, strerror(errno));
+        return NULL;
+    }
+    if(ftruncate(fd, sizeof(struct shmPubRegion_s)) < 0){
+        LOG(LOG_ERR, "shmPub: ftruncate %s: %s", name, strerror(errno));
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+
+    region = mmap(NULL, sizeof(struct shmPubRegion_s), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(region == MAP_FAILED){
+        LOG(LOG_ERR, "shmPub: mmap %s: %s", name, strerror(errno));
+        shm_unlink(name);
+        return NULL;
+    }
+
+    // fresh pages are zero: every section reads as never written
+    region->hdr.version   = SHM_PUB_VERSION;
+    region->hdr.size      = sizeof(struct shmPubRegion_s);
+    region->hdr.writerPid = getpid();
+    __atomic_store_n(&region->hdr.magic, SHM_PUB_MAGIC, __ATOMIC_RELEASE);
+
+    LOG(LOG_INFO, "shmPub: publishing on %s, %d bytes", name, (int)sizeof(struct shmPubRegion_s));
+    return region;
+}
+
+void shmPub_destroy(struct shmPubRegion_s *region, const char *name)
+{
+    if(region){
+        munmap(region, sizeof(struct shmPubRegion_s));
+    }
+    shm_unlink(name);
+}
+
+
+void shmPub_writeFix(struct shmPubRegion_s *region, const struct ubx_nav_posllh *fix)
+{
+    if(region == NULL){
+        return;
+    }
+    seqWriteBegin(&region->fix.seq);
+    memcpy(&region->fix.fix, fix, sizeof(struct ubx_nav_posllh));
+    region->fix.updatedNs = monotonicNs();
+    region->fix.count++;
+    seqWriteEnd(&region->fix.seq);
+}
+
+// Returns 1 if the region was updated, 0 if it already had this data
+int shmPub_writeAssist(struct shmPubRegion_s *region, const struct gps_assist_data *gps)
+{
+    struct gps_assist_data *cur;
+
+    if(region == NULL){
+        return 0;
+    }
+
+    // the writer is the only one changing it, no need for the seqlock here
+    cur = &region->assist.gps;
+    if(region->assist.seq && (cur->gen == gps->gen) && (cur->fields == gps->fields) &&
+       !memcmp(&cur->ref_pos, &gps->ref_pos, sizeof(gps->ref_pos)) &&
+       !memcmp(&cur->ref_time, &gps->ref_time, sizeof(gps->ref_time))){
+        return 0;
+    }
+
+    seqWriteBegin(&region->assist.seq);
+    memcpy(cur, gps, sizeof(struct gps_assist_data));
+    region->assist.updatedNs = monotonicNs();
+    region->assist.count++;
+    seqWriteEnd(&region->assist.seq);
+
+    return 1;
+}
+
+// serial_f
+void shmPub_writeTime(struct shmPubRegion_s *region, const struct shmPubTimeData_s *time)
+{
+    if(region == NULL){
+        return;
+    }
+    seqWriteBegin(&region->time.seq);
+    memcpy(&region->time.time, time, sizeof(struct shmPubTimeData_s));
+    region->time.updatedNs = monotonicNs();
+    region->time.count++;
+    seqWriteEnd(&region->time.seq);
+}
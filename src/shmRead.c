@@ -0,0 +1,155 @@
+/*
+ * shmRead.c
+ *
+ * Reader side of the shared memory publication (see shmPub.h)
+ *
+ * A consumer process needs only this file and the headers. After
+ * shmPub_open() every call is plain loads from the mapping.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "gps.h"
+#include "ubx.h"
+#include "shmPub.h"
+
+
+#if defined(__x86_64__) || defined(__i386__)
+#define cpuRelax()  __builtin_ia32_pause()
+#elif defined(__arm__) || defined(__aarch64__)
+#define cpuRelax()  __asm__ __volatile__("yield" ::: "memory")
+#else
+#define cpuRelax()  do{ }while(0)
+#endif
+
+// spins on a write in progress before giving the cpu to the writer; on a
+// single core target the writer can't finish while we spin
+#define SEQ_SPIN_MAX    64
+
+// Maps the region read only. Returns -1 if there is no (compatible) writer
+int shmPub_open(struct shmPubReader_s *rd, const char *name)
+{
+    struct shmPubRegion_s *region;
+    struct stat st;
+
+    rd->fd     = -1;
+    rd->region = NULL;
+
+    rd->fd = shm_open(name, O_RDONLY, 0);
+    if(rd->fd < 0){
+        return -1;
+    }
+    if((fstat(rd->fd, &st) < 0) || (st.st_size < (off_t)sizeof(struct shmPubRegion_s))){
+        shmPub_close(rd);
+        return -1;
+    }
+
+    region = mmap(NULL, sizeof(struct shmPubRegion_s), PROT_READ, MAP_SHARED, rd->fd, 0);
+    if(region == MAP_FAILED){
+        shmPub_close(rd);
+        return -1;
+    }
+    rd->region = region;
+
+    if((__atomic_load_n(&region->hdr.magic, __ATOMIC_ACQUIRE) != SHM_PUB_MAGIC) ||
+       (region->hdr.version != SHM_PUB_VERSION) ||
+       (region->hdr.size != sizeof(struct shmPubRegion_s))){
+        shmPub_close(rd);
+        return -1;
+    }
+
+    return 0;
+}
+
+void shmPub_close(struct shmPubReader_s *rd)
+{
+    if(rd->region){
+        munmap((void *)rd->region, sizeof(struct shmPubRegion_s));
+        rd->region = NULL;
+    }
+    if(rd->fd >= 0){
+        close(rd->fd);
+        rd->fd = -1;
+    }
+}
+
+
+/* Current sequence numbers: cheap "anything new?" checks, even values only
+ * ever mean a complete update */
+uint32_t shmPub_fixSeq(const struct shmPubReader_s *rd)
+{
+    return __atomic_load_n(&rd->region->fix.seq, __ATOMIC_ACQUIRE) & ~1u;
+}
+
+uint32_t shmPub_assistSeq(const struct shmPubReader_s *rd)
+{
+    return __atomic_load_n(&rd->region->assist.seq, __ATOMIC_ACQUIRE) & ~1u;
+}
+
+uint32_t shmPub_timeSeq(const struct shmPubReader_s *rd)
+{
+    return __atomic_load_n(&rd->region->time.seq, __ATOMIC_ACQUIRE) & ~1u;
+}
+
+
+/* Copies dst from src between two stable, equal, even reads of seq */
+static uint32_t seqRead(const uint32_t *seq, void *dst, const void *src, size_t len,
+                        uint64_t *updatedNs, const uint64_t *srcNs)
+{
+    uint32_t s0, s1;
+    int spins = 0;
+
+    do{
+        while((s0 = __atomic_load_n(seq, __ATOMIC_ACQUIRE)) & 1){
+            if(++spins < SEQ_SPIN_MAX){
+                cpuRelax();
+            }else{
+                sched_yield();
+            }
+        }
+        memcpy(dst, src, len);
+        if(updatedNs){
+            *updatedNs = *srcNs;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s1 = __atomic_load_n(seq, __ATOMIC_RELAXED);
+    }while(s0 != s1);
+
+    return s0;
+}
+
+
+// Returns the sequence number of the snapshot, or -1 if there is no fix yet
+int shmPub_readFix(const struct shmPubReader_s *rd, struct ubx_nav_posllh *fix, uint64_t *updatedNs)
+{
+    const struct shmPubFix_s *s = &rd->region->fix;
+    uint32_t seq;
+
+    seq = seqRead(&s->seq, fix, &s->fix, sizeof(struct ubx_nav_posllh), updatedNs, &s->updatedNs);
+    return seq ? (int)(seq >> 1) : -1;
+}
+
+int shmPub_readAssist(const struct shmPubReader_s *rd, struct gps_assist_data *gps, uint64_t *updatedNs)
+{
+    const struct shmPubAssist_s *s = &rd->region->assist;
+    uint32_t seq;
+
+    seq = seqRead(&s->seq, gps, &s->gps, sizeof(struct gps_assist_data), updatedNs, &s->updatedNs);
+    return seq ? (int)(seq >> 1) : -1;
+}
+
+int shmPub_readTime(const struct shmPubReader_s *rd, struct shmPubTimeData_s *time, uint64_t *updatedNs)
+{
+    const struct shmPubTime_s *s = &rd->region->time;
+    uint32_t seq;
+
+    seq = seqRead(&s->seq, time, &s->time, sizeof(struct shmPubTimeData_s), updatedNs, &s->updatedNs);
+    return seq ? (int)(seq >> 1) : -1;
+}
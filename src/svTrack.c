@@ -0,0 +1,124 @@
+/*
+ * svTrack.c
+ *
+ * NAV-SVINFO into the table of tracked SVs (see svTrack.h)
+ *
+ * serial_f is the only writer, so the sequence counter needs no
+ * read-modify-write, only ordering.
+ *
+ */
+
+#include <string.h>
+#include <sched.h>
+#include <time.h>
+
+#include "config.h"
+#include "monotonic.h"
+#include "metrics.h"
+#include "ubx.h"
+#include "svTrack.h"
+
+
+static inline void seqWriteBegin(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void seqWriteEnd(uint32_t *seq)
+{
+    __atomic_store_n(seq, *seq + 1, __ATOMIC_RELEASE);
+}
+
+
+/* serial_f */
+
+void svTrack_init(struct svTrack_s *t)
+{
+    memset(t, 0, sizeof(struct svTrack_s));
+}
+
+/*
+ * Every frame read off the port. Returns 1 if it was a NAV-SVINFO, 0 if
+ * not.
+ */
+int svTrack_frame(struct svTrack_s *t, const uint8_t *frame, int len)
+{
+    const struct ubx_hdr *hdr = (const struct ubx_hdr *)frame;
+    const struct ubx_nav_svinfo *m;
+    struct svTrackTable_s *tb = &(t->table);
+    uint64_t onChannel = 0;         // bit n: SV n
+    int n = 0;
+
+    if( (hdr->msg_class != UBX_CLASS_NAV) || (hdr->msg_id != UBX_NAV_SVINFO) ){
+        return 0;
+    }
+    if( (m = ubx_nav_svinfo_get(frame + sizeof(struct ubx_hdr), hdr->payload_len)) == NULL ){
+        return 1;
+    }
+
+    seqWriteBegin(&t->seq);
+    tb->updates++;
+    for(int i=0; i < m->num_ch; i++){
+        const struct ubx_nav_svinfo_block *b = ubx_nav_svinfo_block(m, i);
+        struct svTrackSv_s *sv;
+        uint8_t quality = b->quality & 0x0f;
+        uint8_t tracked;
+
+        if( (b->svid < 1) || (b->svid >= SV_TRACK_N_SV) ){
+            continue;                   // SBAS
+        }
+        sv = &(tb->sv[b->svid]);
+        tracked = (quality >= SV_TRACK_MIN_QUALITY) && !(b->flags & SVINFO_UNHEALTHY);
+        if(tracked && !sv->tracked){
+            sv->since = tb->updates;
+        }
+        sv->flags   = b->flags;
+        sv->quality = quality;
+        sv->cno     = b->cno;
+        sv->elev    = b->elev;
+        sv->azim    = b->azim;
+        sv->chn     = b->chn;
+        sv->tracked = tracked;
+        onChannel |= 1ULL << b->svid;
+    }
+    for(int s=1; s < SV_TRACK_N_SV; s++){
+        if( !(onChannel & (1ULL << s)) ){
+            memset(&(tb->sv[s]), 0, sizeof(struct svTrackSv_s));
+        }
+        n += tb->sv[s].tracked;
+    }
+    tb->nTracked  = n;
+    tb->itow      = m->itow;
+    tb->updatedNs = monotonicNs();
+    seqWriteEnd(&t->seq);
+
+    metrics_set(METRIC_NAV_SV_TRACKED, n);
+    return 1;
+}
+
+
+/* Readers */
+
+/*
+ * A consistent copy of the table. Returns the SVs tracked, -1 if there
+ * was no NAV-SVINFO yet or the last is older than maxAgeNs (0: any age).
+ */
+int svTrack_read(const struct svTrack_s *t, struct svTrackTable_s *table, uint64_t maxAgeNs)
+{
+    uint32_t s0, s1;
+
+    do{
+        while((s0 = __atomic_load_n(&t->seq, __ATOMIC_ACQUIRE)) & 1){
+            sched_yield();
+        }
+        memcpy(table, &(t->table), sizeof(struct svTrackTable_s));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        s1 = __atomic_load_n(&t->seq, __ATOMIC_RELAXED);
+    }while(s0 != s1);
+
+    if( (table->updates == 0) || (maxAgeNs && (monotonicNs() - table->updatedNs > maxAgeNs)) ){
+        return -1;
+    }
+    return table->nTracked;
+}
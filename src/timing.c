@@ -0,0 +1,160 @@
+/*
+ * timing.c
+ *
+ * TIM-TP / TIM-TM2 / TIM-SVIN to the NTP SHM refclock and the shared
+ * memory region (see timing.h)
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "debug.h"
+#include "metrics.h"
+#include "ubx.h"
+#include "ntpShm.h"
+#include "shmPub.h"
+#include "timing.h"
+
+
+#define UTC_VALID           (1ULL << 32)
+
+// TIM-TP flags
+#define TP_TIMEBASE_UTC     0x01
+
+
+void timing_init(struct timing_s *t, struct ntpShmTime_s *shm, struct shmPubRegion_s *pub)
+{
+    memset(t, 0, sizeof(struct timing_s));
+    t->shm = shm;
+    t->pub = pub;
+}
+
+// control_f, whenever an AID-HUI came in
+void timing_setUtc(struct timing_s *t, const struct gps_utc_model *utc)
+{
+    uint64_t u = UTC_VALID | (uint8_t)utc->delta_t_ls | ((uint8_t)utc->delta_t_lsf << 8) |
+                 ((uint32_t)(utc->wn_lsf & 0xff) << 16) | ((uint32_t)(utc->dn & 0xff) << 24);
+
+    __atomic_store_n(&t->utc, u, __ATOMIC_RELAXED);
+}
+
+/*
+ * UTC of the pulse tp gives, in ts. Returns the leap indicator of the
+ * refclock: a leap second announced for the end of this UTC day.
+ */
+int timing_pulseUtc(const struct timing_s *t, const struct ubx_tim_tp *tp, struct timespec *ts)
+{
+    uint64_t u = __atomic_load_n(&t->utc, __ATOMIC_RELAXED);
+    int64_t sec = (int64_t)tp->week * GPS_WEEK_SECONDS + tp->tow_ms / 1000;
+    int ls = TIMING_LEAP_SECONDS;
+    int leap = NTP_SHM_LEAP_NONE;
+
+    if(u & UTC_VALID){
+        int lsf = (int8_t)(u >> 8);
+        int wnLsf = (u >> 16) & 0xff;
+        int dn = (u >> 24) & 0xff;
+        int64_t event;
+
+        ls = (int8_t)u;
+        if(lsf != ls){
+            // wn_lsf is the week modulo 256, the one closest to this one
+            wnLsf = tp->week + (int8_t)(wnLsf - (tp->week & 0xff));
+            event = (int64_t)wnLsf * GPS_WEEK_SECONDS + dn * 86400 + ls;
+            if((event > sec) && (event - sec <= 86400)){
+                leap = (lsf > ls) ? NTP_SHM_LEAP_ADD : NTP_SHM_LEAP_DEL;
+            }
+        }
+    }
+
+    ts->tv_sec  = GPS_EPOCH_UNIX + sec - ((tp->flags & TP_TIMEBASE_UTC) ? 0 : ls);
+    ts->tv_nsec = (tp->tow_ms % 1000) * 1000000 + (((uint64_t)tp->tow_sub_ms * 1000000) >> 32);
+    return leap;
+}
+
+// milliseconds from the pulse a gives to the one b gives
+static int64_t pulseGapMs(const struct ubx_tim_tp *a, const struct ubx_tim_tp *b)
+{
+    return ((int64_t)b->week - a->week) * GPS_WEEK_SECONDS * 1000 + (int64_t)b->tow_ms - a->tow_ms;
+}
+
+/*
+ * The pulse the last TIM-TP gave has just been: it's the sample, read at
+ * readTs. The refclock first, everything else after.
+ */
+static void pulseSample(struct timing_s *t, const struct ubx_tim_tp *tp, const struct timespec *readTs)
+{
+    struct ntpShmSample_s s;
+    struct timespec now;
+    int64_t gap = pulseGapMs(&t->data.tp, tp);
+
+    if( !t->havePulse || (gap <= 0) || (gap > 2000) ){
+        return;
+    }
+    s.leap      = timing_pulseUtc(t, &t->data.tp, &s.clock);
+    s.receive   = *readTs;
+    s.precision = TIMING_SHM_PRECISION;
+    if(t->shm){
+        ntpShm_store(t->shm, &s);
+    }
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    metrics_observe(METRIC_REFCLOCK_NS, (now.tv_sec - readTs->tv_sec) * 1000000000LL +
+                                        (now.tv_nsec - readTs->tv_nsec));
+    metrics_add(METRIC_REFCLOCK_SAMPLES, 1);
+    t->samples++;
+}
+
+/*
+ * A frame read off the port at readTs (CLOCK_REALTIME). Returns 1 if it
+ * was one of the timing messages, 0 if not.
+ */
+int timing_frame(struct timing_s *t, const uint8_t *frame, int len, const struct timespec *readTs)
+{
+    const struct ubx_hdr *hdr = (const struct ubx_hdr *)frame;
+    const uint8_t *pl = frame + sizeof(struct ubx_hdr);
+    const struct ubx_tim_tp *tp;
+    const struct ubx_tim_tm2 *tm2;
+    const struct ubx_tim_svin *svin;
+
+    if(hdr->msg_class != UBX_CLASS_TIM){
+        return 0;
+    }
+
+    switch(hdr->msg_id){
+    case UBX_TIM_TP:
+        if( (tp = ubx_tim_tp_get(pl, hdr->payload_len)) == NULL ){
+            return 1;
+        }
+        pulseSample(t, tp, readTs);
+        memcpy(&t->data.tp, tp, sizeof(struct ubx_tim_tp));
+        t->havePulse = 1;
+        metrics_set(METRIC_TIMEPULSE_QERR, tp->q_err);
+        break;
+
+    case UBX_TIM_TM2:
+        if( (tm2 = ubx_tim_tm2_get(pl, hdr->payload_len)) == NULL ){
+            return 1;
+        }
+        memcpy(&t->data.tm2, tm2, sizeof(struct ubx_tim_tm2));
+        break;
+
+    case UBX_TIM_SVIN:
+        if( (svin = ubx_tim_svin_get(pl, hdr->payload_len)) == NULL ){
+            return 1;
+        }
+        memcpy(&t->data.svin, svin, sizeof(struct ubx_tim_svin));
+        metrics_set(METRIC_SURVEY_IN_ACTIVE, svin->active);
+        metrics_set(METRIC_SURVEY_IN_VALID, svin->valid);
+        metrics_set(METRIC_SURVEY_IN_DURATION, svin->dur);
+        break;
+
+    default:
+        return 1;
+    }
+
+    shmPub_writeTime(t->pub, &t->data);
+    return 1;
+}
@@ -0,0 +1,290 @@
+/*
+ * trace.c
+ *
+ * Per frame latency trace (see trace.h)
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "monotonic.h"
+#include "debug.h"
+#include "ubx.h"
+#include "ubxSchema.h"
+#include "trace.h"
+
+
+// serial_f's, read by control_f
+static struct {
+    traceChunk_t ring[TRACE_CHUNKS];
+    uint64_t readNs;                    // of the last read
+    uint64_t written;                   // bytes into rbUartIn_p so far
+    uint32_t head;                      // chunks so far, published with release
+} chunks_G CACHE_ALIGNED;
+
+// control_f's only
+static struct {
+    traceFrame_t ring[TRACE_FRAMES];
+    uint64_t consumed;                  // stream offset of scratchpad[0]
+    int scratchLen;
+    uint32_t next;                      // seq of the next frame
+    uint32_t dispatched;                // frames up to here went through dispatch
+    uint32_t published;
+} frames_G CACHE_ALIGNED;
+
+
+static const struct {
+    uint8_t msgClass;
+    uint8_t msgId;
+    const char *name;
+} names_G[] = {
+#define _TRACE_NAME(K, I, name, x)  { UBX_CLASS_##K, UBX_##K##_##I, #K "-" #I },
+    UBX_MESSAGES(_TRACE_NAME)
+    UBX_BLOCK_MESSAGES(_TRACE_NAME)
+    UBX_ARRAY_MESSAGES(_TRACE_NAME)
+#undef _TRACE_NAME
+};
+
+static const char *stageNames_G[TRACE_N_STAGES] = {
+    "uart read", "framer", "rbUbxMsg", "dispatch", "publish",
+};
+
+
+/* serial_f */
+
+// bytes came off the port
+void trace_read(void)
+{
+    chunks_G.readNs = monotonicNs();
+}
+
+// the framer returned a frame of len bytes, and it went into rbUartIn_p
+void trace_framed(int len)
+{
+    uint32_t h = chunks_G.head;
+    traceChunk_t *c = &chunks_G.ring[h % TRACE_CHUNKS];
+
+    chunks_G.written += len;
+    c->framedNs = monotonicNs();
+    c->readNs   = chunks_G.readNs;
+    c->end      = chunks_G.written;
+    c->len      = len;
+    __atomic_store_n(&chunks_G.head, h + 1, __ATOMIC_RELEASE);
+}
+
+
+/* control_f */
+
+// serial_f's stamps of the frame ending at stream offset end, 0 if it's
+// out of the ring
+static void chunkNs(uint64_t end, uint64_t *readNs, uint64_t *framedNs)
+{
+    uint32_t h = __atomic_load_n(&chunks_G.head, __ATOMIC_ACQUIRE);
+    uint32_t i;
+
+    *readNs = *framedNs = 0;
+    for(i = h; (i != 0) && (h - i < TRACE_CHUNKS - 1); i--){
+        const traceChunk_t *c = &chunks_G.ring[(i - 1) % TRACE_CHUNKS];
+
+        if(c->end - c->len < end){
+            if(c->end >= end){
+                *readNs   = c->readNs;
+                *framedNs = c->framedNs;
+            }
+            break;
+        }
+    }
+    // serial_f may have lapped the ring meanwhile
+    if(__atomic_load_n(&chunks_G.head, __ATOMIC_ACQUIRE) - i >= TRACE_CHUNKS - 1){
+        *readNs = *framedNs = 0;
+    }
+}
+
+// the next len bytes of the stream were read into the scratchpad
+void trace_uartRead(int len)
+{
+    frames_G.consumed  += frames_G.scratchLen;
+    frames_G.scratchLen = len;
+}
+
+/*
+ * A valid frame of len bytes at scratchpad offset pos: opens its record,
+ * with the READ and FRAMED stamps serial_f took. Returns its seq, for
+ * trace_queued().
+ */
+int trace_frame(const void *frame, int pos, int len)
+{
+    const struct ubx_hdr *hdr = frame;
+    uint32_t seq = frames_G.next++;
+    traceFrame_t *f = &frames_G.ring[seq % TRACE_FRAMES];
+
+    memset(f, 0, sizeof(traceFrame_t));
+    chunkNs(frames_G.consumed + pos + len, &f->ns[TRACE_READ], &f->ns[TRACE_FRAMED]);
+    f->seq      = seq;
+    f->len      = len;
+    f->msgClass = hdr->msg_class;
+    f->msgId    = hdr->msg_id;
+    f->sv       = -1;
+    if((hdr->msg_class == UBX_CLASS_AID) && (hdr->payload_len > 0) &&
+       ((hdr->msg_id == UBX_AID_ALM) || (hdr->msg_id == UBX_AID_EPH))){
+        f->sv = ((const uint8_t *)frame)[sizeof(struct ubx_hdr)];
+    }
+
+    return seq;
+}
+
+void trace_queued(int seq)
+{
+    traceFrame_t *f = &frames_G.ring[(uint32_t)seq % TRACE_FRAMES];
+
+    if(f->seq == (uint32_t)seq){
+        f->ns[TRACE_QUEUED] = monotonicNs();
+    }
+}
+
+// the next frame out of rbUbxMsg_p: the oldest queued one not dispatched yet
+void trace_dispatched(void)
+{
+    if(frames_G.next - frames_G.dispatched > TRACE_FRAMES){
+        frames_G.dispatched = frames_G.next - TRACE_FRAMES;
+    }
+    while(frames_G.dispatched != frames_G.next){
+        traceFrame_t *f = &frames_G.ring[frames_G.dispatched++ % TRACE_FRAMES];
+
+        if(f->ns[TRACE_QUEUED]){
+            f->ns[TRACE_DISPATCHED] = monotonicNs();
+            break;
+        }
+    }
+}
+
+// everything dispatched since the last call is out to the consumers
+void trace_published(void)
+{
+    uint64_t now = monotonicNs();
+
+    if(frames_G.dispatched - frames_G.published > TRACE_FRAMES){
+        frames_G.published = frames_G.dispatched - TRACE_FRAMES;
+    }
+    for(; frames_G.published != frames_G.dispatched; frames_G.published++){
+        traceFrame_t *f = &frames_G.ring[frames_G.published % TRACE_FRAMES];
+
+        if(f->ns[TRACE_DISPATCHED]){
+            f->ns[TRACE_PUBLISHED] = now;
+        }
+    }
+}
+
+
+/* Dump */
+
+static const char *frameName(const traceFrame_t *f, char *buf, int size)
+{
+    for(unsigned k=0; k < sizeof(names_G) / sizeof(names_G[0]); k++){
+        if((names_G[k].msgClass == f->msgClass) && (names_G[k].msgId == f->msgId)){
+            return names_G[k].name;
+        }
+    }
+    snprintf(buf, size, "UBX %02x-%02x", f->msgClass, f->msgId);
+    return buf;
+}
+
+// microseconds, as the format wants them, without going through a double
+static void putTs(FILE *fp, const char *key, uint64_t ns)
+{
+    fprintf(fp, ",\"%s\":%" PRIu64 ".%03u", key, ns / 1000, (unsigned)(ns % 1000));
+}
+
+static void dumpFrames(FILE *fp)
+{
+    uint32_t first = (frames_G.next > TRACE_FRAMES) ? frames_G.next - TRACE_FRAMES : 0;
+    char buf[16];
+
+    for(uint32_t seq = first; seq != frames_G.next; seq++){
+        const traceFrame_t *f = &frames_G.ring[seq % TRACE_FRAMES];
+        const char *name = frameName(f, buf, sizeof(buf));
+
+        // a slice per stage, from the stage before to this one
+        for(int s = TRACE_FRAMED; s < TRACE_N_STAGES; s++){
+            if(!f->ns[s - 1] || !f->ns[s]){
+                continue;
+            }
+            fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":%d", name, s + 1);
+            putTs(fp, "ts", f->ns[s - 1]);
+            putTs(fp, "dur", f->ns[s] - f->ns[s - 1]);
+            fprintf(fp, ",\"args\":{\"seq\":%u,\"len\":%u", f->seq, f->len);
+            if(f->sv >= 0){
+                fprintf(fp, ",\"sv\":%d", f->sv);
+            }
+            fprintf(fp, "}}");
+        }
+    }
+}
+
+static void dumpChunks(FILE *fp)
+{
+    uint32_t h = __atomic_load_n(&chunks_G.head, __ATOMIC_ACQUIRE);
+    uint32_t first = (h >= TRACE_CHUNKS) ? h - TRACE_CHUNKS + 1 : 0;
+    uint64_t lastNs = 0;
+    traceChunk_t c;
+
+    for(uint32_t i = first; i != h; i++){
+        c = chunks_G.ring[i % TRACE_CHUNKS];
+        // serial_f keeps writing, skip what it may have overwritten meanwhile
+        if(__atomic_load_n(&chunks_G.head, __ATOMIC_ACQUIRE) - i >= TRACE_CHUNKS){
+            continue;
+        }
+        // one instant per read, however many frames it completed
+        if(c.readNs == lastNs){
+            continue;
+        }
+        lastNs = c.readNs;
+        fprintf(fp, ",\n{\"name\":\"read\",\"cat\":\"uart\",\"ph\":\"i\",\"s\":\"t\",\"pid\":1,\"tid\":1");
+        putTs(fp, "ts", c.readNs);
+        fprintf(fp, ",\"args\":{\"end\":%" PRIu64 "}}", c.end);
+    }
+}
+
+/*
+ * Writes the records in the Chrome trace event format to path, through
+ * a temporary renamed over it. control_f only.
+ */
+int trace_dump(const char *path)
+{
+    char tmp[256];
+    FILE *fp;
+    int ok;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    fp = fopen(tmp, "we");
+    if(fp == NULL){
+        LOG(LOG_WARN, "trace: cannot write %s: %s", tmp, strerror(errno));
+        return -1;
+    }
+
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"rawGpsDataJsonizer\"}}");
+    for(int s=0; s < TRACE_N_STAGES; s++){
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                s + 1, stageNames_G[s]);
+        fprintf(fp, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}",
+                s + 1, s + 1);
+    }
+    dumpChunks(fp);
+    dumpFrames(fp);
+    fprintf(fp, "\n]}\n");
+
+    ok = !ferror(fp);
+    if((fclose(fp) != 0) || !ok || (rename(tmp, path) < 0)){
+        LOG(LOG_WARN, "trace: cannot write %s: %s", path, strerror(errno));
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * txSched.c
+ *
+ * Poll scheduler: commands paced by the size of their answers and the
+ * baud rate (see txSched.h)
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "monotonic.h"
+#include "ubx.h"
+#include "txSched.h"
+
+
+#define ANSWER_ACK          (sizeof(struct ubx_hdr) + 2 + 2)
+#define ANSWER_UNKNOWN      100     // a poll the schema doesn't know
+#define ANSWER_BLOCKS       16      // blocks of a block message, a guess
+
+
+void txSched_init(struct txSched_s *ts, int bps)
+{
+    memset(ts, 0, sizeof(struct txSched_s));
+    ts->nsPerByte  = 10000000000ULL / bps;
+    ts->lineFreeNs = monotonicNs();
+}
+
+/*
+ * Bytes the receiver answers the command with: header and checksum
+ * included, 0 for a command that isn't answered.
+ */
+int txSched_answerSize(const void *cmd)
+{
+    const struct ubx_hdr *hdr = cmd;
+    int n = 1;
+    int pl;
+
+    if(hdr->msg_class == UBX_CLASS_CFG){
+        return ANSWER_ACK;
+    }
+    if(hdr->payload_len > 1){
+        return 0;
+    }
+    // no SV: all of them
+    if( (hdr->msg_class == UBX_CLASS_AID) && (hdr->payload_len == 0) &&
+        ((hdr->msg_id == UBX_AID_ALM) || (hdr->msg_id == UBX_AID_EPH)) ){
+        n = 32;
+    }
+
+#define _TX_ID(K, I)    ((UBX_CLASS_##K << 8) | UBX_##K##_##I)
+#define _TX_SIZE(K, I, name, x) \
+    case _TX_ID(K, I): pl = sizeof(struct ubx_##name); break;
+#define _TX_BLOCK_SIZE(K, I, name, x) \
+    case _TX_ID(K, I): pl = sizeof(struct ubx_##name) + ANSWER_BLOCKS * sizeof(struct ubx_##name##_block); break;
+#define _TX_ARRAY_SIZE(K, I, name, max) \
+    case _TX_ID(K, I): pl = (max) * sizeof(struct ubx_##name); break;
+
+    switch((hdr->msg_class << 8) | hdr->msg_id){
+    UBX_MESSAGES(_TX_SIZE)
+    UBX_BLOCK_MESSAGES(_TX_BLOCK_SIZE)
+    UBX_ARRAY_MESSAGES(_TX_ARRAY_SIZE)
+    default:
+        return ANSWER_UNKNOWN;
+    }
+
+    return n * (sizeof(struct ubx_hdr) + pl + 2);
+}
+
+// answer bytes still to come
+int txSched_pending(struct txSched_s *ts)
+{
+    uint64_t now = monotonicNs();
+    uint64_t onLine, unread;
+
+    if(ts->lineFreeNs <= now){
+        // all of it had the time to come in, whatever did
+        ts->read = ts->asked;
+        return 0;
+    }
+    onLine = (ts->lineFreeNs - now) / ts->nsPerByte;
+    unread = (ts->asked > ts->read) ? ts->asked - ts->read : 0;
+
+    return (onLine < unread) ? onLine : unread;
+}
+
+// whether cmd may go out now, ringFree: room left in rbUartIn_p
+int txSched_admit(struct txSched_s *ts, const void *cmd, int ringFree)
+{
+    int pending = txSched_pending(ts);
+    int size = txSched_answerSize(cmd);
+
+    if(pending == 0){
+        return 1;
+    }
+    return (pending + size <= TX_SCHED_BUDGET) && (pending + size <= ringFree);
+}
+
+// cmd was written: its answer comes after the ones before
+void txSched_sent(struct txSched_s *ts, const void *cmd)
+{
+    const struct ubx_hdr *hdr = cmd;
+    int size = txSched_answerSize(cmd);
+    uint64_t start;
+
+    // the receiver has it once it is through, and answers when the line is free
+    start = monotonicNs() + (sizeof(struct ubx_hdr) + hdr->payload_len + 2) * ts->nsPerByte;
+    if(start < ts->lineFreeNs){
+        start = ts->lineFreeNs;
+    }
+    ts->asked += size;
+    __atomic_store_n(&ts->lineFreeNs, start + size * ts->nsPerByte, __ATOMIC_RELAXED);
+}
+
+void txSched_read(struct txSched_s *ts, int len)
+{
+    ts->read += len;
+}
+
+/*
+ * A frame nobody asked for (TIM-TP and the like) came in: its bytes were
+ * read but were no answer, and answers still to come wait behind it.
+ */
+void txSched_unsolicited(struct txSched_s *ts, int len)
+{
+    uint64_t now = monotonicNs();
+
+    ts->asked += len;
+    if(ts->lineFreeNs > now){
+        __atomic_store_n(&ts->lineFreeNs, ts->lineFreeNs + len * ts->nsPerByte, __ATOMIC_RELAXED);
+    }
+}
+
+// when the answers to everything sent so far should be in, control_f
+uint64_t txSched_drainedNs(const struct txSched_s *ts)
+{
+    return __atomic_load_n(&ts->lineFreeNs, __ATOMIC_RELAXED) + TX_SCHED_SLACK_MS * 1000000ULL;
+}
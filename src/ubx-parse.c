@@ -21,41 +21,70 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 
+#include "config.h"
 #include "gps.h"
 #include "ubx.h"
 #include "ubx-parse.h"
+#include "debug.h"
+#include "gpsView.h"
 
 
 /* Helpers */
 
+/* Index of the almanac / ephemeris entry of sv_id, appending a new one
+ * if it isn't known yet. Returns -1 when the set is full. */
+
 static int
-float_to_fixedpoint(float f, int sf)
+_gps_almanac_slot(struct gps_almanac *alm, int sv_id)
 {
-	if (sf < 0) {
-		while (sf++ < 0)
-			f *= 2.0f;
-	} else {
-		while (sf-- > 0)
-			f *= 0.5f;
-	}
+	int i;
+
+	for (i=0; i<alm->n_sv; i++)
+		if (alm->svs[i].sv_id == sv_id)
+			return i;
 
-	return (int)f;
+	return (alm->n_sv < MAX_SV) ? alm->n_sv++ : -1;
 }
 
-static inline int
-double_to_fixedpoint(double d, int sf)
+static int
+_gps_ephemeris_slot(struct gps_ephemeris *eph, int sv_id)
 {
-	if (sf < 0) {
-		while (sf++ < 0)
-			d *= 2.0;
-	} else {
-		while (sf-- > 0)
-			d *= 0.5;
-	}
+	int i;
+
+	for (i=0; i<eph->n_sv; i++)
+		if (eph->svs[i].sv_id == sv_id)
+			return i;
+
+	return (eph->n_sv < MAX_SV) ? eph->n_sv++ : -1;
+}
+
+
+/* WGS-84 geodetic position of an ECEF one (m), Bowring's formula: well
+ * under a mm anywhere near the surface */
+
+#define WGS84_A		6378137.0
+#define WGS84_E2	6.69437999014e-3
 
-	return (int)d;
+static void
+_ecef_to_ref_pos(double x, double y, double z, struct gps_ref_pos *pos)
+{
+	double b = WGS84_A * sqrt(1.0 - WGS84_E2);
+	double ep2 = (WGS84_A * WGS84_A - b * b) / (b * b);
+	double p = hypot(x, y);
+	double th = atan2(z * WGS84_A, p * b);
+	double st = sin(th), ct = cos(th);
+	double lat = atan2(z + ep2 * b * st * st * st, p - WGS84_E2 * WGS84_A * ct * ct * ct);
+	double sl = sin(lat);
+	double n = WGS84_A / sqrt(1.0 - WGS84_E2 * sl * sl);
+
+	pos->latitude  = lat * 180.0 / M_PI;
+	pos->longitude = atan2(y, x) * 180.0 / M_PI;
+	pos->altitude  = p / cos(lat) - n;
 }
 
 
@@ -64,23 +93,50 @@ double_to_fixedpoint(double d, int sf)
 static void
 _ubx_msg_parse_nav_posllh(struct ubx_hdr *hdr, void *pl, int pl_len, void *ud)
 {
-	//struct ubx_nav_posllh *nav_posllh = pl;
-	//struct gps_assist_data *gps = ud;
+	struct ubx_nav_posllh *nav_posllh = pl;
+	struct gps_assist_data *gps = ud;
 
 	//printf("[.] NAV_POSLLH\n");
 
-	// FIXME: Extract info for "Reference Position"
+	/* Without a fix the receiver reports 0,0 with a huge hAcc, which
+	 * would point the visibility prediction at the wrong sky */
+	if (nav_posllh->hacc > REF_POS_MAX_HACC_M * 1000u)
+		return;
+
+	gps->fields |= GPS_FIELD_REFPOS;
+
+	gps->ref_pos.latitude  = (double)(nav_posllh->lat) * 1e-7;
+	gps->ref_pos.longitude = (double)(nav_posllh->lon) * 1e-7;
+	gps->ref_pos.altitude  = (double)(nav_posllh->height) * 1e-3;
 }
 
 static void
 _ubx_msg_parse_aid_ini(struct ubx_hdr *hdr, void *pl, int pl_len, void *ud)
 {
-	//struct ubx_aid_ini *aid_ini = pl;
-	//struct gps_assist_data *gps = ud;
+	struct ubx_aid_ini *aid_ini = pl;
+	struct gps_assist_data *gps = ud;
 
 	//printf("[.] AID_INI\n");
 
-	// FIXME: Extract info for "Reference Time"
+	if (aid_ini->flags & 0x02) { /* Time valid */
+		gps->fields |= GPS_FIELD_REFTIME;
+		gps->ref_time.wn   = aid_ini->wn;
+		gps->ref_time.tow  = (double)aid_ini->tow * 1e-3;
+		gps->ref_time.when = time(NULL);
+	}
+
+	/* Position valid: a reference until a NAV-POSLLH has a fix */
+	if ((aid_ini->flags & 0x01) && !(gps->fields & GPS_FIELD_REFPOS)) {
+		if (aid_ini->flags & 0x20) { /* lat / lon / alt */
+			gps->ref_pos.latitude  = (double)aid_ini->x * 1e-7;
+			gps->ref_pos.longitude = (double)aid_ini->y * 1e-7;
+			gps->ref_pos.altitude  = (double)aid_ini->z * 1e-2;
+		} else {
+			_ecef_to_ref_pos(aid_ini->x * 1e-2, aid_ini->y * 1e-2,
+			                 aid_ini->z * 1e-2, &gps->ref_pos);
+		}
+		gps->fields |= GPS_FIELD_REFPOS;
+	}
 }
 
 static void
@@ -92,33 +148,47 @@ _ubx_msg_parse_aid_hui(struct ubx_hdr *hdr, void *pl, int pl_len, void *ud)
 	//printf("[.] AID_HUI\n");
 
 	if (aid_hui->flags & 0x2) { /* UTC parameters valid */
-		struct gps_utc_model *utc = &gps->utc;
+		struct gps_utc_view uv = {
+			.a0          = aid_hui->utc_a0,
+			.a1          = aid_hui->utc_a1,
+			.delta_t_ls  = aid_hui->utc_ls,
+			.t_ot        = aid_hui->utc_tot,
+			.wn_t        = aid_hui->utc_wnt,
+			.wn_lsf      = aid_hui->utc_wnf,
+			.dn          = aid_hui->utc_dn,
+			.delta_t_lsf = aid_hui->utc_lsf,
+		};
+		struct gps_utc_model utc;
+
+		gps_utc_to_raw(&utc, &uv);
 
 		gps->fields |= GPS_FIELD_UTC;
-
-		utc->a0          = double_to_fixedpoint(aid_hui->utc_a0, -30);
-		utc->a1          = double_to_fixedpoint(aid_hui->utc_a1, -50);
-		utc->delta_t_ls  = aid_hui->utc_ls;
-		utc->t_ot        = aid_hui->utc_tot >> 12;
-		utc->wn_t        = (aid_hui->utc_wnt);
-		utc->wn_lsf      = (aid_hui->utc_wnf);
-		utc->dn          = aid_hui->utc_dn;
-		utc->delta_t_lsf = aid_hui->utc_lsf;
+		if (memcmp(&utc, &gps->utc, sizeof(utc))) {
+			gps->utc = utc;
+			gps->gen_utc = ++gps->gen;
+		}
 	}
 
 	if (aid_hui->flags & 0x04) { /* Klobuchar parameters valid */
-		struct gps_ionosphere_model *iono = &gps->ionosphere;
+		struct gps_iono_view iv = {
+			.alpha_0 = aid_hui->klob_a0,
+			.alpha_1 = aid_hui->klob_a1,
+			.alpha_2 = aid_hui->klob_a2,
+			.alpha_3 = aid_hui->klob_a3,
+			.beta_0  = aid_hui->klob_b0,
+			.beta_1  = aid_hui->klob_b1,
+			.beta_2  = aid_hui->klob_b2,
+			.beta_3  = aid_hui->klob_b3,
+		};
+		struct gps_ionosphere_model iono;
+
+		gps_iono_to_raw(&iono, &iv);
 
 		gps->fields |= GPS_FIELD_IONOSPHERE;
-
-		iono->alpha_0 = float_to_fixedpoint(aid_hui->klob_a0, -30);
-		iono->alpha_1 = float_to_fixedpoint(aid_hui->klob_a1, -27);
-		iono->alpha_2 = float_to_fixedpoint(aid_hui->klob_a2, -24);
-		iono->alpha_3 = float_to_fixedpoint(aid_hui->klob_a3, -24);
-		iono->beta_0 = float_to_fixedpoint(aid_hui->klob_b0, 11);
-		iono->beta_1 = float_to_fixedpoint(aid_hui->klob_b1, 14);
-		iono->beta_2 = float_to_fixedpoint(aid_hui->klob_b2, 16);
-		iono->beta_3 = float_to_fixedpoint(aid_hui->klob_b3, 16);
+		if (memcmp(&iono, &gps->ionosphere, sizeof(iono))) {
+			gps->ionosphere = iono;
+			gps->gen_ionosphere = ++gps->gen;
+		}
 	}
 }
 
@@ -130,10 +200,30 @@ _ubx_msg_parse_aid_alm(struct ubx_hdr *hdr, void *pl, int pl_len, void *ud)
 
 	//printf("[.] AID_ALM %d - %d\n", aid_alm->sv_id, aid_alm->gps_week);
 
-	if (aid_alm->gps_week) {
+	if (aid_alm->gps_week && (pl_len == sizeof(*aid_alm))) {
+		struct gps_almanac_sv alm;
+		uint32_t words[8];
+		int i;
+
+		/* Decode and check before anything reaches the store */
+		memcpy(words, aid_alm->alm_words, sizeof(words));
+		if (gps_unpack_sf45_almanac(words, &alm) ||
+		    (alm.sv_id != aid_alm->sv_id) ||
+		    gps_check_almanac(&alm)) {
+			LOG(LOG_WARN, "rejecting almanac of sv %d", aid_alm->sv_id);
+			return;
+		}
+
+		i = _gps_almanac_slot(&gps->almanac, aid_alm->sv_id);
+		if (i < 0)
+			return;
 		gps->fields |= GPS_FIELD_ALMANAC;
 		gps->almanac.wna = aid_alm->gps_week & 0xff;
-		gps_unpack_sf45_almanac(aid_alm->alm_words, &gps->almanac.svs[gps->almanac.n_sv++]);
+		if (gps->almanac.gen[i] &&
+		    !memcmp(&alm, &gps->almanac.svs[i], sizeof(alm)))
+			return;	/* unchanged */
+		gps->almanac.svs[i] = alm;
+		gps->almanac.gen[i] = ++gps->gen;
 	}
 }
 
@@ -145,11 +235,28 @@ _ubx_msg_parse_aid_eph(struct ubx_hdr *hdr, void *pl, int pl_len, void *ud)
 
 	//printf("[.] AID_EPH %d - %s\n", aid_eph->sv_id, aid_eph->present ? "present" : "not present");
 
-	if (aid_eph->present) {
-		int i = gps->ephemeris.n_sv++;
+	if (aid_eph->present && (pl_len == sizeof(*aid_eph))) {
+		struct gps_ephemeris_sv eph;
+		uint32_t words[24];
+		int i;
+
+		/* Decode and check before anything reaches the store */
+		memcpy(words, aid_eph->eph_words, sizeof(words));
+		if (gps_unpack_sf123(words, &eph) || gps_check_ephemeris(&eph)) {
+			LOG(LOG_WARN, "rejecting ephemeris of sv %d", aid_eph->sv_id);
+			return;
+		}
+		eph.sv_id = aid_eph->sv_id;
+
+		i = _gps_ephemeris_slot(&gps->ephemeris, aid_eph->sv_id);
+		if (i < 0)
+			return;
 		gps->fields |= GPS_FIELD_EPHEMERIS;
-		gps->ephemeris.svs[i].sv_id = aid_eph->sv_id;
-		gps_unpack_sf123(aid_eph->eph_words, &gps->ephemeris.svs[i]);
+		if (gps->ephemeris.gen[i] &&
+		    !memcmp(&eph, &gps->ephemeris.svs[i], sizeof(eph)))
+			return;	/* unchanged */
+		gps->ephemeris.svs[i] = eph;
+		gps->ephemeris.gen[i] = ++gps->gen;
 	}
 }
 
@@ -161,5 +268,6 @@ struct ubx_dispatch_entry ubx_parse_dt[] = {
 	UBX_DISPATCH(AID, HUI, _ubx_msg_parse_aid_hui),
 	UBX_DISPATCH(AID, ALM, _ubx_msg_parse_aid_alm),
 	UBX_DISPATCH(AID, EPH, _ubx_msg_parse_aid_eph),
+	{ 0, 0, NULL },
 };
 
@@ -23,10 +23,14 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "ubx.h"
 #include "list.h"
 #include "debug.h"
+#include "predict.h"
+#include "metrics.h"
+#include "svTrack.h"
 
 //Private prototype additions
 static void *genPollMessageIndSV(uint8_t msg_class, uint8_t msg_id, uint8_t svid);
@@ -39,15 +43,15 @@ static void *genNmeaSilencer_msg_4(void);
 static void *genNmeaSilencer_msg_5(void);
 static void *genNmeaSilencer_msg_6(void);
 static void *genNmeaSilencer_msg_7(void);
+static void *genCfgMsgRate(uint8_t msg_class, uint8_t msg_id, uint8_t rate);
 // --------------------------
 
 
-static void ubx_checksum(uint8_t *data, int len, uint8_t *cksum);
 static ubx_msg_handler_t ubx_find_handler(struct ubx_dispatch_entry *dt, uint8_t msg_class, uint8_t msg_id);
 
 
 
-static void ubx_checksum(uint8_t *data, int len, uint8_t *cksum)
+void ubx_checksum(const uint8_t *data, int len, uint8_t *cksum)
 {
 	int i;
 	uint8_t ck0 = 0, ck1 = 0;
@@ -71,12 +75,44 @@ static ubx_msg_handler_t ubx_find_handler(struct ubx_dispatch_entry *dt, uint8_t
 }
 
 
+/*
+ * Writes a complete frame (sync, header, payload, checksum) into buf.
+ * Returns its length, or -1 if it doesn't fit in size bytes.
+ */
+int ubx_frame_encode(void *buf, int size, uint8_t msg_class, uint8_t msg_id,
+	const void *payload, int payload_len)
+{
+	uint8_t *p = buf;
+	int len = sizeof(struct ubx_hdr) + payload_len + 2;
+
+	if ((payload_len < 0) || (payload_len > 0xffff) || (len > size))
+		return -1;
+
+	p[0] = UBX_SYNC0;
+	p[1] = UBX_SYNC1;
+	p[2] = msg_class;
+	p[3] = msg_id;
+	p[4] = payload_len & 0xff;
+	p[5] = payload_len >> 8;
+	memcpy(p + sizeof(struct ubx_hdr), payload, payload_len);
+	ubx_checksum(p + 2, sizeof(struct ubx_hdr) - 2 + payload_len, p + len - 2);
+
+	return len;
+}
+
+
 int ubx_msg_dispatch(struct ubx_dispatch_entry *dt, void *msg, int len, void *userdata)
 {
 	struct ubx_hdr *hdr = msg;
 	uint8_t cksum[2], *cksum_ptr;
 	ubx_msg_handler_t h;
 
+	if ((len < (int)sizeof(struct ubx_hdr) + 2) ||
+	    (len < (int)sizeof(struct ubx_hdr) + hdr->payload_len + 2)) {
+		LOG(LOG_ERR, "[!] Truncated frame\n");
+		return -1;
+	}
+
 	if ((hdr->sync[0] != UBX_SYNC0) || (hdr->sync[1] != UBX_SYNC1)) {
 		LOG(LOG_ERR, "[!] Invalid sync bytes\n");
 		return -1;
@@ -89,6 +125,14 @@ int ubx_msg_dispatch(struct ubx_dispatch_entry *dt, void *msg, int len, void *us
 		return -1;
 	}
 
+	/* Handlers only ever see payloads that fit their schema */
+	if (ubx_schema_check(hdr->msg_class, hdr->msg_id,
+			msg + sizeof(struct ubx_hdr), hdr->payload_len) < 0) {
+		LOG(LOG_WARN, "[!] Bad length %d for %02x-%02x\n",
+			hdr->payload_len, hdr->msg_class, hdr->msg_id);
+		return sizeof(struct ubx_hdr) + hdr->payload_len + 2;
+	}
+
 	h = ubx_find_handler(dt, hdr->msg_class, hdr->msg_id);
 	if (h){
         LOG(LOG_INFO, "found handler");
@@ -244,19 +288,138 @@ int getUbx_MsgId(void *msg)
     return ubx->msg_id;
 }
 
+// the PRN of an AID-ALM / AID-EPH, out of UBX_AID_N_SV for anything but GPS
 int getUbx_SVID(uint8_t *msg)
 {
-    uint8_t svid;
-    svid = *(msg + 6);
-    if(svid > 32){
-        svid = 33;  // 33 corresponds to almBuf, ephBuf
+    return *(msg + 6);
+}
+
+// SVs to poll for almanac (UBX_AID_ALM) or ephemeris (UBX_AID_EPH), in
+// polling order. Without a prediction it is every SV, as before.
+static int svPollList(struct msgStrmCheck_s *msgChk, int id, uint8_t *svs)
+{
+    struct svPollPlan_s *plan = &(msgChk->svPlan);
+    int n = 0;
+
+    if(0 == plan->valid){
+        for(int i=1; i<UBX_AID_N_SV; i++){ svs[n++] = i; }
+        return n;
+    }
+
+    if(UBX_AID_EPH == id){
+        memcpy(svs, plan->ephSv, plan->nEph);
+        return plan->nEph;
+    }
+
+    memcpy(svs, plan->almSv, plan->nAlm);
+    return plan->nAlm;
+}
+
+// Rebuild the poll plan from a visibility prediction: ephemerides are only
+// polled for SVs above the horizon now or within PREDICT_HORIZON, visible
+// and rising ones first. Almanacs are still polled for every SV, but the
+// predicted ones go first.
+int updateSvPollPlan(struct msgStrmCheck_s *msgChk, struct predict_set *ps)
+{
+    struct svPollPlan_s *plan = &(msgChk->svPlan);
+    uint8_t seen[UBX_AID_N_SV];
+    int order[MAX_SV];
+    int n;
+
+    memset(seen, 0, sizeof(seen));
+    plan->nEph = 0;
+    plan->nAlm = 0;
+
+    n = predict_poll_order(ps, order, MAX_SV, 1);
+    for(int k=0; k<n; k++){
+        if( (1 <= order[k]) && (order[k] < UBX_AID_N_SV) ){
+            plan->ephSv[plan->nEph++] = order[k];
+        }
+    }
+
+    n = predict_poll_order(ps, order, MAX_SV, 0);
+    for(int k=0; k<n; k++){
+        if( (1 <= order[k]) && (order[k] < UBX_AID_N_SV) && !seen[order[k]] ){
+            seen[order[k]] = 1;
+            plan->almSv[plan->nAlm++] = order[k];
+        }
+    }
+    for(int i=1; i<UBX_AID_N_SV; i++){
+        if(!seen[i]){ plan->almSv[plan->nAlm++] = i; }
+    }
+
+    plan->valid = 1;
+    LOG(LOG_INFO, "poll plan: %d of %d SVs usable for ephemeris", plan->nEph, ps->n_sv);
+
+    return plan->nEph;
+}
+
+// an SV the receiver can give an ephemeris of, with what orders it
+typedef struct svTrackPoll_s
+{
+    uint32_t since;
+    int elev;
+    int sv;
+}svTrackPoll_t;
+
+// the most recently tracked first, then the highest
+static int trackPollCmp(const void *a, const void *b)
+{
+    const struct svTrackPoll_s *x = a, *y = b;
+
+    if(x->since != y->since){
+        return (x->since < y->since) ? 1 : -1;
+    }
+    if(x->elev != y->elev){
+        return y->elev - x->elev;
     }
-    return svid;
+    return x->sv - y->sv;
+}
+
+// Narrow the ephemeris polls to what the receiver can answer now, from its
+// NAV-SVINFO: an SV off its channels, or tracked without an ephemeris of
+// its own yet, would only get an empty AID-EPH back. The SVs that came
+// into view last go first. Almanacs are still polled as predicted.
+int trackSvPollPlan(struct msgStrmCheck_s *msgChk, const struct svTrackTable_s *sky)
+{
+    struct svPollPlan_s *plan = &(msgChk->svPlan);
+    struct svTrackPoll_s poll[SV_TRACK_N_SV];
+    int n = 0;
+
+    for(int s=1; s<SV_TRACK_N_SV; s++){
+        const struct svTrackSv_s *sv = &(sky->sv[s]);
+
+        if( sv->tracked && (sv->flags & SVINFO_ORBIT_EPH) ){
+            poll[n].since = sv->since;
+            poll[n].elev  = sv->elev;
+            poll[n].sv    = s;
+            n++;
+        }
+    }
+    qsort(poll, n, sizeof(poll[0]), trackPollCmp);
+
+    plan->nEph = 0;
+    for(int k=0; k<n; k++){
+        plan->ephSv[plan->nEph++] = poll[k].sv;
+    }
+    if(0 == plan->valid){
+        // nothing predicted: every almanac, as before
+        plan->nAlm = 0;
+        for(int i=1; i<UBX_AID_N_SV; i++){ plan->almSv[plan->nAlm++] = i; }
+        plan->valid = 1;
+    }
+
+    metrics_set(METRIC_POLL_EPH_SVS, plan->nEph);
+    LOG(LOG_INFO, "poll plan: %d of %d tracked SVs have an ephemeris to give", plan->nEph, sky->nTracked);
+
+    return plan->nEph;
 }
 
 int prepAidMissingPollMsgs(struct llist *ll, struct msgStrmCheck_s *msgChk)
 {
     void *ubxMsg_p = NULL;
+    uint8_t svs[32];
+    int n;
 
 
     if(0 == msgChk->ubxAidAck.iniAck){
@@ -277,19 +440,21 @@ int prepAidMissingPollMsgs(struct llist *ll, struct msgStrmCheck_s *msgChk)
         push_back(ll, (void *)ubxMsg_p);
     }
 
-    for(int i=0; i<32; i++)
+    n = svPollList(msgChk, UBX_AID_ALM, svs);
+    for(int k=0; k<n; k++)
     {
-        if(0 == msgChk->ubxAidAck.almAck[i] ){
-            ubxMsg_p = pollAlmanac(i);
+        if(0 == msgChk->ubxAidAck.almAck[svs[k]] ){
+            ubxMsg_p = pollAlmanac(svs[k]);
             if(NULL == ubxMsg_p){ LOG(LOG_ERR, "null pointer alm!!"); }
             push_back(ll, (void *)ubxMsg_p);
         }
     }
 
-    for(int i=0; i<32; i++)
+    n = svPollList(msgChk, UBX_AID_EPH, svs);
+    for(int k=0; k<n; k++)
     {
-        if(0 == msgChk->ubxAidAck.ephAck[i] ){
-            ubxMsg_p = pollEphem(i);
+        if(0 == msgChk->ubxAidAck.ephAck[svs[k]] ){
+            ubxMsg_p = pollEphem(svs[k]);
             if(NULL == ubxMsg_p){ LOG(LOG_ERR, "null pointer eph!!"); }
             push_back(ll, (void *)ubxMsg_p);
         }
@@ -302,20 +467,24 @@ int prepAidMissingPollMsgs(struct llist *ll, struct msgStrmCheck_s *msgChk)
 
 int areThereMissingMessages(struct msgStrmCheck_s *msgChk)
 {
+    uint8_t svs[32];
     int m = 0;
+    int n;
 
-    for(int i=0; i<32; i++)
+    n = svPollList(msgChk, UBX_AID_ALM, svs);
+    for(int k=0; k<n; k++)
     {
-        if(0 == msgChk->ubxAidAck.almAck[i] ){
-            LOG(LOG_WARN, "missing almanac svid:%d", i);
+        if(0 == msgChk->ubxAidAck.almAck[svs[k]] ){
+            LOG(LOG_WARN, "missing almanac svid:%d", svs[k]);
             m++;
         }
     }
 
-    for(int i=0; i<32; i++)
+    n = svPollList(msgChk, UBX_AID_EPH, svs);
+    for(int k=0; k<n; k++)
     {
-        if(0 == msgChk->ubxAidAck.ephAck[i] ){
-            LOG(LOG_WARN, "missing ephemeris svid:%d", i);
+        if(0 == msgChk->ubxAidAck.ephAck[svs[k]] ){
+            LOG(LOG_WARN, "missing ephemeris svid:%d", svs[k]);
             m++;
         }
     }
@@ -341,9 +510,11 @@ int areThereMissingMessages(struct msgStrmCheck_s *msgChk)
 
 
 
-int prepAidPollMsgs(struct llist *ll)
+int prepAidPollMsgs(struct llist *ll, struct msgStrmCheck_s *msgChk)
 {
     void *ubxMsg_p = NULL;
+    uint8_t svs[32];
+    int n;
 
     ubxMsg_p = pollHui();
     push_back(ll, (void *)ubxMsg_p);
@@ -351,8 +522,18 @@ int prepAidPollMsgs(struct llist *ll)
     push_back(ll, (void *)ubxMsg_p);
     ubxMsg_p = pollAlmanac(-1);
     push_back(ll, (void *)ubxMsg_p);
-    ubxMsg_p = pollEphem(-1);
-    push_back(ll, (void *)ubxMsg_p);
+
+    if(0 == msgChk->svPlan.valid){
+        ubxMsg_p = pollEphem(-1);
+        push_back(ll, (void *)ubxMsg_p);
+    }else{
+        // only the SVs that are, or are about to be, above the horizon
+        n = svPollList(msgChk, UBX_AID_EPH, svs);
+        for(int k=0; k<n; k++){
+            ubxMsg_p = pollEphem(svs[k]);
+            push_back(ll, (void *)ubxMsg_p);
+        }
+    }
     ubxMsg_p = pollPosllh();
     push_back(ll, (void *)ubxMsg_p);
 
@@ -383,6 +564,57 @@ int prepNmeaSilencerMsgs(struct llist *ll)
     return 7;
 }
 
+// the timing messages, sent by the receiver on its own from then on (timing.h)
+int prepTimingMsgs(struct llist *ll)
+{
+    push_back(ll, genCfgMsgRate(UBX_CLASS_TIM, UBX_TIM_TP, 1));
+    push_back(ll, genCfgMsgRate(UBX_CLASS_TIM, UBX_TIM_TM2, 1));
+    push_back(ll, genCfgMsgRate(UBX_CLASS_TIM, UBX_TIM_SVIN, TIMING_SVIN_RATE));
+
+    return 3;
+}
+
+// RXM-RAW every measurement, one every measRateMs (rawStore.h)
+int prepRawMsgs(struct llist *ll, int measRateMs)
+{
+    struct ubx_cfg_rate rate;
+    uint8_t *ubxMsg_p = NULL;
+    int len = sizeof(struct ubx_hdr) + sizeof(rate) + 2;
+
+    rate.meas_rate = measRateMs;
+    rate.nav_rate  = 1;
+    rate.time_ref  = 1;         // GPS time
+    ubxMsg_p = malloc(len);
+    if(NULL != ubxMsg_p){
+        ubx_cfg_rate_encode(ubxMsg_p, len, &rate);
+        push_back(ll, (void *)ubxMsg_p);
+    }
+    push_back(ll, genCfgMsgRate(UBX_CLASS_RXM, UBX_RXM_RAW, 1));
+
+    return 2;
+}
+
+// the navigation messages at NAV_RATE_HZ (navHist.h), NAV-SVINFO every NAV_SVINFO_S
+// (svTrack.h), with a measurement every measRateMs
+int prepNavMsgs(struct llist *ll, int measRateMs)
+{
+    int rate = (1000 / NAV_RATE_HZ) / measRateMs;
+
+    if(rate < 1){
+        rate = 1;
+    }
+    push_back(ll, genCfgMsgRate(UBX_CLASS_NAV, UBX_NAV_POSLLH, rate));
+    push_back(ll, genCfgMsgRate(UBX_CLASS_NAV, UBX_NAV_SOL, rate));
+    push_back(ll, genCfgMsgRate(UBX_CLASS_NAV, UBX_NAV_VELNED, rate));
+    push_back(ll, genCfgMsgRate(UBX_CLASS_NAV, UBX_NAV_TIMEUTC, rate));
+
+    // the SVs tracked change slowly, and a NAV-SVINFO is 8 + 12 bytes a channel
+    rate = (NAV_SVINFO_S * 1000) / measRateMs;
+    push_back(ll, genCfgMsgRate(UBX_CLASS_NAV, UBX_NAV_SVINFO, (rate > 255) ? 255 : rate));
+
+    return 5;
+}
+
 
 // check whether we have valid ubx message in incoming uart data
 int parseUartInput_4_UbxMsg(void *msg, int bytesLeftInBuffer)
@@ -413,6 +645,103 @@ int parseUartInput_4_UbxMsg(void *msg, int bytesLeftInBuffer)
 	return sizeof(struct ubx_hdr) + hdr->payload_len + 2;
 }
 
+
+void ubxFramer_init(struct ubxFramer_s *fr)
+{
+    fr->len  = 0;
+    fr->need = 0;
+    fr->frames = 0;
+    fr->cksumErrors = 0;
+    fr->replayPos = 0;
+    fr->replayLen = 0;
+}
+
+/*
+ * What was gathered isn't a frame: the search goes on from the byte after
+ * its sync, as the scratchpad scan does, ahead of the bytes still to be
+ * looked at again. Those are where the gathered ones came from, so both
+ * fit.
+ */
+static void falseStart(struct ubxFramer_s *fr)
+{
+    int n = fr->len - 1;
+    int rest = fr->replayLen - fr->replayPos;
+
+    memmove(fr->replay + n, fr->replay + fr->replayPos, rest);
+    memcpy(fr->replay, fr->buf + 1, n);
+    fr->replayPos = 0;
+    fr->replayLen = n + rest;
+    fr->len = 0;
+}
+
+// one byte more: the length of the frame it completes, 0 if none
+static int framerStep(struct ubxFramer_s *fr, uint8_t b)
+{
+    struct ubx_hdr *hdr = (struct ubx_hdr *)fr->buf;
+    uint8_t cksum[2];
+    int need;
+
+    if( (fr->len == 0) && (b != UBX_SYNC0) ){
+        return 0;
+    }
+    if( (fr->len == 1) && (b != UBX_SYNC1) ){
+        fr->len = (b == UBX_SYNC0);
+        return 0;
+    }
+    fr->buf[fr->len++] = b;
+
+    if(fr->len == sizeof(struct ubx_hdr)){
+        fr->need = sizeof(struct ubx_hdr) + hdr->payload_len + 2;
+        if(fr->need > UBX_MAX_FRAME_SIZE){
+            falseStart(fr);
+        }
+        return 0;
+    }
+    if( (fr->len < sizeof(struct ubx_hdr)) || (fr->len < fr->need) ){
+        return 0;
+    }
+
+    need = fr->need;
+    ubx_checksum(fr->buf + 2, need - 4, cksum);
+    if( (cksum[0] == fr->buf[need - 2]) && (cksum[1] == fr->buf[need - 1]) ){
+        fr->frames++;
+        fr->len = 0;
+        return need;
+    }
+    fr->cksumErrors++;
+    falseStart(fr);
+    return 0;
+}
+
+/*
+ * Takes bytes of the stream up to the end of the next complete frame with
+ * a valid checksum: returns its length, the frame in fr->buf until the
+ * next call, with *used the bytes taken; 0 once all len are taken without
+ * one. A frame may span any number of calls. Frames longer than the buffer
+ * and bad checksums are false starts, the bytes after their sync are
+ * looked at again before the new ones: call again until it returns 0.
+ */
+int ubxFramer_push(struct ubxFramer_s *fr, const uint8_t *data, int len, int *used)
+{
+    int n;
+
+    while(fr->replayPos < fr->replayLen){
+        if( (n = framerStep(fr, fr->replay[fr->replayPos++])) > 0 ){
+            *used = 0;
+            return n;
+        }
+    }
+    for(int i=0; i < len; i++){
+        if( (n = framerStep(fr, data[i])) > 0 ){
+            *used = i + 1;
+            return n;
+        }
+    }
+
+    *used = len;
+    return 0;
+}
+
 int updateValidUbxMsgList(void *ptr, struct msgStrmCheck_s *msgChk)
 {
     struct ubx_hdr *ubxMsg = (struct ubx_hdr *)ptr;
@@ -443,13 +772,17 @@ int updateValidUbxMsgList(void *ptr, struct msgStrmCheck_s *msgChk)
         case UBX_AID_ALM:
 
             LOG(LOG_INFO, "aid alm sat:%d okey",svid);
-            msgChk->ubxAidAck.almAck[svid] = 1;
+            if( (1 <= svid) && (svid < UBX_AID_N_SV) ){
+                msgChk->ubxAidAck.almAck[svid] = 1;
+            }
             break;
 
         case UBX_AID_EPH:
 
             LOG(LOG_INFO, "aid eph sat:%d okey",svid);
-            msgChk->ubxAidAck.ephAck[svid] = 1;
+            if( (1 <= svid) && (svid < UBX_AID_N_SV) ){
+                msgChk->ubxAidAck.ephAck[svid] = 1;
+            }
             break;
 
         default:
@@ -717,3 +1050,20 @@ static void * genNmeaSilencer_msg_7(void)
     return (void *)message;
 }
 
+
+// CFG-MSG: msg_class / msg_id once every rate navigation solutions on the
+// current port, 0 for never
+static void * genCfgMsgRate(uint8_t msg_class, uint8_t msg_id, uint8_t rate)
+{
+    uint8_t payload[3] = { msg_class, msg_id, rate };
+    uint8_t *message = NULL;
+    int len = sizeof(struct ubx_hdr) + sizeof(payload) + 2;
+
+    message = (uint8_t *)malloc(len);
+    if(NULL == message){
+        return NULL;
+    }
+    ubx_frame_encode(message, len, UBX_CLASS_CFG, UBX_CFG_MSG, payload, sizeof(payload));
+
+    return (void *)message;
+}
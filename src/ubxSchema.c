@@ -0,0 +1,266 @@
+/*
+ * ubxSchema.c
+ *
+ * Encoders, serializers and length checks generated from the UBX message
+ * schema (see ubxSchema.h)
+ *
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ubx.h"
+#include "json.h"
+
+
+/* Payload sizes of the u-blox 6 protocol specification */
+#define UBX_LEN_NAV_POSLLH  28
+#define UBX_LEN_NAV_SOL     52
+#define UBX_LEN_NAV_VELNED  36
+#define UBX_LEN_NAV_TIMEUTC 20
+#define UBX_LEN_NAV_SVINFO  8
+#define UBX_LEN_NAV_SVINFO_BLOCK 12
+#define UBX_LEN_TIM_TP      16
+#define UBX_LEN_TIM_TM2     28
+#define UBX_LEN_TIM_SVIN    28
+#define UBX_LEN_AID_INI     48
+#define UBX_LEN_AID_HUI     72
+#define UBX_LEN_AID_ALM     40
+#define UBX_LEN_AID_EPH     104
+#define UBX_LEN_RXM_RAW     8
+#define UBX_LEN_RXM_RAW_BLOCK 24
+#define UBX_LEN_MON_IO      20
+#define UBX_LEN_MON_MSGPP   120
+#define UBX_LEN_MON_RXBUF   24
+#define UBX_LEN_MON_TXBUF   28
+#define UBX_LEN_CFG_RATE    6
+
+/* a schema that doesn't add up doesn't build */
+#define _UBX_SIZE_CHECK(K, I, name, x) \
+    typedef char ubx_size_check_##name[(sizeof(struct ubx_##name) == UBX_LEN_##K##_##I) ? 1 : -1];
+#define _UBX_BLOCK_SIZE_CHECK(K, I, name, count) \
+    _UBX_SIZE_CHECK(K, I, name, count) \
+    typedef char ubx_size_check_##name##_block[ \
+        (sizeof(struct ubx_##name##_block) == UBX_LEN_##K##_##I##_BLOCK) ? 1 : -1];
+
+UBX_MESSAGES(_UBX_SIZE_CHECK)
+UBX_BLOCK_MESSAGES(_UBX_BLOCK_SIZE_CHECK)
+UBX_ARRAY_MESSAGES(_UBX_SIZE_CHECK)
+
+
+/* Encoders */
+#define _UBX_ENCODE(K, I, name, x) \
+int ubx_##name##_encode(void *buf, int size, const struct ubx_##name *m) \
+{ \
+    return ubx_frame_encode(buf, size, UBX_CLASS_##K, UBX_##K##_##I, m, sizeof(*m)); \
+}
+
+#define _UBX_BLOCK_ENCODE(K, I, name, count) \
+int ubx_##name##_encode(void *buf, int size, const struct ubx_##name *m, \
+                        const struct ubx_##name##_block *blocks) \
+{ \
+    int pl_len = sizeof(*m) + m->count * sizeof(*blocks); \
+    uint8_t *p = buf; \
+    int len; \
+    \
+    if((int)sizeof(struct ubx_hdr) + pl_len + 2 > size){ \
+        return -1; \
+    } \
+    ubx_frame_encode(buf, size, UBX_CLASS_##K, UBX_##K##_##I, m, sizeof(*m)); \
+    memcpy(p + sizeof(struct ubx_hdr) + sizeof(*m), blocks, m->count * sizeof(*blocks)); \
+    p[4] = pl_len & 0xff; \
+    p[5] = pl_len >> 8; \
+    len = sizeof(struct ubx_hdr) + pl_len + 2; \
+    ubx_checksum(p + 2, sizeof(struct ubx_hdr) - 2 + pl_len, p + len - 2); \
+    return len; \
+}
+
+#define _UBX_ARRAY_ENCODE(K, I, name, max) \
+int ubx_##name##_encode(void *buf, int size, const struct ubx_##name *m, int n) \
+{ \
+    return ubx_frame_encode(buf, size, UBX_CLASS_##K, UBX_##K##_##I, m, n * sizeof(*m)); \
+}
+
+UBX_MESSAGES(_UBX_ENCODE)
+UBX_BLOCK_MESSAGES(_UBX_BLOCK_ENCODE)
+UBX_ARRAY_MESSAGES(_UBX_ARRAY_ENCODE)
+
+
+/* Serializers: one appender per field type */
+#define _UBX_JSON_U1(jb, v, dec)    json_put_fixed(jb, v, dec)
+#define _UBX_JSON_I1(jb, v, dec)    json_put_fixed(jb, v, dec)
+#define _UBX_JSON_X1(jb, v, dec)    json_put_int(jb, v)
+#define _UBX_JSON_U2(jb, v, dec)    json_put_fixed(jb, v, dec)
+#define _UBX_JSON_I2(jb, v, dec)    json_put_fixed(jb, v, dec)
+#define _UBX_JSON_U4(jb, v, dec)    json_put_fixed(jb, v, dec)
+#define _UBX_JSON_I4(jb, v, dec)    json_put_fixed(jb, v, dec)
+#define _UBX_JSON_X4(jb, v, dec)    json_put_int(jb, v)
+#define _UBX_JSON_R4(jb, v, dec)    json_put_real(jb, v, 7)
+#define _UBX_JSON_R8(jb, v, dec)    json_put_real(jb, v, 15)
+
+/* the comma is skipped for the first member of an object */
+#define _UBX_JSON_KEY(name) \
+    json_put_raw(jb, ",\"" #name "\":" + first, sizeof(",\"" #name "\":") - 1 - first); \
+    first = 0;
+
+#define _UBX_JSON_F(t, name, dec) \
+    _UBX_JSON_KEY(name) _UBX_JSON_##t(jb, m->name, dec);
+
+#define _UBX_JSON_A(t, name, n) \
+    _UBX_JSON_KEY(name) \
+    for(int i=0; i < (n); i++){ \
+        json_put_raw(jb, &"[,"[i ? 1 : 0], 1); \
+        _UBX_JSON_##t(jb, m->name[i], 0); \
+    } \
+    json_put_lit(jb, "]");
+
+#define _UBX_JSON(K, I, name, x) \
+int ubx_##name##_json(struct json_buf *jb, const struct ubx_##name *m) \
+{ \
+    int first = 1; \
+    \
+    json_put_lit(jb, "{"); \
+    UBX_SCHEMA_##K##_##I(_UBX_JSON_F, _UBX_JSON_A) \
+    json_put_lit(jb, "}"); \
+    return jb->overflow ? -1 : 0; \
+}
+
+#define _UBX_BLOCK_JSON(K, I, name, count) \
+static int ubx_##name##_block_json(struct json_buf *jb, const struct ubx_##name##_block *m) \
+{ \
+    int first = 1; \
+    \
+    json_put_lit(jb, "{"); \
+    UBX_SCHEMA_##K##_##I##_BLOCK(_UBX_JSON_F, _UBX_JSON_A) \
+    json_put_lit(jb, "}"); \
+    return jb->overflow ? -1 : 0; \
+} \
+int ubx_##name##_json(struct json_buf *jb, const struct ubx_##name *m) \
+{ \
+    int first = 1; \
+    \
+    json_put_lit(jb, "{"); \
+    UBX_SCHEMA_##K##_##I(_UBX_JSON_F, _UBX_JSON_A) \
+    json_put_lit(jb, ",\"blocks\":["); \
+    for(int i=0; i < m->count; i++){ \
+        if(i){ json_put_lit(jb, ","); } \
+        ubx_##name##_block_json(jb, ubx_##name##_block(m, i)); \
+    } \
+    json_put_lit(jb, "]}"); \
+    return jb->overflow ? -1 : 0; \
+}
+
+#define _UBX_ARRAY_JSON(K, I, name, max) \
+static int ubx_##name##_one_json(struct json_buf *jb, const struct ubx_##name *m) \
+{ \
+    int first = 1; \
+    \
+    json_put_lit(jb, "{"); \
+    UBX_SCHEMA_##K##_##I(_UBX_JSON_F, _UBX_JSON_A) \
+    json_put_lit(jb, "}"); \
+    return jb->overflow ? -1 : 0; \
+} \
+int ubx_##name##_json(struct json_buf *jb, const struct ubx_##name *m, int n) \
+{ \
+    json_put_lit(jb, "["); \
+    for(int i=0; i < n; i++){ \
+        if(i){ json_put_lit(jb, ","); } \
+        ubx_##name##_one_json(jb, m + i); \
+    } \
+    json_put_lit(jb, "]"); \
+    return jb->overflow ? -1 : 0; \
+}
+
+UBX_MESSAGES(_UBX_JSON)
+UBX_BLOCK_MESSAGES(_UBX_BLOCK_JSON)
+UBX_ARRAY_MESSAGES(_UBX_ARRAY_JSON)
+
+
+/* By class / id */
+#define _UBX_ID(K, I)   ((UBX_CLASS_##K << 8) | UBX_##K##_##I)
+
+/*
+ * 0 if the payload fits the schema of its message, -1 if it doesn't,
+ * 1 if the message isn't in the schema.
+ */
+int ubx_schema_check(int msg_class, int msg_id, const void *pl, int len)
+{
+#define _UBX_CHECK_CASE(K, I, name, x) \
+    case _UBX_ID(K, I): return ubx_##name##_get(pl, len) ? 0 : -1;
+
+    switch((msg_class << 8) | msg_id){
+    UBX_MESSAGES(_UBX_CHECK_CASE)
+    UBX_BLOCK_MESSAGES(_UBX_CHECK_CASE)
+    UBX_ARRAY_MESSAGES(_UBX_CHECK_CASE)
+    default:
+        return 1;
+    }
+}
+
+/*
+ * {"class":c,"id":i,"msg":"name","payload":{...}} of a complete frame if
+ * the message is in the schema (a missing optional tail reads as zeros),
+ * as json_ubx_frame() otherwise. Returns -1 if the frame is truncated,
+ * doesn't fit its schema or jb.
+ */
+int ubx_schema_json(struct json_buf *jb, const void *frame, int len)
+{
+    const struct ubx_hdr *hdr = frame;
+    const uint8_t *pl = (const uint8_t *)frame + sizeof(struct ubx_hdr);
+    int pl_len;
+
+    if(len < (int)sizeof(struct ubx_hdr)){
+        return -1;
+    }
+    pl_len = hdr->payload_len;
+    if(len < (int)sizeof(struct ubx_hdr) + pl_len){
+        return -1;
+    }
+
+#define _UBX_JSON_CASE(K, I, name, x) \
+    case _UBX_ID(K, I): { \
+        const struct ubx_##name *m = ubx_##name##_get(pl, pl_len); \
+        struct ubx_##name full; \
+        if(!m){ \
+            return -1; \
+        } \
+        if(pl_len < (int)sizeof(full)){ \
+            memset(&full, 0, sizeof(full)); \
+            memcpy(&full, pl, pl_len); \
+            m = &full; \
+        } \
+        json_put_lit(jb, "{\"class\":"); \
+        json_put_int(jb, hdr->msg_class); \
+        json_put_lit(jb, ",\"id\":"); \
+        json_put_int(jb, hdr->msg_id); \
+        json_put_lit(jb, ",\"msg\":\"" #name "\",\"payload\":"); \
+        ubx_##name##_json(jb, m); \
+        json_put_lit(jb, "}"); \
+        return jb->overflow ? -1 : 0; \
+    }
+
+#define _UBX_ARRAY_JSON_CASE(K, I, name, max) \
+    case _UBX_ID(K, I): { \
+        const struct ubx_##name *m = ubx_##name##_get(pl, pl_len); \
+        if(!m){ \
+            return -1; \
+        } \
+        json_put_lit(jb, "{\"class\":"); \
+        json_put_int(jb, hdr->msg_class); \
+        json_put_lit(jb, ",\"id\":"); \
+        json_put_int(jb, hdr->msg_id); \
+        json_put_lit(jb, ",\"msg\":\"" #name "\",\"payload\":"); \
+        ubx_##name##_json(jb, m, ubx_##name##_count(pl_len)); \
+        json_put_lit(jb, "}"); \
+        return jb->overflow ? -1 : 0; \
+    }
+
+    switch((hdr->msg_class << 8) | hdr->msg_id){
+    UBX_MESSAGES(_UBX_JSON_CASE)
+    UBX_BLOCK_MESSAGES(_UBX_JSON_CASE)
+    UBX_ARRAY_MESSAGES(_UBX_ARRAY_JSON_CASE)
+    default:
+        return json_ubx_frame(jb, frame, len);
+    }
+}